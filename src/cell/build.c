@@ -50,6 +50,7 @@ struct build
 	vector_t*     artifacts;
 	bool          crashed;
 	fs_t*         fs;
+	bool          precompile;
 	vector_t*     targets;
 	time_t        timestamp;
 	visor_t*      visor;
@@ -70,6 +71,8 @@ static bool js_install                       (int num_args, bool is_ctor, intptr
 static bool js_warn                          (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_Compiler           (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_Game               (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_Precompile         (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_set_Precompile         (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_Version            (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_DirectoryStream           (int num_args, bool is_ctor, intptr_t magic);
 static bool js_DirectoryStream_get_fileCount (int num_args, bool is_ctor, intptr_t magic);
@@ -142,6 +145,7 @@ static void    handle_module_import (void);
 static bool    install_target       (int num_args, bool is_ctor, intptr_t magic);
 static path_t* load_package_json    (const char* filename);
 static void    make_file_targets    (fs_t* fs, const char* wildcard, const path_t* path, const path_t* subdir, vector_t* targets, bool recursive, time_t timestamp);
+static void    package_bytecode     (build_t* build, spk_writer_t* spk, const char* filename);
 static void    package_dir          (build_t* build, spk_writer_t* spk, const char* from_dirname, const char* to_dirname);
 static void    push_require         (const char* module_id);
 static int     sort_targets_by_path (const void* p_a, const void* p_b);
@@ -193,6 +197,7 @@ build_new(const path_t* source_path, const path_t* out_path)
 	api_define_function(NULL, "warn", js_warn, 0);
 	api_define_static_prop("Sphere", "Compiler", js_Sphere_get_Compiler, NULL);
 	api_define_static_prop("Sphere", "Game", js_Sphere_get_Game, NULL);
+	api_define_static_prop("Sphere", "Precompile", js_Sphere_get_Precompile, js_Sphere_set_Precompile);
 	api_define_static_prop("Sphere", "Version", js_Sphere_get_Version, NULL);
 	api_define_class("DirectoryStream", CELL_DIR_STREAM, js_new_DirectoryStream, js_DirectoryStream_finalize, 0);
 	api_define_property("DirectoryStream", "fileCount", false, js_DirectoryStream_get_fileCount, NULL);
@@ -401,6 +406,8 @@ build_package(build_t* build, const char* filename)
 		spk_add_file(spk, build->fs,
 			path_cstr(target_path(*target_ptr)),
 			path_cstr(out_path));
+		if (build->precompile && path_has_extension(in_path, ".js"))
+			package_bytecode(build, spk, path_cstr(in_path));
 		path_free(out_path);
 		visor_end_op(build->visor);
 	}
@@ -914,6 +921,48 @@ make_file_targets(fs_t* fs, const char* wildcard, const path_t* path, const path
 	vector_free(list);
 }
 
+static void
+package_bytecode(build_t* build, spk_writer_t* spk, const char* filename)
+{
+	void*      bytecode;
+	size_t     bytecode_size;
+	lstring_t* code_string;
+	char*      name;
+	char*      pathname;
+	char*      source;
+	size_t     source_size;
+	int        i;
+
+	// note: the engine looks up bytecode by a hash of the exact source text it
+	//       compiles, so the script is serialized twice: once as-is (for scripts
+	//       run directly, e.g. by RequireScript()) and once wrapped the same way
+	//       the engine's require() wraps a CommonJS module.  scripts which don't
+	//       compile, or are too small to be worth caching, are silently skipped.
+	if (!(source = fs_fslurp(build->fs, filename, &source_size)))
+		return;
+	for (i = 0; i < 2; ++i) {
+		if (i == 0) {
+			code_string = lstr_from_cp1252(source, source_size);
+			jsal_push_lstring_t(code_string);
+		}
+		else {
+			code_string = lstr_from_utf8(source, source_size, true);
+			jsal_push_sprintf("(function (exports, require, module, __filename, __dirname) {%s%s\n})",
+				strncmp(lstr_cstr(code_string), "#!", 2) == 0 ? "//" : "",  // shebang?
+				lstr_cstr(code_string));
+		}
+		lstr_free(code_string);
+		if (!(bytecode = jsal_make_bytecode(SPHERE_VERSION, &name, &bytecode_size)))
+			continue;
+		pathname = strnewf(".bytecode/%s", name);
+		spk_add_data(spk, bytecode, bytecode_size, pathname);
+		free(pathname);
+		free(name);
+		free(bytecode);
+	}
+	free(source);
+}
+
 static void
 package_dir(build_t* build, spk_writer_t* spk, const char* from_dirname, const char* to_dirname)
 {
@@ -1299,6 +1348,20 @@ js_Sphere_get_Game(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_Sphere_get_Precompile(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_push_boolean(s_build->precompile);
+	return true;
+}
+
+static bool
+js_Sphere_set_Precompile(int num_args, bool is_ctor, intptr_t magic)
+{
+	s_build->precompile = jsal_require_boolean(0);
+	return true;
+}
+
 static bool
 js_Sphere_get_Version(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -130,30 +130,25 @@ spk_close(spk_writer_t* writer)
 }
 
 bool
-spk_add_file(spk_writer_t* writer, fs_t* fs, const char* filename, const char* spk_pathname)
+spk_add_data(spk_writer_t* writer, const void* data, size_t size, const char* spk_pathname)
 {
 	struct spk_entry idx_entry;
-	void*            file_data = NULL;
-	size_t           file_size;
 	long             offset;
 	void*            pack_data = NULL;
 	size_t           pack_size;
 
-	if (!(file_data = fs_fslurp(fs, filename, &file_size)))
+	if (size > UINT32_MAX)
 		goto on_error;
-	if (file_size > UINT32_MAX)
-		goto on_error;
-	if (!(pack_data = z_deflate(file_data, file_size, 9, &pack_size)))
+	if (!(pack_data = z_deflate(data, size, 9, &pack_size)))
 		goto on_error;
 	if (pack_size > UINT32_MAX)
 		goto on_error;
 	offset = ftell(writer->file);
 	fwrite(pack_data, pack_size, 1, writer->file);
 	free(pack_data);
-	free(file_data);
 
 	idx_entry.pathname = strdup(spk_pathname);
-	idx_entry.file_size = (uint32_t)file_size;
+	idx_entry.file_size = (uint32_t)size;
 	idx_entry.pack_size = (uint32_t)pack_size;
 	idx_entry.offset = offset;
 	vector_push(writer->index, &idx_entry);
@@ -161,6 +156,19 @@ spk_add_file(spk_writer_t* writer, fs_t* fs, const char* filename, const char* s
 
 on_error:
 	free(pack_data);
-	free(file_data);
 	return false;
 }
+
+bool
+spk_add_file(spk_writer_t* writer, fs_t* fs, const char* filename, const char* spk_pathname)
+{
+	void*  file_data;
+	size_t file_size;
+	bool   retval;
+
+	if (!(file_data = fs_fslurp(fs, filename, &file_size)))
+		return false;
+	retval = spk_add_data(writer, file_data, file_size, spk_pathname);
+	free(file_data);
+	return retval;
+}
@@ -0,0 +1,146 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+// the counter registry keeps a running tally of interesting engine events (draw
+// calls, script invocations, bytes read, etc.) over the course of a frame.  at the
+// end of each frame the tallies are snapshotted and reset, so what the game sees
+// is always the totals for the last complete frame.  counters owned by JSAL are
+// cumulative, so those are sampled and turned into per-frame deltas instead.
+
+#include "minisphere.h"
+#include "counter.h"
+
+#include "jsal.h"
+
+static const char* const COUNTER_NAMES[COUNTER_MAX] =
+{
+	"drawCalls",
+	"textureBinds",
+	"vertices",
+	"nativeCalls",
+	"scriptRuns",
+	"jobsRun",
+	"bytesRead",
+	"gcRuns",
+	"newObjects",
+};
+
+static unsigned int    s_counts[COUNTER_MAX];
+static unsigned int    s_last_counts[COUNTER_MAX];
+static js_stats_t      s_last_js_stats;
+static ALLEGRO_BITMAP* s_last_texture = NULL;
+static ALLEGRO_MUTEX*  s_mutex = NULL;
+static unsigned int    s_shared_counts[COUNTER_MAX];
+
+void
+counters_init(void)
+{
+	memset(s_counts, 0, sizeof s_counts);
+	memset(s_last_counts, 0, sizeof s_last_counts);
+	memset(s_shared_counts, 0, sizeof s_shared_counts);
+	if (s_mutex == NULL)
+		s_mutex = al_create_mutex();
+	s_last_js_stats = jsal_stats();
+	s_last_texture = NULL;
+}
+
+void
+counters_end_frame(void)
+{
+	js_stats_t js_stats;
+
+	int i;
+
+	al_lock_mutex(s_mutex);
+	for (i = 0; i < COUNTER_MAX; ++i)
+		s_counts[i] += s_shared_counts[i];
+	memset(s_shared_counts, 0, sizeof s_shared_counts);
+	al_unlock_mutex(s_mutex);
+
+	js_stats = jsal_stats();
+	s_counts[COUNTER_NATIVE_CALLS] = js_stats.num_native_calls - s_last_js_stats.num_native_calls;
+	s_counts[COUNTER_GC_RUNS] = js_stats.num_gc_runs - s_last_js_stats.num_gc_runs;
+	s_counts[COUNTER_OBJECTS] = js_stats.num_object_allocs - s_last_js_stats.num_object_allocs;
+	s_last_js_stats = js_stats;
+
+	memcpy(s_last_counts, s_counts, sizeof s_counts);
+	memset(s_counts, 0, sizeof s_counts);
+
+	// the texture may have been freed in the meantime, so don't trust it
+	s_last_texture = NULL;
+}
+
+void
+counter_add(counter_t counter, unsigned int amount)
+{
+	s_counts[counter] += amount;
+}
+
+void
+counter_add_shared(counter_t counter, unsigned int amount)
+{
+	// note: unlike counter_add(), this is safe to call from any thread, e.g. for
+	//       file I/O done by the thread pool.  the amount is folded into the main
+	//       count at the end of the frame.
+	al_lock_mutex(s_mutex);
+	s_shared_counts[counter] += amount;
+	al_unlock_mutex(s_mutex);
+}
+
+void
+counter_bind(ALLEGRO_BITMAP* texture)
+{
+	ALLEGRO_BITMAP* parent;
+
+	// a draw only costs a texture bind if it uses a different texture than the
+	// last one.  sub-bitmaps share their parent's texture, so they don't count.
+	if (texture == NULL)
+		return;
+	if ((parent = al_get_parent_bitmap(texture)) != NULL)
+		texture = parent;
+	if (texture == s_last_texture)
+		return;
+	s_last_texture = texture;
+	++s_counts[COUNTER_BINDS];
+}
+
+const char*
+counter_name(counter_t counter)
+{
+	return COUNTER_NAMES[counter];
+}
+
+unsigned int
+counter_value(counter_t counter)
+{
+	return s_last_counts[counter];
+}
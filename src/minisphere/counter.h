@@ -0,0 +1,59 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef SPHERE__COUNTER_H__INCLUDED
+#define SPHERE__COUNTER_H__INCLUDED
+
+typedef
+enum counter
+{
+	COUNTER_DRAWS,
+	COUNTER_BINDS,
+	COUNTER_VERTICES,
+	COUNTER_NATIVE_CALLS,
+	COUNTER_SCRIPTS,
+	COUNTER_JOBS,
+	COUNTER_BYTES_READ,
+	COUNTER_GC_RUNS,
+	COUNTER_OBJECTS,
+	COUNTER_MAX
+} counter_t;
+
+void         counters_init      (void);
+void         counters_end_frame (void);
+void         counter_add        (counter_t counter, unsigned int amount);
+void         counter_add_shared (counter_t counter, unsigned int amount);
+void         counter_bind       (ALLEGRO_BITMAP* texture);
+const char*  counter_name       (counter_t counter);
+unsigned int counter_value      (counter_t counter);
+
+#endif // SPHERE__COUNTER_H__INCLUDED
@@ -33,75 +33,156 @@
 #include "minisphere.h"
 #include "dispatch.h"
 
+#include "counter.h"
 #include "script.h"
 #include "vector.h"
 
 struct job
 {
 	bool       background;
+	double     budget;
 	bool       critical;
+	int64_t    due;
 	bool       finished;
 	job_type_t hint;
+	uint32_t   idle_frame;
+	double     idle_time;
 	double     priority;
 	bool       paused;
-	int        timer;
+	bool       recurring;
+	int64_t    timer;
 	int64_t    token;
 	script_t*  script;
 };
 
-static struct job* job_from_token (int64_t token);
-static int         sort_jobs      (const void* in_a, const void* in_b);
+struct queue
+{
+	int64_t   num_runs;
+	int       num_onetime;
+	bool      need_compact;
+	vector_t* new_recurring;
+	vector_t* recurring;
+	int       run_depth;
+	vector_t* timers;
+};
+
+struct timer
+{
+	int64_t due;
+	int64_t token;
+};
+
+struct token_slot
+{
+	int64_t token;
+	int     slot;
+};
 
-static vector_t* s_exit_jobs;
-static bool      s_is_busy = false;
-static bool      s_need_sort = false;
-static int64_t   s_next_token = 1;
-static vector_t* s_onetime_jobs;
-static vector_t* s_recurring_jobs;
+static void        compact_queue    (struct queue* queue);
+static void        free_job         (int slot);
+static struct job* job_from_token   (int64_t token, int *out_slot);
+static bool        job_sorts_before (const struct job* job, const struct job* other);
+static int         map_find         (int64_t token);
+static void        map_insert       (int64_t token, int slot);
+static void        map_remove       (int64_t token);
+static void        merge_new_jobs   (struct queue* queue);
+static int         new_job          (const struct job* job);
+static void        pop_timer        (struct queue* queue);
+static void        push_timer       (struct queue* queue, int64_t due, int64_t token);
+static bool        timer_before     (const struct timer* timer, const struct timer* other);
+
+static vector_t*          s_free_slots;
+static int                s_idle_cursor = 0;
+static bool               s_in_idle = false;
+static vector_t*          s_jobs = NULL;
+static int                s_map_capacity;
+static int                s_map_count;
+static int64_t            s_next_token = 1;
+static int                s_num_foreground = 0;
+static struct queue       s_queues[JOB_TYPE_MAX];
+static struct token_slot* s_token_map;
 
 void
 dispatch_init(void)
 {
+	int i;
+
 	console_log(1, "initializing dispatch manager");
-	s_onetime_jobs = vector_new(sizeof(struct job));
-	s_recurring_jobs = vector_new(sizeof(struct job));
-	s_exit_jobs = vector_new(sizeof(struct job));
+
+	// jobs live in a single slot array, recycled through a free list, with a
+	// hash map to find them by token.  each hint then gets its own queues:
+	// a priority-sorted list of recurring jobs and a min-heap of one-time jobs
+	// keyed on the run they come due.  this keeps the per-job cost of
+	// Dispatch.later() et al. constant, or logarithmic at worst, so games can
+	// have thousands of timers in flight.
+	s_jobs = vector_new(sizeof(struct job));
+	s_free_slots = vector_new(sizeof(int));
+	for (i = 0; i < JOB_TYPE_MAX; ++i) {
+		memset(&s_queues[i], 0, sizeof(struct queue));
+		s_queues[i].new_recurring = vector_new(sizeof(int));
+		s_queues[i].recurring = vector_new(sizeof(int));
+		s_queues[i].timers = vector_new(sizeof(struct timer));
+	}
+	s_map_capacity = 64;
+	s_map_count = 0;
+	s_token_map = calloc(s_map_capacity, sizeof(struct token_slot));
 
 	// reserve extra slots for one-time jobs.  realloc() is fairly expensive
 	// and the one-time queue gets very heavy traffic.
-	vector_reserve(s_onetime_jobs, 32);
+	vector_reserve(s_jobs, 32);
 }
 
 void
 dispatch_uninit(void)
 {
+	int i;
+
 	console_log(1, "shutting down dispatch manager");
-	vector_free(s_onetime_jobs);
-	vector_free(s_recurring_jobs);
-	vector_free(s_exit_jobs);
+	for (i = 0; i < JOB_TYPE_MAX; ++i) {
+		vector_free(s_queues[i].new_recurring);
+		vector_free(s_queues[i].recurring);
+		vector_free(s_queues[i].timers);
+	}
+	vector_free(s_free_slots);
+	vector_free(s_jobs);
+	free(s_token_map);
+	s_jobs = NULL;
 }
 
 bool
 dispatch_busy(void)
 {
-	return s_is_busy || vector_len(s_onetime_jobs) > 0;
+	return s_num_foreground > 0
+		|| s_queues[JOB_ON_RENDER].num_onetime > 0
+		|| s_queues[JOB_ON_TICK].num_onetime > 0
+		|| s_queues[JOB_ON_UPDATE].num_onetime > 0;
 }
 
 bool
 dispatch_can_exit(void)
 {
-	return !dispatch_busy() && vector_len(s_exit_jobs) == 0;
+	return !dispatch_busy() && s_queues[JOB_ON_EXIT].num_onetime == 0;
 }
 
 void
 dispatch_cancel(int64_t token)
 {
 	struct job* job;
+	int         slot;
 
-	if (!(job = job_from_token(token)))
+	// note: a one-time job is marked finished just before it runs, so this
+	//       can't free a job out from under dispatch_run().
+	if (!(job = job_from_token(token, &slot)) || job->finished)
 		return;
-	job->finished = true;
-	s_need_sort = true;
+	if (job->recurring) {
+		job->finished = true;
+		if (!job->background)
+			--s_num_foreground;
+		s_queues[job->hint].need_compact = true;
+	}
+	else {
+		free_job(slot);
+	}
 }
 
 void
@@ -113,90 +194,113 @@ dispatch_cancel_all(bool recurring, bool also_critical)
 
 	struct job* job;
 
-	iter_t iter;
-
-	iter = vector_enum(s_onetime_jobs);
-	while ((job = iter_next(&iter))) {
-		if (!job->critical || also_critical)
-			job->finished = true;
-	}
-
-	iter = vector_enum(s_exit_jobs);
-	while ((job = iter_next(&iter))) {
-		if (!job->critical || also_critical)
-			job->finished = true;
-	}
+	int i;
 
-	if (recurring) {
-		iter = vector_enum(s_recurring_jobs);
-		while ((job = iter_next(&iter)))
-			job->finished = true;
-		s_need_sort = true;
-		s_is_busy = false;
+	for (i = 0; i < vector_len(s_jobs); ++i) {
+		job = vector_get(s_jobs, i);
+		if (job->token == 0 || job->finished)
+			continue;
+		if (job->recurring && recurring)
+			dispatch_cancel(job->token);
+		else if (!job->recurring && (!job->critical || also_critical))
+			free_job(i);
 	}
 }
 
 int64_t
 dispatch_defer(script_t* script, int timeout, job_type_t hint, bool critical)
 {
-	struct job job;
-	vector_t*  queue;
+	struct job    job;
+	struct queue* queue;
 
-	if (s_onetime_jobs == NULL)
+	if (s_jobs == NULL)
 		return 0;
+	queue = &s_queues[hint];
+	memset(&job, 0, sizeof(struct job));
 	job.critical = critical;
-	job.finished = false;
 	job.hint = hint;
 	job.script = script;
-	job.paused = false;
-	job.timer = timeout;
 	job.token = s_next_token++;
-	queue = hint == JOB_ON_EXIT ? s_exit_jobs
-		: s_onetime_jobs;
-	vector_push(queue, &job);
+
+	// a job deferred while its queue is being run gets picked up by that same
+	// run if it's due, just like it would if it were appended to a list.
+	job.due = queue->num_runs + timeout + (queue->run_depth > 0 ? 0 : 1);
+	new_job(&job);
+	push_timer(queue, job.due, job.token);
+	++queue->num_onetime;
 	return job.token;
 }
 
+int64_t
+dispatch_idle(script_t* script, double priority, double budget)
+{
+	struct job* job;
+	int64_t     token;
+
+	// idle jobs never keep the event loop alive: there's no idle time to
+	// speak of once everything else is done.
+	if (!(token = dispatch_recur(script, priority, true, JOB_ON_IDLE)))
+		return 0;
+	job = job_from_token(token, NULL);
+	job->budget = budget;
+	return token;
+}
+
 void
 dispatch_pause(int64_t token, bool paused)
 {
-	struct job* job;
+	struct job*   job;
+	struct queue* queue;
 
-	if (!(job = job_from_token(token)))
+	if (!(job = job_from_token(token, NULL)) || job->paused == paused)
 		return;
 	job->paused = paused;
+	if (job->recurring || job->finished)
+		return;
+
+	// a paused one-time job drops out of the timer heap (its entry gets
+	// discarded when it surfaces) and remembers how many runs it had left.
+	// unpausing schedules it again from there.
+	queue = &s_queues[job->hint];
+	if (paused) {
+		job->timer = job->due - queue->num_runs;
+	}
+	else {
+		job->due = queue->num_runs + job->timer;
+		push_timer(queue, job->due, job->token);
+	}
 }
 
 int64_t
 dispatch_recur(script_t* script, double priority, bool background, job_type_t hint)
 {
 	struct job job;
+	int        slot;
 
-	iter_t iter;
-
-	if (s_recurring_jobs == NULL)
+	if (s_jobs == NULL)
 		return 0;
 	if (hint == JOB_ON_RENDER) {
 		// invert priority for render jobs.  this ensures higher priority jobs
 		// get rendered later in a frame, i.e. closer to the screen.
 		priority = -priority;
 	}
+	memset(&job, 0, sizeof(struct job));
 	job.background = background;
-	job.finished = false;
 	job.hint = hint;
 	job.priority = priority;
+	job.recurring = true;
 	job.script = script;
-	job.paused = false;
 	job.token = s_next_token++;
-	vector_push(s_recurring_jobs, &job);
+	slot = new_job(&job);
 
-	// check whether we should keep the event loop alive
-	s_is_busy = false;
-	iter = vector_enum(s_recurring_jobs);
-	while (iter_next(&iter))
-		s_is_busy |= !((struct job*)iter.ptr)->background;
+	// new recurring jobs are merged into the sorted list at the start of the
+	// next run.  inserting them right away would shift the list under a run
+	// that's in progress.
+	vector_push(s_queues[hint].new_recurring, &slot);
 
-	s_need_sort = true;
+	// check whether we should keep the event loop alive
+	if (!background)
+		++s_num_foreground;
 
 	return job.token;
 }
@@ -206,9 +310,11 @@ dispatch_run(job_type_t hint)
 {
 	static unsigned int last_call_id = 0;
 
-	unsigned int call_id;
-	struct job*  job;
-	vector_t*    queue;
+	unsigned int  call_id;
+	struct job*   job;
+	struct queue* queue;
+	int           slot;
+	struct timer  timer;
 
 	int i;
 
@@ -217,100 +323,358 @@ dispatch_run(job_type_t hint)
 	// call to `dispatch_run` happened before this one returned.
 	call_id = ++last_call_id;
 
-	if (s_need_sort) {
-		vector_sort(s_recurring_jobs, sort_jobs);
-		s_need_sort = false;
-	}
+	queue = &s_queues[hint];
+	++queue->num_runs;
+	++queue->run_depth;
+	merge_new_jobs(queue);
 
 	// process recurring jobs
-	for (i = 0; i < vector_len(s_recurring_jobs); ++i) {
-		job = (struct job*)vector_get(s_recurring_jobs, i);
-		if (job->hint != hint)
-			continue;
-		if (!job->paused && !job->finished)
+	for (i = 0; i < vector_len(queue->recurring); ++i) {
+		slot = *(int*)vector_get(queue->recurring, i);
+		job = vector_get(s_jobs, slot);
+		if (!job->paused && !job->finished) {
+			counter_add(COUNTER_JOBS, 1);
 			script_run(job->script, true);  // invalidates job pointer
-		if (last_call_id == call_id) {
-			job = (struct job*)vector_get(s_recurring_jobs, i);
-			if (job->finished) {
-				script_unref(job->script);
-				vector_remove(s_recurring_jobs, i--);
-			}
 		}
-		else {
+		if (last_call_id != call_id) {
 			// reentrancy detected; bail out since it's unsafe to continue
+			--queue->run_depth;
 			return false;
 		}
 	}
-
-	// process one-time jobs
-	queue = hint == JOB_ON_EXIT ? s_exit_jobs
-		: s_onetime_jobs;
-	for (i = 0; i < vector_len(queue); ++i) {
-		job = (struct job*)vector_get(queue, i);
-		if (job->hint != hint)
-			continue;
-		if (!job->paused && job->timer-- <= 0 && !job->finished) {
-			job->finished = true;
-			script_run(job->script, false);  // invalidates job pointer
-		}
-		if (last_call_id == call_id) {
-			job = (struct job*)vector_get(queue, i);
-			if (job->finished) {
-				script_unref(job->script);
-				vector_remove(queue, i--);
-			}
-		}
-		else {
+	if (queue->need_compact)
+		compact_queue(queue);
+
+	// process one-time jobs which have come due
+	while (vector_len(queue->timers) > 0) {
+		timer = *(struct timer*)vector_get(queue->timers, 0);
+		if (timer.due > queue->num_runs)
+			break;
+		pop_timer(queue);
+		if (!(job = job_from_token(timer.token, &slot)))
+			continue;  // canceled
+		if (job->paused || job->due != timer.due)
+			continue;  // stale entry, job was paused and rescheduled
+		job->finished = true;
+		counter_add(COUNTER_JOBS, 1);
+		script_run(job->script, false);  // invalidates job pointer
+		free_job(slot);
+		if (last_call_id != call_id) {
 			// reentrancy detected; bail out since it's unsafe to continue
+			--queue->run_depth;
 			return false;
 		}
 	}
 
+	--queue->run_depth;
 	return true;
 }
 
-static struct job*
-job_from_token(int64_t token)
+void
+dispatch_run_idle(double deadline)
+{
+	bool          cut_short = false;
+	struct job*   job;
+	int           num_jobs;
+	double        now;
+	struct queue* queue;
+	int           slot;
+	double        start_time;
+
+	int i, index;
+
+	// idle jobs soak up the slack before the next frame is due.  each job is
+	// called repeatedly until it's used up its budget for the frame; if the
+	// deadline arrives first, the job that got cut off goes first next time so
+	// low-priority jobs aren't starved when there's little slack to go around.
+	if (s_jobs == NULL || s_in_idle)
+		return;
+	queue = &s_queues[JOB_ON_IDLE];
+	merge_new_jobs(queue);
+	if ((num_jobs = vector_len(queue->recurring)) == 0)
+		return;
+	s_in_idle = true;
+	now = al_get_time();
+	for (i = 0; i < num_jobs && now < deadline; ++i) {
+		index = (s_idle_cursor + i) % num_jobs;
+		slot = *(int*)vector_get(queue->recurring, index);
+		job = vector_get(s_jobs, slot);
+		if (job->idle_frame != g_tick_count) {
+			job->idle_frame = g_tick_count;
+			job->idle_time = 0.0;
+		}
+		while (!job->paused && !job->finished && job->idle_time < job->budget) {
+			if (now >= deadline) {
+				s_idle_cursor = index;
+				cut_short = true;
+				break;
+			}
+			start_time = now;
+			counter_add(COUNTER_JOBS, 1);
+			script_run(job->script, true);  // invalidates job pointer
+			now = al_get_time();
+			job = vector_get(s_jobs, slot);
+			job->idle_time += now - start_time;
+		}
+		if (cut_short)
+			break;
+	}
+	if (!cut_short)
+		s_idle_cursor = i < num_jobs ? (s_idle_cursor + i) % num_jobs : 0;
+	if (queue->need_compact) {
+		compact_queue(queue);
+		s_idle_cursor = 0;
+	}
+	s_in_idle = false;
+}
+
+static void
+compact_queue(struct queue* queue)
 {
 	struct job* job;
+	int         num_slots;
+	int         slot;
+
+	int i, j;
+
+	// remove all finished jobs in a single pass rather than calling
+	// vector_remove() for each one, which would be quadratic.
+	num_slots = vector_len(queue->recurring);
+	for (i = 0, j = 0; i < num_slots; ++i) {
+		slot = *(int*)vector_get(queue->recurring, i);
+		job = vector_get(s_jobs, slot);
+		if (job->finished)
+			free_job(slot);
+		else
+			vector_put(queue->recurring, j++, &slot);
+	}
+	vector_resize(queue->recurring, j);
+	queue->need_compact = false;
+}
 
-	iter_t iter;
+static void
+free_job(int slot)
+{
+	struct job* job;
+
+	job = vector_get(s_jobs, slot);
+	script_unref(job->script);
+	map_remove(job->token);
+	if (!job->recurring)
+		--s_queues[job->hint].num_onetime;
+	job->script = NULL;
+	job->token = 0;
+	vector_push(s_free_slots, &slot);
+}
+
+static struct job*
+job_from_token(int64_t token, int *out_slot)
+{
+	int slot;
+
+	if ((slot = map_find(token)) < 0)
+		return NULL;
+	if (out_slot != NULL)
+		*out_slot = slot;
+	return vector_get(s_jobs, slot);
+}
+
+static bool
+job_sorts_before(const struct job* job, const struct job* other)
+{
+	// job tokens are strictly sequential, so using the token as a tiebreaker
+	// keeps jobs with equal priority in FIFO order.
+	return job->priority > other->priority
+		|| (job->priority == other->priority && job->token < other->token);
+}
+
+static int
+map_find(int64_t token)
+{
+	int mask;
+
+	int i;
 
-	iter = vector_enum(s_recurring_jobs);
-	while ((job = iter_next(&iter))) {
-		if (token == job->token)
-			return job;
+	// job tokens are handed out sequentially, so the low bits make a perfectly
+	// good hash with no clustering to speak of.
+	mask = s_map_capacity - 1;
+	for (i = (int)(token & mask); s_token_map[i].token != 0; i = (i + 1) & mask) {
+		if (s_token_map[i].token == token)
+			return s_token_map[i].slot;
 	}
-	iter = vector_enum(s_onetime_jobs);
-	while ((job = iter_next(&iter))) {
-		if (token == job->token)
-			return job;
+	return -1;
+}
+
+static void
+map_insert(int64_t token, int slot)
+{
+	int                mask;
+	struct token_slot* old_map;
+	int                old_capacity;
+
+	int i;
+
+	// keep the load factor under 50% so probe sequences stay short.
+	if ((s_map_count + 1) * 2 > s_map_capacity) {
+		old_map = s_token_map;
+		old_capacity = s_map_capacity;
+		s_map_capacity *= 2;
+		s_map_count = 0;
+		s_token_map = calloc(s_map_capacity, sizeof(struct token_slot));
+		for (i = 0; i < old_capacity; ++i) {
+			if (old_map[i].token != 0)
+				map_insert(old_map[i].token, old_map[i].slot);
+		}
+		free(old_map);
+	}
+	mask = s_map_capacity - 1;
+	i = (int)(token & mask);
+	while (s_token_map[i].token != 0)
+		i = (i + 1) & mask;
+	s_token_map[i].token = token;
+	s_token_map[i].slot = slot;
+	++s_map_count;
+}
+
+static void
+map_remove(int64_t token)
+{
+	int home;
+	int mask;
+
+	int i, j;
+
+	mask = s_map_capacity - 1;
+	for (i = (int)(token & mask); s_token_map[i].token != token; i = (i + 1) & mask) {
+		if (s_token_map[i].token == 0)
+			return;
 	}
-	iter = vector_enum(s_exit_jobs);
-	while ((job = iter_next(&iter))) {
-		if (token == job->token)
-			return job;
+
+	// backward-shift deletion: pull later entries in the probe sequence into
+	// the hole so lookups never need tombstones.
+	j = i;
+	while (true) {
+		j = (j + 1) & mask;
+		if (s_token_map[j].token == 0)
+			break;
+		home = (int)(s_token_map[j].token & mask);
+		if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+			s_token_map[i] = s_token_map[j];
+			i = j;
+		}
 	}
-	return NULL;
+	s_token_map[i].token = 0;
+	--s_map_count;
+}
+
+static void
+merge_new_jobs(struct queue* queue)
+{
+	struct job* job;
+	int         num_new;
+	int         lo, hi, mid;
+	int         slot;
+
+	int i;
+
+	num_new = vector_len(queue->new_recurring);
+	for (i = 0; i < num_new; ++i) {
+		slot = *(int*)vector_get(queue->new_recurring, i);
+		job = vector_get(s_jobs, slot);
+		if (job->finished) {
+			free_job(slot);
+			continue;
+		}
+
+		// binary search for the insertion point.  this replaces re-sorting the
+		// whole list every time a job is added.
+		lo = 0;
+		hi = vector_len(queue->recurring);
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (job_sorts_before(vector_get(s_jobs, *(int*)vector_get(queue->recurring, mid)), job))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		vector_insert(queue->recurring, lo, &slot);
+	}
+	vector_clear(queue->new_recurring);
 }
 
 static int
-sort_jobs(const void* in_a, const void* in_b)
+new_job(const struct job* job)
+{
+	int num_free;
+	int slot;
+
+	if ((num_free = vector_len(s_free_slots)) > 0) {
+		slot = *(int*)vector_get(s_free_slots, num_free - 1);
+		vector_pop(s_free_slots, 1);
+		vector_put(s_jobs, slot, job);
+	}
+	else {
+		slot = vector_len(s_jobs);
+		vector_push(s_jobs, job);
+	}
+	map_insert(job->token, slot);
+	return slot;
+}
+
+static void
+pop_timer(struct queue* queue)
+{
+	struct timer* child;
+	int           child_index;
+	struct timer* heap;
+	int           num_timers;
+	struct timer  timer;
+
+	int i;
+
+	num_timers = vector_len(queue->timers) - 1;
+	heap = vector_get(queue->timers, 0);
+	timer = heap[num_timers];
+	i = 0;
+	while ((child_index = i * 2 + 1) < num_timers) {
+		child = &heap[child_index];
+		if (child_index + 1 < num_timers && timer_before(child + 1, child))
+			++child_index, ++child;
+		if (!timer_before(child, &timer))
+			break;
+		heap[i] = *child;
+		i = child_index;
+	}
+	heap[i] = timer;
+	vector_pop(queue->timers, 1);
+}
+
+static void
+push_timer(struct queue* queue, int64_t due, int64_t token)
+{
+	struct timer* heap;
+	int           parent;
+	struct timer  timer;
+
+	int i;
+
+	timer.due = due;
+	timer.token = token;
+	vector_push(queue->timers, &timer);
+	heap = vector_get(queue->timers, 0);
+	i = vector_len(queue->timers) - 1;
+	while (i > 0 && timer_before(&timer, &heap[parent = (i - 1) / 2])) {
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = timer;
+}
+
+static bool
+timer_before(const struct timer* timer, const struct timer* other)
 {
-	// qsort() is not stable.  luckily job tokens are strictly sequential,
-	// so we can maintain FIFO order by just using the token as part of the
-	// sort key.
-
-	double      delta;
-	int64_t     fifo_delta;
-	struct job* job_a;
-	struct job* job_b;
-
-	job_a = (struct job*)in_a;
-	job_b = (struct job*)in_b;
-	delta = job_b->priority - job_a->priority;
-	fifo_delta = job_a->token - job_b->token;
-	return delta < 0.0 ? -1 : delta > 0.0 ? 1
-		: fifo_delta < 0 ? -1 : fifo_delta > 0 ? 1
-		: 0;
+	// ties are broken by token to run jobs due on the same frame in the order
+	// they were queued.
+	return timer->due < other->due
+		|| (timer->due == other->due && timer->token < other->token);
 }
@@ -39,6 +39,7 @@ typedef
 enum job_type
 {
 	JOB_ON_EXIT,
+	JOB_ON_IDLE,
 	JOB_ON_RENDER,
 	JOB_ON_TICK,
 	JOB_ON_UPDATE,
@@ -52,8 +53,10 @@ bool    dispatch_can_exit   (void);
 void    dispatch_cancel     (int64_t token);
 void    dispatch_cancel_all (bool recurring, bool also_critical);
 int64_t dispatch_defer      (script_t* script, int timeout, job_type_t hint, bool critical);
+int64_t dispatch_idle       (script_t* script, double priority, double budget);
 void    dispatch_pause      (int64_t token, bool paused);
 int64_t dispatch_recur      (script_t* script, double priority, bool background, job_type_t hint);
 bool    dispatch_run        (job_type_t hint);
+void    dispatch_run_idle   (double deadline);
 
 #endif // SPHERE__DISPATCH_H__INCLUDED
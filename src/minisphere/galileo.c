@@ -34,13 +34,13 @@
 #include "galileo.h"
 
 #include "color.h"
+#include "counter.h"
+#include "render.h"
 #include "vector.h"
 
-static void free_cached_uniform (shader_t* shader, const char* name);
-static void render_shape        (shape_t* shape);
-
 enum uniform_type
 {
+	UNIFORM_NONE,
 	UNIFORM_BOOL,
 	UNIFORM_INT,
 	UNIFORM_INT_ARR,
@@ -52,7 +52,10 @@ enum uniform_type
 };
 struct uniform
 {
-	char              name[256];
+	char*             name;
+	bool              dirty;
+	unsigned int      hash;
+	unsigned int      owner_id;
 	enum uniform_type type;
 	int               num_values;
 	union {
@@ -71,7 +74,9 @@ struct ibo
 {
 	unsigned int          refcount;
 	ALLEGRO_INDEX_BUFFER* buffer;
+	bool                  dynamic;
 	vector_t*             indices;
+	int                   num_indices;
 };
 
 struct model
@@ -87,8 +92,11 @@ struct shader
 {
 	unsigned int    id;
 	unsigned int    refcount;
+	vector_t*       dirty_slots;
 	char*           fragment_path;
 	ALLEGRO_SHADER* program;
+	int*            slot_map;
+	int             slot_map_size;
 	vector_t*       uniforms;
 	char*           vertex_path;
 };
@@ -107,42 +115,121 @@ struct vbo
 {
 	unsigned int           refcount;
 	ALLEGRO_VERTEX_BUFFER* buffer;
+	bool                   dynamic;
+	int                    num_vertices;
 	vector_t*              vertices;
 };
 
-static shader_t*    s_def_shader;
-static shader_t*    s_last_shader;
-static unsigned int s_next_model_id = 1;
-static unsigned int s_next_shader_id = 1;
-static unsigned int s_next_shape_id = 1;
+static bool            defer_shape      (shape_t* shape, image_t* surface, transform_t* transform);
+static void            free_uniform     (struct uniform* uniform);
+static unsigned int    hash_name        (const char* name);
+static int             prim_type_of     (shape_type_t type);
+static void            push_list_index  (const shape_t* shape, int index);
+static void            render_instances (shape_t* shape, const instance_t* instances, int num_instances);
+static void            render_shape     (shape_t* shape);
+static struct uniform* reset_uniform    (shader_t* shader, int slot, enum uniform_type type, int num_values);
+static void            update_uniform   (shader_t* shader, int slot);
+static void            upload_uniform   (struct uniform* uniform);
+
+static vector_t*              s_batch_indices;
+static vector_t*              s_batch_vertices;
+static shader_t*              s_def_shader;
+static bool                   s_have_def_shader;
+static shader_t*              s_last_shader;
+static vector_t*              s_list_indices;
+static ALLEGRO_VERTEX_BUFFER* s_stream_buffer;
+static int                    s_stream_offset;
+static unsigned int           s_next_model_id = 1;
+static unsigned int           s_next_shader_id = 1;
+static unsigned int           s_next_shape_id = 1;
 
 void
 galileo_init(void)
 {
 	console_log(1, "initializing Galileo subsystem");
+	s_batch_indices = vector_new(sizeof(int));
+	s_batch_vertices = vector_new(sizeof(ALLEGRO_VERTEX));
 	s_def_shader = NULL;
+	s_have_def_shader = false;
 	s_last_shader = NULL;
+	s_list_indices = vector_new(sizeof(int));
+	s_stream_buffer = NULL;
+	s_stream_offset = 0;
 }
 
 void
 galileo_uninit(void)
 {
 	console_log(1, "shutting down Galileo subsystem");
+	if (s_stream_buffer != NULL)
+		al_destroy_vertex_buffer(s_stream_buffer);
 	shader_unref(s_def_shader);
+	vector_free(s_batch_indices);
+	vector_free(s_batch_vertices);
+	vector_free(s_list_indices);
 }
 
 shader_t*
 galileo_shader(void)
 {
-	if (s_def_shader == NULL) {
+	// note: compilation fails when there's no display (e.g. headless mode).  the
+	//       attempt is only made once so a failure doesn't send every draw back
+	//       to the disk to read the GLSL files again.
+	if (!s_have_def_shader) {
 		console_log(3, "compiling Galileo default shaders");
 		s_def_shader = shader_new(
 			"#/shaders/default.vert.glsl",
 			"#/shaders/default.frag.glsl");
+		s_have_def_shader = true;
 	}
 	return s_def_shader;
 }
 
+void
+galileo_draw_immediate(image_t* surface, shape_type_t type, image_t* texture, const ALLEGRO_VERTEX* vertices, int num_vertices)
+{
+	ALLEGRO_BITMAP* bitmap;
+	ALLEGRO_VERTEX* entries;
+	int             draw_mode;
+
+	// note: immediate-mode vertices are streamed through a single large vertex
+	//       buffer used as a ring: each draw claims the next free range and the
+	//       cursor wraps around when it runs out of room.  this avoids creating a
+	//       new GPU buffer for every call while still letting the driver overlap
+	//       uploads with rendering.
+
+	if (image_defer_draw(surface, galileo_shader(), NULL, type, texture, vertices, num_vertices))
+		return;
+
+	image_render_with(surface, galileo_shader(), NULL);
+
+	draw_mode = prim_type_of(type);
+	bitmap = texture != NULL ? image_bitmap(texture) : NULL;
+	counter_bind(bitmap);
+	counter_add(COUNTER_VERTICES, num_vertices);
+	if (s_stream_buffer == NULL) {
+		console_log(3, "allocating %d-vertex Galileo stream buffer", GALILEO_STREAM_SIZE);
+		s_stream_buffer = al_create_vertex_buffer(NULL, NULL, GALILEO_STREAM_SIZE, ALLEGRO_PRIM_BUFFER_STREAM);
+	}
+	if (s_stream_buffer == NULL || num_vertices > GALILEO_STREAM_SIZE) {
+		al_draw_prim(vertices, NULL, bitmap, 0, num_vertices, draw_mode);
+		render_count_draws(1);
+		return;
+	}
+	if (s_stream_offset + num_vertices > GALILEO_STREAM_SIZE)
+		s_stream_offset = 0;
+	if (!(entries = al_lock_vertex_buffer(s_stream_buffer, s_stream_offset, num_vertices, ALLEGRO_LOCK_WRITEONLY))) {
+		al_draw_prim(vertices, NULL, bitmap, 0, num_vertices, draw_mode);
+		render_count_draws(1);
+		return;
+	}
+	memcpy(entries, vertices, num_vertices * sizeof(ALLEGRO_VERTEX));
+	al_unlock_vertex_buffer(s_stream_buffer);
+	al_draw_vertex_buffer(s_stream_buffer, bitmap, s_stream_offset, s_stream_offset + num_vertices, draw_mode);
+	render_count_draws(1);
+	s_stream_offset += num_vertices;
+}
+
 void
 galileo_reset(void)
 {
@@ -151,16 +238,16 @@ galileo_reset(void)
 	//       having to undo its own state changes all the time, keeping things snappy.
 
 	image_render_to(screen_backbuffer(g_screen), NULL);
-	shader_use(NULL, false);
 }
 
 ibo_t*
-ibo_new(void)
+ibo_new(bool dynamic)
 {
 	ibo_t* ibo;
 
 	ibo = calloc(1, sizeof(ibo_t));
 	ibo->indices = vector_new(sizeof(uint16_t));
+	ibo->dynamic = dynamic;
 	return ibo_ref(ibo);
 }
 
@@ -194,7 +281,7 @@ int
 ibo_len(const ibo_t* it)
 {
 	if (it != NULL)
-		return vector_len(it->indices);
+		return it->num_indices;
 	else
 		return 0;
 }
@@ -206,36 +293,55 @@ ibo_add_index(ibo_t* it, uint16_t index)
 }
 
 bool
-ibo_upload(ibo_t* it)
+ibo_update(ibo_t* it, int offset, const uint16_t* indices, int num_indices)
 {
-	ALLEGRO_INDEX_BUFFER* buffer;
-	uint16_t*             entries;
-
-	iter_t iter;
+	uint16_t* entries;
 
+	if (offset < 0 || offset + num_indices > it->num_indices)
+		return false;
 	if (it->buffer != NULL) {
-		al_destroy_index_buffer(it->buffer);
-		it->buffer = NULL;
+		if (!(entries = al_lock_index_buffer(it->buffer, offset, num_indices, ALLEGRO_LOCK_WRITEONLY)))
+			return false;
+		memcpy(entries, indices, num_indices * sizeof(uint16_t));
+		al_unlock_index_buffer(it->buffer);
 	}
+	memcpy(vector_get(it->indices, offset), indices, num_indices * sizeof(uint16_t));
+	return true;
+}
 
-	// create the index buffer object
-	if (!(buffer = al_create_index_buffer(2, NULL, vector_len(it->indices), ALLEGRO_PRIM_BUFFER_STATIC)))
-		return false;
-
-	// upload indices to the GPU
-	if (!(entries = al_lock_index_buffer(buffer, 0, vector_len(it->indices), ALLEGRO_LOCK_WRITEONLY))) {
-		al_destroy_index_buffer(buffer);
+bool
+ibo_upload(ibo_t* it)
+{
+	ALLEGRO_INDEX_BUFFER* buffer;
+	int                   buffer_flags;
+
+	// note: the index list is kept around after upload.  Allegro can't read back
+	//       a buffer unless it was created as READWRITE, which is slow, and
+	//       instanced drawing needs the indices on the CPU side to expand the
+	//       batch.
+	buffer_flags = it->dynamic ? ALLEGRO_PRIM_BUFFER_DYNAMIC : ALLEGRO_PRIM_BUFFER_STATIC;
+	if (al_get_current_display() == NULL)
+		buffer = NULL;  // headless, render_shape() draws from system memory
+	else if (!(buffer = al_create_index_buffer(2, vector_get(it->indices, 0), vector_len(it->indices), buffer_flags)))
 		return false;
-	}
-	iter = vector_enum(it->indices);
-	while (iter_next(&iter))
-		entries[iter.index] = *(uint16_t*)iter.ptr;
-	al_unlock_index_buffer(buffer);
-
+	if (it->buffer != NULL)
+		al_destroy_index_buffer(it->buffer);
 	it->buffer = buffer;
+	it->num_indices = vector_len(it->indices);
 	return true;
 }
 
+bool
+ibo_upload_raw(ibo_t* it, const uint16_t* indices, int num_indices)
+{
+	// note: this replaces the index list wholesale with the caller's data.  any
+	//       indices previously added are discarded.
+	if (!vector_resize(it->indices, num_indices))
+		return false;
+	memcpy(vector_get(it->indices, 0), indices, num_indices * sizeof(uint16_t));
+	return ibo_upload(it);
+}
+
 model_t*
 model_new(shader_t* shader)
 {
@@ -325,15 +431,32 @@ model_add_shape(model_t* it, shape_t* shape)
 
 void
 model_draw(const model_t* it, image_t* surface)
+{
+	iter_t   iter;
+	shape_t* shape;
+
+	// note: a custom shader's uniforms may change before the queue gets flushed,
+	//       so only models using the default shader are eligible for deferral.
+	iter = vector_enum(it->shapes);
+	while (iter_next(&iter)) {
+		shape = *(shape_t**)iter.ptr;
+		if (it->shader == NULL && defer_shape(shape, surface, it->transform))
+			continue;
+		image_render_with(surface, it->shader != NULL ? it->shader : galileo_shader(), it->transform);
+		render_shape(shape);
+	}
+}
+
+void
+model_draw_instanced(const model_t* it, image_t* surface, const instance_t* instances, int num_instances)
 {
 	iter_t iter;
 
-	image_render_to(surface, it->transform);
-	shader_use(it->shader != NULL ? it->shader : galileo_shader(), false);
+	image_render_with(surface, it->shader != NULL ? it->shader : galileo_shader(), it->transform);
 
 	iter = vector_enum(it->shapes);
 	while (iter_next(&iter))
-		render_shape(*(shape_t**)iter.ptr);
+		render_instances(*(shape_t**)iter.ptr, instances, num_instances);
 }
 
 shader_t*
@@ -372,6 +495,7 @@ shader_new(const char* vert_filename, const char* frag_filename)
 	shader->fragment_path = strdup(frag_filename);
 	shader->vertex_path = strdup(vert_filename);
 	shader->uniforms = vector_new(sizeof(struct uniform));
+	shader->dirty_slots = vector_new(sizeof(int));
 	return shader_ref(shader);
 
 on_error:
@@ -386,9 +510,26 @@ on_error:
 shader_t*
 shader_dup(const shader_t* it)
 {
-	shader_t* dolly;
+	shader_t*       dolly;
+	int             slot;
+	struct uniform* uniform;
+
+	iter_t iter;
+
+	if (!(dolly = shader_new(it->vertex_path, it->fragment_path)))
+		return NULL;
 
-	dolly = shader_new(it->vertex_path, it->fragment_path);
+	// note: uniform values aren't copied, but the slot assignments and their owners
+	//       are.  that way any uniform handles resolved against the original remain
+	//       valid for the clone.
+	iter = vector_enum(it->uniforms);
+	while ((uniform = iter_next(&iter))) {
+		if ((slot = shader_uniform_slot(dolly, uniform->name)) < 0) {
+			shader_unref(dolly);
+			return NULL;
+		}
+		((struct uniform*)vector_get(dolly->uniforms, slot))->owner_id = uniform->owner_id;
+	}
 	return dolly;
 }
 
@@ -404,180 +545,248 @@ shader_ref(shader_t* it)
 void
 shader_unref(shader_t* it)
 {
+	struct uniform* uniform;
+
+	iter_t iter;
+
 	if (it == NULL || --it->refcount > 0)
 		return;
 
 	console_log(3, "disposing shader program #%u no longer in use", it->id);
 	al_destroy_shader(it->program);
+	iter = vector_enum(it->uniforms);
+	while ((uniform = iter_next(&iter))) {
+		free_uniform(uniform);
+		free(uniform->name);
+	}
 	vector_free(it->uniforms);
+	vector_free(it->dirty_slots);
+	free(it->slot_map);
+	free(it->fragment_path);
+	free(it->vertex_path);
 	free(it);
 }
 
+int
+shader_num_uniforms(const shader_t* it)
+{
+	return vector_len(it->uniforms);
+}
+
 ALLEGRO_SHADER*
 shader_program(const shader_t* it)
 {
 	return it->program;
 }
 
-void
-shader_put_bool(shader_t* it, const char* name, bool value)
+unsigned int
+shader_slot_owner(const shader_t* it, int slot)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_bool(name, value);
+	// note: the owner of a slot is the ID of the shader it was first assigned on.
+	//       clones inherit it, so the owner and slot together identify a uniform
+	//       across a shader and all its clones.
+	if (slot < 0 || slot >= vector_len(it->uniforms))
+		return 0;
+	uniform = vector_get(it->uniforms, slot);
+	return uniform->owner_id;
+}
+
+int
+shader_uniform_slot(shader_t* it, const char* name)
+{
+	// note: uniform names are resolved to integer slots through an open-addressed
+	//       hash table, which lets the shader_put_*() functions index directly into
+	//       the uniform list rather than doing a name search every time a value
+	//       is set.
+
+	unsigned int    hash;
+	int*            new_map;
+	int             new_size;
+	int             slot;
+	struct uniform* uniform;
+	struct uniform  unif;
+
+	int i, j;
+
+	hash = hash_name(name);
+	if (it->slot_map != NULL) {
+		i = hash & (it->slot_map_size - 1);
+		while (it->slot_map[i] > 0) {
+			uniform = vector_get(it->uniforms, it->slot_map[i] - 1);
+			if (uniform->hash == hash && strcmp(uniform->name, name) == 0)
+				return it->slot_map[i] - 1;
+			i = (i + 1) & (it->slot_map_size - 1);
+		}
 	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_BOOL;
-		unif.bool_value = value;
-		vector_push(it->uniforms, &unif);
+
+	// new uniform name, assign it the next available slot.  the table is kept
+	// at most half full to keep probe sequences short.
+	slot = vector_len(it->uniforms);
+	if ((slot + 1) * 2 > it->slot_map_size) {
+		new_size = it->slot_map_size > 0 ? it->slot_map_size * 2 : 16;
+		if (!(new_map = calloc(new_size, sizeof(int))))
+			return -1;
+		for (j = 0; j < slot; ++j) {
+			uniform = vector_get(it->uniforms, j);
+			i = uniform->hash & (new_size - 1);
+			while (new_map[i] > 0)
+				i = (i + 1) & (new_size - 1);
+			new_map[i] = j + 1;
+		}
+		free(it->slot_map);
+		it->slot_map = new_map;
+		it->slot_map_size = new_size;
+	}
+	memset(&unif, 0, sizeof(struct uniform));
+	unif.name = strdup(name);
+	unif.hash = hash;
+	unif.owner_id = it->id;
+	unif.type = UNIFORM_NONE;
+	if (!vector_push(it->uniforms, &unif)) {
+		free(unif.name);
+		return -1;
 	}
+	i = hash & (it->slot_map_size - 1);
+	while (it->slot_map[i] > 0)
+		i = (i + 1) & (it->slot_map_size - 1);
+	it->slot_map[i] = slot + 1;
+	return slot;
 }
 
 void
-shader_put_float(shader_t* it, const char* name, float value)
+shader_put_bool(shader_t* it, int slot, bool value)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_float(name, value);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_FLOAT;
-		unif.float_value = value;
-		vector_push(it->uniforms, &unif);
-	}
+	uniform = vector_get(it->uniforms, slot);
+	if (uniform->type == UNIFORM_BOOL && uniform->bool_value == value)
+		return;
+	uniform = reset_uniform(it, slot, UNIFORM_BOOL, 1);
+	uniform->bool_value = value;
+	update_uniform(it, slot);
 }
 
 void
-shader_put_float_array(shader_t* it, const char* name, float values[], int size)
+shader_put_float(shader_t* it, int slot, float value)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_float_vector(name, 1, values, size);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_FLOAT_ARR;
-		unif.float_list = malloc(size * sizeof(float));
-		unif.num_values = size;
-		memcpy(unif.float_list, values, size * sizeof(float));
-		vector_push(it->uniforms, &unif);
-	}
+	uniform = vector_get(it->uniforms, slot);
+	if (uniform->type == UNIFORM_FLOAT && uniform->float_value == value)
+		return;
+	uniform = reset_uniform(it, slot, UNIFORM_FLOAT, 1);
+	uniform->float_value = value;
+	update_uniform(it, slot);
 }
 
 void
-shader_put_float_vector(shader_t* it, const char* name, float values[], int size)
+shader_put_float_array(shader_t* it, int slot, float values[], int size)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_float_vector(name, size, values, 1);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_FLOAT_VEC;
-		unif.num_values = size;
-		memcpy(unif.float_vec, values, sizeof(float) * size);
-		vector_push(it->uniforms, &unif);
+	uniform = vector_get(it->uniforms, slot);
+	if (uniform->type == UNIFORM_FLOAT_ARR && uniform->num_values == size
+		&& memcmp(uniform->float_list, values, size * sizeof(float)) == 0)
+	{
+		return;
 	}
+	uniform = reset_uniform(it, slot, UNIFORM_FLOAT_ARR, size);
+	memcpy(uniform->float_list, values, size * sizeof(float));
+	update_uniform(it, slot);
 }
 
 void
-shader_put_int(shader_t* it, const char* name, int value)
+shader_put_float_vector(shader_t* it, int slot, float values[], int size)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_int(name, value);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_INT;
-		unif.int_value = value;
-		vector_push(it->uniforms, &unif);
+	uniform = vector_get(it->uniforms, slot);
+	if (uniform->type == UNIFORM_FLOAT_VEC && uniform->num_values == size
+		&& memcmp(uniform->float_vec, values, size * sizeof(float)) == 0)
+	{
+		return;
 	}
+	uniform = reset_uniform(it, slot, UNIFORM_FLOAT_VEC, size);
+	memcpy(uniform->float_vec, values, size * sizeof(float));
+	update_uniform(it, slot);
 }
 
 void
-shader_put_int_array(shader_t* it, const char* name, int values[], int size)
+shader_put_int(shader_t* it, int slot, int value)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_int_vector(name, 1, values, size);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_INT_ARR;
-		unif.int_list = malloc(size * sizeof(int));
-		unif.num_values = size;
-		memcpy(unif.int_list, values, size * sizeof(int));
-		vector_push(it->uniforms, &unif);
-	}
+	uniform = vector_get(it->uniforms, slot);
+	if (uniform->type == UNIFORM_INT && uniform->int_value == value)
+		return;
+	uniform = reset_uniform(it, slot, UNIFORM_INT, 1);
+	uniform->int_value = value;
+	update_uniform(it, slot);
 }
 
 void
-shader_put_int_vector(shader_t* it, const char* name, int values[], int size)
+shader_put_int_array(shader_t* it, int slot, int values[], int size)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_int_vector(name, size, values, 1);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_INT_VEC;
-		unif.num_values = size;
-		memcpy(unif.int_vec, values, sizeof(int) * size);
-		vector_push(it->uniforms, &unif);
+	uniform = vector_get(it->uniforms, slot);
+	if (uniform->type == UNIFORM_INT_ARR && uniform->num_values == size
+		&& memcmp(uniform->int_list, values, size * sizeof(int)) == 0)
+	{
+		return;
 	}
+	uniform = reset_uniform(it, slot, UNIFORM_INT_ARR, size);
+	memcpy(uniform->int_list, values, size * sizeof(int));
+	update_uniform(it, slot);
 }
 
 void
-shader_put_matrix(shader_t* it, const char* name, const transform_t* matrix)
+shader_put_int_vector(shader_t* it, int slot, int values[], int size)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_matrix(name, transform_matrix(matrix));
+	uniform = vector_get(it->uniforms, slot);
+	if (uniform->type == UNIFORM_INT_VEC && uniform->num_values == size
+		&& memcmp(uniform->int_vec, values, size * sizeof(int)) == 0)
+	{
+		return;
 	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_MATRIX;
-		al_copy_transform(&unif.mat_value, transform_matrix(matrix));
-		vector_push(it->uniforms, &unif);
+	uniform = reset_uniform(it, slot, UNIFORM_INT_VEC, size);
+	memcpy(uniform->int_vec, values, size * sizeof(int));
+	update_uniform(it, slot);
+}
+
+void
+shader_put_matrix(shader_t* it, int slot, const transform_t* matrix)
+{
+	struct uniform* uniform;
+
+	uniform = vector_get(it->uniforms, slot);
+	if (uniform->type == UNIFORM_MATRIX
+		&& memcmp(&uniform->mat_value, transform_matrix(matrix), sizeof(ALLEGRO_TRANSFORM)) == 0)
+	{
+		return;
 	}
+	uniform = reset_uniform(it, slot, UNIFORM_MATRIX, 1);
+	al_copy_transform(&uniform->mat_value, transform_matrix(matrix));
+	update_uniform(it, slot);
 }
 
 bool
 shader_use(shader_t* it, bool force_set)
 {
 	ALLEGRO_SHADER* al_shader;
-	struct uniform* uniform;
+	int*            slot_ptr;
 
 	iter_t iter;
 
-	if (it == s_last_shader && !force_set)
+	// note: Allegro stores the active shader per bitmap, so a shader may need to
+	//       be re-activated after a change of render target even if it's the same
+	//       one as last time.  the render state tracker keeps track of that.
+	al_shader = it != NULL ? it->program : NULL;
+	if (it == s_last_shader && !force_set && render_has_shader(al_shader))
 		return true;
 
 	if (it != NULL)
@@ -585,44 +794,16 @@ shader_use(shader_t* it, bool force_set)
 	else
 		console_log(4, "activating legacy shaders");
 
-	al_shader = it != NULL ? it->program : NULL;
-	if (!al_use_shader(al_shader))
+	if (!render_set_shader(al_shader))
 		return false;
 
-	// set any uniforms defined while we were inactive
+	// upload any uniforms changed while we were inactive.  GL retains uniform
+	// values per program, so ones which haven't changed don't need to be re-sent.
 	if (it != NULL) {
-		iter = vector_enum(it->uniforms);
-		while ((uniform = iter_next(&iter))) {
-			switch (uniform->type) {
-			case UNIFORM_BOOL:
-				al_set_shader_bool(uniform->name, uniform->bool_value);
-				break;
-			case UNIFORM_FLOAT:
-				al_set_shader_float(uniform->name, uniform->float_value);
-				break;
-			case UNIFORM_FLOAT_ARR:
-				al_set_shader_float_vector(uniform->name, 1, uniform->float_list, uniform->num_values);
-				free(uniform->float_list);
-				break;
-			case UNIFORM_FLOAT_VEC:
-				al_set_shader_float_vector(uniform->name, uniform->num_values, uniform->float_vec, 1);
-				break;
-			case UNIFORM_INT:
-				al_set_shader_int(uniform->name, uniform->int_value);
-				break;
-			case UNIFORM_INT_ARR:
-				al_set_shader_int_vector(uniform->name, 1, uniform->int_list, uniform->num_values);
-				free(uniform->int_list);
-				break;
-			case UNIFORM_INT_VEC:
-				al_set_shader_int_vector(uniform->name, uniform->num_values, uniform->int_vec, 1);
-				break;
-			case UNIFORM_MATRIX:
-				al_set_shader_matrix(uniform->name, &uniform->mat_value);
-				break;
-			}
-		}
-		vector_clear(it->uniforms);
+		iter = vector_enum(it->dirty_slots);
+		while ((slot_ptr = iter_next(&iter)))
+			upload_uniform(vector_get(it->uniforms, *slot_ptr));
+		vector_clear(it->dirty_slots);
 	}
 
 	s_last_shader = it;
@@ -725,18 +906,27 @@ shape_set_vbo(shape_t* it, vbo_t* vbo)
 void
 shape_draw(shape_t* it, image_t* surface, transform_t* transform)
 {
-	image_render_to(surface, transform);
-	shader_use(galileo_shader(), false);
+	if (defer_shape(it, surface, transform))
+		return;
+	image_render_with(surface, galileo_shader(), transform);
 	render_shape(it);
 }
 
+void
+shape_draw_instanced(shape_t* it, image_t* surface, transform_t* transform, const instance_t* instances, int num_instances)
+{
+	image_render_with(surface, galileo_shader(), transform);
+	render_instances(it, instances, num_instances);
+}
+
 vbo_t*
-vbo_new(void)
+vbo_new(bool dynamic)
 {
 	vbo_t* vbo;
 
 	vbo = calloc(1, sizeof(vbo_t));
-	vbo->vertices = vector_new(sizeof(vertex_t));
+	vbo->vertices = vector_new(sizeof(ALLEGRO_VERTEX));
+	vbo->dynamic = dynamic;
 	return vbo_ref(vbo);
 }
 
@@ -767,66 +957,271 @@ vbo_buffer(const vbo_t* it)
 int
 vbo_len(const vbo_t* it)
 {
-	return vector_len(it->vertices);
+	return it->num_vertices;
 }
 
 void
 vbo_add_vertex(vbo_t* it, vertex_t vertex)
 {
-	vector_push(it->vertices, &vertex);
+	ALLEGRO_VERTEX entry;
+
+	entry.x = vertex.x;
+	entry.y = vertex.y;
+	entry.z = vertex.z;
+	entry.u = vertex.u;
+	entry.v = vertex.v;
+	entry.color = nativecolor(vertex.color);
+	vector_push(it->vertices, &entry);
 }
 
 bool
-vbo_upload(vbo_t* it)
+vbo_update(vbo_t* it, int offset, const ALLEGRO_VERTEX* vertices, int num_vertices)
 {
-	ALLEGRO_VERTEX_BUFFER* buffer;
-	ALLEGRO_VERTEX*        entries;
-	vertex_t*              vertex;
-
-	iter_t iter;
+	ALLEGRO_VERTEX* entries;
 
+	if (offset < 0 || offset + num_vertices > it->num_vertices)
+		return false;
 	if (it->buffer != NULL) {
-		al_destroy_vertex_buffer(it->buffer);
-		it->buffer = NULL;
+		if (!(entries = al_lock_vertex_buffer(it->buffer, offset, num_vertices, ALLEGRO_LOCK_WRITEONLY)))
+			return false;
+		memcpy(entries, vertices, num_vertices * sizeof(ALLEGRO_VERTEX));
+		al_unlock_vertex_buffer(it->buffer);
 	}
+	memcpy(vector_get(it->vertices, offset), vertices, num_vertices * sizeof(ALLEGRO_VERTEX));
+	return true;
+}
+
+bool
+vbo_upload(vbo_t* it)
+{
+	ALLEGRO_VERTEX_BUFFER* buffer;
+	int                    buffer_flags;
+
+	// note: as with index lists, the vertices are kept in system memory after
+	//       upload so instanced draws can expand them without a GPU readback.
+	buffer_flags = it->dynamic ? ALLEGRO_PRIM_BUFFER_DYNAMIC : ALLEGRO_PRIM_BUFFER_STATIC;
+	if (al_get_current_display() == NULL)
+		buffer = NULL;  // headless, render_shape() draws from system memory
+	else if (!(buffer = al_create_vertex_buffer(NULL, vector_get(it->vertices, 0), vector_len(it->vertices), buffer_flags)))
+		return false;
+	if (it->buffer != NULL)
+		al_destroy_vertex_buffer(it->buffer);
+	it->buffer = buffer;
+	it->num_vertices = vector_len(it->vertices);
+	return true;
+}
 
-	// create the vertex buffer object
-	if (!(buffer = al_create_vertex_buffer(NULL, NULL, vector_len(it->vertices), ALLEGRO_PRIM_BUFFER_STATIC)))
+bool
+vbo_upload_raw(vbo_t* it, const ALLEGRO_VERTEX* vertices, int num_vertices)
+{
+	// note: this replaces the vertex list wholesale with the caller's data.  any
+	//       vertices previously added are discarded.
+	if (!vector_resize(it->vertices, num_vertices))
 		return false;
+	memcpy(vector_get(it->vertices, 0), vertices, num_vertices * sizeof(ALLEGRO_VERTEX));
+	return vbo_upload(it);
+}
+
+static bool
+defer_shape(shape_t* shape, image_t* surface, transform_t* transform)
+{
+	ALLEGRO_VERTEX* vertices;
+	uint16_t*       indices;
+	int             num_indices;
+	int             num_vertices;
 
-	// upload indices to the GPU
-	if (!(entries = al_lock_vertex_buffer(buffer, 0, vector_len(it->vertices), ALLEGRO_LOCK_WRITEONLY))) {
-		al_destroy_vertex_buffer(buffer);
+	int i;
+
+	// note: only small shapes are worth queueing; for anything bigger, copying
+	//       the vertices out of the VBO costs more than the draw call we'd save.
+	if (!image_get_deferred(surface))
 		return false;
+	if (shape->vbo == NULL)
+		return true;
+	num_vertices = vbo_len(shape->vbo);
+	num_indices = ibo_len(shape->ibo);
+	if (num_vertices > GALILEO_DEFER_LIMIT || num_indices > GALILEO_DEFER_LIMIT)
+		return false;
+	vertices = vector_get(shape->vbo->vertices, 0);
+	if (shape->ibo != NULL) {
+		indices = vector_get(shape->ibo->indices, 0);
+		vector_clear(s_batch_vertices);
+		for (i = 0; i < num_indices; ++i) {
+			if (indices[i] >= num_vertices)
+				return false;
+			vector_push(s_batch_vertices, &vertices[indices[i]]);
+		}
+		vertices = vector_get(s_batch_vertices, 0);
+		num_vertices = num_indices;
 	}
-	iter = vector_enum(it->vertices);
-	while (iter_next(&iter)) {
-		vertex = iter.ptr;
-		entries[iter.index].x = vertex->x;
-		entries[iter.index].y = vertex->y;
-		entries[iter.index].z = vertex->z;
-		entries[iter.index].u = vertex->u;
-		entries[iter.index].v = vertex->v;
-		entries[iter.index].color = nativecolor(vertex->color);
+	if (num_vertices == 0)
+		return true;
+	return image_defer_draw(surface, galileo_shader(), transform, shape->type, shape->texture,
+		vertices, num_vertices);
+}
+
+static void
+free_uniform(struct uniform* uniform)
+{
+	if (uniform->type == UNIFORM_FLOAT_ARR)
+		free(uniform->float_list);
+	else if (uniform->type == UNIFORM_INT_ARR)
+		free(uniform->int_list);
+	uniform->type = UNIFORM_NONE;
+}
+
+static unsigned int
+hash_name(const char* name)
+{
+	unsigned int hash = 2166136261u;
+
+	// 32-bit FNV-1a
+	while (*name != '\0') {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
 	}
-	al_unlock_vertex_buffer(buffer);
+	return hash;
+}
 
-	it->buffer = buffer;
-	return true;
+static int
+prim_type_of(shape_type_t type)
+{
+	return type == SHAPE_LINES ? ALLEGRO_PRIM_LINE_LIST
+		: type == SHAPE_LINE_LOOP ? ALLEGRO_PRIM_LINE_LOOP
+		: type == SHAPE_LINE_STRIP ? ALLEGRO_PRIM_LINE_STRIP
+		: type == SHAPE_TRIANGLES ? ALLEGRO_PRIM_TRIANGLE_LIST
+		: type == SHAPE_TRI_STRIP ? ALLEGRO_PRIM_TRIANGLE_STRIP
+		: type == SHAPE_TRI_FAN ? ALLEGRO_PRIM_TRIANGLE_FAN
+		: ALLEGRO_PRIM_POINT_LIST;
 }
 
 static void
-free_cached_uniform(shader_t* shader, const char* name)
+push_list_index(const shape_t* shape, int index)
 {
-	struct uniform* uniform;
+	int vertex_index;
 
-	iter_t iter;
+	vertex_index = shape->ibo != NULL
+		? *(uint16_t*)vector_get(shape->ibo->indices, index)
+		: index;
+	vector_push(s_list_indices, &vertex_index);
+}
 
-	iter = vector_enum(shader->uniforms);
-	while ((uniform = iter_next(&iter))) {
-		if (strcmp(uniform->name, name) == 0)
-			iter_remove(&iter);
+static void
+render_instances(shape_t* shape, const instance_t* instances, int num_instances)
+{
+	ALLEGRO_BITMAP*       bitmap;
+	int                   draw_mode;
+	int*                  indices;
+	int                   num_indices;
+	int                   num_list_indices;
+	int                   num_vertices;
+	const ALLEGRO_VERTEX* source;
+	ALLEGRO_VERTEX*       vertices;
+	float                 cos_angle;
+	float                 sin_angle;
+	float                 x, y;
+
+	int i, j, k;
+
+	// note: Allegro has no API for hardware instancing, so instead every copy of
+	//       the shape is transformed on the CPU and concatenated into a single
+	//       indexed batch.  strips, fans and loops are converted to their list
+	//       equivalents first so the copies don't get stitched together.  the
+	//       result is one draw call per shape no matter how many instances there are.
+
+	if (shape->vbo == NULL || num_instances <= 0)
+		return;
+
+	source = vector_get(shape->vbo->vertices, 0);
+	num_vertices = vector_len(shape->vbo->vertices);
+	num_indices = shape->ibo != NULL ? vector_len(shape->ibo->indices) : num_vertices;
+	if (num_vertices == 0 || num_indices == 0)
+		return;
+
+	// an index that points past the end of the vertex list would make the CPU
+	// expansion below read out of bounds, so refuse to draw the shape at all.
+	if (shape->ibo != NULL) {
+		for (i = 0; i < num_indices; ++i) {
+			if (*(uint16_t*)vector_get(shape->ibo->indices, i) >= num_vertices)
+				return;
+		}
+	}
+
+	// build a list-type index template for a single instance
+	vector_clear(s_list_indices);
+	switch (shape->type) {
+	case SHAPE_LINE_LOOP:
+	case SHAPE_LINE_STRIP:
+		draw_mode = ALLEGRO_PRIM_LINE_LIST;
+		for (i = 0; i < num_indices - 1; ++i) {
+			push_list_index(shape, i);
+			push_list_index(shape, i + 1);
+		}
+		if (shape->type == SHAPE_LINE_LOOP && num_indices > 2) {
+			push_list_index(shape, num_indices - 1);
+			push_list_index(shape, 0);
+		}
+		break;
+	case SHAPE_TRI_FAN:
+		draw_mode = ALLEGRO_PRIM_TRIANGLE_LIST;
+		for (i = 1; i < num_indices - 1; ++i) {
+			push_list_index(shape, 0);
+			push_list_index(shape, i);
+			push_list_index(shape, i + 1);
+		}
+		break;
+	case SHAPE_TRI_STRIP:
+		// every other triangle in a strip has reversed winding; swap the first
+		// two vertices of those to keep the facing consistent.
+		draw_mode = ALLEGRO_PRIM_TRIANGLE_LIST;
+		for (i = 0; i < num_indices - 2; ++i) {
+			push_list_index(shape, i % 2 == 0 ? i : i + 1);
+			push_list_index(shape, i % 2 == 0 ? i + 1 : i);
+			push_list_index(shape, i + 2);
+		}
+		break;
+	default:
+		draw_mode = prim_type_of(shape->type);
+		for (i = 0; i < num_indices; ++i)
+			push_list_index(shape, i);
+	}
+	num_list_indices = vector_len(s_list_indices);
+	if (num_list_indices == 0)
+		return;
+
+	// expand the batch, one copy of the shape per instance
+	if (!vector_resize(s_batch_vertices, num_vertices * num_instances))
+		return;
+	if (!vector_resize(s_batch_indices, num_list_indices * num_instances))
+		return;
+	vertices = vector_get(s_batch_vertices, 0);
+	indices = vector_get(s_batch_indices, 0);
+	for (i = 0; i < num_instances; ++i) {
+		cos_angle = cosf(instances[i].angle);
+		sin_angle = sinf(instances[i].angle);
+		for (j = 0; j < num_vertices; ++j) {
+			k = i * num_vertices + j;
+			x = source[j].x * instances[i].scale_x;
+			y = source[j].y * instances[i].scale_y;
+			vertices[k] = source[j];
+			vertices[k].x = x * cos_angle - y * sin_angle + instances[i].x;
+			vertices[k].y = x * sin_angle + y * cos_angle + instances[i].y;
+			vertices[k].color.r *= instances[i].r;
+			vertices[k].color.g *= instances[i].g;
+			vertices[k].color.b *= instances[i].b;
+			vertices[k].color.a *= instances[i].a;
+		}
+		for (j = 0; j < num_list_indices; ++j) {
+			k = i * num_list_indices + j;
+			indices[k] = *(int*)vector_get(s_list_indices, j) + i * num_vertices;
+		}
 	}
+
+	bitmap = shape->texture != NULL ? image_bitmap(shape->texture) : NULL;
+	al_draw_indexed_prim(vertices, NULL, bitmap, indices, num_list_indices * num_instances, draw_mode);
+	render_count_draws(1);
+	counter_bind(bitmap);
+	counter_add(COUNTER_VERTICES, num_list_indices * num_instances);
 }
 
 static void
@@ -834,25 +1229,114 @@ render_shape(shape_t* shape)
 {
 	ALLEGRO_BITMAP* bitmap;
 	int             draw_mode;
+	int             index;
 	int             num_indices;
 	int             num_vertices;
 
+	int i;
+
 	if (shape->vbo == NULL)
 		return;
 
 	num_vertices = vbo_len(shape->vbo);
 	num_indices = ibo_len(shape->ibo);
-	draw_mode = shape->type == SHAPE_LINES ? ALLEGRO_PRIM_LINE_LIST
-		: shape->type == SHAPE_LINE_LOOP ? ALLEGRO_PRIM_LINE_LOOP
-		: shape->type == SHAPE_LINE_STRIP ? ALLEGRO_PRIM_LINE_STRIP
-		: shape->type == SHAPE_TRIANGLES ? ALLEGRO_PRIM_TRIANGLE_LIST
-		: shape->type == SHAPE_TRI_STRIP ? ALLEGRO_PRIM_TRIANGLE_STRIP
-		: shape->type == SHAPE_TRI_FAN ? ALLEGRO_PRIM_TRIANGLE_FAN
-		: ALLEGRO_PRIM_POINT_LIST;
+	draw_mode = prim_type_of(shape->type);
 
 	bitmap = shape->texture != NULL ? image_bitmap(shape->texture) : NULL;
-	if (shape->ibo != NULL)
+	if (shape->vbo->buffer == NULL) {
+		// no GPU buffers (headless mode), draw straight from the vertex list
+		if (shape->ibo != NULL) {
+			// al_draw_indexed_prim() reads the vertex list on the CPU, so an index
+			// past the end of it would read out of bounds.  skip the draw instead.
+			if (!vector_resize(s_batch_indices, num_indices))
+				return;
+			for (i = 0; i < num_indices; ++i) {
+				index = *(uint16_t*)vector_get(shape->ibo->indices, i);
+				if (index >= num_vertices)
+					return;
+				*(int*)vector_get(s_batch_indices, i) = index;
+			}
+			al_draw_indexed_prim(vector_get(shape->vbo->vertices, 0), NULL, bitmap,
+				vector_get(s_batch_indices, 0), num_indices, draw_mode);
+		}
+		else {
+			al_draw_prim(vector_get(shape->vbo->vertices, 0), NULL, bitmap, 0, num_vertices, draw_mode);
+		}
+	}
+	else if (shape->ibo != NULL)
 		al_draw_indexed_buffer(vbo_buffer(shape->vbo), bitmap, ibo_buffer(shape->ibo), 0, num_indices, draw_mode);
 	else
 		al_draw_vertex_buffer(vbo_buffer(shape->vbo), bitmap, 0, num_vertices, draw_mode);
+	render_count_draws(1);
+	counter_bind(bitmap);
+	counter_add(COUNTER_VERTICES, shape->ibo != NULL ? num_indices : num_vertices);
+}
+
+static struct uniform*
+reset_uniform(shader_t* shader, int slot, enum uniform_type type, int num_values)
+{
+	struct uniform* uniform;
+
+	uniform = vector_get(shader->uniforms, slot);
+	if (uniform->type == type && uniform->num_values == num_values)
+		return uniform;
+	free_uniform(uniform);
+	if (type == UNIFORM_FLOAT_ARR)
+		uniform->float_list = malloc(num_values * sizeof(float));
+	else if (type == UNIFORM_INT_ARR)
+		uniform->int_list = malloc(num_values * sizeof(int));
+	uniform->type = type;
+	uniform->num_values = num_values;
+	return uniform;
+}
+
+static void
+update_uniform(shader_t* shader, int slot)
+{
+	struct uniform* uniform;
+
+	// if the shader is active, the new value can be sent to the GPU right away.
+	// otherwise mark it dirty so shader_use() picks it up next time.
+	uniform = vector_get(shader->uniforms, slot);
+	if (shader == s_last_shader && render_has_shader(shader->program)) {
+		upload_uniform(uniform);
+	}
+	else if (!uniform->dirty) {
+		uniform->dirty = true;
+		vector_push(shader->dirty_slots, &slot);
+	}
+}
+
+static void
+upload_uniform(struct uniform* uniform)
+{
+	switch (uniform->type) {
+	case UNIFORM_NONE:
+		break;
+	case UNIFORM_BOOL:
+		al_set_shader_bool(uniform->name, uniform->bool_value);
+		break;
+	case UNIFORM_FLOAT:
+		al_set_shader_float(uniform->name, uniform->float_value);
+		break;
+	case UNIFORM_FLOAT_ARR:
+		al_set_shader_float_vector(uniform->name, 1, uniform->float_list, uniform->num_values);
+		break;
+	case UNIFORM_FLOAT_VEC:
+		al_set_shader_float_vector(uniform->name, uniform->num_values, uniform->float_vec, 1);
+		break;
+	case UNIFORM_INT:
+		al_set_shader_int(uniform->name, uniform->int_value);
+		break;
+	case UNIFORM_INT_ARR:
+		al_set_shader_int_vector(uniform->name, 1, uniform->int_list, uniform->num_values);
+		break;
+	case UNIFORM_INT_VEC:
+		al_set_shader_int_vector(uniform->name, uniform->num_values, uniform->int_vec, 1);
+		break;
+	case UNIFORM_MATRIX:
+		al_set_shader_matrix(uniform->name, &uniform->mat_value);
+		break;
+	}
+	uniform->dirty = false;
 }
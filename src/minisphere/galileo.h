@@ -33,6 +33,9 @@
 #ifndef SPHERE__GALILEO_H__INCLUDED
 #define SPHERE__GALILEO_H__INCLUDED
 
+#define GALILEO_DEFER_LIMIT 1024
+#define GALILEO_STREAM_SIZE 65536
+
 typedef struct ibo    ibo_t;
 typedef struct model  model_t;
 typedef struct shader shader_t;
@@ -60,6 +63,15 @@ enum shape_type
 	SHAPE_MAX
 } shape_type_t;
 
+typedef
+struct instance
+{
+	float x, y;
+	float scale_x, scale_y;
+	float angle;
+	float r, g, b, a;
+} instance_t;
+
 typedef
 struct vertex
 {
@@ -71,14 +83,17 @@ struct vertex
 void                   galileo_init            (void);
 void                   galileo_uninit          (void);
 shader_t*              galileo_shader          (void);
+void                   galileo_draw_immediate  (image_t* surface, shape_type_t type, image_t* texture, const ALLEGRO_VERTEX* vertices, int num_vertices);
 void                   galileo_reset           (void);
-ibo_t*                 ibo_new                 (void);
+ibo_t*                 ibo_new                 (bool dynamic);
 ibo_t*                 ibo_ref                 (ibo_t* it);
 void                   ibo_unref               (ibo_t* it);
 ALLEGRO_INDEX_BUFFER*  ibo_buffer              (const ibo_t* it);
 int                    ibo_len                 (const ibo_t* it);
 void                   ibo_add_index           (ibo_t* it, uint16_t index);
+bool                   ibo_update              (ibo_t* it, int offset, const uint16_t* indices, int num_indices);
 bool                   ibo_upload              (ibo_t* it);
+bool                   ibo_upload_raw          (ibo_t* it, const uint16_t* indices, int num_indices);
 model_t*               model_new               (shader_t* shader);
 model_t*               model_ref               (model_t* it);
 void                   model_unref             (model_t* it);
@@ -88,19 +103,23 @@ void                   model_set_shader        (model_t* it, shader_t* shader);
 void                   model_set_transform     (model_t* it, transform_t* transform);
 bool                   model_add_shape         (model_t* it, shape_t* shape);
 void                   model_draw              (const model_t* it, image_t* surface);
+void                   model_draw_instanced    (const model_t* it, image_t* surface, const instance_t* instances, int num_instances);
 shader_t*              shader_new              (const char* vert_filename, const char* frag_filename);
 shader_t*              shader_dup              (const shader_t* it);
 shader_t*              shader_ref              (shader_t* shader);
 void                   shader_unref            (shader_t* shader);
+int                    shader_num_uniforms     (const shader_t* it);
 ALLEGRO_SHADER*        shader_program          (const shader_t* it);
-void                   shader_put_bool         (shader_t* it, const char* name, bool value);
-void                   shader_put_float        (shader_t* it, const char* name, float value);
-void                   shader_put_float_array  (shader_t* it, const char* name, float values[], int size);
-void                   shader_put_float_vector (shader_t* it, const char* name, float values[], int size);
-void                   shader_put_int          (shader_t* it, const char* name, int value);
-void                   shader_put_int_array    (shader_t* it, const char* name, int values[], int size);
-void                   shader_put_int_vector   (shader_t* it, const char* name, int values[], int size);
-void                   shader_put_matrix       (shader_t* it, const char* name, const transform_t* transform);
+unsigned int           shader_slot_owner       (const shader_t* it, int slot);
+int                    shader_uniform_slot     (shader_t* it, const char* name);
+void                   shader_put_bool         (shader_t* it, int slot, bool value);
+void                   shader_put_float        (shader_t* it, int slot, float value);
+void                   shader_put_float_array  (shader_t* it, int slot, float values[], int size);
+void                   shader_put_float_vector (shader_t* it, int slot, float values[], int size);
+void                   shader_put_int          (shader_t* it, int slot, int value);
+void                   shader_put_int_array    (shader_t* it, int slot, int values[], int size);
+void                   shader_put_int_vector   (shader_t* it, int slot, int values[], int size);
+void                   shader_put_matrix       (shader_t* it, int slot, const transform_t* transform);
 bool                   shader_use              (shader_t* shader, bool force_set);
 shape_t*               shape_new               (vbo_t* vertices, ibo_t* indices, shape_type_t type, image_t* texture);
 shape_t*               shape_ref               (shape_t* it);
@@ -112,12 +131,15 @@ void                   shape_set_ibo           (shape_t* it, ibo_t* ibo);
 void                   shape_set_texture       (shape_t* it, image_t* texture);
 void                   shape_set_vbo           (shape_t* it, vbo_t* vbo);
 void                   shape_draw              (shape_t* it, image_t* surface, transform_t* transform);
-vbo_t*                 vbo_new                 (void);
+void                   shape_draw_instanced    (shape_t* it, image_t* surface, transform_t* transform, const instance_t* instances, int num_instances);
+vbo_t*                 vbo_new                 (bool dynamic);
 vbo_t*                 vbo_ref                 (vbo_t* it);
 void                   vbo_unref               (vbo_t* it);
 ALLEGRO_VERTEX_BUFFER* vbo_buffer              (const vbo_t* it);
 int                    vbo_len                 (const vbo_t* it);
 void                   vbo_add_vertex          (vbo_t* it, vertex_t vertex);
+bool                   vbo_update              (vbo_t* it, int offset, const ALLEGRO_VERTEX* vertices, int num_vertices);
 bool                   vbo_upload              (vbo_t* it);
+bool                   vbo_upload_raw          (vbo_t* it, const ALLEGRO_VERTEX* vertices, int num_vertices);
 
 #endif // SPHERE__GALILEO_H__INCLUDED
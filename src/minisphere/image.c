@@ -34,35 +34,153 @@
 #include "image.h"
 
 #include "color.h"
+#include "counter.h"
 #include "galileo.h"
+#include "render.h"
 #include "transform.h"
+#include "vector.h"
 
 struct image
 {
 	unsigned int    refcount;
 	unsigned int    id;
 	ALLEGRO_BITMAP* bitmap;
+	int             bitmap_flags;
+	int             bitmap_format;
 	blend_mode_t    blend_mode;
 	unsigned int    cache_hits;
-	bool            clipping_set;
+	bool            demoted;
 	image_lock_t    lock;
 	unsigned int    lock_count;
-	transform_t*    modelview;
 	char*           path;
 	color_t*        pixel_cache;
+	render_queue_t* queue;
 	rect_t          scissor_box;
 	transform_t*    transform;
 	int             width;
 	int             height;
 	image_t*        parent;
+	image_t*        lru_next;
+	image_t*        lru_prev;
+	size_t          num_bytes;
+	int             num_readers;
 };
 
-static void apply_blend_mode (blend_mode_t mode);
-static void cache_pixels     (image_t* image);
-static void uncache_pixels   (image_t* image);
+struct pooled_bitmap
+{
+	ALLEGRO_BITMAP* bitmap;
+	int             flags;
+	int             format;
+	int             width;
+	int             height;
+};
 
-static image_t*     s_last_image = NULL;
+static ALLEGRO_BITMAP* acquire_bitmap (int width, int height);
+static void            cache_pixels   (image_t* image);
+static bool            demote_image   (image_t* image);
+static void            enforce_budget (void);
+static void            flush_readers  (image_t* image);
+static void            release_bitmap (ALLEGRO_BITMAP* bitmap, int flags, int format);
+static void            touch_image    (image_t* image);
+static void            track_image    (image_t* image);
+static void            uncache_pixels (image_t* image);
+static void            undefer_image  (image_t* image);
+static void            untrack_image  (image_t* image);
+
+static vector_t*    s_deferred_images = NULL;
+static image_t*     s_lru_head = NULL;
+static image_t*     s_lru_tail = NULL;
 static unsigned int s_next_image_id = 0;
+static int          s_num_images = 0;
+static unsigned int s_num_demotions = 0;
+static unsigned int s_num_uploads = 0;
+static size_t       s_system_bytes = 0;
+static size_t       s_texture_budget = 0;
+static size_t       s_video_bytes = 0;
+static vector_t*    s_pool = NULL;
+static size_t       s_pool_bytes = 0;
+static unsigned int s_pool_hits = 0;
+static size_t       s_pool_limit = IMAGE_POOL_LIMIT;
+static unsigned int s_pool_misses = 0;
+
+void
+images_init(void)
+{
+	console_log(1, "initializing image manager");
+	s_deferred_images = vector_new(sizeof(image_t*));
+	s_pool = vector_new(sizeof(struct pooled_bitmap));
+	s_pool_bytes = 0;
+	s_pool_hits = 0;
+	s_pool_misses = 0;
+}
+
+void
+images_uninit(void)
+{
+	console_log(1, "shutting down image manager");
+	console_log(2, "    pool hits: %u, misses: %u", s_pool_hits, s_pool_misses);
+	console_log(2, "    demotions: %u, uploads: %u", s_num_demotions, s_num_uploads);
+	console_log(2, "    in use: %d images, %d KB video, %d KB system", s_num_images,
+		(int)(s_video_bytes / 1024), (int)(s_system_bytes / 1024));
+	image_pool_set_limit(0);
+	vector_free(s_deferred_images);
+	vector_free(s_pool);
+	s_deferred_images = NULL;
+	s_pool = NULL;
+}
+
+image_pool_stats_t
+image_pool_stats(void)
+{
+	image_pool_stats_t stats;
+
+	stats.hits = s_pool_hits;
+	stats.misses = s_pool_misses;
+	stats.num_bitmaps = s_pool != NULL ? vector_len(s_pool) : 0;
+	stats.num_bytes = s_pool_bytes;
+	stats.max_bytes = s_pool_limit;
+	return stats;
+}
+
+image_memory_stats_t
+image_memory_stats(void)
+{
+	image_memory_stats_t stats;
+
+	stats.num_images = s_num_images;
+	stats.video_bytes = s_video_bytes;
+	stats.system_bytes = s_system_bytes;
+	stats.budget = s_texture_budget;
+	stats.num_demotions = s_num_demotions;
+	stats.num_uploads = s_num_uploads;
+	return stats;
+}
+
+void
+image_set_texture_budget(size_t max_bytes)
+{
+	console_log(2, "setting texture budget to %d KB", (int)(max_bytes / 1024));
+	s_texture_budget = max_bytes;
+	enforce_budget();
+}
+
+void
+image_pool_set_limit(size_t max_bytes)
+{
+	struct pooled_bitmap* entry;
+
+	s_pool_limit = max_bytes;
+	if (s_pool == NULL)
+		return;
+
+	// evict the oldest bitmaps until the pool is back under the limit
+	while (s_pool_bytes > s_pool_limit) {
+		entry = vector_get(s_pool, 0);
+		s_pool_bytes -= (size_t)entry->width * entry->height * 4;
+		al_destroy_bitmap(entry->bitmap);
+		vector_remove(s_pool, 0);
+	}
+}
 
 image_t*
 image_new(int width, int height, const color_t* pixels)
@@ -71,8 +189,10 @@ image_new(int width, int height, const color_t* pixels)
 
 	console_log(3, "creating image #%u at %dx%d", s_next_image_id, width, height);
 	image = calloc(1, sizeof(image_t));
-	if ((image->bitmap = al_create_bitmap(width, height)) == NULL)
+	if ((image->bitmap = acquire_bitmap(width, height)) == NULL)
 		goto on_error;
+	image->bitmap_flags = al_get_new_bitmap_flags();
+	image->bitmap_format = al_get_new_bitmap_format();
 	image->id = s_next_image_id++;
 	image->width = al_get_bitmap_width(image->bitmap);
 	image->height = al_get_bitmap_height(image->bitmap);
@@ -87,6 +207,7 @@ image_new(int width, int height, const color_t* pixels)
 	if (pixels != NULL && !image_upload(image, pixels))
 		goto on_error;
 
+	track_image(image);
 	return image;
 
 on_error:
@@ -120,14 +241,25 @@ on_error:
 image_t*
 image_dup(const image_t* it)
 {
-	image_t* image;
+	image_t*      image;
+	ALLEGRO_STATE old_state;
 
 	console_log(3, "cloning image #%u from source image #%u",
 		s_next_image_id, it->id);
 
+	if (it->queue != NULL)
+		render_queue_flush(it->queue, it->bitmap);
 	image = calloc(1, sizeof(image_t));
-	if (!(image->bitmap = al_clone_bitmap(it->bitmap)))
+	if (!(image->bitmap = acquire_bitmap(it->width, it->height)))
 		goto on_error;
+	image->bitmap_flags = al_get_new_bitmap_flags();
+	image->bitmap_format = al_get_new_bitmap_format();
+	al_store_state(&old_state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+	al_set_target_bitmap(image->bitmap);
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+	al_draw_bitmap(it->bitmap, 0, 0, 0x0);
+	render_count_draws(1);
+	al_restore_state(&old_state);
 	image->id = s_next_image_id++;
 	image->width = al_get_bitmap_width(image->bitmap);
 	image->height = al_get_bitmap_height(image->bitmap);
@@ -135,6 +267,7 @@ image_dup(const image_t* it)
 	image->transform = transform_new();
 	transform_orthographic(image->transform, 0.0f, 0.0f, image->width, image->height, -1.0f, 1.0f);
 
+	track_image(image);
 	return image_ref(image);
 
 on_error:
@@ -174,6 +307,8 @@ image_load(const char* filename)
 
 	if (!(image->bitmap = al_load_bitmap_flags_f(al_file, file_ext, ALLEGRO_NO_PREMULTIPLIED_ALPHA)))
 		goto on_error;
+	image->bitmap_flags = al_get_new_bitmap_flags();
+	image->bitmap_format = al_get_new_bitmap_format();
 	al_fclose(al_file);
 	free(slurp);
 	image->width = al_get_bitmap_width(image->bitmap);
@@ -184,6 +319,7 @@ image_load(const char* filename)
 
 	image->path = strdup(filename);
 	image->id = s_next_image_id++;
+	track_image(image);
 	return image_ref(image);
 
 on_error:
@@ -213,7 +349,17 @@ image_unref(image_t* it)
 	console_log(3, "disposing image #%u no longer in use",
 		it->id);
 	uncache_pixels(it);
-	al_destroy_bitmap(it->bitmap);
+	if (it->queue != NULL)
+		undefer_image(it);
+	render_queue_free(it->queue);
+	if (it->parent == NULL) {
+		untrack_image(it);
+		release_bitmap(it->bitmap, it->bitmap_flags, it->bitmap_format);
+	}
+	else {
+		render_forget(it->bitmap);
+		al_destroy_bitmap(it->bitmap);
+	}
 	image_unref(it->parent);
 	free(it->path);
 	transform_unref(it->transform);
@@ -223,6 +369,8 @@ image_unref(image_t* it)
 ALLEGRO_BITMAP*
 image_bitmap(image_t* it)
 {
+	touch_image(it);
+	image_flush(it);
 	uncache_pixels(it);
 	return it->bitmap;
 }
@@ -251,6 +399,12 @@ image_get_blend_mode(const image_t* it)
 	return it->blend_mode;
 }
 
+bool
+image_get_deferred(const image_t* it)
+{
+	return it->queue != NULL;
+}
+
 rect_t
 image_get_scissor(const image_t* it)
 {
@@ -267,18 +421,33 @@ void
 image_set_blend_mode(image_t* it, blend_mode_t mode)
 {
 	it->blend_mode = mode;
-	if (it == s_last_image)
-		apply_blend_mode(mode);
+	if (it->bitmap == render_target())
+		render_set_blend(mode);
+}
+
+void
+image_set_deferred(image_t* it, bool deferred)
+{
+	if (deferred && it->queue == NULL) {
+		console_log(3, "enabling deferred rendering for image #%u", it->id);
+		it->queue = render_queue_new();
+		vector_push(s_deferred_images, &it);
+	}
+	else if (!deferred && it->queue != NULL) {
+		console_log(3, "disabling deferred rendering for image #%u", it->id);
+		image_flush(it);
+		undefer_image(it);
+		render_queue_free(it->queue);
+		it->queue = NULL;
+	}
 }
 
 void
 image_set_scissor(image_t* it, rect_t value)
 {
 	it->scissor_box = value;
-	if (it == s_last_image)
-		al_set_clipping_rectangle(value.x1, value.y1, value.x2 - value.x1, value.y2 - value.y1);
-	else
-		it->clipping_set = false;
+	if (it->bitmap == render_target())
+		render_set_clip(value);
 }
 
 void
@@ -291,6 +460,13 @@ image_set_transform(image_t* it, transform_t* transform)
 	transform_unref(old_value);
 }
 
+void
+image_add_reader(image_t* it)
+{
+	if (it != NULL)
+		++it->num_readers;
+}
+
 bool
 image_apply_color_fx(image_t* it, color_fx_t matrix, int x, int y, int width, int height)
 {
@@ -354,12 +530,14 @@ image_apply_color_fx_4(image_t* it, color_fx_t ul_mat, color_fx_t ur_mat, color_
 bool
 image_apply_lookup(image_t* it, int x, int y, int width, int height, uint8_t red_lu[256], uint8_t green_lu[256], uint8_t blue_lu[256], uint8_t alpha_lu[256])
 {
-	ALLEGRO_BITMAP*        bitmap = image_bitmap(it);
+	ALLEGRO_BITMAP*        bitmap;
 	uint8_t*               pixel;
 	ALLEGRO_LOCKED_REGION* lock;
 
 	int i_x, i_y;
 
+	flush_readers(it);
+	bitmap = image_bitmap(it);
 	if ((lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READWRITE)) == NULL)
 		return false;
 	uncache_pixels(it);
@@ -382,15 +560,37 @@ image_blit(image_t* it, image_t* target_image, int x, int y)
 	int             blend_op;
 	ALLEGRO_BITMAP* old_target;
 
+	flush_readers(target_image);
 	old_target = al_get_target_bitmap();
 	al_set_target_bitmap(image_bitmap(target_image));
 	al_get_blender(&blend_op, &blend_mode_src, &blend_mode_dest);
 	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
 	al_draw_bitmap(image_bitmap(it), x, y, 0x0);
+	render_count_draws(1);
 	al_set_blender(blend_op, blend_mode_src, blend_mode_dest);
 	al_set_target_bitmap(old_target);
 }
 
+bool
+image_defer_draw(image_t* it, shader_t* shader, transform_t* transform, int type, image_t* texture, const ALLEGRO_VERTEX* vertices, int num_vertices)
+{
+	ALLEGRO_TRANSFORM matrix;
+
+	// if the image isn't in deferred mode, this returns false and the caller
+	// should go ahead and draw normally.
+	if (it->queue == NULL)
+		return false;
+	flush_readers(it);
+	if (transform != NULL)
+		matrix = *transform_matrix(transform);
+	else
+		al_identity_transform(&matrix);
+	render_queue_add(it->queue, (shape_type_t)type, texture, shader,
+		it->blend_mode, it->scissor_box, transform_matrix(it->transform), &matrix,
+		vertices, num_vertices);
+	return true;
+}
+
 bool
 image_download(image_t* it, color_t* buffer)
 {
@@ -426,29 +626,49 @@ on_error:
 void
 image_draw(image_t* it, int x, int y)
 {
+	touch_image(it);
+	image_flush(it);
 	al_draw_bitmap(it->bitmap, x, y, 0x0);
+	render_count_draws(1);
+	counter_bind(it->bitmap);
+	counter_add(COUNTER_VERTICES, 4);
 }
 
 void
 image_draw_masked(image_t* it, color_t mask, int x, int y)
 {
+	touch_image(it);
+	image_flush(it);
 	al_draw_tinted_bitmap(it->bitmap, nativecolor(mask), x, y, 0x0);
+	render_count_draws(1);
+	counter_bind(it->bitmap);
+	counter_add(COUNTER_VERTICES, 4);
 }
 
 void
 image_draw_scaled(image_t* it, int x, int y, int width, int height)
 {
+	touch_image(it);
+	image_flush(it);
 	al_draw_scaled_bitmap(it->bitmap,
 		0, 0, al_get_bitmap_width(it->bitmap), al_get_bitmap_height(it->bitmap),
 		x, y, width, height, 0x0);
+	render_count_draws(1);
+	counter_bind(it->bitmap);
+	counter_add(COUNTER_VERTICES, 4);
 }
 
 void
 image_draw_scaled_masked(image_t* it, color_t mask, int x, int y, int width, int height)
 {
+	touch_image(it);
+	image_flush(it);
 	al_draw_tinted_scaled_bitmap(it->bitmap, nativecolor(mask),
 		0, 0, al_get_bitmap_width(it->bitmap), al_get_bitmap_height(it->bitmap),
 		x, y, width, height, 0x0);
+	render_count_draws(1);
+	counter_bind(it->bitmap);
+	counter_add(COUNTER_VERTICES, 4);
 }
 
 void
@@ -467,6 +687,8 @@ image_draw_tiled_masked(image_t* it, color_t mask, int x, int y, int width, int
 
 	int i_x, i_y;
 
+	touch_image(it);
+	image_flush(it);
 	img_w = it->width; img_h = it->height;
 	if (img_w >= 16 && img_h >= 16) {
 		// tile in hardware whenever possible
@@ -477,6 +699,9 @@ image_draw_tiled_masked(image_t* it, color_t mask, int x, int y, int width, int
 			{ x + width, y + height, 0, width, height, native_mask }
 		};
 		al_draw_prim(vbuf, NULL, it->bitmap, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+		render_count_draws(1);
+		counter_bind(it->bitmap);
+		counter_add(COUNTER_VERTICES, 4);
 	}
 	else {
 		// texture smaller than 16x16, tile it in software (Allegro pads it)
@@ -488,6 +713,9 @@ image_draw_tiled_masked(image_t* it, color_t mask, int x, int y, int width, int
 			al_draw_tinted_bitmap_region(it->bitmap, native_mask,
 				0, 0, tile_w, tile_h,
 				x + i_x * img_w, y + i_y * img_h, 0x0);
+			render_count_draws(1);
+			counter_bind(it->bitmap);
+			counter_add(COUNTER_VERTICES, 4);
 		}
 		al_hold_bitmap_drawing(is_drawing_held);
 	}
@@ -502,6 +730,11 @@ image_fill(image_t* it, color_t color)
 	int             clip_y;
 	ALLEGRO_BITMAP* old_target;
 
+	// filling the image overwrites everything, so there's no point in drawing
+	// anything still waiting in the queue.
+	flush_readers(it);
+	if (it->queue != NULL)
+		render_queue_clear(it->queue);
 	uncache_pixels(it);
 	al_get_clipping_rectangle(&clip_x, &clip_y, &clip_width, &clip_height);
 	al_reset_clipping_rectangle();
@@ -521,8 +754,11 @@ image_flip(image_t* it, bool is_h_flip, bool is_v_flip)
 
 	if (!is_h_flip && !is_v_flip)  // this really shouldn't happen...
 		return true;
+	flush_readers(it);
+	image_flush(it);
+	touch_image(it);
 	uncache_pixels(it);
-	if (!(new_bitmap = al_create_bitmap(it->width, it->height)))
+	if (!(new_bitmap = acquire_bitmap(it->width, it->height)))
 		return false;
 	old_target = al_get_target_bitmap();
 	al_set_target_bitmap(new_bitmap);
@@ -531,9 +767,14 @@ image_flip(image_t* it, bool is_h_flip, bool is_v_flip)
 	if (is_v_flip)
 		draw_flags |= ALLEGRO_FLIP_VERTICAL;
 	al_draw_bitmap(it->bitmap, 0, 0, draw_flags);
+	render_count_draws(1);
 	al_set_target_bitmap(old_target);
-	al_destroy_bitmap(it->bitmap);
+	untrack_image(it);
+	release_bitmap(it->bitmap, it->bitmap_flags, it->bitmap_format);
 	it->bitmap = new_bitmap;
+	it->bitmap_flags = al_get_new_bitmap_flags();
+	it->bitmap_format = al_get_new_bitmap_format();
+	track_image(it);
 	return true;
 }
 
@@ -555,6 +796,9 @@ image_lock(image_t* it, bool uploading, bool downloading)
 	ALLEGRO_LOCKED_REGION* ll_lock;
 	int                    lock_flag;
 
+	if (uploading)
+		flush_readers(it);
+	image_flush(it);
 	if (it->lock_count == 0) {
 		lock_flag = downloading && uploading ? ALLEGRO_LOCK_READWRITE
 			: downloading ? ALLEGRO_LOCK_READONLY
@@ -571,39 +815,37 @@ image_lock(image_t* it, bool uploading, bool downloading)
 	return &it->lock;
 }
 
+void
+image_flush(image_t* it)
+{
+	if (it->queue != NULL)
+		render_queue_flush(it->queue, it->bitmap);
+}
+
 void
 image_render_to(image_t* it, transform_t* transform)
 {
-	ALLEGRO_TRANSFORM matrix;
-	rect_t            scissor;
+	// note: callers of this draw with plain Allegro calls, which expect the
+	//       legacy shaders.  Galileo binds its own shader and should use
+	//       image_render_with() instead to avoid switching shaders twice.
+	image_render_with(it, NULL, transform);
+}
 
-	if (it != s_last_image) {
-		al_set_target_bitmap(it->bitmap);
-		shader_use(NULL, true);
-	}
-	scissor = it->scissor_box;
-	if (!it->clipping_set) {
-		al_set_clipping_rectangle(scissor.x1, scissor.y1, scissor.x2 - scissor.x1, scissor.y2 - scissor.y1);
-		it->clipping_set = true;
-	}
-	if (transform_dirty(it->transform)) {
-		al_use_projection_transform(transform_matrix(it->transform));
-		transform_make_clean(it->transform);
-	}
-	if (transform != it->modelview || transform_dirty(transform)) {
-		if (transform != NULL) {
-			al_use_transform(transform_matrix(transform));
-		}
-		else {
-			al_identity_transform(&matrix);
-			al_use_transform(&matrix);
-		}
-		transform_unref(it->modelview);
-		it->modelview = transform_ref(transform);
-		transform_make_clean(transform);
-	}
-	apply_blend_mode(it->blend_mode);
-	s_last_image = it;
+void
+image_render_with(image_t* it, shader_t* shader, transform_t* transform)
+{
+	// note: the render state tracker filters out redundant changes, so it's safe
+	//       (and cheap) to apply the full state here on every call.  anything
+	//       still queued for the image is drawn first to keep things in order.
+	flush_readers(it);
+	touch_image(it);
+	image_flush(it);
+	render_set_target(it->bitmap);
+	render_set_clip(it->scissor_box);
+	render_set_projection(transform_matrix(it->transform));
+	render_set_transform(transform != NULL ? transform_matrix(transform) : NULL);
+	render_set_blend(it->blend_mode);
+	shader_use(shader, false);
 }
 
 bool
@@ -616,6 +858,7 @@ image_replace_color(image_t* it, color_t color, color_t new_color)
 
 	int i_x, i_y;
 
+	flush_readers(it);
 	bitmap = image_bitmap(it);
 	if ((lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READWRITE)) == NULL)
 		return false;
@@ -639,6 +882,13 @@ image_replace_color(image_t* it, color_t color, color_t new_color)
 	return true;
 }
 
+void
+image_remove_reader(image_t* it)
+{
+	if (it != NULL)
+		--it->num_readers;
+}
+
 bool
 image_rescale(image_t* it, int width, int height)
 {
@@ -647,19 +897,27 @@ image_rescale(image_t* it, int width, int height)
 
 	if (width == it->width && height == it->height)
 		return true;
-	if (!(new_bitmap = al_create_bitmap(width, height)))
+	if (!(new_bitmap = acquire_bitmap(width, height)))
 		return false;
+	flush_readers(it);
+	touch_image(it);
+	image_flush(it);
 	uncache_pixels(it);
 	old_target = al_get_target_bitmap();
 	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
 	al_set_target_bitmap(new_bitmap);
 	al_draw_scaled_bitmap(it->bitmap, 0, 0, it->width, it->height, 0, 0, width, height, 0x0);
+	render_count_draws(1);
 	al_set_target_bitmap(old_target);
-	al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
-	al_destroy_bitmap(it->bitmap);
+	render_invalidate();
+	untrack_image(it);
+	release_bitmap(it->bitmap, it->bitmap_flags, it->bitmap_format);
 	it->bitmap = new_bitmap;
+	it->bitmap_flags = al_get_new_bitmap_flags();
+	it->bitmap_format = al_get_new_bitmap_format();
 	it->width = al_get_bitmap_width(it->bitmap);
 	it->height = al_get_bitmap_height(it->bitmap);
+	track_image(it);
 	return true;
 }
 
@@ -673,6 +931,7 @@ image_save(image_t* it, const char* filename)
 	size_t        next_buf_size;
 	bool          result;
 
+	image_flush(it);
 	next_buf_size = 65536;
 	do {
 		buffer = realloc(buffer, next_buf_size);
@@ -693,10 +952,13 @@ image_set_pixel(image_t* it, int x, int y, color_t color)
 {
 	ALLEGRO_BITMAP* old_target;
 
+	flush_readers(it);
+	image_flush(it);
 	uncache_pixels(it);
 	old_target = al_get_target_bitmap();
 	al_set_target_bitmap(it->bitmap);
 	al_draw_pixel(x + 0.5, y + 0.5, nativecolor(color));
+	render_count_draws(1);
 	al_set_target_bitmap(old_target);
 }
 
@@ -739,47 +1001,52 @@ image_upload(image_t* it, const color_t* pixels)
 	return true;
 }
 
-static void
-apply_blend_mode(blend_mode_t mode)
-{
-	switch (mode) {
-		case BLEND_NORMAL:
-			al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
-			break;
-		case BLEND_ADD:
-			al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ONE);
-			break;
-		case BLEND_AVERAGE:
-			al_set_blender(ALLEGRO_ADD, ALLEGRO_CONST_COLOR, ALLEGRO_CONST_COLOR);
-			al_set_blend_color(al_map_rgba_f(0.5, 0.5, 0.5, 0.5));
-			break;
-		case BLEND_COPY_ALPHA:
-			al_set_separate_blender(
-				ALLEGRO_ADD, ALLEGRO_ZERO, ALLEGRO_ONE,
-				ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
-			break;
-		case BLEND_COPY_RGB:
-			al_set_separate_blender(
-				ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO,
-				ALLEGRO_ADD, ALLEGRO_ZERO, ALLEGRO_ONE);
-			break;
-		case BLEND_INVERT:
-			al_set_blender(ALLEGRO_ADD, ALLEGRO_ZERO, ALLEGRO_INVERSE_SRC_COLOR);
-			break;
-		case BLEND_MULTIPLY:
-			al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ONE);
-			break;
-		case BLEND_REPLACE:
-			al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
-			break;
-		case BLEND_SUBTRACT:
-			al_set_blender(ALLEGRO_DEST_MINUS_SRC, ALLEGRO_ONE, ALLEGRO_ONE);
-			break;
-		default:
-			// this shouldn't happen, but in case it does, just output nothing to make it
-			// obvious something went wrong.
-			al_set_blender(ALLEGRO_ADD, ALLEGRO_ZERO, ALLEGRO_ZERO);
+static ALLEGRO_BITMAP*
+acquire_bitmap(int width, int height)
+{
+	ALLEGRO_BITMAP*       bitmap;
+	struct pooled_bitmap* entry;
+	int                   flags;
+	int                   format;
+	ALLEGRO_STATE         old_state;
+	ALLEGRO_TRANSFORM     transform;
+
+	int i;
+
+	// search from the end so the most recently released bitmaps, which are
+	// least likely to still be in use by the GPU, are reused first.  a pooled
+	// bitmap is only a match if it was created under the same new-bitmap format
+	// and flags as are in effect now.
+	flags = al_get_new_bitmap_flags();
+	format = al_get_new_bitmap_format();
+	for (i = (s_pool != NULL ? vector_len(s_pool) : 0) - 1; i >= 0; --i) {
+		entry = vector_get(s_pool, i);
+		if (entry->width != width || entry->height != height
+			|| entry->flags != flags || entry->format != format)
+		{
+			continue;
+		}
+		bitmap = entry->bitmap;
+		s_pool_bytes -= (size_t)width * height * 4;
+		vector_remove(s_pool, i);
+		++s_pool_hits;
+
+		// a recycled bitmap still has the previous owner's contents and render
+		// state, so put it back the way al_create_bitmap() would have made it.
+		al_store_state(&old_state, ALLEGRO_STATE_TARGET_BITMAP);
+		al_set_target_bitmap(bitmap);
+		al_identity_transform(&transform);
+		al_use_transform(&transform);
+		al_orthographic_transform(&transform, 0.0f, 0.0f, -1.0f, width, height, 1.0f);
+		al_use_projection_transform(&transform);
+		al_reset_clipping_rectangle();
+		al_use_shader(NULL);
+		al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+		al_restore_state(&old_state);
+		return bitmap;
 	}
+	++s_pool_misses;
+	return al_create_bitmap(width, height);
 }
 
 static void
@@ -812,6 +1079,170 @@ on_error:
 		al_unlock_bitmap(image->bitmap);
 }
 
+static bool
+demote_image(image_t* image)
+{
+	ALLEGRO_STATE   old_state;
+	ALLEGRO_BITMAP* target;
+
+	// an image can't be demoted while it's locked or being rendered to.  this
+	// includes rendering to a slice of it, since slices share its pixels.
+	target = al_get_target_bitmap();
+	if (image->lock_count > 0 || image->bitmap == render_target() || image->bitmap == target
+		|| (target != NULL && al_get_parent_bitmap(target) == image->bitmap))
+	{
+		return false;
+	}
+
+	// note: al_convert_bitmap() changes the bitmap in place, so slices and
+	//       anything else holding the ALLEGRO_BITMAP pointer keep working.
+	console_log(3, "demoting image #%u to system memory (%d KB)", image->id,
+		(int)(image->num_bytes / 1024));
+	image_flush(image);
+	al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP | (al_get_bitmap_flags(image->bitmap) & ~ALLEGRO_VIDEO_BITMAP));
+	al_convert_bitmap(image->bitmap);
+	al_restore_state(&old_state);
+	if (!(al_get_bitmap_flags(image->bitmap) & ALLEGRO_MEMORY_BITMAP))
+		return false;
+	render_forget(image->bitmap);
+	s_video_bytes -= image->num_bytes;
+	s_system_bytes += image->num_bytes;
+	image->demoted = true;
+	++s_num_demotions;
+	return true;
+}
+
+static void
+enforce_budget(void)
+{
+	image_t* image;
+	image_t* prev;
+
+	// demote the least recently used images until we're back within budget.
+	// the most recently used image is never demoted, as it's about to be drawn.
+	if (s_texture_budget == 0)
+		return;
+	image = s_lru_tail;
+	while (s_video_bytes > s_texture_budget && image != NULL && image != s_lru_head) {
+		prev = image->lru_prev;
+		if (!image->demoted && !(al_get_bitmap_flags(image->bitmap) & ALLEGRO_MEMORY_BITMAP))
+			demote_image(image);
+		image = prev;
+	}
+}
+
+static void
+flush_readers(image_t* image)
+{
+	image_t* deferred;
+
+	iter_t iter;
+
+	// a draw waiting in a render queue samples its texture only when the queue
+	// is flushed.  if the texture is about to be changed, every queue has to be
+	// drawn first so those draws see the old contents rather than the new.
+	if (image->num_readers <= 0)
+		return;
+	console_log(4, "flushing render queues reading from image #%u", image->id);
+	iter = vector_enum(s_deferred_images);
+	while (iter_next(&iter)) {
+		deferred = *(image_t**)iter.ptr;
+		image_flush(deferred);
+	}
+}
+
+static void
+release_bitmap(ALLEGRO_BITMAP* bitmap, int flags, int format)
+{
+	struct pooled_bitmap entry;
+	size_t               size;
+
+	// note: only plain video bitmaps are pooled.  memory bitmaps are cheap to
+	//       create anyway and sub-bitmaps share their parent's pixels.
+	render_forget(bitmap);
+	entry.bitmap = bitmap;
+	entry.flags = flags;
+	entry.format = format;
+	entry.width = al_get_bitmap_width(bitmap);
+	entry.height = al_get_bitmap_height(bitmap);
+	size = (size_t)entry.width * entry.height * 4;
+	if (s_pool == NULL || size > s_pool_limit
+		|| al_is_sub_bitmap(bitmap)
+		|| (al_get_bitmap_flags(bitmap) & ALLEGRO_MEMORY_BITMAP))
+	{
+		al_destroy_bitmap(bitmap);
+		return;
+	}
+	vector_push(s_pool, &entry);
+	s_pool_bytes += size;
+	image_pool_set_limit(s_pool_limit);
+}
+
+static void
+touch_image(image_t* image)
+{
+	ALLEGRO_STATE old_state;
+
+	// slices share their parent's bitmap, so it's the parent that gets tracked
+	while (image->parent != NULL)
+		image = image->parent;
+	if (image->lru_prev == NULL && image != s_lru_head)
+		return;  // not tracked
+
+	// move the image to the front of the LRU list
+	if (image != s_lru_head) {
+		image->lru_prev->lru_next = image->lru_next;
+		if (image->lru_next != NULL)
+			image->lru_next->lru_prev = image->lru_prev;
+		else
+			s_lru_tail = image->lru_prev;
+		image->lru_prev = NULL;
+		image->lru_next = s_lru_head;
+		s_lru_head->lru_prev = image;
+		s_lru_head = image;
+	}
+
+	// if the image was demoted to system memory, upload it back to the GPU
+	if (image->demoted) {
+		console_log(3, "uploading image #%u back to video memory", image->id);
+		al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+		al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP | (al_get_bitmap_flags(image->bitmap) & ~ALLEGRO_MEMORY_BITMAP));
+		al_convert_bitmap(image->bitmap);
+		al_restore_state(&old_state);
+		if (!(al_get_bitmap_flags(image->bitmap) & ALLEGRO_MEMORY_BITMAP)) {
+			render_forget(image->bitmap);
+			s_system_bytes -= image->num_bytes;
+			s_video_bytes += image->num_bytes;
+			image->demoted = false;
+			++s_num_uploads;
+		}
+	}
+	if (s_video_bytes > s_texture_budget)
+		enforce_budget();
+}
+
+static void
+track_image(image_t* image)
+{
+	image->num_bytes = (size_t)image->width * image->height * 4;
+	image->demoted = false;
+	if (al_get_bitmap_flags(image->bitmap) & ALLEGRO_MEMORY_BITMAP)
+		s_system_bytes += image->num_bytes;
+	else
+		s_video_bytes += image->num_bytes;
+	++s_num_images;
+
+	image->lru_prev = NULL;
+	image->lru_next = s_lru_head;
+	if (s_lru_head != NULL)
+		s_lru_head->lru_prev = image;
+	else
+		s_lru_tail = image;
+	s_lru_head = image;
+	enforce_budget();
+}
+
 static void
 uncache_pixels(image_t* image)
 {
@@ -821,3 +1252,37 @@ uncache_pixels(image_t* image)
 	free(image->pixel_cache);
 	image->pixel_cache = NULL;
 }
+
+static void
+undefer_image(image_t* image)
+{
+	iter_t iter;
+
+	iter = vector_enum(s_deferred_images);
+	while (iter_next(&iter)) {
+		if (*(image_t**)iter.ptr == image)
+			iter_remove(&iter);
+	}
+}
+
+static void
+untrack_image(image_t* image)
+{
+	if (image->lru_prev == NULL && image != s_lru_head)
+		return;  // not tracked
+	if (image->demoted || (al_get_bitmap_flags(image->bitmap) & ALLEGRO_MEMORY_BITMAP))
+		s_system_bytes -= image->num_bytes;
+	else
+		s_video_bytes -= image->num_bytes;
+	--s_num_images;
+
+	if (image->lru_prev != NULL)
+		image->lru_prev->lru_next = image->lru_next;
+	else
+		s_lru_head = image->lru_next;
+	if (image->lru_next != NULL)
+		image->lru_next->lru_prev = image->lru_prev;
+	else
+		s_lru_tail = image->lru_prev;
+	image->lru_prev = image->lru_next = NULL;
+}
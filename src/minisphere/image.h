@@ -36,7 +36,10 @@
 #include "geometry.h"
 #include "transform.h"
 
+#define IMAGE_POOL_LIMIT (64 * 1048576)
+
 typedef struct image image_t;
+struct shader;
 
 typedef
 struct image_lock
@@ -63,6 +66,34 @@ enum blend_mode
 	BLEND_MAX,
 } blend_mode_t;
 
+typedef
+struct image_memory_stats
+{
+	int          num_images;
+	size_t       video_bytes;
+	size_t       system_bytes;
+	size_t       budget;
+	unsigned int num_demotions;
+	unsigned int num_uploads;
+} image_memory_stats_t;
+
+typedef
+struct image_pool_stats
+{
+	unsigned int hits;
+	unsigned int misses;
+	int          num_bitmaps;
+	size_t       num_bytes;
+	size_t       max_bytes;
+} image_pool_stats_t;
+
+void                 images_init              (void);
+void                 images_uninit            (void);
+image_memory_stats_t image_memory_stats       (void);
+image_pool_stats_t   image_pool_stats         (void);
+void                 image_pool_set_limit     (size_t max_bytes);
+void                 image_set_texture_budget (size_t max_bytes);
+
 image_t*        image_new                (int width, int height, const color_t* pixels);
 image_t*        image_new_slice          (image_t* parent, int x, int y, int width, int height);
 image_t*        image_dup                (const image_t* it);
@@ -74,15 +105,19 @@ int             image_height             (const image_t* it);
 const char*     image_path               (const image_t* it);
 int             image_width              (const image_t* it);
 blend_mode_t    image_get_blend_mode     (const image_t* it);
+bool            image_get_deferred       (const image_t* it);
 rect_t          image_get_scissor        (const image_t* it);
 transform_t*    image_get_transform      (const image_t* it);
 void            image_set_blend_mode     (image_t* it, blend_mode_t mode);
+void            image_set_deferred       (image_t* it, bool deferred);
 void            image_set_scissor        (image_t* it, rect_t value);
 void            image_set_transform      (image_t* it, transform_t* transform);
+void            image_add_reader         (image_t* it);
 bool            image_apply_color_fx     (image_t* it, color_fx_t matrix, int x, int y, int width, int height);
 bool            image_apply_color_fx_4   (image_t* it, color_fx_t ul_mat, color_fx_t ur_mat, color_fx_t ll_mat, color_fx_t lr_mat, int x, int y, int width, int height);
 bool            image_apply_lookup       (image_t* it, int x, int y, int width, int height, uint8_t red_lu[256], uint8_t green_lu[256], uint8_t blue_lu[256], uint8_t alpha_lu[256]);
 void            image_blit               (image_t* it, image_t* target_image, int x, int y);
+bool            image_defer_draw         (image_t* it, struct shader* shader, transform_t* transform, int type, image_t* texture, const ALLEGRO_VERTEX* vertices, int num_vertices);
 bool            image_download           (image_t* it, color_t* buffer);
 void            image_draw               (image_t* it, int x, int y);
 void            image_draw_masked        (image_t* it, color_t mask, int x, int y);
@@ -92,10 +127,13 @@ void            image_draw_tiled         (image_t* it, int x, int y, int width,
 void            image_draw_tiled_masked  (image_t* it, color_t mask, int x, int y, int width, int height);
 void            image_fill               (image_t* it, color_t color);
 bool            image_flip               (image_t* it, bool is_h_flip, bool is_v_flip);
+void            image_flush              (image_t* it);
 color_t         image_get_pixel          (image_t* it, int x, int y);
 image_lock_t*   image_lock               (image_t* it, bool uploading, bool downloading);
 void            image_render_to          (image_t* it, transform_t* transform);
+void            image_render_with        (image_t* it, struct shader* shader, transform_t* transform);
 bool            image_replace_color      (image_t* it, color_t color, color_t new_color);
+void            image_remove_reader      (image_t* it);
 bool            image_rescale            (image_t* it, int width, int height);
 bool            image_save               (image_t* it, const char* filename);
 void            image_set_pixel          (image_t* it, int x, int y, color_t color);
@@ -33,6 +33,8 @@
 #include "minisphere.h"
 #include "input.h"
 
+#include <inttypes.h>
+
 #include "debugger.h"
 #include "jsal.h"
 #include "kev_file.h"
@@ -45,8 +47,32 @@ struct key_queue
 	int keys[255];
 };
 
+enum script_op
+{
+	SCRIPT_KEY,
+	SCRIPT_KEY_CHAR,
+	SCRIPT_MOUSE_MOVE,
+	SCRIPT_MOUSE_BUTTON,
+	SCRIPT_MOUSE_WHEEL,
+	SCRIPT_SEED,
+};
+
+struct script_event
+{
+	uint32_t       frame;
+	enum script_op op;
+	int            code;
+	bool           down;
+	uint64_t       seed;
+	int            x;
+	int            y;
+};
+
+static void play_input_script (void);
 static void queue_key         (int keycode);
 static void queue_mouse_event (mouse_key_t key, int x, int y);
+static void record_event      (const char* fmt, ...);
+static void record_mouse      (void);
 
 static vector_t*            s_bound_buttons;
 static vector_t*            s_bound_keys;
@@ -64,6 +90,19 @@ static mouse_event_t        s_mouse_queue[255];
 static int                  s_num_joysticks = 0;
 static int                  s_num_mouse_events = 0;
 static bool                 s_has_keymap_changed = false;
+static bool                 s_record_buttons[MOUSE_KEY_MAX];
+static FILE*                s_record_file = NULL;
+static double               s_record_start_time;
+static int                  s_record_x;
+static int                  s_record_y;
+static vector_t*            s_script_events = NULL;
+static bool                 s_script_buttons[MOUSE_KEY_MAX];
+static bool                 s_script_has_chars = false;
+static bool                 s_script_has_mouse = false;
+static int                  s_script_index;
+static int                  s_script_seed_index;
+static int                  s_script_x;
+static int                  s_script_y;
 
 struct bound_button
 {
@@ -89,7 +128,8 @@ initialize_input(void)
 
 	console_log(1, "initializing input subsystem");
 
-	al_install_keyboard();
+	if (!al_install_keyboard())
+		console_log(1, "  keyboard initialization failed");
 	if (!(s_have_mouse = al_install_mouse()))
 		console_log(1, "  mouse initialization failed");
 	if (!(s_have_joystick = al_install_joystick()))
@@ -98,7 +138,8 @@ initialize_input(void)
 	memset(s_key_state, 0, sizeof s_key_state);
 
 	s_event_queue = al_create_event_queue();
-	al_register_event_source(s_event_queue, al_get_keyboard_event_source());
+	if (al_is_keyboard_installed())
+		al_register_event_source(s_event_queue, al_get_keyboard_event_source());
 	if (s_have_mouse)
 		al_register_event_source(s_event_queue, al_get_mouse_event_source());
 	if (s_have_joystick)
@@ -182,6 +223,13 @@ shutdown_input(void)
 	}
 	vector_free(s_bound_buttons);
 	vector_free(s_bound_keys);
+	vector_free(s_script_events);
+	s_script_events = NULL;
+	if (s_record_file != NULL) {
+		console_log(1, "    %u frames of input recorded", g_tick_count);
+		fclose(s_record_file);
+		s_record_file = NULL;
+	}
 
 	// shut down Allegro input
 	al_destroy_event_queue(s_event_queue);
@@ -466,12 +514,26 @@ mouse_get_event(void)
 	return event;
 }
 
+bool
+mouse_scripted_xy(int* out_x, int* out_y)
+{
+	if (!s_script_has_mouse)
+		return false;
+	*out_x = s_script_x;
+	*out_y = s_script_y;
+	return true;
+}
+
 bool
 mouse_is_key_down(mouse_key_t key)
 {
 	ALLEGRO_DISPLAY*    display;
 	ALLEGRO_MOUSE_STATE state;
 
+	if (s_script_events != NULL)
+		return s_script_buttons[key];
+	if (!s_have_mouse)
+		return false;
 	display = screen_display(g_screen);
 	al_get_mouse_state(&state);
 	if (state.display != display)
@@ -497,10 +559,143 @@ get_player_key(int player, player_key_t vkey)
 void
 attach_input_display(void)
 {
+	if (screen_display(g_screen) == NULL)
+		return;
 	al_register_event_source(s_event_queue,
 		al_get_display_event_source(screen_display(g_screen)));
 }
 
+bool
+is_input_deterministic(void)
+{
+	return s_script_events != NULL || s_record_file != NULL;
+}
+
+uint64_t
+get_random_seed(void)
+{
+	struct script_event* event;
+	uint64_t             seed;
+
+	// when replaying, hand out the seeds from the input script in the order
+	// they were recorded so the game sees the same random numbers as before.
+	if (s_script_events != NULL) {
+		while (s_script_seed_index < vector_len(s_script_events)) {
+			event = vector_get(s_script_events, s_script_seed_index++);
+			if (event->op == SCRIPT_SEED)
+				return event->seed;
+		}
+		console_log(1, "input script ran out of RNG seeds at frame %u", g_tick_count);
+	}
+	seed = (uint64_t)(al_get_time() * 1000000);
+	if (s_record_file != NULL)
+		record_event("seed %" PRIu64, seed);
+	return seed;
+}
+
+bool
+load_input_script(const char* filename)
+{
+	struct script_event event;
+	FILE*               file;
+	char                line[256];
+	int                 line_no = 0;
+	char                name[32];
+	char                state[8];
+
+	// an input script is a plain text file with one event per line, each tagged
+	// with the frame (per Sphere.now()) it happens on.  events must be in frame
+	// order.  blank lines and lines starting with '#' are ignored.
+	//     <frame> key <keycode> down|up
+	//     <frame> char <keycode>
+	//     <frame> mouse <x> <y>
+	//     <frame> button left|right|middle down|up
+	//     <frame> wheel up|down
+	//     <frame> seed <value>
+	// 'char' events go into the key queue as-is.  if a script doesn't have any,
+	// 'key ... down' queues the key instead, which is handy for hand-written
+	// scripts.  'seed' events are handed out by get_random_seed() in order.
+	console_log(1, "loading input script '%s'", filename);
+	if (!(file = fopen(filename, "r")))
+		return false;
+	vector_free(s_script_events);
+	s_script_events = vector_new(sizeof(struct script_event));
+	memset(s_script_buttons, 0, sizeof s_script_buttons);
+	s_script_has_chars = false;
+	s_script_has_mouse = false;
+	s_script_index = 0;
+	s_script_seed_index = 0;
+	s_script_x = s_script_y = 0;
+	while (fgets(line, sizeof line, file) != NULL) {
+		++line_no;
+		if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#')
+			continue;
+		memset(&event, 0, sizeof(struct script_event));
+		if (sscanf(line, "%u key %d %7s", &event.frame, &event.code, state) == 3) {
+			event.op = SCRIPT_KEY;
+			event.down = strcmp(state, "down") == 0;
+			if (event.code <= 0 || event.code >= ALLEGRO_KEY_MAX)
+				goto bad_line;
+		}
+		else if (sscanf(line, "%u char %d", &event.frame, &event.code) == 2) {
+			event.op = SCRIPT_KEY_CHAR;
+			s_script_has_chars = true;
+			if (event.code <= 0 || event.code >= ALLEGRO_KEY_MAX)
+				goto bad_line;
+		}
+		else if (sscanf(line, "%u mouse %d %d", &event.frame, &event.x, &event.y) == 3) {
+			event.op = SCRIPT_MOUSE_MOVE;
+			s_script_has_mouse = true;
+		}
+		else if (sscanf(line, "%u button %31s %7s", &event.frame, name, state) == 3) {
+			event.op = SCRIPT_MOUSE_BUTTON;
+			event.code = strcmp(name, "left") == 0 ? MOUSE_KEY_LEFT
+				: strcmp(name, "right") == 0 ? MOUSE_KEY_RIGHT
+				: strcmp(name, "middle") == 0 ? MOUSE_KEY_MIDDLE
+				: MOUSE_KEY_NONE;
+			event.down = strcmp(state, "down") == 0;
+			if (event.code == MOUSE_KEY_NONE)
+				goto bad_line;
+		}
+		else if (sscanf(line, "%u wheel %7s", &event.frame, state) == 2) {
+			event.op = SCRIPT_MOUSE_WHEEL;
+			event.code = strcmp(state, "up") == 0 ? MOUSE_KEY_WHEEL_UP
+				: MOUSE_KEY_WHEEL_DOWN;
+		}
+		else if (sscanf(line, "%u seed %" SCNu64, &event.frame, &event.seed) == 2) {
+			event.op = SCRIPT_SEED;
+		}
+		else {
+			goto bad_line;
+		}
+		vector_push(s_script_events, &event);
+	}
+	fclose(file);
+	console_log(1, "    %d events in script", vector_len(s_script_events));
+	return true;
+
+bad_line:
+	fprintf(stderr, "ERROR: invalid input event at '%s':%d\n", filename, line_no);
+	fclose(file);
+	vector_free(s_script_events);
+	s_script_events = NULL;
+	return false;
+}
+
+bool
+record_input_script(const char* filename)
+{
+	console_log(1, "recording input to '%s'", filename);
+	if (!(s_record_file = fopen(filename, "w")))
+		return false;
+	s_record_start_time = al_get_time();
+	memset(s_record_buttons, 0, sizeof s_record_buttons);
+	s_record_x = s_record_y = -1;
+	fprintf(s_record_file, "# input recorded by %s %s\n", SPHERE_ENGINE_NAME, SPHERE_VERSION);
+	fprintf(s_record_file, "# replay with: spherun --input <this file> <game>\n");
+	return true;
+}
+
 void
 set_player_key(int player, player_key_t vkey, int keycode)
 {
@@ -549,8 +744,14 @@ update_input(void)
 	int                    keycode;
 	ALLEGRO_MOUSE_STATE    mouse_state;
 
+	// feed in any scripted events which are due.  during a replay, live input
+	// is discarded so it can't throw the playback off.
+	play_input_script();
+
 	// process Allegro input events
 	while (al_get_next_event(s_event_queue, &event)) {
+		if (s_script_events != NULL)
+			continue;
 		switch (event.type) {
 		case ALLEGRO_EVENT_DISPLAY_SWITCH_OUT:
 			// Alt+Tabbing out can cause keys to get "stuck", this works around it
@@ -560,6 +761,8 @@ update_input(void)
 		case ALLEGRO_EVENT_KEY_DOWN:
 			keycode = event.keyboard.keycode;
 			s_key_state[keycode] = true;
+			if (s_record_file != NULL)
+				record_event("key %d down", keycode);
 
 			// queue Ctrl/Alt/Shift keys (Sphere compatibility hack)
 			if (keycode == ALLEGRO_KEY_LCTRL || keycode == ALLEGRO_KEY_RCTRL
@@ -577,6 +780,8 @@ update_input(void)
 			break;
 		case ALLEGRO_EVENT_KEY_UP:
 			s_key_state[event.keyboard.keycode] = false;
+			if (s_record_file != NULL)
+				record_event("key %d up", event.keyboard.keycode);
 			break;
 		case ALLEGRO_EVENT_KEY_CHAR:
 			s_keymod_state = event.keyboard.modifiers;
@@ -610,7 +815,10 @@ update_input(void)
 		}
 	}
 
-	if (s_have_mouse) {
+	if (s_have_mouse && s_script_events == NULL) {
+		if (s_record_file != NULL)
+			record_mouse();
+
 		// check for mouse wheel movement
 		al_get_mouse_state(&mouse_state);
 		if (mouse_state.z > s_last_wheel_pos)
@@ -664,11 +872,53 @@ kb_bind_key(int keycode, script_t* on_down_script, script_t* on_up_script)
 		vector_push(s_bound_keys, &new_binding);
 }
 
+static void
+play_input_script(void)
+{
+	struct script_event* event;
+
+	if (s_script_events == NULL)
+		return;
+	while (s_script_index < vector_len(s_script_events)) {
+		event = vector_get(s_script_events, s_script_index);
+		if (event->frame > g_tick_count)
+			break;
+		switch (event->op) {
+		case SCRIPT_KEY:
+			s_key_state[event->code] = event->down;
+			if (event->down && !s_script_has_chars)
+				queue_key(event->code);
+			break;
+		case SCRIPT_KEY_CHAR:
+			queue_key(event->code);
+			break;
+		case SCRIPT_MOUSE_MOVE:
+			s_script_x = event->x;
+			s_script_y = event->y;
+			break;
+		case SCRIPT_MOUSE_BUTTON:
+			s_script_buttons[event->code] = event->down;
+			if (event->down)
+				queue_mouse_event(event->code, s_script_x, s_script_y);
+			break;
+		case SCRIPT_MOUSE_WHEEL:
+			queue_mouse_event(event->code, s_script_x, s_script_y);
+			break;
+		case SCRIPT_SEED:
+			// consumed by get_random_seed()
+			break;
+		}
+		++s_script_index;
+	}
+}
+
 static void
 queue_key(int keycode)
 {
 	int key_index;
 
+	if (s_record_file != NULL)
+		record_event("char %d", keycode);
 	if (s_key_queue.num_keys < 255) {
 		key_index = s_key_queue.num_keys;
 		++s_key_queue.num_keys;
@@ -689,3 +939,48 @@ queue_mouse_event(mouse_key_t key, int x, int y)
 		++s_num_mouse_events;
 	}
 }
+
+static void
+record_event(const char* fmt, ...)
+{
+	va_list ap;
+
+	// events are tagged with the frame they happen on, which is all playback
+	// needs.  the wall-clock time is written as a comment for reference.
+	fprintf(s_record_file, "%u ", g_tick_count);
+	va_start(ap, fmt);
+	vfprintf(s_record_file, fmt, ap);
+	va_end(ap);
+	fprintf(s_record_file, "  # %.3f\n", al_get_time() - s_record_start_time);
+}
+
+static void
+record_mouse(void)
+{
+	static const char* const NAMES[] = { NULL, "left", "right", "middle" };
+
+	ALLEGRO_MOUSE_STATE mouse_state;
+	bool                is_down;
+	int                 x;
+	int                 y;
+
+	int i;
+
+	al_get_mouse_state(&mouse_state);
+	screen_get_mouse_xy(g_screen, &x, &y);
+	if (x != s_record_x || y != s_record_y)
+		record_event("mouse %d %d", x, y);
+	s_record_x = x;
+	s_record_y = y;
+	for (i = MOUSE_KEY_LEFT; i <= MOUSE_KEY_MIDDLE; ++i) {
+		is_down = mouse_state.display == screen_display(g_screen)
+			&& al_mouse_button_down(&mouse_state, i);
+		if (is_down != s_record_buttons[i])
+			record_event("button %s %s", NAMES[i], is_down ? "down" : "up");
+		s_record_buttons[i] = is_down;
+	}
+	if (mouse_state.z > s_last_wheel_pos)
+		record_event("wheel up");
+	if (mouse_state.z < s_last_wheel_pos)
+		record_event("wheel down");
+}
@@ -100,15 +100,20 @@ void          kb_clear_queue     (void);
 int           kb_get_key         (void);
 void          kb_load_keymap     (void);
 void          kb_save_keymap     (void);
+bool          mouse_scripted_xy  (int* out_x, int* out_y);
 bool          mouse_is_key_down  (mouse_key_t key);
 int           mouse_queue_len    (void);
 void          mouse_clear_queue  (void);
 mouse_event_t mouse_get_event    (void);
 
-int   get_player_key       (int player, player_key_t vkey);
-void  set_player_key       (int player, player_key_t vkey, int keycode);
-void  attach_input_display (void);
-void  update_bound_keys    (bool use_map_keys);
-void  update_input         (void);
+int      get_player_key         (int player, player_key_t vkey);
+void     set_player_key         (int player, player_key_t vkey, int keycode);
+void     attach_input_display   (void);
+bool     is_input_deterministic (void);
+uint64_t get_random_seed        (void);
+bool     load_input_script      (const char* filename);
+bool     record_input_script    (const char* filename);
+void     update_bound_keys      (bool use_map_keys);
+void     update_input           (void);
 
 #endif // SPHERE__INPUT_H__INCLUDED
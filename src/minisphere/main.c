@@ -37,16 +37,21 @@
 #include <zlib.h>
 #include "api.h"
 #include "audio.h"
+#include "counter.h"
 #include "debugger.h"
 #include "dispatch.h"
 #include "galileo.h"
+#include "image.h"
 #include "input.h"
 #include "jsal.h"
 #include "map_engine.h"
+#include "pacer.h"
 #include "pegasus.h"
+#include "prim_cache.h"
 #include "profiler.h"
 #include "sockets.h"
 #include "spriteset.h"
+#include "thread_pool.h"
 #include "vanilla.h"
 
 // enable Windows visual styles (MSVC)
@@ -72,18 +77,22 @@ enum fullscreen_mode
 	FULLSCREEN_OFF,
 };
 
+static void on_collect_garbage  (size_t heap_size, size_t heap_growth);
 static void on_enqueue_js_job   (void);
 static bool on_reject_promise   (void);
 static void on_socket_idle      (void);
+static void collect_idle        (double deadline);
 static bool initialize_engine   (void);
 static void shutdown_engine     (void);
 static bool find_startup_game   (path_t* *out_path);
-static bool parse_command_line  (int argc, char* argv[], path_t* *out_game_path, int *out_fullscreen, int *out_frameskip, int *out_verbosity, ssj_mode_t *out_ssj_mode, bool *out_retro_mode, int *out_extras_offset);
+static bool parse_command_line  (int argc, char* argv[], path_t* *out_game_path, int *out_fullscreen, int *out_frameskip, bool *out_vsync, int *out_verbosity, ssj_mode_t *out_ssj_mode, bool *out_retro_mode, bool *out_headless, bool *out_benchmark, char* *out_capture_dir, char* *out_input_script, char* *out_record_file, int *out_extras_offset);
 static void print_banner        (bool want_copyright, bool want_deps);
 static void print_usage         (void);
 static void report_error        (const char* fmt, ...);
 static void show_error_screen   (const char* message);
 
+static double               s_clock_time = 0.0;
+static double               s_gc_cost = 0.001;
 static int                  s_event_loop_version;
 static ALLEGRO_EVENT_QUEUE* s_event_queue = NULL;
 static path_t*              s_game_path = NULL;
@@ -118,6 +127,7 @@ main(int argc, char* argv[])
 
 	int                  api_level;
 	int                  api_version;
+	bool                 benchmark;
 	bool                 eval_succeeded;
 	lstring_t*           dialog_name;
 	int                  error_column;
@@ -139,15 +149,20 @@ main(int argc, char* argv[])
 	ssj_mode_t           ssj_mode;
 	int                  use_frameskip;
 	int                  use_verbosity;
+	bool                 use_vsync;
+	char*                capture_dir;
+	bool                 headless;
+	char*                input_script;
+	char*                record_file;
 
 	int i;
 
 	// parse the command line
 	if (parse_command_line(argc, argv, &s_game_path,
-		&fullscreen_mode, &use_frameskip, &use_verbosity, &ssj_mode, &retro_mode,
-		&game_args_offset))
+		&fullscreen_mode, &use_frameskip, &use_vsync, &use_verbosity, &ssj_mode, &retro_mode,
+		&headless, &benchmark, &capture_dir, &input_script, &record_file, &game_args_offset))
 	{
-		if (ssj_mode == SSJ_ACTIVE)
+		if (ssj_mode == SSJ_ACTIVE || headless)
 			fullscreen_mode = FULLSCREEN_OFF;
 		console_init(use_verbosity);
 	}
@@ -167,8 +182,16 @@ main(int argc, char* argv[])
 			: fullscreen_mode == FULLSCREEN_OFF ? "off"
 			: "auto");
 	console_log(1, "    frameskip limit: %d frames", use_frameskip);
+	console_log(1, "    vsync: %s", use_vsync ? "on" : "off");
 	console_log(1, "    console verbosity: V%d", use_verbosity);
 #if defined(MINISPHERE_SPHERUN)
+	console_log(1, "    headless: %s", headless ? "yes" : "no");
+	if (capture_dir != NULL)
+		console_log(1, "    capture frames to: %s", capture_dir);
+	if (input_script != NULL)
+		console_log(1, "    input script: %s", input_script);
+	if (record_file != NULL)
+		console_log(1, "    record input to: %s", record_file);
 	console_log(1, "    debugger mode: %s",
 		ssj_mode == SSJ_ACTIVE ? "active"
 			: ssj_mode == SSJ_PASSIVE ? "passive"
@@ -179,6 +202,15 @@ main(int argc, char* argv[])
 	if (!initialize_engine())
 		return EXIT_FAILURE;
 
+#if defined(MINISPHERE_SPHERUN)
+	// '--benchmark' measures the JS binding layer on its own, no game required
+	if (benchmark) {
+		eval_succeeded = profiler_run_benchmarks();
+		shutdown_engine();
+		return eval_succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+#endif
+
 	// set up jump points for script bailout
 	console_log(1, "setting up jump points for longjmp");
 	if (setjmp(exit_label) != 0) {
@@ -276,7 +308,7 @@ main(int argc, char* argv[])
 	resolution = game_resolution(g_game);
 	if (!(icon = image_load("@/icon.png")))
 		icon = image_load("#/icon.png");
-	g_screen = screen_new(game_name(g_game), icon, resolution, use_frameskip, game_default_font(g_game));
+	g_screen = screen_new(game_name(g_game), icon, resolution, use_frameskip, use_vsync, headless, game_default_font(g_game));
 	if (g_screen == NULL) {
 		al_show_native_message_box(NULL, "Unable to Create Render Context", "miniSphere couldn't create a render context.",
 			"Your hardware may be too old to run miniSphere, or there could be a problem with the drivers on this system.  Check that your graphics drivers in particular are fully installed and up-to-date.",
@@ -286,10 +318,21 @@ main(int argc, char* argv[])
 
 	al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
 	s_event_queue = al_create_event_queue();
-	al_register_event_source(s_event_queue,
-		al_get_display_event_source(screen_display(g_screen)));
+	if (screen_display(g_screen) != NULL) {
+		al_register_event_source(s_event_queue,
+			al_get_display_event_source(screen_display(g_screen)));
+	}
 	attach_input_display();
 	kb_load_keymap();
+	screen_capture_frames(g_screen, capture_dir);
+	if (input_script != NULL && !load_input_script(input_script)) {
+		fprintf(stderr, "ERROR: couldn't load input script '%s'\n", input_script);
+		longjmp(exit_label, 1);
+	}
+	if (record_file != NULL && !record_input_script(record_file)) {
+		fprintf(stderr, "ERROR: couldn't open '%s' to record input\n", record_file);
+		longjmp(exit_label, 1);
+	}
 	
 	// in retrograde mode, only provide access to functions up to the targeted
 	// API level, nothing newer.
@@ -314,7 +357,7 @@ main(int argc, char* argv[])
 
 	// enable the SSj debug server, wait for a connection if requested.
 #if defined(MINISPHERE_SPHERUN)
-	if (ssj_mode == SSJ_ACTIVE) {
+	if (ssj_mode == SSJ_ACTIVE && screen_display(g_screen) != NULL) {
 		al_clear_to_color(al_map_rgba(0, 0, 0, 255));
 		screen_draw_status(g_screen, "waiting for debugger...", mk_color(255, 255, 255, 255));
 		al_flip_display();
@@ -460,6 +503,15 @@ sphere_change_game(const char* pathname)
 	sphere_restart();
 }
 
+void
+sphere_delay(double time)
+{
+	// an explicit delay requested by the game.  unlike the engine's own waits,
+	// this counts against the fixed-step clock, but it can never run it backwards.
+	s_clock_time += time > 0.0 ? time : 0.0;
+	sphere_sleep(time);
+}
+
 void
 sphere_exit(bool allow_game_change)
 {
@@ -495,6 +547,7 @@ sphere_heartbeat(bool in_event_loop, int api_version)
 		debugger_update();
 #endif
 		s_event_loop_version = api_version;
+		thread_pool_update();
 		jsal_update(true);
 	}
 
@@ -519,6 +572,31 @@ sphere_heartbeat(bool in_event_loop, int api_version)
 #endif
 }
 
+void
+sphere_idle(double deadline)
+{
+	// the time left before the next frame is due belongs to idle jobs.  this is
+	// only called by the frame pacer: the engine's other waits (debugger, sockets,
+	// GetKey() and the like) can happen while script is halted mid-call, where
+	// running more JS would be unsafe, so sphere_sleep() doesn't run them.
+	// note: this doesn't sleep; whatever time is left over is up to the caller.
+	dispatch_run_idle(deadline);
+	collect_idle(deadline);
+}
+
+double
+sphere_now(void)
+{
+	// while input is being recorded or replayed, the game gets a fixed-step
+	// clock which only advances when a frame is processed or the game delays,
+	// so timing-based game logic plays out identically on every run.  each read
+	// nudges it forward by a microsecond so busy-wait loops still terminate.
+	if (!is_input_deterministic())
+		return al_get_time();
+	s_clock_time += 0.000001;
+	return s_clock_time;
+}
+
 void
 sphere_restart(void)
 {
@@ -544,21 +622,35 @@ sphere_sleep(double time)
 void
 sphere_tick(int api_version, bool clear_screen, int framerate)
 {
+	double start_time;
+
 	sphere_heartbeat(true, api_version);
 	if (!screen_skipping_frame(g_screen)) {
+		start_time = al_get_time();
 		if (!dispatch_run(JOB_ON_RENDER))
 			return;
+		pacer_record(PACER_RENDER, al_get_time() - start_time);
 	}
 	screen_flip(g_screen, framerate, clear_screen);
 	if (api_version >= 2)
 		image_set_scissor(screen_backbuffer(g_screen), screen_bounds(g_screen));
+	start_time = al_get_time();
 	if (!dispatch_run(JOB_ON_UPDATE))
 		return;
 	if (!dispatch_run(JOB_ON_TICK))
 		return;
+	pacer_record(PACER_UPDATE, al_get_time() - start_time);
+	s_clock_time += 1.0 / (framerate > 0 ? framerate : 60);
 	++g_tick_count;
 }
 
+static void
+on_collect_garbage(size_t heap_size, size_t heap_growth)
+{
+	console_log(3, "collecting JS garbage, heap at %u KiB (+%u KiB)",
+		(unsigned int)(heap_size / 1024), (unsigned int)(heap_growth / 1024));
+}
+
 static void
 on_enqueue_js_job(void)
 {
@@ -617,6 +709,48 @@ on_socket_idle(void)
 	sphere_sleep(0.05);
 }
 
+static void
+collect_idle(double deadline)
+{
+	// minimum slack needed before it's worth doing any GC work at all, and the amount
+	// of heap growth since the last collection that justifies a full collection.
+	const double   MIN_SLACK = 0.002;
+	const size_t   MIN_GROWTH = 8 << 20;
+
+	double     elapsed;
+	double     heap_mib;
+	double     slack;
+	double     start_time;
+	js_stats_t stats;
+
+	// when there's slack left over at the end of a frame, use it to get garbage
+	// collection out of the way so it doesn't land in the middle of the next one.
+	// the cost of a full collection grows with the heap, so the last one is used
+	// to estimate a cost per MiB, and a full collection is only done if one of the
+	// current heap would fit in the time available.  otherwise ChakraCore just
+	// gets a chance to do its idle work.
+	// note: ChakraCore refuses both while script is on the stack, which is the
+	//       case when a Sphere v1 game calls FlipScreen().
+	if (jsal_in_script())
+		return;
+	start_time = al_get_time();
+	if ((slack = deadline - start_time) < MIN_SLACK)
+		return;
+	stats = jsal_stats();
+	heap_mib = (double)stats.heap_size / (1 << 20);
+	if (stats.heap_growth >= MIN_GROWTH && slack >= heap_mib * s_gc_cost) {
+		jsal_gc();
+		elapsed = al_get_time() - start_time;
+		if (heap_mib > 0.0)
+			s_gc_cost = elapsed / heap_mib;
+		console_log(3, "idle JS collection of %u KiB heap took %.2f ms, %.2f ms slack",
+			(unsigned int)(stats.heap_size / 1024), elapsed * 1000.0, slack * 1000.0);
+	}
+	else {
+		jsal_idle();
+	}
+}
+
 static bool
 initialize_engine(void)
 {
@@ -651,16 +785,22 @@ initialize_engine(void)
 		goto on_error;
 	jsal_on_enqueue_job(on_enqueue_js_job);
 	jsal_on_reject_promise(on_reject_promise);
+	jsal_on_collect_garbage(on_collect_garbage);
 
 	// initialize engine components
+	counters_init();
 	dispatch_init();
+	images_init();
 	galileo_init();
+	prim_cache_init();
+	pacer_init();
 	audio_init();
 	initialize_input();
 	sockets_init(on_socket_idle);
 	spritesets_init();
 	map_engine_init();
 	scripts_init();
+	thread_pool_init();
 
 	return true;
 
@@ -684,8 +824,10 @@ shutdown_engine(void)
 
 	map_engine_uninit();
 	shutdown_input();
+	thread_pool_uninit();
 	scripts_uninit();
 	sockets_uninit();
+	vanilla_uninit();
 
 	console_log(1, "shutting down JavaScript");
 	jsal_uninit();
@@ -695,8 +837,11 @@ shutdown_engine(void)
 
 	spritesets_uninit();
 	audio_uninit();
+	pacer_uninit();
+	prim_cache_uninit();
 	galileo_uninit();
 	dispatch_uninit();
+	images_uninit();
 
 	console_log(1, "shutting down Allegro");
 	screen_free(g_screen);
@@ -774,8 +919,9 @@ static bool
 parse_command_line(
 	int argc, char* argv[],
 	path_t* *out_game_path, int *out_fullscreen, int *out_frameskip,
-	int *out_verbosity, ssj_mode_t *out_ssj_mode, bool *out_retro_mode,
-	int *out_extras_offset)
+	bool *out_vsync, int *out_verbosity, ssj_mode_t *out_ssj_mode, bool *out_retro_mode,
+	bool *out_headless, bool *out_benchmark, char* *out_capture_dir,
+	char* *out_input_script, char* *out_record_file, int *out_extras_offset)
 {
 	bool parse_options = true;
 
@@ -789,6 +935,12 @@ parse_command_line(
 	*out_retro_mode = false;
 	*out_ssj_mode = SSJ_PASSIVE;
 	*out_verbosity = 0;
+	*out_vsync = false;
+	*out_headless = false;
+	*out_benchmark = false;
+	*out_capture_dir = NULL;
+	*out_input_script = NULL;
+	*out_record_file = NULL;
 
 	// process command line arguments
 	for (i = 1; i < argc; ++i) {
@@ -806,6 +958,9 @@ parse_command_line(
 			else if (strcmp(argv[i], "--windowed") == 0) {
 				*out_fullscreen = FULLSCREEN_OFF;
 			}
+			else if (strcmp(argv[i], "--vsync") == 0) {
+				*out_vsync = true;
+			}
 #if defined(MINISPHERE_SPHERUN)
 			else if (strcmp(argv[i], "--version") == 0) {
 				print_banner(true, true);
@@ -821,6 +976,27 @@ parse_command_line(
 			else if (strcmp(argv[i], "--retro") == 0) {
 				*out_retro_mode = true;
 			}
+			else if (strcmp(argv[i], "--headless") == 0) {
+				*out_headless = true;
+			}
+			else if (strcmp(argv[i], "--benchmark") == 0) {
+				*out_benchmark = true;
+			}
+			else if (strcmp(argv[i], "--capture") == 0) {
+				if (++i >= argc)
+					goto missing_argument;
+				*out_capture_dir = argv[i];
+			}
+			else if (strcmp(argv[i], "--input") == 0) {
+				if (++i >= argc)
+					goto missing_argument;
+				*out_input_script = argv[i];
+			}
+			else if (strcmp(argv[i], "--record") == 0) {
+				if (++i >= argc)
+					goto missing_argument;
+				*out_record_file = argv[i];
+			}
 			else if (strcmp(argv[i], "--profile") == 0) {
 				*out_ssj_mode = SSJ_OFF;
 			}
@@ -879,10 +1055,14 @@ parse_command_line(
 	}
 
 #if defined(MINISPHERE_SPHERUN)
-	if (*out_game_path == NULL) {
+	if (*out_game_path == NULL && !*out_benchmark) {
 		print_usage();
 		return false;
 	}
+	if (*out_input_script != NULL && *out_record_file != NULL) {
+		report_error("'--input' and '--record' can't be used together\n");
+		return false;
+	}
 #endif
 
 	return true;
@@ -921,16 +1101,26 @@ print_usage(void)
 	print_banner(true, false);
 	printf("\n");
 	printf("USAGE:\n");
-	printf("   spherun [--fullscreen | --windowed] [--frameskip <n>] [--debug | --profile]\n");
-	printf("           [--retro] [--verbose <n>] <game_path> [<game_args>]                \n");
+	printf("   spherun [--fullscreen | --windowed] [--frameskip <n>] [--vsync]            \n");
+	printf("           [--debug | --profile] [--retro] [--verbose <n>] [--headless]       \n");
+	printf("           [--capture <dir>] [--input <file> | --record <file>] <game_path>   \n");
+	printf("           [<game_args>]                                                      \n");
+	printf("   spherun --benchmark [--verbose <n>]                                        \n");
 	printf("\n");
 	printf("OPTIONS:\n");
 	printf("       --fullscreen   Start the game in fullscreen mode                       \n");
 	printf("       --windowed     Start the game in windowed mode (default for SpheRun)   \n");
 	printf("       --frameskip    Set the maximum number of consecutive frames to skip    \n");
+	printf("       --vsync        Synchronize frame flips with the monitor's refresh rate \n");
 	printf("   -d  --debug        Wait 30 seconds for an SSj/Ki debugger to connect       \n");
 	printf("   -p  --profile      Enable the profiler for this session (disables debugger)\n");
 	printf("   -r  --retro        Emulate the game's targeted API level (retrograde mode) \n");
+	printf("       --headless     Run without a window, rendering in software             \n");
+	printf("       --capture      Save each frame as a PNG file in the given directory    \n");
+	printf("       --input        Play back keyboard and mouse input from an input script \n");
+	printf("       --record       Record keyboard and mouse input to an input script      \n");
+	printf("       --benchmark    Time JS-to-native calls and stress-test the texture     \n");
+	printf("                      budget, print a report, then exit                       \n");
 	printf("       --verbose      Set the engine's verbosity level from 0 to 4            \n");
 	printf("   -v  --version      Show which version of miniSphere is installed           \n");
 	printf("       --help         Show this help text                                     \n");
@@ -979,6 +1169,13 @@ show_error_screen(const char* message)
 
 	int i;
 
+	// in headless mode there's no one around to dismiss the error screen, so
+	// just log the error and move on.
+	if (screen_display(g_screen) == NULL) {
+		fprintf(stderr, "%s\n", message);
+		return;
+	}
+
 	title_index = rand() % (sizeof ERROR_TEXT / sizeof(const char*) / 2);
 	title = ERROR_TEXT[title_index][0];
 	subtitle = ERROR_TEXT[title_index][1];
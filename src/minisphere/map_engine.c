@@ -42,6 +42,7 @@
 #include "input.h"
 #include "jsal.h"
 #include "obstruction.h"
+#include "render.h"
 #include "script.h"
 #include "spriteset.h"
 #include "tileset.h"
@@ -610,6 +611,7 @@ map_engine_draw_map(void)
 	}
 
 	al_draw_filled_rectangle(0, 0, resolution.width, resolution.height, nativecolor(s_color_mask));
+	render_count_draws(1);
 	script_run(s_render_script, false);
 }
 
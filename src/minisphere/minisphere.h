@@ -79,10 +79,13 @@ extern double    g_idle_time;
 extern screen_t* g_screen;
 extern uint32_t  g_tick_count;
 
-void sphere_abort       (const char* message);
-void sphere_change_game (const char* pathname);
-void sphere_exit        (bool shutting_down);
-void sphere_heartbeat   (bool in_event_loop, int api_version);
-void sphere_restart     (void);
-void sphere_sleep       (double time);
-void sphere_tick        (int api_version, bool clear_screen, int framerate);
+void   sphere_abort       (const char* message);
+void   sphere_change_game (const char* pathname);
+void   sphere_delay       (double time);
+void   sphere_exit        (bool shutting_down);
+void   sphere_heartbeat   (bool in_event_loop, int api_version);
+void   sphere_idle        (double deadline);
+double sphere_now         (void);
+void   sphere_restart     (void);
+void   sphere_sleep       (double time);
+void   sphere_tick        (int api_version, bool clear_screen, int framerate);
@@ -0,0 +1,223 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include "minisphere.h"
+#include "pacer.h"
+
+#include "table.h"
+
+#define TIME_PRECISION 1.0e6    // microseconds
+#define UNIT_NAME      "us"
+
+static int  find_bucket   (double time);
+static void print_results (void);
+
+static const double BUCKET_LIMITS[PACER_NUM_BUCKETS] =
+{
+	0.5, 1.0, 2.0, 4.0, 8.0, 12.0, 16.0, 20.0, 33.0, 50.0, 100.0, INFINITY,
+};
+
+static const char* const PHASE_NAMES[PACER_MAX] =
+{
+	"frame", "update", "render", "flip", "idle",
+};
+
+static double        s_frame_times[PACER_MAX];
+static double        s_last_frame_time;
+static pacer_stats_t s_stats;
+
+void
+pacer_init(void)
+{
+	console_log(1, "initializing frame pacer");
+	pacer_reset();
+}
+
+void
+pacer_uninit(void)
+{
+	console_log(1, "shutting down frame pacer");
+#if defined(MINISPHERE_SPHERUN)
+	if (s_stats.num_frames > 0)
+		print_results();
+#endif
+}
+
+double
+pacer_bucket_limit(int bucket)
+{
+	return BUCKET_LIMITS[bucket];
+}
+
+const char*
+pacer_phase_name(pacer_phase_t phase)
+{
+	return PHASE_NAMES[phase];
+}
+
+pacer_stats_t
+pacer_stats(void)
+{
+	return s_stats;
+}
+
+void
+pacer_end_frame(bool skipped)
+{
+	int    bucket;
+	double now;
+
+	int i;
+
+	now = al_get_time();
+	s_frame_times[PACER_FRAME] = now - s_last_frame_time;
+
+	// the first frame after a reset spans whatever came before it (e.g. game
+	// startup), so it would only skew the numbers.  start counting from here.
+	if (s_last_frame_time >= 0.0) {
+		for (i = 0; i < PACER_MAX; ++i) {
+			bucket = find_bucket(s_frame_times[i]);
+			++s_stats.histogram[i][bucket];
+			s_stats.total_time[i] += s_frame_times[i];
+			if (s_frame_times[i] > s_stats.max_time[i])
+				s_stats.max_time[i] = s_frame_times[i];
+		}
+		++s_stats.num_frames;
+		if (skipped)
+			++s_stats.num_skipped;
+	}
+	memset(s_frame_times, 0, sizeof s_frame_times);
+	s_last_frame_time = now;
+}
+
+void
+pacer_idle(double until)
+{
+	double start_time;
+
+	// runs idle jobs without waiting out the rest of the frame, for when something
+	// else (e.g. a vsync'd flip) is going to do the waiting.
+	start_time = al_get_time();
+	sphere_idle(until);
+	pacer_record(PACER_IDLE, al_get_time() - start_time);
+}
+
+void
+pacer_record(pacer_phase_t phase, double time)
+{
+	s_frame_times[phase] += time;
+}
+
+void
+pacer_reset(void)
+{
+	memset(&s_stats, 0, sizeof(pacer_stats_t));
+	memset(s_frame_times, 0, sizeof s_frame_times);
+	s_last_frame_time = -1.0;
+}
+
+void
+pacer_wait(double until, bool spin)
+{
+	double start_time;
+
+	// OS sleeps are only accurate to a millisecond or so (often much worse), so
+	// when spinning is enabled, wake up a bit early and busy-wait the rest of the
+	// way.  sphere_sleep() is always called, even when we're already late, so that
+	// events keep getting pumped.
+	start_time = al_get_time();
+	if (spin) {
+		sphere_idle(until - PACER_SPIN_TIME);
+		sphere_sleep(until - PACER_SPIN_TIME - al_get_time());
+		while (al_get_time() < until) {
+			// spin
+		}
+	}
+	else {
+		sphere_idle(until);
+		sphere_sleep(until - al_get_time());
+	}
+	pacer_record(PACER_IDLE, al_get_time() - start_time);
+}
+
+static int
+find_bucket(double time)
+{
+	double millis;
+
+	int i;
+
+	millis = time * 1000.0;
+	for (i = 0; i < PACER_NUM_BUCKETS - 1; ++i) {
+		if (millis < BUCKET_LIMITS[i])
+			break;
+	}
+	return i;
+}
+
+static void
+print_results(void)
+{
+	char*    heading;
+	char*    label;
+	table_t* table;
+
+	int i, j;
+
+	printf("\n");
+
+	heading = strnewf("frame timing - %u frames, %u skipped",
+		s_stats.num_frames, s_stats.num_skipped);
+	table = table_new(heading, true);
+	table_add_column(table, "time (ms)");
+	for (i = 0; i < PACER_MAX; ++i)
+		table_add_column(table, "%s", PHASE_NAMES[i]);
+	for (j = 0; j < PACER_NUM_BUCKETS; ++j) {
+		if (j < PACER_NUM_BUCKETS - 1)
+			label = strnewf("< %g", BUCKET_LIMITS[j]);
+		else
+			label = strnewf(">= %g", BUCKET_LIMITS[j - 1]);
+		table_add_text(table, 0, label);
+		for (i = 0; i < PACER_MAX; ++i)
+			table_add_number(table, i + 1, s_stats.histogram[i][j]);
+		free(label);
+	}
+	table_add_text(table, 0, "max (" UNIT_NAME ")");
+	for (i = 0; i < PACER_MAX; ++i)
+		table_add_number(table, i + 1, s_stats.max_time[i] * TIME_PRECISION);
+	table_add_text(table, 0, "avg (" UNIT_NAME ")");
+	for (i = 0; i < PACER_MAX; ++i)
+		table_add_number(table, i + 1, s_stats.total_time[i] / s_stats.num_frames * TIME_PRECISION);
+	table_print(table);
+	table_free(table);
+	free(heading);
+}
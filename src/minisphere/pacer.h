@@ -0,0 +1,71 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef SPHERE__PACER_H__INCLUDED
+#define SPHERE__PACER_H__INCLUDED
+
+#define PACER_NUM_BUCKETS 12
+#define PACER_SPIN_TIME   0.002
+
+typedef
+enum pacer_phase
+{
+	PACER_FRAME,
+	PACER_UPDATE,
+	PACER_RENDER,
+	PACER_FLIP,
+	PACER_IDLE,
+	PACER_MAX
+} pacer_phase_t;
+
+typedef
+struct pacer_stats
+{
+	unsigned int num_frames;
+	unsigned int num_skipped;
+	double       max_time[PACER_MAX];
+	double       total_time[PACER_MAX];
+	unsigned int histogram[PACER_MAX][PACER_NUM_BUCKETS];
+} pacer_stats_t;
+
+void          pacer_init         (void);
+void          pacer_uninit       (void);
+double        pacer_bucket_limit (int bucket);
+const char*   pacer_phase_name   (pacer_phase_t phase);
+pacer_stats_t pacer_stats        (void);
+void          pacer_end_frame    (bool skipped);
+void          pacer_idle         (double until);
+void          pacer_record       (pacer_phase_t phase, double time);
+void          pacer_reset        (void);
+void          pacer_wait         (double until, bool spin);
+
+#endif // SPHERE__PACER_H__INCLUDED
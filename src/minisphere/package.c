@@ -34,6 +34,7 @@
 #include "package.h"
 
 #include "compress.h"
+#include "counter.h"
 #include "vector.h"
 
 struct asset
@@ -46,11 +47,12 @@ struct asset
 
 struct package
 {
-	unsigned int  refcount;
-	unsigned int  id;
-	path_t*       path;
-	ALLEGRO_FILE* file;
-	vector_t*     index;
+	unsigned int   refcount;
+	unsigned int   id;
+	path_t*        path;
+	ALLEGRO_FILE*  file;
+	vector_t*      index;
+	ALLEGRO_MUTEX* mutex;
 };
 
 struct spk_entry
@@ -81,6 +83,9 @@ struct spk_entry_hdr
 };
 #pragma pack(pop)
 
+static struct spk_entry* find_entry   (package_t* package, const char* path);
+static bool              unpack_asset (asset_t* asset);
+
 static unsigned int s_next_package_id = 1;
 
 package_t*
@@ -98,6 +103,7 @@ package_open(const char* path)
 	package = calloc(1, sizeof(package_t));
 
 	if (!(package->file = al_fopen(path, "rb"))) goto on_error;
+	if (!(package->mutex = al_create_mutex())) goto on_error;
 	if (al_fread(package->file, &spk_hdr, sizeof(struct spk_header)) != sizeof(struct spk_header))
 		goto on_error;
 	if (memcmp(spk_hdr.signature, ".spk", 4) != 0) goto on_error;
@@ -130,6 +136,8 @@ on_error:
 		path_free(package->path);
 		if (package->file != NULL)
 			al_fclose(package->file);
+		if (package->mutex != NULL)
+			al_destroy_mutex(package->mutex);
 		vector_free(package->index);
 		free(package);
 	}
@@ -152,6 +160,7 @@ package_unref(package_t* it)
 	console_log(4, "disposing package #%u no longer in use", it->id);
 	vector_free(it->index);
 	al_fclose(it->file);
+	al_destroy_mutex(it->mutex);
 	free(it);
 }
 
@@ -312,29 +321,29 @@ asset_fopen(package_t* package, const char* path, const char* mode)
 		if (!(al_file = al_fopen(local_filename, mode)))
 			goto on_error;
 	}
-	else {
+	else if (strcmp(mode, "r") != 0 && strcmp(mode, "rb") != 0) {
 		if (!(buffer = asset_fslurp(package, path, &file_size)) && mode[0] == 'r')
 			goto on_error;
-		if (strcmp(mode, "r") != 0 && strcmp(mode, "rb") != 0) {
-			if (buffer != NULL && mode[0] != 'w') {
-				// if a game requests write access to an existing file,
-				// we extract it. this ensures file operations originating from
-				// inside an SPK are transparent to the game.
-				console_log(4, "extracting #%u:'%s', write access requested", package->id, path);
-				if (!(al_file = al_fopen(local_filename, "w")))
-					goto on_error;
-				al_fwrite(al_file, buffer, file_size);
-				al_fclose(al_file);
-			}
-			free(buffer); buffer = NULL;
-			if (!(al_file = al_fopen(local_filename, mode)))
-				goto on_error;
-		}
-		else {
-			// read-only: access unpacked file from memory (performance)
-			if (!(al_file = al_open_memfile(buffer, file_size, mode)))
+		if (buffer != NULL && mode[0] != 'w') {
+			// if a game requests write access to an existing file,
+			// we extract it. this ensures file operations originating from
+			// inside an SPK are transparent to the game.
+			console_log(4, "extracting #%u:'%s', write access requested", package->id, path);
+			if (!(al_file = al_fopen(local_filename, "w")))
 				goto on_error;
+			al_fwrite(al_file, buffer, file_size);
+			al_fclose(al_file);
 		}
+		free(buffer); buffer = NULL;
+		if (!(al_file = al_fopen(local_filename, mode)))
+			goto on_error;
+	}
+	else {
+		// read-only: the file will be unpacked into memory on first access (see
+		// unpack_asset()).  deferring it keeps opening the file cheap and allows the
+		// inflate to happen on whichever thread actually reads the file.
+		if (find_entry(package, path) == NULL)
+			goto on_error;
 	}
 
 	path_free(local_path);
@@ -361,7 +370,8 @@ asset_fclose(asset_t* file)
 	if (file == NULL)
 		return;
 	console_log(4, "closing '%s' from package #%u", file->filename, file->package->id);
-	al_fclose(file->handle);
+	if (file->handle != NULL)
+		al_fclose(file->handle);
 	free(file->buffer);
 	free(file->filename);
 	package_unref(file->package);
@@ -371,24 +381,42 @@ asset_fclose(asset_t* file)
 int
 asset_fputc(int ch, asset_t* file)
 {
+	// note: a file with no handle yet is read-only and hasn't been unpacked,
+	//       so writing to it fails the same way it would after unpacking.
+	if (file->handle == NULL)
+		return EOF;
 	return al_fputc(file->handle, ch);
 }
 
 int
 asset_fputs(const char* string, asset_t* file)
 {
+	if (file->handle == NULL)
+		return EOF;
 	return al_fputs(file->handle, string);
 }
 
 size_t
 asset_fread(void* buf, size_t size, size_t count, asset_t* file)
 {
-	return al_fread(file->handle, buf, size * count) / size;
+	size_t num_bytes;
+
+	if (!unpack_asset(file))
+		return 0;
+	num_bytes = al_fread(file->handle, buf, size * count);
+
+	// files opened read-only are unpacked into memory on first access, so only
+	// reads from the local cache actually touch the disk.
+	if (file->buffer == NULL)
+		counter_add_shared(COUNTER_BYTES_READ, (unsigned int)num_bytes);
+	return num_bytes / size;
 }
 
 bool
 asset_fseek(asset_t* file, long long offset, spk_seek_origin_t origin)
 {
+	if (!unpack_asset(file))
+		return false;
 	return al_fseek(file->handle, offset, origin);
 }
 
@@ -397,25 +425,25 @@ asset_fslurp(package_t* package, const char* path, size_t *out_size)
 {
 	struct spk_entry* entry;
 	void*             packdata = NULL;
+	size_t            read_size;
 	void*             unpacked = NULL;
 	size_t            unpack_size;
 
-	iter_t iter;
-
+	// note: this may be called from an I/O thread.  the package file handle is shared,
+	//       so the seek and read need to happen under the lock; the inflate doesn't.
 	console_log(3, "unpacking '%s' from package #%u", path, package->id);
 
-	iter = vector_enum(package->index);
-	while ((entry = iter_next(&iter))) {
-		if (strcasecmp(path, entry->file_path) == 0)
-			break;
-	}
-	if (entry == NULL)
+	if (!(entry = find_entry(package, path)))
 		goto on_error;
 	if (!(packdata = malloc(entry->pack_size)))
 		goto on_error;
+	al_lock_mutex(package->mutex);
 	al_fseek(package->file, entry->offset, ALLEGRO_SEEK_SET);
-	if (al_fread(package->file, packdata, entry->pack_size) < entry->pack_size)
+	read_size = al_fread(package->file, packdata, entry->pack_size);
+	al_unlock_mutex(package->mutex);
+	if (read_size < entry->pack_size)
 		goto on_error;
+	counter_add_shared(COUNTER_BYTES_READ, (unsigned int)entry->pack_size);
 	if (!(unpacked = z_inflate(packdata, entry->pack_size, entry->file_size, &unpack_size)))
 		goto on_error;
 	free(packdata);
@@ -433,11 +461,48 @@ on_error:
 long long
 asset_ftell(asset_t* file)
 {
+	if (!unpack_asset(file))
+		return -1;
 	return al_ftell(file->handle);
 }
 
 size_t
 asset_fwrite(const void* buf, size_t size, size_t count, asset_t* file)
 {
+	if (file->handle == NULL)
+		return 0;
 	return al_fwrite(file->handle, buf, size * count) / size;
 }
+
+static struct spk_entry*
+find_entry(package_t* package, const char* path)
+{
+	struct spk_entry* entry;
+
+	iter_t iter;
+
+	iter = vector_enum(package->index);
+	while ((entry = iter_next(&iter))) {
+		if (strcasecmp(path, entry->file_path) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+static bool
+unpack_asset(asset_t* asset)
+{
+	void*  buffer;
+	size_t file_size;
+
+	if (asset->handle != NULL)
+		return true;
+	if (!(buffer = asset_fslurp(asset->package, asset->filename, &file_size)))
+		return false;
+	if (!(asset->handle = al_open_memfile(buffer, file_size, "rb"))) {
+		free(buffer);
+		return false;
+	}
+	asset->buffer = buffer;
+	return true;
+}
@@ -38,6 +38,7 @@
 #include "color.h"
 #include "compress.h"
 #include "console.h"
+#include "counter.h"
 #include "debugger.h"
 #include "dispatch.h"
 #include "encoding.h"
@@ -46,13 +47,22 @@
 #include "image.h"
 #include "input.h"
 #include "jsal.h"
+#include "pacer.h"
 #include "profiler.h"
+#include "render.h"
 #include "sockets.h"
+#include "sprite_batch.h"
+#include "thread_pool.h"
 #include "unicode.h"
+#include "worker.h"
 #include "xoroshiro.h"
 
 #define API_VERSION 2
 
+// uniform handles encode the owning shader's ID along with the slot number, so
+// a handle can't be used with a shader it wasn't resolved against.
+#define MAX_UNIFORM_SLOTS 65536
+
 enum file_op
 {
 	FILE_OP_READ,
@@ -61,6 +71,24 @@ enum file_op
 	FILE_OP_MAX,
 };
 
+struct file_task
+{
+	void*      buffer;
+	bool       disposed;
+	file_t*    file;
+	char*      pathname;
+	bool       read_all;
+	js_ref_t*  rejector;
+	js_ref_t*  resolver;
+	size_t     size;
+	js_ref_t*  stream;
+	void*      stream_data;
+	bool       succeeded;
+	lstring_t* text;
+	bool       text_mode;
+	bool       writing;
+};
+
 static const
 struct x11_color
 {
@@ -226,12 +254,24 @@ static bool js_Sphere_get_Compiler           (int num_args, bool is_ctor, intptr
 static bool js_Sphere_get_Engine             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_Game               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_Version            (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_counters           (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_frameRate          (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_frameSkip          (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_frameStats         (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_fullScreen         (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_heapLimit          (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_heapSize           (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_renderStats        (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_surfacePool        (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_surfacePoolSize    (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_textureBudget      (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_textureMemory      (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_set_frameRate          (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_set_frameSkip          (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_set_fullScreen         (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_set_heapLimit          (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_set_surfacePoolSize    (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_set_textureBudget      (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_abort                  (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_now                    (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_restart                (int num_args, bool is_ctor, intptr_t magic);
@@ -267,6 +307,7 @@ static bool js_Dispatch_cancelAll            (int num_args, bool is_ctor, intptr
 static bool js_Dispatch_later                (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Dispatch_now                  (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Dispatch_onExit               (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Dispatch_onIdle               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Dispatch_onRender             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Dispatch_onUpdate             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FS_createDirectory            (int num_args, bool is_ctor, intptr_t magic);
@@ -276,10 +317,12 @@ static bool js_FS_evaluateScript             (int num_args, bool is_ctor, intptr
 static bool js_FS_fileExists                 (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FS_fullPath                   (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FS_readFile                   (int num_args, bool is_ctor, intptr_t magic);
+static bool js_FS_readFileAsync              (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FS_relativePath               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FS_rename                     (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FS_removeDirectory            (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FS_writeFile                  (int num_args, bool is_ctor, intptr_t magic);
+static bool js_FS_writeFileAsync             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_FileStream                (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FileStream_dispose            (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FileStream_get_fileName       (int num_args, bool is_ctor, intptr_t magic);
@@ -287,7 +330,9 @@ static bool js_FileStream_get_fileSize       (int num_args, bool is_ctor, intptr
 static bool js_FileStream_get_position       (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FileStream_set_position       (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FileStream_read               (int num_args, bool is_ctor, intptr_t magic);
+static bool js_FileStream_readAsync          (int num_args, bool is_ctor, intptr_t magic);
 static bool js_FileStream_write              (int num_args, bool is_ctor, intptr_t magic);
+static bool js_FileStream_writeAsync         (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Font_get_Default              (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_Font                      (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Font_get_fileName             (int num_args, bool is_ctor, intptr_t magic);
@@ -296,6 +341,7 @@ static bool js_Font_drawText                 (int num_args, bool is_ctor, intptr
 static bool js_Font_getTextSize              (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Font_wordWrap                 (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_IndexList                 (int num_args, bool is_ctor, intptr_t magic);
+static bool js_IndexList_update              (int num_args, bool is_ctor, intptr_t magic);
 static bool js_JobToken_cancel               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_JobToken_pause_resume         (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Joystick_get_Null             (int num_args, bool is_ctor, intptr_t magic);
@@ -313,6 +359,7 @@ static bool js_Keyboard_charOf               (int num_args, bool is_ctor, intptr
 static bool js_Keyboard_clearQueue           (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Keyboard_getKey               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Keyboard_isPressed            (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Math_random                   (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Mixer_get_Default             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_Mixer                     (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Mixer_get_volume              (int num_args, bool is_ctor, intptr_t magic);
@@ -323,6 +370,7 @@ static bool js_Model_get_transform           (int num_args, bool is_ctor, intptr
 static bool js_Model_set_shader              (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Model_set_transform           (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Model_draw                    (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Model_drawInstanced           (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Mouse_get_Default             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Mouse_get_x                   (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Mouse_get_y                   (int num_args, bool is_ctor, intptr_t magic);
@@ -351,6 +399,7 @@ static bool js_Server_accept                 (int num_args, bool is_ctor, intptr
 static bool js_Shader_get_Default            (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_Shader                    (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Shader_clone                  (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Shader_getUniform             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Shader_setBoolean             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Shader_setColorVector         (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Shader_setFloat               (int num_args, bool is_ctor, intptr_t magic);
@@ -369,6 +418,7 @@ static bool js_Shape_set_indexList           (int num_args, bool is_ctor, intptr
 static bool js_Shape_set_texture             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Shape_set_vertexList          (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Shape_draw                    (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Shape_drawInstanced           (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_Socket                    (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Socket_get_bytesPending       (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Socket_get_connected          (int num_args, bool is_ctor, intptr_t magic);
@@ -402,11 +452,21 @@ static bool js_SoundStream_pause             (int num_args, bool is_ctor, intptr
 static bool js_SoundStream_stop              (int num_args, bool is_ctor, intptr_t magic);
 static bool js_SoundStream_write             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Surface_get_Screen            (int num_args, bool is_ctor, intptr_t magic);
+static bool js_new_SpriteBatch               (int num_args, bool is_ctor, intptr_t magic);
+static void js_SpriteBatch_finalize          (void* host_ptr);
+static bool js_SpriteBatch_get_blendOp       (int num_args, bool is_ctor, intptr_t magic);
+static bool js_SpriteBatch_get_length        (int num_args, bool is_ctor, intptr_t magic);
+static bool js_SpriteBatch_set_blendOp       (int num_args, bool is_ctor, intptr_t magic);
+static bool js_SpriteBatch_add               (int num_args, bool is_ctor, intptr_t magic);
+static bool js_SpriteBatch_clear             (int num_args, bool is_ctor, intptr_t magic);
+static bool js_SpriteBatch_draw              (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Surface_get_blendOp           (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Surface_get_deferred          (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Surface_get_height            (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Surface_get_transform         (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Surface_get_width             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Surface_set_blendOp           (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Surface_set_deferred          (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Surface_set_transform         (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Surface_clipTo                (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Surface_toTexture             (int num_args, bool is_ctor, intptr_t magic);
@@ -435,6 +495,11 @@ static bool js_Transform_rotate              (int num_args, bool is_ctor, intptr
 static bool js_Transform_scale               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Transform_translate           (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_VertexList                (int num_args, bool is_ctor, intptr_t magic);
+static bool js_VertexList_update             (int num_args, bool is_ctor, intptr_t magic);
+static bool js_new_Worker                    (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Worker_poll                   (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Worker_postMessage            (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Worker_terminate              (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Z_deflate                     (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Z_inflate                     (int num_args, bool is_ctor, intptr_t magic);
 
@@ -460,35 +525,56 @@ static void js_TextEncoder_finalize     (void* host_ptr);
 static void js_Texture_finalize         (void* host_ptr);
 static void js_Transform_finalize       (void* host_ptr);
 static void js_VertexList_finalize      (void* host_ptr);
-
-static void      cache_value_to_this         (const char* key);
-static void      create_joystick_objects     (void);
-static path_t*   find_module_file            (const char* id, const char* origin, const char* sys_origin, bool es6_mode);
-static bool      handle_main_event_loop      (int num_args, bool is_ctor, intptr_t magic);
-static void      handle_module_import        (void);
-static void      jsal_pegasus_push_color     (color_t color, bool in_ctor);
-static void      jsal_pegasus_push_job_token (int64_t token);
-static void      jsal_pegasus_push_require   (const char* module_id);
-static color_t   jsal_pegasus_require_color  (int index);
-static script_t* jsal_pegasus_require_script (int index);
-static path_t*   load_package_json           (const char* filename);
+static void js_Worker_finalize          (void* host_ptr);
+
+static void            cache_value_to_this           (const char* key);
+static void            create_joystick_objects       (void);
+static void            defer_worker_poll             (int object_index, int timeout);
+static path_t*         find_module_file              (const char* id, const char* origin, const char* sys_origin, bool es6_mode);
+static void            finish_file_task              (void* userdata);
+static bool            handle_main_event_loop        (int num_args, bool is_ctor, intptr_t magic);
+static void            handle_module_import          (void);
+static void            jsal_pegasus_push_color       (color_t color, bool in_ctor);
+static void            jsal_pegasus_push_job_token   (int64_t token);
+static void            jsal_pegasus_push_require     (const char* module_id);
+static color_t         jsal_pegasus_require_color     (int index);
+static uint16_t*       jsal_pegasus_require_indices   (int index, int *out_num_indices);
+static instance_t*     jsal_pegasus_require_instances (int index, int *out_num_instances);
+static script_t*       jsal_pegasus_require_script    (int index);
+static int             jsal_pegasus_require_slot      (int index, shader_t* shader);
+static ALLEGRO_VERTEX* jsal_pegasus_require_vertices  (int index, int *out_num_vertices);
+static path_t*         load_package_json              (const char* filename);
+static void            push_file_task                (struct file_task* task);
+static void            run_file_task                 (void* userdata);
+static void            take_file_stream              (struct file_task* task, int stream_index);
 
 static int       s_api_level;
 static int       s_api_level_nominal;
 static mixer_t*  s_def_mixer;
 static int       s_frame_rate = 60;
+static xoro_t*   s_math_rng = NULL;
 static int       s_next_module_id = 1;
 static js_ref_t* s_screen_obj;
 static bool      s_shutting_down = false;
+static vector_t* s_stream_tasks;
 
+static uint16_t*       s_index_scratch = NULL;
+static int             s_index_scratch_size = 0;
+static ALLEGRO_VERTEX* s_vertex_scratch = NULL;
+static int             s_vertex_scratch_size = 0;
+
+static js_ref_t* s_key_budget;
 static js_ref_t* s_key_color;
 static js_ref_t* s_key_done;
+static js_ref_t* s_key_height;
 static js_ref_t* s_key_inBackground;
+static js_ref_t* s_key_key;
 static js_ref_t* s_key_priority;
 static js_ref_t* s_key_stack;
 static js_ref_t* s_key_u;
 static js_ref_t* s_key_v;
 static js_ref_t* s_key_value;
+static js_ref_t* s_key_width;
 static js_ref_t* s_key_x;
 static js_ref_t* s_key_y;
 static js_ref_t* s_key_z;
@@ -502,6 +588,7 @@ pegasus_init(int api_level)
 
 	s_api_level = api_level;
 	s_def_mixer = mixer_new(44100, 16, 2);
+	s_stream_tasks = vector_new(sizeof(struct file_task*));
 	
 	// only advertise highest stable API level; games must test for experimental
 	// features on an individual basis.
@@ -511,14 +598,18 @@ pegasus_init(int api_level)
 
 	jsal_on_import_module(handle_module_import);
 
+	s_key_budget = jsal_new_key("budget");
 	s_key_color = jsal_new_key("color");
 	s_key_done = jsal_new_key("done");
+	s_key_height = jsal_new_key("height");
 	s_key_inBackground = jsal_new_key("inBackground");
+	s_key_key = jsal_new_key("key");
 	s_key_priority = jsal_new_key("priority");
 	s_key_stack = jsal_new_key("stack");
 	s_key_u = jsal_new_key("u");
 	s_key_v = jsal_new_key("v");
 	s_key_value = jsal_new_key("value");
+	s_key_width = jsal_new_key("width");
 	s_key_x = jsal_new_key("x");
 	s_key_y = jsal_new_key("y");
 	s_key_z = jsal_new_key("z");
@@ -536,6 +627,13 @@ pegasus_init(int api_level)
 	jsal_def_prop_string(-2, "require");
 	jsal_pop(1);
 
+	// when recording or replaying input, Math.random() is driven by a seed logged
+	// in the input script so the game sees the same random numbers every run.
+	if (is_input_deterministic()) {
+		s_math_rng = xoro_new(get_random_seed());
+		api_define_function("Math", "random", js_Math_random, 0);
+	}
+
 	// initialize the Sphere v2 API
 	api_define_function(NULL, "print", js_SSj_log, KI_LOG_NORMAL);
 	api_define_static_prop("Sphere", "APILevel", js_Sphere_get_APILevel, NULL);
@@ -847,11 +945,40 @@ pegasus_init(int api_level)
 	if (api_level >= 2) {
 		api_define_method("JobToken", "pause", js_JobToken_pause_resume, (intptr_t)true);
 		api_define_method("JobToken", "resume", js_JobToken_pause_resume, (intptr_t)false);
+		api_define_method("IndexList", "update", js_IndexList_update, 0);
+		api_define_method("Model", "drawInstanced", js_Model_drawInstanced, 0);
+		api_define_method("Shader", "getUniform", js_Shader_getUniform, 0);
+		api_define_method("VertexList", "update", js_VertexList_update, 0);
 		api_define_function("Dispatch", "onExit", js_Dispatch_onExit, 0);
+		api_define_function("Dispatch", "onIdle", js_Dispatch_onIdle, 0);
+		api_define_method("FileStream", "readAsync", js_FileStream_readAsync, 0);
+		api_define_method("FileStream", "writeAsync", js_FileStream_writeAsync, 0);
+		api_define_function("FS", "readFileAsync", js_FS_readFileAsync, 0);
+		api_define_function("FS", "writeFileAsync", js_FS_writeFileAsync, 0);
 		api_define_function("Shape", "drawImmediate", js_Shape_drawImmediate, 0);
+		api_define_method("Shape", "drawInstanced", js_Shape_drawInstanced, 0);
+		api_define_static_prop("Sphere", "counters", js_Sphere_get_counters, NULL);
+		api_define_static_prop("Sphere", "frameStats", js_Sphere_get_frameStats, NULL);
+		api_define_static_prop("Sphere", "heapLimit", js_Sphere_get_heapLimit, js_Sphere_set_heapLimit);
+		api_define_static_prop("Sphere", "heapSize", js_Sphere_get_heapSize, NULL);
+		api_define_static_prop("Sphere", "renderStats", js_Sphere_get_renderStats, NULL);
+		api_define_static_prop("Sphere", "surfacePool", js_Sphere_get_surfacePool, NULL);
+		api_define_static_prop("Sphere", "surfacePoolSize", js_Sphere_get_surfacePoolSize, js_Sphere_set_surfacePoolSize);
+		api_define_static_prop("Sphere", "textureBudget", js_Sphere_get_textureBudget, js_Sphere_set_textureBudget);
+		api_define_static_prop("Sphere", "textureMemory", js_Sphere_get_textureMemory, NULL);
+		api_define_class("SpriteBatch", PEGASUS_SPRITE_BATCH, js_new_SpriteBatch, js_SpriteBatch_finalize, 0);
+		api_define_property("SpriteBatch", "blendOp", false, js_SpriteBatch_get_blendOp, js_SpriteBatch_set_blendOp);
+		api_define_property("SpriteBatch", "length", false, js_SpriteBatch_get_length, NULL);
+		api_define_method("SpriteBatch", "add", js_SpriteBatch_add, 0);
+		api_define_method("SpriteBatch", "clear", js_SpriteBatch_clear, 0);
+		api_define_method("SpriteBatch", "draw", js_SpriteBatch_draw, 0);
 		api_define_property("Surface", "blendOp", false, js_Surface_get_blendOp, js_Surface_set_blendOp);
+		api_define_property("Surface", "deferred", false, js_Surface_get_deferred, js_Surface_set_deferred);
 		api_define_method("Texture", "download", js_Texture_download, 0);
 		api_define_method("Texture", "upload", js_Texture_upload, 0);
+		api_define_class("Worker", PEGASUS_WORKER, js_new_Worker, js_Worker_finalize, 0);
+		api_define_method("Worker", "postMessage", js_Worker_postMessage, 0);
+		api_define_method("Worker", "terminate", js_Worker_terminate, 0);
 		api_define_function("Z", "deflate", js_Z_deflate, 0);
 		api_define_function("Z", "inflate", js_Z_inflate, 0);
 
@@ -895,19 +1022,28 @@ pegasus_uninit(void)
 {
 	jsal_unref(s_screen_obj);
 
+	jsal_unref(s_key_budget);
 	jsal_unref(s_key_color);
 	jsal_unref(s_key_done);
+	jsal_unref(s_key_height);
 	jsal_unref(s_key_inBackground);
+	jsal_unref(s_key_key);
 	jsal_unref(s_key_priority);
 	jsal_unref(s_key_stack);
 	jsal_unref(s_key_u);
 	jsal_unref(s_key_v);
 	jsal_unref(s_key_value);
+	jsal_unref(s_key_width);
 	jsal_unref(s_key_x);
 	jsal_unref(s_key_y);
 	jsal_unref(s_key_z);
 
+	free(s_index_scratch);
+	free(s_vertex_scratch);
 	mixer_unref(s_def_mixer);
+	vector_free(s_stream_tasks);
+	if (s_math_rng != NULL)
+		xoro_unref(s_math_rng);
 }
 
 bool
@@ -1106,12 +1242,151 @@ jsal_pegasus_require_color(int index)
 	return *color_ptr;
 }
 
+static uint16_t*
+jsal_pegasus_require_indices(int index, int *out_num_indices)
+{
+	void*  data;
+	size_t data_size;
+	int    num_indices;
+	int    value;
+
+	int i;
+
+	// note: a Uint16Array or ArrayBuffer is used in place, without copying.
+	//       arrays are converted into a scratch buffer which is only valid until
+	//       the next call.
+	index = jsal_normalize_index(index);
+	if (jsal_is_buffer(index)) {
+		if (jsal_get_buffer_type(index) != JS_UINT16ARRAY && jsal_get_buffer_type(index) != JS_ARRAYBUFFER)
+			jsal_error(JS_TYPE_ERROR, "Expected a Uint16Array or ArrayBuffer");
+		data = jsal_get_buffer_ptr(index, &data_size);
+		if (data_size % sizeof(uint16_t) != 0)
+			jsal_error(JS_RANGE_ERROR, "Buffer size '%zu' is not a multiple of 2", data_size);
+		*out_num_indices = (int)(data_size / sizeof(uint16_t));
+		return data;
+	}
+
+	if (!jsal_is_array(index))
+		jsal_error(JS_TYPE_ERROR, "Expected an array or Uint16Array");
+	num_indices = jsal_get_length(index);
+	if (num_indices > s_index_scratch_size) {
+		s_index_scratch = realloc(s_index_scratch, num_indices * sizeof(uint16_t));
+		s_index_scratch_size = num_indices;
+	}
+	for (i = 0; i < num_indices; ++i) {
+		jsal_get_prop_index(index, i);
+		value = jsal_require_int(-1);
+		if (value < 0 || value > UINT16_MAX)
+			jsal_error(JS_RANGE_ERROR, "Index value out of range '%d'", value);
+		s_index_scratch[i] = (uint16_t)value;
+		jsal_pop(1);
+	}
+	*out_num_indices = num_indices;
+	return s_index_scratch;
+}
+
+static instance_t*
+jsal_pegasus_require_instances(int index, int *out_num_instances)
+{
+	void*  data;
+	size_t data_size;
+
+	// note: instance data is 9 floats per instance (x, y, scaleX, scaleY, angle,
+	//       r, g, b, a) and is always used in place.
+	index = jsal_normalize_index(index);
+	if (!jsal_is_buffer(index))
+		jsal_error(JS_TYPE_ERROR, "Expected a Float32Array or ArrayBuffer");
+	if (jsal_get_buffer_type(index) != JS_FLOAT32ARRAY && jsal_get_buffer_type(index) != JS_ARRAYBUFFER)
+		jsal_error(JS_TYPE_ERROR, "Expected a Float32Array or ArrayBuffer");
+	data = jsal_get_buffer_ptr(index, &data_size);
+	if (data_size % sizeof(instance_t) != 0)
+		jsal_error(JS_RANGE_ERROR, "Buffer size '%zu' is not a multiple of %d", data_size, (int)sizeof(instance_t));
+	*out_num_instances = (int)(data_size / sizeof(instance_t));
+	return data;
+}
+
 static script_t*
 jsal_pegasus_require_script(int index)
 {
 	return script_new_function(index);
 }
 
+static int
+jsal_pegasus_require_slot(int index, shader_t* shader)
+{
+	double       handle;
+	unsigned int owner_id;
+	int          slot;
+
+	// uniforms can be specified either by name or by a handle previously obtained
+	// from Shader#getUniform().  using a handle avoids the name lookup.
+	if (jsal_is_number(index)) {
+		handle = jsal_require_number(index);
+		if (handle < 0.0 || handle != floor(handle) || handle >= (double)UINT_MAX * MAX_UNIFORM_SLOTS)
+			jsal_error(JS_TYPE_ERROR, "Invalid uniform handle '%g'", handle);
+		owner_id = (unsigned int)(handle / MAX_UNIFORM_SLOTS);
+		slot = (int)fmod(handle, MAX_UNIFORM_SLOTS);
+		if (owner_id == 0 || shader_slot_owner(shader, slot) != owner_id)
+			jsal_error(JS_TYPE_ERROR, "Uniform handle '%g' doesn't belong to this shader", handle);
+	}
+	else {
+		if ((slot = shader_uniform_slot(shader, jsal_require_string(index))) < 0)
+			jsal_error(JS_ERROR, "Couldn't allocate uniform slot");
+	}
+	return slot;
+}
+
+static ALLEGRO_VERTEX*
+jsal_pegasus_require_vertices(int index, int *out_num_vertices)
+{
+	void*           data;
+	size_t          data_size;
+	int             item_idx;
+	int             num_vertices;
+	ALLEGRO_VERTEX* vertex;
+
+	int i;
+
+	// note: the layout of ALLEGRO_VERTEX is 9 floats (x, y, z, u, v, r, g, b, a),
+	//       so a Float32Array in that format can be used in place.  arrays of
+	//       vertex objects are converted into a scratch buffer which is only valid
+	//       until the next call.
+	index = jsal_normalize_index(index);
+	if (jsal_is_buffer(index)) {
+		if (jsal_get_buffer_type(index) != JS_FLOAT32ARRAY && jsal_get_buffer_type(index) != JS_ARRAYBUFFER)
+			jsal_error(JS_TYPE_ERROR, "Expected a Float32Array or ArrayBuffer");
+		data = jsal_get_buffer_ptr(index, &data_size);
+		if (data_size % sizeof(ALLEGRO_VERTEX) != 0)
+			jsal_error(JS_RANGE_ERROR, "Buffer size '%zu' is not a multiple of %d", data_size, (int)sizeof(ALLEGRO_VERTEX));
+		*out_num_vertices = (int)(data_size / sizeof(ALLEGRO_VERTEX));
+		return data;
+	}
+
+	jsal_require_array(index);
+	num_vertices = jsal_get_length(index);
+	if (num_vertices > s_vertex_scratch_size) {
+		s_vertex_scratch = realloc(s_vertex_scratch, num_vertices * sizeof(ALLEGRO_VERTEX));
+		s_vertex_scratch_size = num_vertices;
+	}
+	for (i = 0; i < num_vertices; ++i) {
+		vertex = &s_vertex_scratch[i];
+		jsal_get_prop_index(index, i);
+		jsal_require_object_coercible(-1);
+		item_idx = jsal_normalize_index(-1);
+		vertex->x = jsal_get_prop_key(item_idx, s_key_x) ? jsal_require_number(-1) : 0.0f;
+		vertex->y = jsal_get_prop_key(item_idx, s_key_y) ? jsal_require_number(-1) : 0.0f;
+		vertex->z = jsal_get_prop_key(item_idx, s_key_z) ? jsal_require_number(-1) : 0.0f;
+		vertex->u = jsal_get_prop_key(item_idx, s_key_u) ? jsal_require_number(-1) : 0.0f;
+		vertex->v = jsal_get_prop_key(item_idx, s_key_v) ? jsal_require_number(-1) : 0.0f;
+		vertex->color = jsal_get_prop_key(item_idx, s_key_color)
+			? nativecolor(jsal_pegasus_require_color(-1))
+			: al_map_rgba_f(1.0f, 1.0f, 1.0f, 1.0f);
+		jsal_pop(7);
+	}
+	*out_num_vertices = num_vertices;
+	return s_vertex_scratch;
+}
+
 static void
 cache_value_to_this(const char* key)
 {
@@ -1143,6 +1418,22 @@ create_joystick_objects(void)
 	jsal_pop(1);
 }
 
+static void
+defer_worker_poll(int object_index, int timeout)
+{
+	script_t* script;
+
+	object_index = jsal_normalize_index(object_index);
+	jsal_push_new_function(js_Worker_poll, "poll", 0, 0);
+	jsal_get_prop_string(-1, "bind");
+	jsal_pull(-2);
+	jsal_dup(object_index);
+	jsal_call_method(1);
+	script = script_new_function(-1);
+	jsal_pop(1);
+	dispatch_defer(script, timeout, JOB_ON_UPDATE, false);
+}
+
 static path_t*
 find_module_file(const char* id, const char* origin, const char* sys_origin, bool es6_mode)
 {
@@ -1215,6 +1506,67 @@ find_module_file(const char* id, const char* origin, const char* sys_origin, boo
 	return NULL;
 }
 
+static void
+finish_file_task(void* userdata)
+{
+	void*             buffer;
+	struct file_task* task;
+
+	iter_t iter;
+
+	task = userdata;
+
+	if (task->stream != NULL) {
+		// hand the file back to the FileStream.  if the stream was disposed while the
+		// task was in flight, close the file instead.
+		iter = vector_enum(s_stream_tasks);
+		while (iter_next(&iter)) {
+			if (*(struct file_task**)iter.ptr == task)
+				iter_remove(&iter);
+		}
+		if (!task->disposed) {
+			jsal_push_ref_weak(task->stream);
+			jsal_set_class_ptr(-1, task->file);
+			jsal_pop(1);
+		}
+		else {
+			file_close(task->file);
+		}
+		jsal_unref(task->stream);
+	}
+	else {
+		file_close(task->file);
+	}
+
+	if (task->succeeded) {
+		jsal_push_ref_weak(task->resolver);
+		if (task->writing) {
+			jsal_push_undefined();
+		}
+		else if (task->text_mode) {
+			jsal_push_lstring_t(task->text);
+		}
+		else {
+			jsal_push_new_buffer(JS_ARRAYBUFFER, task->size, &buffer);
+			memcpy(buffer, task->buffer, task->size);
+		}
+	}
+	else {
+		jsal_push_ref_weak(task->rejector);
+		jsal_push_new_error(JS_ERROR, "Couldn't %s file '%s'",
+			task->writing ? "write to" : "read from", task->pathname);
+	}
+	jsal_call(1);
+	jsal_pop(1);
+
+	jsal_unref(task->rejector);
+	jsal_unref(task->resolver);
+	lstr_free(task->text);
+	free(task->buffer);
+	free(task->pathname);
+	free(task);
+}
+
 static bool
 handle_main_event_loop(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -1225,12 +1577,13 @@ handle_main_event_loop(int num_args, bool is_ctor, intptr_t magic)
 	//    - promise continuations (e.g. await completion or .then())
 	//    - JS module loader jobs
 	//    - unhandled promise rejections
+	//    - async file operations still in progress
 
 	// Sphere v1 exit paths disable the JavaScript VM to force the engine to
 	// bail, so we need to re-enable it here.
 	jsal_enable_vm(true);
 
-	while (dispatch_busy() || jsal_busy())
+	while (dispatch_busy() || jsal_busy() || thread_pool_busy())
 		sphere_tick(2, true, s_frame_rate);
 
 	// deal with Dispatch.onExit() jobs
@@ -1238,7 +1591,7 @@ handle_main_event_loop(int num_args, bool is_ctor, intptr_t magic)
 	//       bailout; we'll need to re-enable it if so.
 	jsal_enable_vm(true);
 	s_shutting_down = true;
-	while (!dispatch_can_exit() || jsal_busy()) {
+	while (!dispatch_can_exit() || jsal_busy() || thread_pool_busy()) {
 		sphere_heartbeat(true, 2);
 		dispatch_run(JOB_ON_TICK);
 		dispatch_run(JOB_ON_EXIT);
@@ -1351,6 +1704,70 @@ on_error:
 	return NULL;
 }
 
+static void
+push_file_task(struct file_task* task)
+{
+	// note: the task must not be touched after this returns; it belongs to the thread
+	//       pool until its finish callback runs.
+	jsal_push_new_promise(&task->resolver, &task->rejector);
+	if (!thread_pool_push(run_file_task, finish_file_task, task)) {
+		task->succeeded = false;
+		finish_file_task(task);
+	}
+}
+
+static void
+run_file_task(void* userdata)
+{
+	// IMPORTANT: this runs on a pool thread, so it can't touch JavaScript or any
+	//            engine state other than the file itself.
+
+	long long         file_size;
+	long long         position = 0;
+	struct file_task* task;
+
+	task = userdata;
+
+	if (task->writing) {
+		if (task->text != NULL)
+			task->succeeded = file_write(task->file, lstr_cstr(task->text), lstr_len(task->text), 1) == lstr_len(task->text);
+		else
+			task->succeeded = file_write(task->file, task->buffer, task->size, 1) == task->size;
+		return;
+	}
+
+	if (task->read_all) {
+		position = file_position(task->file);
+		file_seek(task->file, 0, WHENCE_END);
+		if ((file_size = file_position(task->file)) < 0)
+			return;
+		task->size = (size_t)file_size;
+		file_seek(task->file, 0, WHENCE_SET);
+	}
+	if (!(task->buffer = malloc(task->size + 1)))
+		return;
+	task->size = file_read(task->file, task->buffer, task->size, 1);
+	if (task->read_all)
+		file_seek(task->file, position, WHENCE_SET);
+	if (task->text_mode) {
+		// decoding the text can be expensive for large files, so do that here too.
+		if (!(task->text = lstr_from_utf8(task->buffer, task->size, true)))
+			return;
+	}
+	task->succeeded = true;
+}
+
+static void
+take_file_stream(struct file_task* task, int stream_index)
+{
+	// while an async operation is pending, the FileStream's file pointer is cleared so
+	// that it can't be used from the main thread at the same time.
+	task->stream = jsal_ref(stream_index);
+	task->stream_data = jsal_get_host_data(stream_index);
+	jsal_set_class_ptr(stream_index, NULL);
+	vector_push(s_stream_tasks, &task);
+}
+
 static bool
 js_require(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -1430,6 +1847,19 @@ js_Sphere_get_Version(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_Sphere_get_counters(int num_args, bool is_ctor, intptr_t magic)
+{
+	int i;
+
+	jsal_push_new_object();
+	for (i = 0; i < COUNTER_MAX; ++i) {
+		jsal_push_number(counter_value(i));
+		jsal_put_prop_string(-2, counter_name(i));
+	}
+	return true;
+}
+
 static bool
 js_Sphere_get_frameRate(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -1446,6 +1876,44 @@ js_Sphere_get_frameSkip(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_Sphere_get_frameStats(int num_args, bool is_ctor, intptr_t magic)
+{
+	pacer_stats_t stats;
+
+	int i, j;
+
+	stats = pacer_stats();
+	jsal_push_new_object();
+	jsal_push_number(stats.num_frames);
+	jsal_put_prop_string(-2, "frames");
+	jsal_push_number(stats.num_skipped);
+	jsal_put_prop_string(-2, "skipped");
+	jsal_push_new_array();
+	for (i = 0; i < PACER_NUM_BUCKETS; ++i) {
+		jsal_push_number(pacer_bucket_limit(i));
+		jsal_put_prop_index(-2, i);
+	}
+	jsal_put_prop_string(-2, "buckets");
+	for (i = 0; i < PACER_MAX; ++i) {
+		jsal_push_new_object();
+		jsal_push_number(stats.num_frames > 0
+			? stats.total_time[i] / stats.num_frames * 1000.0
+			: 0.0);
+		jsal_put_prop_string(-2, "average");
+		jsal_push_number(stats.max_time[i] * 1000.0);
+		jsal_put_prop_string(-2, "max");
+		jsal_push_new_array();
+		for (j = 0; j < PACER_NUM_BUCKETS; ++j) {
+			jsal_push_number(stats.histogram[i][j]);
+			jsal_put_prop_index(-2, j);
+		}
+		jsal_put_prop_string(-2, "histogram");
+		jsal_put_prop_string(-2, pacer_phase_name(i));
+	}
+	return true;
+}
+
 static bool
 js_Sphere_get_fullScreen(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -1453,6 +1921,97 @@ js_Sphere_get_fullScreen(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_Sphere_get_heapLimit(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_push_number((double)jsal_stats().memory_limit);
+	return true;
+}
+
+static bool
+js_Sphere_get_heapSize(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_push_number((double)jsal_stats().heap_size);
+	return true;
+}
+
+static bool
+js_Sphere_get_renderStats(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_push_new_object();
+	jsal_push_int(render_stat(RENDER_STAT_DRAWS));
+	jsal_put_prop_string(-2, "drawCalls");
+	jsal_push_int(render_stat(RENDER_STAT_BLEND));
+	jsal_put_prop_string(-2, "blendChanges");
+	jsal_push_int(render_stat(RENDER_STAT_CLIP));
+	jsal_put_prop_string(-2, "clipChanges");
+	jsal_push_int(render_stat(RENDER_STAT_SHADER));
+	jsal_put_prop_string(-2, "shaderChanges");
+	jsal_push_int(render_stat(RENDER_STAT_TARGET));
+	jsal_put_prop_string(-2, "targetChanges");
+	jsal_push_int(render_stat(RENDER_STAT_TRANSFORM));
+	jsal_put_prop_string(-2, "transformChanges");
+	jsal_push_int(render_stat(RENDER_STAT_SKIPPED));
+	jsal_put_prop_string(-2, "skippedChanges");
+	jsal_push_int(render_stat(RENDER_STAT_QUEUED));
+	jsal_put_prop_string(-2, "queuedDraws");
+	jsal_push_int(render_stat(RENDER_STAT_FLUSHED));
+	jsal_put_prop_string(-2, "flushedDraws");
+	return true;
+}
+
+static bool
+js_Sphere_get_surfacePool(int num_args, bool is_ctor, intptr_t magic)
+{
+	image_pool_stats_t stats;
+
+	stats = image_pool_stats();
+	jsal_push_new_object();
+	jsal_push_number(stats.hits);
+	jsal_put_prop_string(-2, "hits");
+	jsal_push_number(stats.misses);
+	jsal_put_prop_string(-2, "misses");
+	jsal_push_int(stats.num_bitmaps);
+	jsal_put_prop_string(-2, "count");
+	jsal_push_number((double)stats.num_bytes);
+	jsal_put_prop_string(-2, "size");
+	return true;
+}
+
+static bool
+js_Sphere_get_surfacePoolSize(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_push_number((double)image_pool_stats().max_bytes);
+	return true;
+}
+
+static bool
+js_Sphere_get_textureBudget(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_push_number((double)image_memory_stats().budget);
+	return true;
+}
+
+static bool
+js_Sphere_get_textureMemory(int num_args, bool is_ctor, intptr_t magic)
+{
+	image_memory_stats_t stats;
+
+	stats = image_memory_stats();
+	jsal_push_new_object();
+	jsal_push_int(stats.num_images);
+	jsal_put_prop_string(-2, "images");
+	jsal_push_number((double)stats.video_bytes);
+	jsal_put_prop_string(-2, "videoBytes");
+	jsal_push_number((double)stats.system_bytes);
+	jsal_put_prop_string(-2, "systemBytes");
+	jsal_push_number(stats.num_demotions);
+	jsal_put_prop_string(-2, "demotions");
+	jsal_push_number(stats.num_uploads);
+	jsal_put_prop_string(-2, "uploads");
+	return true;
+}
+
 static bool
 js_Sphere_set_frameRate(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -1493,6 +2052,45 @@ js_Sphere_set_fullScreen(int num_args, bool is_ctor, intptr_t magic)
 	return false;
 }
 
+static bool
+js_Sphere_set_heapLimit(int num_args, bool is_ctor, intptr_t magic)
+{
+	double max_bytes;
+
+	max_bytes = jsal_require_number(0);
+
+	if (max_bytes < 0.0 || max_bytes > SIZE_MAX)
+		jsal_error(JS_RANGE_ERROR, "Invalid heap limit '%g'", max_bytes);
+	jsal_set_memory_limit((size_t)max_bytes);
+	return false;
+}
+
+static bool
+js_Sphere_set_surfacePoolSize(int num_args, bool is_ctor, intptr_t magic)
+{
+	double max_bytes;
+
+	max_bytes = jsal_require_number(0);
+
+	if (max_bytes < 0.0 || max_bytes > SIZE_MAX)
+		jsal_error(JS_RANGE_ERROR, "Invalid surface pool size '%g'", max_bytes);
+	image_pool_set_limit((size_t)max_bytes);
+	return false;
+}
+
+static bool
+js_Sphere_set_textureBudget(int num_args, bool is_ctor, intptr_t magic)
+{
+	double max_bytes;
+
+	max_bytes = jsal_require_number(0);
+
+	if (max_bytes < 0.0 || max_bytes > SIZE_MAX)
+		jsal_error(JS_RANGE_ERROR, "Invalid texture budget '%g'", max_bytes);
+	image_set_texture_budget((size_t)max_bytes);
+	return false;
+}
+
 static bool
 js_Sphere_abort(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -2041,6 +2639,34 @@ js_Dispatch_onExit(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_Dispatch_onIdle(int num_args, bool is_ctor, intptr_t magic)
+{
+	double    budget = 1.0;
+	double    priority = 0.0;
+	script_t* script;
+	int64_t   token;
+
+	script = jsal_pegasus_require_script(0);
+	if (num_args >= 2) {
+		jsal_require_object_coercible(1);
+		if (jsal_get_prop_key(1, s_key_budget))
+			budget = jsal_require_number(-1);
+		if (jsal_get_prop_key(1, s_key_priority))
+			priority = jsal_require_number(-1);
+		jsal_pop(2);
+	}
+
+	if (budget <= 0.0)
+		jsal_error(JS_RANGE_ERROR, "Invalid idle budget '%g'", budget);
+	if (s_shutting_down)
+		jsal_error(JS_RANGE_ERROR, "Job creation not allowed during shutdown");
+	if (!(token = dispatch_idle(script, priority, budget / 1000.0)))
+		jsal_error(JS_ERROR, "Couldn't set up Dispatch job");
+	jsal_pegasus_push_job_token(token);
+	return true;
+}
+
 static bool
 js_Dispatch_onRender(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -2184,6 +2810,26 @@ js_FS_readFile(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_FS_readFileAsync(int num_args, bool is_ctor, intptr_t magic)
+{
+	file_t*           file;
+	const char*       pathname;
+	struct file_task* task;
+
+	pathname = jsal_require_pathname(0, NULL, false, false);
+
+	if (!(file = file_open(g_game, pathname, "rb")))
+		jsal_error(JS_ERROR, "Couldn't open file '%s' for reading", pathname);
+	task = calloc(1, sizeof(struct file_task));
+	task->file = file;
+	task->pathname = strdup(pathname);
+	task->read_all = true;
+	task->text_mode = true;
+	push_file_task(task);
+	return true;
+}
+
 static bool
 js_FS_relativePath(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -2245,6 +2891,30 @@ js_FS_writeFile(int num_args, bool is_ctor, intptr_t magic)
 	return false;
 }
 
+static bool
+js_FS_writeFileAsync(int num_args, bool is_ctor, intptr_t magic)
+{
+	file_t*           file;
+	const char*       pathname;
+	struct file_task* task;
+	lstring_t*        text;
+
+	pathname = jsal_require_pathname(0, NULL, false, true);
+	text = jsal_require_lstring_t(1);
+
+	if (!(file = file_open(g_game, pathname, "wb"))) {
+		lstr_free(text);
+		jsal_error(JS_ERROR, "Couldn't open file '%s' for writing", pathname);
+	}
+	task = calloc(1, sizeof(struct file_task));
+	task->file = file;
+	task->pathname = strdup(pathname);
+	task->text = text;
+	task->writing = true;
+	push_file_task(task);
+	return true;
+}
+
 static bool
 js_new_FileStream(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -2286,7 +2956,7 @@ js_FileStream_get_fileName(int num_args, bool is_ctor, intptr_t magic)
 
 	jsal_push_this();
 	if (!(file = jsal_require_class_obj(-1, PEGASUS_FILE_STREAM)))
-		jsal_error(JS_ERROR, "FileStream has already been disposed");
+		jsal_error(JS_ERROR, "FileStream is disposed or busy");
 
 	jsal_push_string(file_pathname(file));
 	return true;
@@ -2300,7 +2970,7 @@ js_FileStream_get_fileSize(int num_args, bool is_ctor, intptr_t magic)
 
 	jsal_push_this();
 	if (!(file = jsal_require_class_obj(-1, PEGASUS_FILE_STREAM)))
-		jsal_error(JS_ERROR, "FileStream has already been disposed");
+		jsal_error(JS_ERROR, "FileStream is disposed or busy");
 
 	file_pos = file_position(file);
 	file_seek(file, 0, WHENCE_END);
@@ -2316,7 +2986,7 @@ js_FileStream_get_position(int num_args, bool is_ctor, intptr_t magic)
 
 	jsal_push_this();
 	if (!(file = jsal_require_class_obj(-1, PEGASUS_FILE_STREAM)))
-		jsal_error(JS_ERROR, "FileStream has already been disposed");
+		jsal_error(JS_ERROR, "FileStream is disposed or busy");
 
 	jsal_push_number(file_position(file));
 	return true;
@@ -2330,7 +3000,7 @@ js_FileStream_set_position(int num_args, bool is_ctor, intptr_t magic)
 
 	jsal_push_this();
 	if (!(file = jsal_require_class_obj(-1, PEGASUS_FILE_STREAM)))
-		jsal_error(JS_ERROR, "FileStream has already been disposed");
+		jsal_error(JS_ERROR, "FileStream is disposed or busy");
 
 	new_pos = jsal_require_number(0);
 	file_seek(file, new_pos, WHENCE_SET);
@@ -2340,11 +3010,24 @@ js_FileStream_set_position(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_FileStream_dispose(int num_args, bool is_ctor, intptr_t magic)
 {
-	file_t* file;
+	file_t*            file;
+	void*              host_data;
+	struct file_task** p_task;
+
+	iter_t iter;
 
 	jsal_push_this();
 	file = jsal_require_class_obj(-1, PEGASUS_FILE_STREAM);
 
+	if (file == NULL) {
+		// if an async operation is in flight, the file is closed once it completes.
+		host_data = jsal_get_host_data(-1);
+		iter = vector_enum(s_stream_tasks);
+		while ((p_task = iter_next(&iter))) {
+			if ((*p_task)->stream_data == host_data)
+				(*p_task)->disposed = true;
+		}
+	}
 	jsal_set_class_ptr(-1, NULL);
 	file_close(file);
 	return false;
@@ -2360,7 +3043,7 @@ js_FileStream_read(int num_args, bool is_ctor, intptr_t magic)
 
 	jsal_push_this();
 	if (!(file = jsal_require_class_obj(-1, PEGASUS_FILE_STREAM)))
-		jsal_error(JS_ERROR, "FileStream has already been disposed");
+		jsal_error(JS_ERROR, "FileStream is disposed or busy");
 	if (num_args >= 1)
 		num_bytes = jsal_require_int(0);
 
@@ -2380,6 +3063,32 @@ js_FileStream_read(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_FileStream_readAsync(int num_args, bool is_ctor, intptr_t magic)
+{
+	file_t*           file;
+	int               num_bytes = 0;
+	struct file_task* task;
+
+	jsal_push_this();
+	if (!(file = jsal_require_class_obj(-1, PEGASUS_FILE_STREAM)))
+		jsal_error(JS_ERROR, "FileStream is disposed or busy");
+	if (num_args >= 1)
+		num_bytes = jsal_require_int(0);
+
+	if (num_bytes < 0)
+		jsal_error(JS_RANGE_ERROR, "Invalid read size '%d'", num_bytes);
+
+	task = calloc(1, sizeof(struct file_task));
+	task->file = file;
+	task->pathname = strdup(file_pathname(file));
+	task->read_all = num_args < 1;
+	task->size = num_bytes;
+	take_file_stream(task, -1);
+	push_file_task(task);
+	return true;
+}
+
 static bool
 js_FileStream_write(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -2391,13 +3100,41 @@ js_FileStream_write(int num_args, bool is_ctor, intptr_t magic)
 
 	jsal_push_this();
 	if (!(file = jsal_require_class_obj(-1, PEGASUS_FILE_STREAM)))
-		jsal_error(JS_ERROR, "FileStream has already been disposed");
+		jsal_error(JS_ERROR, "FileStream is disposed or busy");
 
 	if (file_write(file, data, num_bytes, 1) != num_bytes)
 		jsal_error(JS_ERROR, "Couldn't write '%zu' bytes to file", num_bytes);
 	return false;
 }
 
+static bool
+js_FileStream_writeAsync(int num_args, bool is_ctor, intptr_t magic)
+{
+	const void*       data;
+	file_t*           file;
+	size_t            num_bytes;
+	struct file_task* task;
+
+	data = jsal_require_buffer_ptr(0, &num_bytes);
+
+	jsal_push_this();
+	if (!(file = jsal_require_class_obj(-1, PEGASUS_FILE_STREAM)))
+		jsal_error(JS_ERROR, "FileStream is disposed or busy");
+
+	// note: the data is copied up front, so the caller is free to reuse the buffer as
+	//       soon as this returns.
+	task = calloc(1, sizeof(struct file_task));
+	task->buffer = malloc(num_bytes > 0 ? num_bytes : 1);
+	memcpy(task->buffer, data, num_bytes);
+	task->file = file;
+	task->pathname = strdup(file_pathname(file));
+	task->size = num_bytes;
+	task->writing = true;
+	take_file_stream(task, -1);
+	push_file_task(task);
+	return true;
+}
+
 static bool
 js_Font_get_Default(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -2486,8 +3223,7 @@ js_Font_drawText(int num_args, bool is_ctor, intptr_t magic)
 		return false;
 	}
 	else {
-		image_render_to(surface, NULL);
-		shader_use(galileo_shader(), false);
+		image_render_with(surface, galileo_shader(), NULL);
 		if (num_args < 6) {
 			font_set_mask(font, color);
 			font_draw_text(font, x, y, TEXT_ALIGN_LEFT, text);
@@ -2526,15 +3262,15 @@ js_Font_getTextSize(int num_args, bool is_ctor, intptr_t magic)
 		num_lines = wraptext_len(wraptext);
 		wraptext_free(wraptext);
 		jsal_push_int(width);
-		jsal_put_prop_string(-2, "width");
+		jsal_put_prop_key(-2, s_key_width);
 		jsal_push_int(font_height(font) * num_lines);
-		jsal_put_prop_string(-2, "height");
+		jsal_put_prop_key(-2, s_key_height);
 	}
 	else {
 		jsal_push_int(font_get_width(font, text));
-		jsal_put_prop_string(-2, "width");
+		jsal_put_prop_key(-2, s_key_width);
 		jsal_push_int(font_height(font));
-		jsal_put_prop_string(-2, "height");
+		jsal_put_prop_key(-2, s_key_height);
 	}
 	return true;
 }
@@ -2568,30 +3304,22 @@ js_Font_wordWrap(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_new_IndexList(int num_args, bool is_ctor, intptr_t magic)
 {
-	ibo_t* ibo;
-	int    index;
-	int    num_entries;
-
-	int i;
-
-	if (!jsal_is_array(0))
-		jsal_error(JS_TYPE_ERROR, "Expected an array as first argument");
+	bool      dynamic = false;
+	ibo_t*    ibo;
+	uint16_t* indices;
+	int       num_entries;
 
-	num_entries = jsal_get_length(0);
+	indices = jsal_pegasus_require_indices(0, &num_entries);
 	if (num_entries == 0)
-		jsal_error(JS_RANGE_ERROR, "Empty list is not allowed");
-	ibo = ibo_new();
-	for (i = 0; i < num_entries; ++i) {
-		jsal_get_prop_index(0, i);
-		index = jsal_require_int(-1);
-		if (index < 0 || index > UINT16_MAX) {
-			ibo_unref(ibo);
-			jsal_error(JS_RANGE_ERROR, "Index value out of range '%d'", index);
-		}
-		ibo_add_index(ibo, index);
-		jsal_pop(1);
+		jsal_error(JS_RANGE_ERROR, "Empty list is not allowed");
+	if (num_args >= 2) {
+		jsal_require_object_coercible(1);
+		if (jsal_get_prop_string(1, "dynamic"))
+			dynamic = jsal_require_boolean(-1);
 	}
-	if (!ibo_upload(ibo)) {
+
+	ibo = ibo_new(dynamic);
+	if (!ibo_upload_raw(ibo, indices, num_entries)) {
 		ibo_unref(ibo);
 		jsal_error(JS_ERROR, "Couldn't upload IndexList to GPU");
 	}
@@ -2599,6 +3327,27 @@ js_new_IndexList(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_IndexList_update(int num_args, bool is_ctor, intptr_t magic)
+{
+	ibo_t*    ibo;
+	uint16_t* indices;
+	int       num_entries;
+	int       offset = 0;
+
+	jsal_push_this();
+	ibo = jsal_require_class_obj(-1, PEGASUS_INDEX_LIST);
+	indices = jsal_pegasus_require_indices(0, &num_entries);
+	if (num_args >= 2)
+		offset = jsal_require_int(1);
+
+	if (offset < 0 || offset + num_entries > ibo_len(ibo))
+		jsal_error(JS_RANGE_ERROR, "Update range [%d,%d) is out of bounds", offset, offset + num_entries);
+	if (!ibo_update(ibo, offset, indices, num_entries))
+		jsal_error(JS_ERROR, "Couldn't update IndexList on GPU");
+	return false;
+}
+
 static void
 js_IndexList_finalize(void* host_ptr)
 {
@@ -2887,6 +3636,13 @@ js_Keyboard_isPressed(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_Math_random(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_push_number(xoro_gen_double(s_math_rng));
+	return true;
+}
+
 static bool
 js_Mixer_get_Default(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -3058,6 +3814,24 @@ js_Model_draw(int num_args, bool is_ctor, intptr_t magic)
 	return false;
 }
 
+static bool
+js_Model_drawInstanced(int num_args, bool is_ctor, intptr_t magic)
+{
+	instance_t* instances;
+	model_t*    model;
+	int         num_instances;
+	image_t*    surface;
+
+	jsal_push_this();
+	model = jsal_require_class_obj(-1, PEGASUS_MODEL);
+	surface = jsal_require_class_obj(0, PEGASUS_SURFACE);
+	instances = jsal_pegasus_require_instances(1, &num_instances);
+
+	if (!screen_skipping_frame(g_screen))
+		model_draw_instanced(model, surface, instances, num_instances);
+	return false;
+}
+
 static bool
 js_Shader_clone(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -3073,18 +3847,35 @@ js_Shader_clone(int num_args, bool is_ctor, intptr_t magic)
 }
 
 static bool
-js_Shader_setBoolean(int num_args, bool is_ctor, intptr_t magic)
+js_Shader_getUniform(int num_args, bool is_ctor, intptr_t magic)
 {
 	const char* name;
 	shader_t*   shader;
-	bool        value;
+	int         slot;
 
 	jsal_push_this();
 	shader = jsal_require_class_obj(-1, PEGASUS_SHADER);
 	name = jsal_require_string(0);
+
+	if ((slot = shader_uniform_slot(shader, name)) < 0 || slot >= MAX_UNIFORM_SLOTS)
+		jsal_error(JS_ERROR, "Couldn't allocate uniform slot");
+	jsal_push_number((double)shader_slot_owner(shader, slot) * MAX_UNIFORM_SLOTS + slot);
+	return true;
+}
+
+static bool
+js_Shader_setBoolean(int num_args, bool is_ctor, intptr_t magic)
+{
+	shader_t*   shader;
+	int         slot;
+	bool        value;
+
+	jsal_push_this();
+	shader = jsal_require_class_obj(-1, PEGASUS_SHADER);
+	slot = jsal_pegasus_require_slot(0, shader);
 	value = jsal_require_boolean(1);
 
-	shader_put_bool(shader, name, value);
+	shader_put_bool(shader, slot, value);
 	return false;
 }
 
@@ -3092,44 +3883,44 @@ static bool
 js_Shader_setColorVector(int num_args, bool is_ctor, intptr_t magic)
 {
 	color_t     color;
-	const char* name;
 	shader_t*   shader;
+	int         slot;
 	float       values[4];
 
 	jsal_push_this();
 	shader = jsal_require_class_obj(-1, PEGASUS_SHADER);
-	name = jsal_require_string(0);
+	slot = jsal_pegasus_require_slot(0, shader);
 	color = jsal_pegasus_require_color(1);
 
 	values[0] = color.r / 255.0;
 	values[1] = color.g / 255.0;
 	values[2] = color.b / 255.0;
 	values[3] = color.a / 255.0;
-	shader_put_float_vector(shader, name, values, 4);
+	shader_put_float_vector(shader, slot, values, 4);
 	return false;
 }
 
 static bool
 js_Shader_setFloat(int num_args, bool is_ctor, intptr_t magic)
 {
-	const char* name;
 	shader_t*   shader;
+	int         slot;
 	float       value;
 
 	jsal_push_this();
 	shader = jsal_require_class_obj(-1, PEGASUS_SHADER);
-	name = jsal_require_string(0);
+	slot = jsal_pegasus_require_slot(0, shader);
 	value = jsal_require_number(1);
 
-	shader_put_float(shader, name, value);
+	shader_put_float(shader, slot, value);
 	return false;
 }
 
 static bool
 js_Shader_setFloatArray(int num_args, bool is_ctor, intptr_t magic)
 {
-	const char* name;
 	shader_t*   shader;
+	int         slot;
 	int         size;
 	float*      values;
 
@@ -3137,7 +3928,7 @@ js_Shader_setFloatArray(int num_args, bool is_ctor, intptr_t magic)
 
 	jsal_push_this();
 	shader = jsal_require_class_obj(-1, PEGASUS_SHADER);
-	name = jsal_require_string(0);
+	slot = jsal_pegasus_require_slot(0, shader);
 	if (!jsal_is_array(1))
 		jsal_error(JS_TYPE_ERROR, "Expected an array as second argument");
 
@@ -3149,15 +3940,15 @@ js_Shader_setFloatArray(int num_args, bool is_ctor, intptr_t magic)
 		values[i] = jsal_require_number(-1);
 		jsal_pop(1);
 	}
-	shader_put_float_array(shader, name, values, size);
+	shader_put_float_array(shader, slot, values, size);
 	return false;
 }
 
 static bool
 js_Shader_setFloatVector(int num_args, bool is_ctor, intptr_t magic)
 {
-	const char* name;
 	shader_t*   shader;
+	int         slot;
 	int         size;
 	float       values[4];
 
@@ -3165,7 +3956,7 @@ js_Shader_setFloatVector(int num_args, bool is_ctor, intptr_t magic)
 
 	jsal_push_this();
 	shader = jsal_require_class_obj(-1, PEGASUS_SHADER);
-	name = jsal_require_string(0);
+	slot = jsal_pegasus_require_slot(0, shader);
 	jsal_require_array(1);
 
 	size = jsal_get_length(1);
@@ -3177,31 +3968,31 @@ js_Shader_setFloatVector(int num_args, bool is_ctor, intptr_t magic)
 		values[i] = jsal_require_number(-1);
 		jsal_pop(1);
 	}
-	shader_put_float_vector(shader, name, values, size);
+	shader_put_float_vector(shader, slot, values, size);
 	return false;
 }
 
 static bool
 js_Shader_setInt(int num_args, bool is_ctor, intptr_t magic)
 {
-	const char* name;
 	shader_t*   shader;
+	int         slot;
 	int         value;
 
 	jsal_push_this();
 	shader = jsal_require_class_obj(-1, PEGASUS_SHADER);
-	name = jsal_require_string(0);
+	slot = jsal_pegasus_require_slot(0, shader);
 	value = jsal_require_int(1);
 
-	shader_put_int(shader, name, value);
+	shader_put_int(shader, slot, value);
 	return false;
 }
 
 static bool
 js_Shader_setIntArray(int num_args, bool is_ctor, intptr_t magic)
 {
-	const char* name;
 	shader_t*   shader;
+	int         slot;
 	int         size;
 	int*        values;
 
@@ -3209,7 +4000,7 @@ js_Shader_setIntArray(int num_args, bool is_ctor, intptr_t magic)
 
 	jsal_push_this();
 	shader = jsal_require_class_obj(-1, PEGASUS_SHADER);
-	name = jsal_require_string(0);
+	slot = jsal_pegasus_require_slot(0, shader);
 	if (!jsal_is_array(1))
 		jsal_error(JS_TYPE_ERROR, "Expected array as second argument");
 
@@ -3220,7 +4011,7 @@ js_Shader_setIntArray(int num_args, bool is_ctor, intptr_t magic)
 		values[i] = jsal_require_int(-1);
 		jsal_pop(1);
 	}
-	shader_put_int_array(shader, name, values, size);
+	shader_put_int_array(shader, slot, values, size);
 	return false;
 }
 
@@ -3228,7 +4019,7 @@ static bool
 js_Shader_setIntVector(int num_args, bool is_ctor, intptr_t magic)
 {
 	shader_t*   shader;
-	const char* name;
+	int         slot;
 	int         size;
 	int         values[4];
 
@@ -3236,7 +4027,7 @@ js_Shader_setIntVector(int num_args, bool is_ctor, intptr_t magic)
 
 	jsal_push_this();
 	shader = jsal_require_class_obj(-1, PEGASUS_SHADER);
-	name = jsal_require_string(0);
+	slot = jsal_pegasus_require_slot(0, shader);
 	if (!jsal_is_array(1))
 		jsal_error(JS_TYPE_ERROR, "Expected array as second argument");
 
@@ -3249,23 +4040,23 @@ js_Shader_setIntVector(int num_args, bool is_ctor, intptr_t magic)
 		values[i] = jsal_require_int(-1);
 		jsal_pop(1);
 	}
-	shader_put_int_vector(shader, name, values, size);
+	shader_put_int_vector(shader, slot, values, size);
 	return false;
 }
 
 static bool
 js_Shader_setMatrix(int num_args, bool is_ctor, intptr_t magic)
 {
-	const char*  name;
 	shader_t*    shader;
+	int          slot;
 	transform_t* transform;
 
 	jsal_push_this();
 	shader = jsal_require_class_obj(-1, PEGASUS_SHADER);
-	name = jsal_require_string(0);
+	slot = jsal_pegasus_require_slot(0, shader);
 	transform = jsal_require_class_obj(1, PEGASUS_TRANSFORM);
 
-	shader_put_matrix(shader, name, transform);
+	shader_put_matrix(shader, slot, transform);
 	return false;
 }
 
@@ -3329,11 +4120,11 @@ js_Mouse_getEvent(int num_args, bool is_ctor, intptr_t magic)
 		event = mouse_get_event();
 		jsal_push_new_object();
 		jsal_push_int(event.key);
-		jsal_put_prop_string(-2, "key");
+		jsal_put_prop_key(-2, s_key_key);
 		jsal_push_int(event.x);
-		jsal_put_prop_string(-2, "x");
+		jsal_put_prop_key(-2, s_key_x);
 		jsal_push_int(event.y);
-		jsal_put_prop_string(-2, "y");
+		jsal_put_prop_key(-2, s_key_y);
 	}
 	return true;
 }
@@ -3389,7 +4180,7 @@ js_new_RNG(int num_args, bool is_ctor, intptr_t magic)
 {
 	xoro_t* xoro;
 
-	xoro = xoro_new((uint64_t)(al_get_time() * 1000000));
+	xoro = xoro_new(get_random_seed());
 	jsal_push_class_obj(PEGASUS_RNG, xoro, true);
 	return true;
 }
@@ -3787,17 +4578,12 @@ static bool
 js_Shape_drawImmediate(int num_args, bool is_ctor, intptr_t magic)
 {
 	int             array_idx;
-	ALLEGRO_BITMAP* bitmap = NULL;
-	int             draw_mode;
-	int             item_idx;
 	int             num_entries;
 	image_t*        surface;
 	image_t*        texture = NULL;
 	shape_type_t    type;
 	ALLEGRO_VERTEX* vertices;
 
-	int i;
-
 	if ((surface = jsal_get_class_obj(0, PEGASUS_SURFACE))) {
 		type = jsal_require_int(1);
 		array_idx = 2;
@@ -3813,44 +4599,16 @@ js_Shape_drawImmediate(int num_args, bool is_ctor, intptr_t magic)
 		array_idx = 1;
 		if (num_args >= 3) {
 			if (!jsal_is_null(1) && !jsal_is_undefined(1))
-				texture = jsal_require_class_obj(2, PEGASUS_TEXTURE);
+				texture = jsal_require_class_obj(1, PEGASUS_TEXTURE);
 			array_idx = 2;
 		}
 	}
-	jsal_require_array(array_idx);
 
-	num_entries = jsal_get_length(array_idx);
+	vertices = jsal_pegasus_require_vertices(array_idx, &num_entries);
 	if (num_entries == 0)
 		jsal_error(JS_RANGE_ERROR, "Empty list is not allowed");
 
-	vertices = alloca(num_entries * sizeof(ALLEGRO_VERTEX));
-	for (i = 0; i < num_entries; ++i) {
-		jsal_get_prop_index(array_idx, i);
-		jsal_require_object_coercible(-1);
-		item_idx = jsal_normalize_index(-1);
-		vertices[i].x = jsal_get_prop_key(item_idx, s_key_x) ? jsal_require_number(-1) : 0.0f;
-		vertices[i].y = jsal_get_prop_key(item_idx, s_key_y) ? jsal_require_number(-1) : 0.0f;
-		vertices[i].z = jsal_get_prop_key(item_idx, s_key_z) ? jsal_require_number(-1) : 0.0f;
-		vertices[i].u = jsal_get_prop_key(item_idx, s_key_u) ? jsal_require_number(-1) : 0.0f;
-		vertices[i].v = jsal_get_prop_key(item_idx, s_key_v) ? jsal_require_number(-1) : 0.0f;
-		vertices[i].color = jsal_get_prop_key(item_idx, s_key_color)
-			? nativecolor(jsal_pegasus_require_color(-1))
-			: al_map_rgba_f(1.0f, 1.0f, 1.0f, 1.0f);
-		jsal_pop(7);
-	}
-
-	draw_mode = type == SHAPE_LINES ? ALLEGRO_PRIM_LINE_LIST
-		: type == SHAPE_LINE_LOOP ? ALLEGRO_PRIM_LINE_LOOP
-		: type == SHAPE_LINE_STRIP ? ALLEGRO_PRIM_LINE_STRIP
-		: type == SHAPE_TRIANGLES ? ALLEGRO_PRIM_TRIANGLE_LIST
-		: type == SHAPE_TRI_STRIP ? ALLEGRO_PRIM_TRIANGLE_STRIP
-		: type == SHAPE_TRI_FAN ? ALLEGRO_PRIM_TRIANGLE_FAN
-		: ALLEGRO_PRIM_POINT_LIST;
-	if (texture != NULL)
-		bitmap = image_bitmap(texture);
-	image_render_to(surface, NULL);
-	shader_use(galileo_shader(), false);
-	al_draw_prim(vertices, NULL, bitmap, 0, num_entries, draw_mode);
+	galileo_draw_immediate(surface, type, texture, vertices, num_entries);
 	return false;
 }
 
@@ -3997,6 +4755,27 @@ js_Shape_draw(int num_args, bool is_ctor, intptr_t magic)
 	return false;
 }
 
+static bool
+js_Shape_drawInstanced(int num_args, bool is_ctor, intptr_t magic)
+{
+	instance_t*  instances;
+	int          num_instances;
+	shape_t*     shape;
+	image_t*     surface;
+	transform_t* transform = NULL;
+
+	jsal_push_this();
+	shape = jsal_require_class_obj(-1, PEGASUS_SHAPE);
+	surface = jsal_require_class_obj(0, PEGASUS_SURFACE);
+	instances = jsal_pegasus_require_instances(1, &num_instances);
+	if (num_args >= 3)
+		transform = jsal_require_class_obj(2, PEGASUS_TRANSFORM);
+
+	if (!screen_skipping_frame(g_screen))
+		shape_draw_instanced(shape, surface, transform, instances, num_instances);
+	return false;
+}
+
 static bool
 js_new_Socket(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -4491,6 +5270,136 @@ js_Surface_get_Screen(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_new_SpriteBatch(int num_args, bool is_ctor, intptr_t magic)
+{
+	sprite_batch_t* batch;
+	bool            sorted = false;
+
+	if (num_args >= 1) {
+		jsal_require_object_coercible(0);
+		if (jsal_get_prop_string(0, "sorted"))
+			sorted = jsal_require_boolean(-1);
+	}
+
+	batch = sprite_batch_new(sorted);
+	jsal_push_class_obj(PEGASUS_SPRITE_BATCH, batch, true);
+	return true;
+}
+
+static void
+js_SpriteBatch_finalize(void* host_ptr)
+{
+	sprite_batch_unref(host_ptr);
+}
+
+static bool
+js_SpriteBatch_get_blendOp(int num_args, bool is_ctor, intptr_t magic)
+{
+	sprite_batch_t* batch;
+
+	jsal_push_this();
+	batch = jsal_require_class_obj(-1, PEGASUS_SPRITE_BATCH);
+
+	jsal_push_int(sprite_batch_get_blend_mode(batch));
+	return true;
+}
+
+static bool
+js_SpriteBatch_get_length(int num_args, bool is_ctor, intptr_t magic)
+{
+	sprite_batch_t* batch;
+
+	jsal_push_this();
+	batch = jsal_require_class_obj(-1, PEGASUS_SPRITE_BATCH);
+
+	jsal_push_int(sprite_batch_len(batch));
+	return true;
+}
+
+static bool
+js_SpriteBatch_set_blendOp(int num_args, bool is_ctor, intptr_t magic)
+{
+	sprite_batch_t* batch;
+	blend_mode_t    mode;
+
+	jsal_push_this();
+	batch = jsal_require_class_obj(-1, PEGASUS_SPRITE_BATCH);
+	mode = jsal_require_int(0);
+
+	if (mode < 0 || mode >= BLEND_MAX)
+		jsal_error(JS_RANGE_ERROR, "Invalid blending mode constant '%d'", mode);
+
+	sprite_batch_set_blend_mode(batch, mode);
+	return false;
+}
+
+static bool
+js_SpriteBatch_add(int num_args, bool is_ctor, intptr_t magic)
+{
+	sprite_batch_t* batch;
+	color_t         color;
+	float           height;
+	image_t*        texture = NULL;
+	float           u1 = 0.0f, u2 = 1.0f;
+	float           v1 = 1.0f, v2 = 0.0f;
+	float           width;
+	float           x;
+	float           y;
+
+	jsal_push_this();
+	batch = jsal_require_class_obj(-1, PEGASUS_SPRITE_BATCH);
+	if (!jsal_is_null(0))
+		texture = jsal_require_class_obj(0, PEGASUS_TEXTURE);
+	x = jsal_require_number(1);
+	y = jsal_require_number(2);
+	width = jsal_require_number(3);
+	height = jsal_require_number(4);
+	if (num_args >= 9) {
+		u1 = jsal_require_number(5);
+		v1 = jsal_require_number(6);
+		u2 = jsal_require_number(7);
+		v2 = jsal_require_number(8);
+	}
+	color = num_args == 6 ? jsal_pegasus_require_color(5)
+		: num_args >= 10 ? jsal_pegasus_require_color(9)
+		: mk_color(255, 255, 255, 255);
+
+	sprite_batch_add(batch, texture, x, y, width, height, u1, v1, u2, v2, color);
+	return false;
+}
+
+static bool
+js_SpriteBatch_clear(int num_args, bool is_ctor, intptr_t magic)
+{
+	sprite_batch_t* batch;
+
+	jsal_push_this();
+	batch = jsal_require_class_obj(-1, PEGASUS_SPRITE_BATCH);
+
+	sprite_batch_clear(batch);
+	return false;
+}
+
+static bool
+js_SpriteBatch_draw(int num_args, bool is_ctor, intptr_t magic)
+{
+	sprite_batch_t* batch;
+	image_t*        surface;
+	transform_t*    transform = NULL;
+
+	jsal_push_this();
+	batch = jsal_require_class_obj(-1, PEGASUS_SPRITE_BATCH);
+	surface = num_args >= 1 ? jsal_require_class_obj(0, PEGASUS_SURFACE)
+		: screen_backbuffer(g_screen);
+	if (num_args >= 2)
+		transform = jsal_require_class_obj(1, PEGASUS_TRANSFORM);
+
+	if (!screen_skipping_frame(g_screen))
+		sprite_batch_draw(batch, surface, transform);
+	return false;
+}
+
 static bool
 js_Surface_get_blendOp(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -4503,6 +5412,18 @@ js_Surface_get_blendOp(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_Surface_get_deferred(int num_args, bool is_ctor, intptr_t magic)
+{
+	image_t* image;
+
+	jsal_push_this();
+	image = jsal_require_class_obj(-1, PEGASUS_SURFACE);
+
+	jsal_push_boolean(image_get_deferred(image));
+	return true;
+}
+
 static bool
 js_Surface_get_height(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -4560,6 +5481,20 @@ js_Surface_set_blendOp(int num_args, bool is_ctor, intptr_t magic)
 	return false;
 }
 
+static bool
+js_Surface_set_deferred(int num_args, bool is_ctor, intptr_t magic)
+{
+	bool     deferred;
+	image_t* image;
+
+	jsal_push_this();
+	image = jsal_require_class_obj(-1, PEGASUS_SURFACE);
+	deferred = jsal_require_boolean(0);
+
+	image_set_deferred(image, deferred);
+	return false;
+}
+
 static bool
 js_Surface_set_transform(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -5153,56 +6088,151 @@ js_Transform_translate(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_new_VertexList(int num_args, bool is_ctor, intptr_t magic)
 {
-	int      num_entries;
-	int      stack_idx;
-	vbo_t*   vbo;
-	vertex_t vertex;
-
-	int i;
-
-	jsal_require_array(0);
+	bool            dynamic = false;
+	int             num_entries;
+	vbo_t*          vbo;
+	ALLEGRO_VERTEX* vertices;
 
-	num_entries = jsal_get_length(0);
+	vertices = jsal_pegasus_require_vertices(0, &num_entries);
 	if (num_entries == 0)
 		jsal_error(JS_RANGE_ERROR, "Empty list is not allowed");
-
-	vbo = vbo_new();
-	for (i = 0; i < num_entries; ++i) {
-		jsal_get_prop_index(0, i);
-		jsal_require_object_coercible(-1);
-		stack_idx = jsal_normalize_index(-1);
-		vertex.x = jsal_get_prop_key(stack_idx, s_key_x) ? jsal_require_number(-1) : 0.0;
-		vertex.y = jsal_get_prop_key(stack_idx, s_key_y) ? jsal_require_number(-1) : 0.0;
-		vertex.z = jsal_get_prop_key(stack_idx, s_key_z) ? jsal_require_number(-1) : 0.0;
-		if (jsal_get_prop_key(stack_idx, s_key_u))
-			vertex.u = jsal_require_number(-1);
-		else
-			vertex.u = 0;
-		if (jsal_get_prop_key(stack_idx, s_key_v))
-			vertex.v = jsal_require_number(-1);
-		else
-			vertex.v = 0;
-		vertex.color = jsal_get_prop_key(stack_idx, s_key_color)
-			? jsal_pegasus_require_color(-1)
-			: mk_color(255, 255, 255, 255);
-		vbo_add_vertex(vbo, vertex);
-		jsal_pop(7);
+	if (num_args >= 2) {
+		jsal_require_object_coercible(1);
+		if (jsal_get_prop_string(1, "dynamic"))
+			dynamic = jsal_require_boolean(-1);
 	}
-	if (!vbo_upload(vbo)) {
+
+	vbo = vbo_new(dynamic);
+	if (!vbo_upload_raw(vbo, vertices, num_entries)) {
 		vbo_unref(vbo);
 		jsal_error(JS_ERROR, "Couldn't upload VertexList to GPU");
 	}
-
 	jsal_push_class_obj(PEGASUS_VERTEX_LIST, vbo, true);
 	return true;
 }
 
+static bool
+js_VertexList_update(int num_args, bool is_ctor, intptr_t magic)
+{
+	int             num_entries;
+	int             offset = 0;
+	vbo_t*          vbo;
+	ALLEGRO_VERTEX* vertices;
+
+	jsal_push_this();
+	vbo = jsal_require_class_obj(-1, PEGASUS_VERTEX_LIST);
+	vertices = jsal_pegasus_require_vertices(0, &num_entries);
+	if (num_args >= 2)
+		offset = jsal_require_int(1);
+
+	if (offset < 0 || offset + num_entries > vbo_len(vbo))
+		jsal_error(JS_RANGE_ERROR, "Update range [%d,%d) is out of bounds", offset, offset + num_entries);
+	if (!vbo_update(vbo, offset, vertices, num_entries))
+		jsal_error(JS_ERROR, "Couldn't update VertexList on GPU");
+	return false;
+}
+
 static void
 js_VertexList_finalize(void* host_ptr)
 {
 	vbo_unref(host_ptr);
 }
 
+static bool
+js_new_Worker(int num_args, bool is_ctor, intptr_t magic)
+{
+	const char* filename;
+	size_t      size;
+	void*       source;
+	worker_t*   worker;
+
+	filename = jsal_require_pathname(0, NULL, false, false);
+
+	if (s_shutting_down)
+		jsal_error(JS_RANGE_ERROR, "Worker creation not allowed during shutdown");
+	if (!(source = game_read_file(g_game, filename, &size)))
+		jsal_error(JS_ERROR, "Couldn't load worker script '%s'", filename);
+	worker = worker_new(filename, source, size);
+	free(source);
+	if (worker == NULL)
+		jsal_error(JS_ERROR, "Couldn't start worker thread for '%s'", filename);
+	jsal_push_class_obj(PEGASUS_WORKER, worker, true);
+	defer_worker_poll(-1, 0);
+	return true;
+}
+
+static void
+js_Worker_finalize(void* host_ptr)
+{
+	worker_unref(host_ptr);
+}
+
+static bool
+js_Worker_poll(int num_args, bool is_ctor, intptr_t magic)
+{
+	js_message_t* message;
+	worker_t*     worker;
+
+	jsal_push_this();
+	worker = jsal_require_class_obj(-1, PEGASUS_WORKER);
+
+	// re-arm the poll job first: as long as the worker is running, it keeps the event
+	// loop alive.
+	if (worker_running(worker) && !s_shutting_down)
+		defer_worker_poll(-1, 1);
+	while ((message = worker_receive(worker))) {
+		jsal_get_prop_string(-1, "onMessage");
+		if (!jsal_is_function(-1)) {
+			jsal_message_free(message);
+			jsal_pop(1);
+			continue;
+		}
+		jsal_dup(-2);
+
+		// note: the message has to be freed even if decoding it throws, so the error
+		//       is caught here and rethrown once that's done.
+		if (!jsal_try_push_message(message)) {
+			jsal_message_free(message);
+			jsal_throw();
+		}
+		jsal_message_free(message);
+		jsal_call_method(1);
+		jsal_pop(1);
+	}
+	return false;
+}
+
+static bool
+js_Worker_postMessage(int num_args, bool is_ctor, intptr_t magic)
+{
+	js_message_t* message;
+	worker_t*     worker;
+
+	jsal_push_this();
+	worker = jsal_require_class_obj(-1, PEGASUS_WORKER);
+
+	if (num_args < 1)
+		jsal_error(JS_TYPE_ERROR, "No message value was provided");
+
+	// note: messages posted to a worker that has already stopped are dropped silently,
+	//       same as on the Web.
+	message = jsal_message_new(0);
+	worker_post(worker, message);
+	return false;
+}
+
+static bool
+js_Worker_terminate(int num_args, bool is_ctor, intptr_t magic)
+{
+	worker_t* worker;
+
+	jsal_push_this();
+	worker = jsal_require_class_obj(-1, PEGASUS_WORKER);
+
+	worker_terminate(worker);
+	return false;
+}
+
 static bool
 js_Z_deflate(int num_args, bool is_ctor, intptr_t magic)
 {
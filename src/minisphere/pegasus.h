@@ -54,12 +54,14 @@ enum pegasus_type
 	PEGASUS_SOCKET,
 	PEGASUS_SOUND,
 	PEGASUS_SOUND_STREAM,
+	PEGASUS_SPRITE_BATCH,
 	PEGASUS_SURFACE,
 	PEGASUS_TEXT_DEC,
 	PEGASUS_TEXT_ENC,
 	PEGASUS_TEXTURE,
 	PEGASUS_TRANSFORM,
 	PEGASUS_VERTEX_LIST,
+	PEGASUS_WORKER,
 };
 
 void pegasus_init             (int api_level);
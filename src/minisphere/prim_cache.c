@@ -0,0 +1,363 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+// the primitive cache keeps tessellated geometry for the Sphere v1 primitives
+// (circles, ellipses, rounded rectangles) so that drawing the same shape over and
+// over doesn't mean redoing all the trigonometry and reuploading the vertices
+// each time.  shapes are tessellated once around the origin, stored in a vertex
+// buffer and then positioned using the model-view transform.  the cache holds a
+// fixed number of shapes and throws out the least recently used one when full.
+//
+// note: colors are baked into the vertices, so they're part of the cache key.
+//       in practice this is fine since HUD code tends to reuse the same colors.
+
+#include "minisphere.h"
+#include "prim_cache.h"
+
+#include "color.h"
+#include "render.h"
+#include "vector.h"
+
+enum prim_kind
+{
+	PRIM_ELLIPSE,
+	PRIM_ELLIPSE_OUTLINE,
+	PRIM_ROUND_RECT,
+};
+
+struct key
+{
+	enum prim_kind kind;
+	float          width;
+	float          height;
+	float          param;
+	int            num_points;
+	color_t        color_1;
+	color_t        color_2;
+};
+
+struct entry
+{
+	struct key             key;
+	ALLEGRO_VERTEX_BUFFER* buffer;
+	uint32_t               hash;
+	bool                   in_use;
+	uint64_t               last_used;
+	int                    num_vertices;
+	int                    prim_type;
+	ALLEGRO_VERTEX*        vertices;
+};
+
+static void     draw_cached           (const struct key* key, float x, float y);
+static uint32_t hash_key              (const struct key* key);
+static void     make_key              (struct key* key, enum prim_kind kind, float width, float height, float param, int num_points, color_t color_1, color_t color_2);
+static void     release_entry         (struct entry* entry);
+static int      tessellate            (const struct key* key, int* out_prim_type);
+static void     tessellate_ellipse    (const struct key* key);
+static void     tessellate_outline    (const struct key* key);
+static void     tessellate_round_rect (const struct key* key);
+
+static struct entry s_entries[PRIM_CACHE_SIZE];
+static unsigned int s_num_hits;
+static unsigned int s_num_misses;
+static vector_t*    s_scratch;
+static uint64_t     s_tick;
+
+void
+prim_cache_init(void)
+{
+	console_log(1, "initializing primitive cache");
+	memset(s_entries, 0, sizeof s_entries);
+	s_num_hits = 0;
+	s_num_misses = 0;
+	s_scratch = vector_new(sizeof(ALLEGRO_VERTEX));
+	s_tick = 0;
+}
+
+void
+prim_cache_uninit(void)
+{
+	int i;
+
+	console_log(1, "shutting down primitive cache");
+	console_log(2, "    hits: %u, misses: %u", s_num_hits, s_num_misses);
+	for (i = 0; i < PRIM_CACHE_SIZE; ++i)
+		release_entry(&s_entries[i]);
+	vector_free(s_scratch);
+}
+
+void
+prim_draw_ellipse(float x, float y, float rx, float ry, int num_points, color_t inner_color, color_t outer_color)
+{
+	struct key key;
+
+	if (num_points < 1)
+		return;
+	make_key(&key, PRIM_ELLIPSE, rx, ry, 0.0f, num_points, inner_color, outer_color);
+	draw_cached(&key, x, y);
+}
+
+void
+prim_draw_ellipse_outline(float x, float y, float rx, float ry, float thickness, color_t color)
+{
+	struct key key;
+	int        num_points;
+
+	// note: this matches the tessellation used by al_draw_ellipse(), so cached
+	//       outlines look exactly the same as the uncached ones did.
+	num_points = ALLEGRO_PRIM_QUALITY * sqrtf((rx + ry) / 2.0f);
+	if (num_points < 2)
+		num_points = 2;
+	if (num_points > 127)
+		num_points = 127;
+	make_key(&key, PRIM_ELLIPSE_OUTLINE, rx, ry, thickness, num_points, color, color);
+	draw_cached(&key, x, y);
+}
+
+void
+prim_draw_round_rect(float x, float y, float width, float height, float radius, color_t color)
+{
+	struct key key;
+	int        num_points;
+
+	if (radius > width / 2)
+		radius = width / 2;
+	if (radius > height / 2)
+		radius = height / 2;
+	if (radius < 0.0f)
+		radius = 0.0f;
+	num_points = ALLEGRO_PRIM_QUALITY * sqrtf(radius) / 4;
+	if (num_points < 2)
+		num_points = 2;
+	if (num_points > 63)
+		num_points = 63;
+	make_key(&key, PRIM_ROUND_RECT, width, height, radius, num_points, color, color);
+	draw_cached(&key, x, y);
+}
+
+static void
+draw_cached(const struct key* key, float x, float y)
+{
+	struct entry*     entry = NULL;
+	uint32_t          hash;
+	ALLEGRO_TRANSFORM matrix;
+	int               num_vertices;
+	int               prim_type;
+	struct entry*     victim = NULL;
+
+	int i;
+
+	// look for the shape in the cache, keeping track of the best entry to replace
+	// along the way (an empty one if possible, else the least recently used).
+	hash = hash_key(key);
+	for (i = 0; i < PRIM_CACHE_SIZE; ++i) {
+		if (!s_entries[i].in_use) {
+			if (victim == NULL || victim->in_use)
+				victim = &s_entries[i];
+			continue;
+		}
+		if (s_entries[i].hash == hash && memcmp(&s_entries[i].key, key, sizeof(struct key)) == 0) {
+			entry = &s_entries[i];
+			break;
+		}
+		if (victim == NULL || (victim->in_use && s_entries[i].last_used < victim->last_used))
+			victim = &s_entries[i];
+	}
+	if (entry != NULL)
+		++s_num_hits;
+	else {
+		// cache miss, tessellate the shape and upload it to the GPU
+		++s_num_misses;
+		entry = victim;
+		release_entry(entry);
+		num_vertices = tessellate(key, &prim_type);
+		entry->key = *key;
+		entry->hash = hash;
+		entry->num_vertices = num_vertices;
+		entry->prim_type = prim_type;
+		entry->buffer = al_create_vertex_buffer(NULL, vector_get(s_scratch, 0), num_vertices, ALLEGRO_PRIM_BUFFER_STATIC);
+		if (entry->buffer == NULL) {
+			// no vertex buffer support, keep the vertices in main memory instead
+			entry->vertices = malloc(num_vertices * sizeof(ALLEGRO_VERTEX));
+			memcpy(entry->vertices, vector_get(s_scratch, 0), num_vertices * sizeof(ALLEGRO_VERTEX));
+		}
+		entry->in_use = true;
+	}
+	entry->last_used = s_tick++;
+
+	al_identity_transform(&matrix);
+	al_translate_transform(&matrix, x, y);
+	render_set_transform(&matrix);
+	if (entry->buffer != NULL)
+		al_draw_vertex_buffer(entry->buffer, NULL, 0, entry->num_vertices, entry->prim_type);
+	else
+		al_draw_prim(entry->vertices, NULL, NULL, 0, entry->num_vertices, entry->prim_type);
+	render_count_draws(1);
+	render_set_transform(NULL);
+}
+
+static uint32_t
+hash_key(const struct key* key)
+{
+	const uint8_t* p;
+	uint32_t       hash = 2166136261u;
+
+	size_t i;
+
+	// FNV-1a
+	p = (const uint8_t*)key;
+	for (i = 0; i < sizeof(struct key); ++i)
+		hash = (hash ^ p[i]) * 16777619u;
+	return hash;
+}
+
+static void
+make_key(struct key* key, enum prim_kind kind, float width, float height, float param, int num_points, color_t color_1, color_t color_2)
+{
+	// note: keys are compared and hashed bytewise, so clear out any padding first.
+	memset(key, 0, sizeof(struct key));
+	key->kind = kind;
+	key->width = width;
+	key->height = height;
+	key->param = param;
+	key->num_points = num_points;
+	key->color_1 = color_1;
+	key->color_2 = color_2;
+}
+
+static void
+release_entry(struct entry* entry)
+{
+	if (!entry->in_use)
+		return;
+	if (entry->buffer != NULL)
+		al_destroy_vertex_buffer(entry->buffer);
+	free(entry->vertices);
+	entry->buffer = NULL;
+	entry->vertices = NULL;
+	entry->in_use = false;
+}
+
+static int
+tessellate(const struct key* key, int* out_prim_type)
+{
+	ALLEGRO_VERTEX* vertex;
+	ALLEGRO_COLOR   color;
+
+	int i;
+
+	vector_clear(s_scratch);
+	switch (key->kind) {
+	case PRIM_ELLIPSE:
+		tessellate_ellipse(key);
+		*out_prim_type = ALLEGRO_PRIM_TRIANGLE_FAN;
+		break;
+	case PRIM_ELLIPSE_OUTLINE:
+		tessellate_outline(key);
+		*out_prim_type = ALLEGRO_PRIM_TRIANGLE_STRIP;
+		break;
+	case PRIM_ROUND_RECT:
+		tessellate_round_rect(key);
+		*out_prim_type = ALLEGRO_PRIM_TRIANGLE_FAN;
+		break;
+	}
+
+	// the outer color applies to every vertex except the center of an ellipse
+	color = nativecolor(key->color_2);
+	for (i = 0; i < vector_len(s_scratch); ++i) {
+		vertex = vector_get(s_scratch, i);
+		vertex->z = 0.0f;
+		vertex->u = vertex->v = 0.0f;
+		vertex->color = color;
+	}
+	if (key->kind == PRIM_ELLIPSE) {
+		vertex = vector_get(s_scratch, 0);
+		vertex->color = nativecolor(key->color_1);
+	}
+	return vector_len(s_scratch);
+}
+
+static void
+tessellate_ellipse(const struct key* key)
+{
+	double         phi;
+	ALLEGRO_VERTEX vertex;
+
+	int i;
+
+	memset(&vertex, 0, sizeof(ALLEGRO_VERTEX));
+	vector_push(s_scratch, &vertex);
+	for (i = 0; i <= key->num_points; ++i) {
+		phi = 2 * M_PI * (i % key->num_points) / key->num_points;
+		vertex.x = cosf(phi) * key->width;
+		vertex.y = -sinf(phi) * key->height;
+		vector_push(s_scratch, &vertex);
+	}
+}
+
+static void
+tessellate_outline(const struct key* key)
+{
+	if (!vector_resize(s_scratch, key->num_points * 2))
+		return;
+	al_calculate_arc(&((ALLEGRO_VERTEX*)vector_get(s_scratch, 0))->x, sizeof(ALLEGRO_VERTEX),
+		0.0f, 0.0f, key->width, key->height, 0.0f, M_PI * 2, key->param, key->num_points);
+}
+
+static void
+tessellate_round_rect(const struct key* key)
+{
+	// corner centers and starting angles, going clockwise from the top left.
+	// angles are in screen space, so +y points down.
+	const float centers[4][2] = {
+		{ key->param, key->param },
+		{ key->width - key->param, key->param },
+		{ key->width - key->param, key->height - key->param },
+		{ key->param, key->height - key->param },
+	};
+	const double angles[4] = { M_PI, M_PI * 1.5, 0.0, M_PI * 0.5 };
+
+	double         phi;
+	ALLEGRO_VERTEX vertex;
+
+	int i, j;
+
+	memset(&vertex, 0, sizeof(ALLEGRO_VERTEX));
+	for (i = 0; i < 4; ++i) {
+		for (j = 0; j <= key->num_points; ++j) {
+			phi = angles[i] + M_PI / 2 * j / key->num_points;
+			vertex.x = centers[i][0] + cos(phi) * key->param;
+			vertex.y = centers[i][1] + sin(phi) * key->param;
+			vector_push(s_scratch, &vertex);
+		}
+	}
+}
@@ -33,11 +33,34 @@
 #include "minisphere.h"
 #include "profiler.h"
 
+#include "image.h"
 #include "jsal.h"
 #include "table.h"
 
-#define TIME_PRECISION 1.0e6    // microseconds
-#define UNIT_NAME      "us"
+#define TIME_PRECISION    1.0e6    // microseconds
+#define UNIT_NAME         "us"
+#define WARMUP_ITERATIONS 10000
+
+#define STRESS_BUDGET     8     // textures' worth of video memory
+#define STRESS_PASSES     4
+#define STRESS_SIZE       256   // width and height of each texture
+#define STRESS_TEXTURES   32
+
+enum prop_mode
+{
+	PROP_BY_STRING,  // push a JS string as the key (no property ID caching)
+	PROP_BY_NAME,    // jsal_get_prop_string() and friends (interned)
+	PROP_BY_KEY,     // jsal_get_prop_key() with a key made by jsal_new_key()
+};
+
+struct benchmark
+{
+	const char*   name;
+	js_function_t callback;
+	intptr_t      magic;
+	int           num_iterations;
+	const char*   driver;
+};
 
 struct record
 {
@@ -48,12 +71,51 @@ struct record
 	double    total_cost;
 };
 
+static bool js_benchmarkArgs       (int num_args, bool is_ctor, intptr_t magic);
+static bool js_benchmarkBuffer     (int num_args, bool is_ctor, intptr_t magic);
+static bool js_benchmarkNoOp       (int num_args, bool is_ctor, intptr_t magic);
+static bool js_benchmarkObject     (int num_args, bool is_ctor, intptr_t magic);
+static bool js_benchmarkProperty   (int num_args, bool is_ctor, intptr_t magic);
+static bool js_benchmarkThrow      (int num_args, bool is_ctor, intptr_t magic);
 static bool js_instrumentedWrapper (int num_args, bool is_ctor, intptr_t magic);
 
-static int  order_records (const void* a_ptr, const void* b_ptr);
-static void print_results (double running_time);
+static int  order_records         (const void* a_ptr, const void* b_ptr);
+static void print_results         (double running_time);
+static bool stress_texture_budget (void);
+static bool time_driver           (int num_iterations, double *out_time);
+
+// each driver is a JS function `(f, n)` which exercises the native function `f`
+// `n` times.  the first entry has no native calls and gives a baseline for the
+// cost of the JS loop itself.
+static const struct benchmark BENCHMARKS[] =
+{
+	{ "JS-to-JS call (baseline)", js_benchmarkNoOp, 0, 1000000,
+		"(function (f, n) { const g = function () {}; for (let i = 0; i < n; ++i) g(); })" },
+	{ "native call, 0 args", js_benchmarkNoOp, 0, 1000000,
+		"(function (f, n) { for (let i = 0; i < n; ++i) f(); })" },
+	{ "native call, 4 args", js_benchmarkArgs, 4, 1000000,
+		"(function (f, n) { for (let i = 0; i < n; ++i) f(i, 1, 2, 3); })" },
+	{ "native call, 8 args", js_benchmarkArgs, 8, 1000000,
+		"(function (f, n) { for (let i = 0; i < n; ++i) f(i, 1, 2, 3, 4, 5, 6, 7); })" },
+	{ "native getter", js_benchmarkNoOp, 0, 1000000,
+		"(function (f, n) { const o = Object.defineProperty({}, 'x', { get: f }); for (let i = 0; i < n; ++i) o.x; })" },
+	{ "property get/put, string key", js_benchmarkProperty, PROP_BY_STRING, 1000000,
+		"(function (f, n) { const o = { x: 0 }; for (let i = 0; i < n; ++i) f(o); })" },
+	{ "property get/put, interned name", js_benchmarkProperty, PROP_BY_NAME, 1000000,
+		"(function (f, n) { const o = { x: 0 }; for (let i = 0; i < n; ++i) f(o); })" },
+	{ "property get/put, pre-created key", js_benchmarkProperty, PROP_BY_KEY, 1000000,
+		"(function (f, n) { const o = { x: 0 }; for (let i = 0; i < n; ++i) f(o); })" },
+	{ "host object creation", js_benchmarkObject, 0, 1000000,
+		"(function (f, n) { for (let i = 0; i < n; ++i) f(); })" },
+	{ "typed array access", js_benchmarkBuffer, 0, 1000000,
+		"(function (f, n) { const a = new Uint8Array(256); for (let i = 0; i < n; ++i) f(a); })" },
+	{ "exception throw/catch", js_benchmarkThrow, 0, 100000,
+		"(function (f, n) { for (let i = 0; i < n; ++i) { try { f(); } catch (e) {} } })" },
+};
 
 bool      s_initialized = false;
+js_ref_t* s_key_x;
+js_ref_t* s_prototype;
 vector_t* s_records;
 double    s_startup_time;
 
@@ -119,6 +181,61 @@ profiler_attach_to(js_ref_t* function, const char* description)
 	return shim_ref;
 }
 
+bool
+profiler_run_benchmarks(void)
+{
+	const struct benchmark* benchmark;
+	double                  running_time;
+	table_t*                table;
+	char*                   text;
+
+	int i;
+
+	printf("running JS binding layer benchmarks...\n");
+
+	s_key_x = jsal_new_key("x");
+	jsal_push_new_bare_object();
+	s_prototype = jsal_ref(-1);
+	jsal_pop(1);
+
+	table = table_new("jsal benchmark - JS/native call overhead", false);
+	table_add_column(table, "benchmark");
+	table_add_column(table, "iterations");
+	table_add_column(table, "time (%s)", UNIT_NAME);
+	table_add_column(table, "ns/op");
+	for (i = 0; i < sizeof BENCHMARKS / sizeof BENCHMARKS[0]; ++i) {
+		benchmark = &BENCHMARKS[i];
+		jsal_push_eval(benchmark->driver);
+		jsal_push_new_function(benchmark->callback, "", 0, benchmark->magic);
+		if (!time_driver(WARMUP_ITERATIONS, &running_time))
+			goto on_error;
+		if (!time_driver(benchmark->num_iterations, &running_time))
+			goto on_error;
+		jsal_pop(2);
+		text = strnewf("%.1f", running_time * 1.0e9 / benchmark->num_iterations);
+		table_add_text(table, 0, benchmark->name);
+		table_add_number(table, 1, benchmark->num_iterations);
+		table_add_number(table, 2, running_time * TIME_PRECISION);
+		table_add_text(table, 3, text);
+		free(text);
+	}
+	printf("\n");
+	table_print(table);
+	table_free(table);
+	jsal_unref(s_key_x);
+	jsal_unref(s_prototype);
+	return stress_texture_budget();
+
+on_error:
+	printf("benchmark '%s' failed\n", benchmark->name);
+	printf("-> %s\n", jsal_to_string(-1));
+	jsal_pop(3);
+	table_free(table);
+	jsal_unref(s_key_x);
+	jsal_unref(s_prototype);
+	return false;
+}
+
 static int
 order_records(const void* a_ptr, const void* b_ptr)
 {
@@ -188,6 +305,203 @@ print_results(double running_time)
 	free(heading);
 }
 
+static bool
+stress_texture_budget(void)
+{
+	color_t              color;
+	ALLEGRO_DISPLAY*     display = NULL;
+	bool                 is_ok = true;
+	image_memory_stats_t old_stats;
+	image_pool_stats_t   pool_stats;
+	double               start_time;
+	image_memory_stats_t stats;
+	table_t*             table;
+	image_t*             target = NULL;
+	image_t*             textures[STRESS_TEXTURES] = { NULL };
+	size_t               texture_size;
+
+	int i, j;
+
+	// note: this draws more textures than the budget allows, in a round-robin order
+	//       that makes the least recently used one the next one drawn.  every draw
+	//       after the first pass therefore forces both a demotion and an upload.
+	//       video bitmaps need a display, so make one if there isn't one already.
+	if (al_get_current_display() == NULL) {
+		if (!(display = al_create_display(64, 64))) {
+			printf("no display available, skipping texture budget stress test\n");
+			return true;
+		}
+	}
+	printf("running texture budget stress test...\n");
+	old_stats = image_memory_stats();
+	pool_stats = image_pool_stats();
+	texture_size = (size_t)STRESS_SIZE * STRESS_SIZE * 4;
+	if (!(target = image_new(STRESS_SIZE, STRESS_SIZE, NULL)))
+		goto on_error;
+	for (i = 0; i < STRESS_TEXTURES; ++i) {
+		if (!(textures[i] = image_new(STRESS_SIZE, STRESS_SIZE, NULL)))
+			goto on_error;
+		image_fill(textures[i], mk_color(i, 255 - i, i * 2, 255));
+	}
+	image_set_texture_budget(STRESS_BUDGET * texture_size);
+	start_time = al_get_time();
+	for (j = 0; j < STRESS_PASSES; ++j) {
+		for (i = 0; i < STRESS_TEXTURES; ++i) {
+			image_render_to(target, NULL);
+			image_draw(textures[i], 0, 0);
+			stats = image_memory_stats();
+			if (stats.video_bytes > STRESS_BUDGET * texture_size) {
+				printf("video memory over budget: %d KB\n", (int)(stats.video_bytes / 1024));
+				is_ok = false;
+			}
+		}
+	}
+	stats = image_memory_stats();
+
+	// make sure the contents survived the trips to system memory and back
+	for (i = 0; i < STRESS_TEXTURES; ++i) {
+		color = image_get_pixel(textures[i], STRESS_SIZE / 2, STRESS_SIZE / 2);
+		if (color.r != i || color.g != 255 - i || color.b != i * 2) {
+			printf("texture #%d lost its contents\n", i);
+			is_ok = false;
+		}
+	}
+	if (stats.num_demotions == old_stats.num_demotions || stats.num_uploads == old_stats.num_uploads) {
+		printf("no textures were demoted and uploaded again\n");
+		is_ok = false;
+	}
+
+	table = table_new("texture budget stress test", false);
+	table_add_column(table, "textures");
+	table_add_column(table, "budget (KB)");
+	table_add_column(table, "draws");
+	table_add_column(table, "demotions");
+	table_add_column(table, "uploads");
+	table_add_column(table, "time (%s)", UNIT_NAME);
+	table_add_number(table, 0, STRESS_TEXTURES);
+	table_add_number(table, 1, STRESS_BUDGET * texture_size / 1024);
+	table_add_number(table, 2, STRESS_TEXTURES * STRESS_PASSES);
+	table_add_number(table, 3, stats.num_demotions - old_stats.num_demotions);
+	table_add_number(table, 4, stats.num_uploads - old_stats.num_uploads);
+	table_add_number(table, 5, (al_get_time() - start_time) * TIME_PRECISION);
+	printf("\n");
+	table_print(table);
+	table_free(table);
+	goto clean_up;
+
+on_error:
+	printf("couldn't create textures for the stress test\n");
+	is_ok = false;
+
+clean_up:
+	image_set_texture_budget(old_stats.budget);
+	for (i = 0; i < STRESS_TEXTURES; ++i)
+		image_unref(textures[i]);
+	image_unref(target);
+
+	// pooled bitmaps belong to the display, so they have to go before it does
+	if (display != NULL) {
+		image_pool_set_limit(0);
+		al_destroy_display(display);
+		image_pool_set_limit(pool_stats.max_bytes);
+	}
+	return is_ok;
+}
+
+static bool
+time_driver(int num_iterations, double *out_time)
+{
+	double start_time;
+
+	// the driver and the native function under test should be on top of the
+	// value stack.  both are left there to allow additional passes.
+	jsal_dup(-2);
+	jsal_dup(-2);
+	jsal_push_int(num_iterations);
+	start_time = al_get_time();
+	if (!jsal_try_call(2))
+		return false;
+	*out_time = al_get_time() - start_time;
+	jsal_pop(1);
+	return true;
+}
+
+static bool
+js_benchmarkArgs(int num_args, bool is_ctor, intptr_t magic)
+{
+	double sum = 0.0;
+
+	int i;
+
+	for (i = 0; i < magic; ++i)
+		sum += jsal_require_number(i);
+	jsal_push_number(sum);
+	return true;
+}
+
+static bool
+js_benchmarkBuffer(int num_args, bool is_ctor, intptr_t magic)
+{
+	uint8_t* data;
+	size_t   size;
+
+	data = jsal_require_buffer_ptr(0, &size);
+	if (size > 0)
+		++data[0];
+	return false;
+}
+
+static bool
+js_benchmarkNoOp(int num_args, bool is_ctor, intptr_t magic)
+{
+	return false;
+}
+
+static bool
+js_benchmarkObject(int num_args, bool is_ctor, intptr_t magic)
+{
+	int* data;
+
+	// note: all objects share a single prototype, so they don't get chained together.
+	jsal_push_ref_weak(s_prototype);
+	jsal_push_new_host_object(NULL, sizeof(int), (void**)&data);
+	*data = 812;
+	return true;
+}
+
+static bool
+js_benchmarkProperty(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_require_object(0);
+	switch (magic) {
+	case PROP_BY_STRING:
+		jsal_push_string("x");
+		jsal_get_prop(0);
+		jsal_push_string("x");
+		jsal_push_int(jsal_to_int(-2) + 1);
+		jsal_put_prop(0);
+		break;
+	case PROP_BY_NAME:
+		jsal_get_prop_string(0, "x");
+		jsal_push_int(jsal_to_int(-1) + 1);
+		jsal_put_prop_string(0, "x");
+		break;
+	case PROP_BY_KEY:
+		jsal_get_prop_key(0, s_key_x);
+		jsal_push_int(jsal_to_int(-1) + 1);
+		jsal_put_prop_key(0, s_key_x);
+		break;
+	}
+	return false;
+}
+
+static bool
+js_benchmarkThrow(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_error(JS_ERROR, "Benchmark exception");
+	return false;
+}
+
 static bool
 js_instrumentedWrapper(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -35,9 +35,10 @@
 
 #include "jsal.h"
 
-void      profiler_init      (void);
-void      profiler_uninit    (void);
-bool      profiler_enabled   (void);
-js_ref_t* profiler_attach_to (js_ref_t* function, const char* description);
+void      profiler_init           (void);
+void      profiler_uninit         (void);
+bool      profiler_enabled        (void);
+js_ref_t* profiler_attach_to      (js_ref_t* function, const char* description);
+bool      profiler_run_benchmarks (void);
 
 #endif // SPHERE__PROFILER_H__INCLUDED
@@ -0,0 +1,556 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+// the render state tracker is the single point through which the engine changes
+// Allegro render state (target, blender, shader, transformations and clipping).
+// it remembers what was last set and skips changes which wouldn't do anything,
+// which matters because nearly every draw call re-applies its full state.
+//
+// note: in Allegro, everything except the blender is stored per bitmap, so
+//       switching targets makes the tracker forget all but the blend mode.
+//
+// this is also home to the deferred render queue.  a queue records draws made to
+// a surface and plays them back later, merging draws that share the same state
+// into a single draw call.  a draw may also be moved back past earlier ones to
+// join a compatible group, but only if it doesn't overlap anything it would be
+// moved past.  as bounds can't be known when a custom shader is in use, only
+// draws using the default shader are eligible to be moved.
+
+#include "minisphere.h"
+#include "render.h"
+
+#include "counter.h"
+#include "galileo.h"
+#include "image.h"
+#include "vector.h"
+
+struct render_queue
+{
+	vector_t* commands;
+	bool      flushing;
+	vector_t* groups;
+	vector_t* scratch;
+	vector_t* vertices;
+};
+
+struct command
+{
+	int first_vertex;
+	int next_command;
+	int num_vertices;
+};
+
+struct group
+{
+	blend_mode_t      blend_mode;
+	rect_t            clip_box;
+	int               first_command;
+	int               last_command;
+	bool              movable;
+	int               num_vertices;
+	int               prim_type;
+	ALLEGRO_TRANSFORM projection;
+	shader_t*         shader;
+	image_t*          texture;
+	ALLEGRO_TRANSFORM transform;
+	float             x1, y1, x2, y2;
+};
+
+struct render_state
+{
+	ALLEGRO_BITMAP*   target;
+	bool              have_blend;
+	bool              have_clip;
+	bool              have_projection;
+	bool              have_shader;
+	bool              have_transform;
+	blend_mode_t      blend_mode;
+	rect_t            clip_box;
+	ALLEGRO_TRANSFORM projection;
+	ALLEGRO_SHADER*   shader;
+	ALLEGRO_TRANSFORM transform;
+};
+
+static void apply_blend_mode (blend_mode_t mode);
+static int  push_as_list     (vector_t* list, shape_type_t type, const ALLEGRO_VERTEX* vertices, int num_vertices);
+
+static unsigned int        s_counts[RENDER_STAT_MAX];
+static unsigned int        s_last_counts[RENDER_STAT_MAX];
+static struct render_state s_state;
+
+void
+render_count_draws(int num_draws)
+{
+	s_counts[RENDER_STAT_DRAWS] += num_draws;
+	counter_add(COUNTER_DRAWS, num_draws);
+}
+
+void
+render_end_frame(void)
+{
+	memcpy(s_last_counts, s_counts, sizeof s_counts);
+	memset(s_counts, 0, sizeof s_counts);
+}
+
+void
+render_forget(ALLEGRO_BITMAP* bitmap)
+{
+	// note: call this before destroying a bitmap.  if it's the current target, a
+	//       new bitmap allocated at the same address would otherwise be mistaken
+	//       for it and never actually be selected.
+	if (bitmap == s_state.target)
+		render_invalidate();
+}
+
+void
+render_invalidate(void)
+{
+	// call this after touching Allegro render state directly, to make sure the
+	// next change goes through even if it looks like a no-op.
+	memset(&s_state, 0, sizeof(struct render_state));
+}
+
+bool
+render_has_shader(ALLEGRO_SHADER* shader)
+{
+	return s_state.have_shader && s_state.shader == shader;
+}
+
+ALLEGRO_BITMAP*
+render_target(void)
+{
+	return s_state.target;
+}
+
+void
+render_set_blend(blend_mode_t mode)
+{
+	if (s_state.have_blend && mode == s_state.blend_mode) {
+		++s_counts[RENDER_STAT_SKIPPED];
+		return;
+	}
+	apply_blend_mode(mode);
+	s_state.blend_mode = mode;
+	s_state.have_blend = true;
+	++s_counts[RENDER_STAT_BLEND];
+}
+
+void
+render_set_clip(rect_t clip_box)
+{
+	if (s_state.have_clip
+		&& clip_box.x1 == s_state.clip_box.x1 && clip_box.y1 == s_state.clip_box.y1
+		&& clip_box.x2 == s_state.clip_box.x2 && clip_box.y2 == s_state.clip_box.y2)
+	{
+		++s_counts[RENDER_STAT_SKIPPED];
+		return;
+	}
+	al_set_clipping_rectangle(clip_box.x1, clip_box.y1,
+		clip_box.x2 - clip_box.x1, clip_box.y2 - clip_box.y1);
+	s_state.clip_box = clip_box;
+	s_state.have_clip = true;
+	++s_counts[RENDER_STAT_CLIP];
+}
+
+void
+render_set_projection(const ALLEGRO_TRANSFORM* matrix)
+{
+	if (s_state.have_projection && memcmp(matrix, &s_state.projection, sizeof(ALLEGRO_TRANSFORM)) == 0) {
+		++s_counts[RENDER_STAT_SKIPPED];
+		return;
+	}
+	al_use_projection_transform(matrix);
+	s_state.projection = *matrix;
+	s_state.have_projection = true;
+	++s_counts[RENDER_STAT_TRANSFORM];
+}
+
+bool
+render_set_shader(ALLEGRO_SHADER* shader)
+{
+	if (render_has_shader(shader)) {
+		++s_counts[RENDER_STAT_SKIPPED];
+		return true;
+	}
+	if (!al_use_shader(shader))
+		return false;
+	s_state.shader = shader;
+	s_state.have_shader = true;
+	++s_counts[RENDER_STAT_SHADER];
+	return true;
+}
+
+void
+render_set_target(ALLEGRO_BITMAP* bitmap)
+{
+	if (bitmap == s_state.target) {
+		++s_counts[RENDER_STAT_SKIPPED];
+		return;
+	}
+	al_set_target_bitmap(bitmap);
+	s_state.target = bitmap;
+	s_state.have_clip = false;
+	s_state.have_projection = false;
+	s_state.have_shader = false;
+	s_state.have_transform = false;
+	++s_counts[RENDER_STAT_TARGET];
+}
+
+void
+render_set_transform(const ALLEGRO_TRANSFORM* matrix)
+{
+	ALLEGRO_TRANSFORM identity;
+
+	if (matrix == NULL) {
+		al_identity_transform(&identity);
+		matrix = &identity;
+	}
+	if (s_state.have_transform && memcmp(matrix, &s_state.transform, sizeof(ALLEGRO_TRANSFORM)) == 0) {
+		++s_counts[RENDER_STAT_SKIPPED];
+		return;
+	}
+	al_use_transform(matrix);
+	s_state.transform = *matrix;
+	s_state.have_transform = true;
+	++s_counts[RENDER_STAT_TRANSFORM];
+}
+
+unsigned int
+render_stat(render_stat_t stat)
+{
+	// note: this reports on the last complete frame; counts for the frame in
+	//       progress aren't available until the next screen_flip().
+	return s_last_counts[stat];
+}
+
+render_queue_t*
+render_queue_new(void)
+{
+	render_queue_t* queue;
+
+	queue = calloc(1, sizeof(render_queue_t));
+	queue->commands = vector_new(sizeof(struct command));
+	queue->groups = vector_new(sizeof(struct group));
+	queue->scratch = vector_new(sizeof(ALLEGRO_VERTEX));
+	queue->vertices = vector_new(sizeof(ALLEGRO_VERTEX));
+	return queue;
+}
+
+void
+render_queue_free(render_queue_t* it)
+{
+	if (it == NULL)
+		return;
+	render_queue_clear(it);
+	vector_free(it->commands);
+	vector_free(it->groups);
+	vector_free(it->scratch);
+	vector_free(it->vertices);
+	free(it);
+}
+
+int
+render_queue_len(const render_queue_t* it)
+{
+	return vector_len(it->commands);
+}
+
+void
+render_queue_add(render_queue_t* it, shape_type_t type, image_t* texture, shader_t* shader, blend_mode_t blend_mode, rect_t clip_box, const ALLEGRO_TRANSFORM* projection, const ALLEGRO_TRANSFORM* transform, const ALLEGRO_VERTEX* vertices, int num_vertices)
+{
+	struct command  command;
+	int             first_vertex;
+	struct group*   group = NULL;
+	int             index;
+	bool            movable;
+	struct group    new_group;
+	int             prim_type;
+	ALLEGRO_VERTEX* vertex;
+	float           x, y;
+	float           x1 = 0.0f, y1 = 0.0f;
+	float           x2 = 0.0f, y2 = 0.0f;
+
+	int i;
+
+	first_vertex = vector_len(it->vertices);
+	prim_type = push_as_list(it->vertices, type, vertices, num_vertices);
+	num_vertices = vector_len(it->vertices) - first_vertex;
+	if (num_vertices == 0)
+		return;
+	++s_counts[RENDER_STAT_QUEUED];
+
+	// work out the bounding box of the draw in model-view space.  pad it by a
+	// pixel to account for rasterization of points and lines.
+	movable = shader == galileo_shader();
+	if (movable) {
+		for (i = 0; i < num_vertices; ++i) {
+			vertex = vector_get(it->vertices, first_vertex + i);
+			x = vertex->x;
+			y = vertex->y;
+			al_transform_coordinates(transform, &x, &y);
+			x1 = i == 0 || x < x1 ? x : x1;
+			y1 = i == 0 || y < y1 ? y : y1;
+			x2 = i == 0 || x > x2 ? x : x2;
+			y2 = i == 0 || y > y2 ? y : y2;
+		}
+		x1 -= 1.0f; y1 -= 1.0f;
+		x2 += 1.0f; y2 += 1.0f;
+	}
+
+	// look for a compatible group to merge into, walking backwards as long as
+	// the draw can be safely moved past the groups in between.
+	for (index = vector_len(it->groups) - 1; index >= 0; --index) {
+		if (vector_len(it->groups) - index > RENDER_QUEUE_LOOKBACK) {
+			index = -1;
+			break;
+		}
+		group = vector_get(it->groups, index);
+		if (group->prim_type == prim_type
+			&& group->texture == texture
+			&& group->shader == shader
+			&& group->blend_mode == blend_mode
+			&& memcmp(&group->clip_box, &clip_box, sizeof(rect_t)) == 0
+			&& memcmp(&group->projection, projection, sizeof(ALLEGRO_TRANSFORM)) == 0
+			&& memcmp(&group->transform, transform, sizeof(ALLEGRO_TRANSFORM)) == 0)
+		{
+			break;
+		}
+		if (!movable || !group->movable
+			|| memcmp(&group->projection, projection, sizeof(ALLEGRO_TRANSFORM)) != 0
+			|| (x1 < group->x2 && x2 > group->x1 && y1 < group->y2 && y2 > group->y1))
+		{
+			index = -1;
+			break;
+		}
+	}
+	if (index < 0) {
+		memset(&new_group, 0, sizeof(struct group));
+		new_group.blend_mode = blend_mode;
+		new_group.clip_box = clip_box;
+		new_group.first_command = -1;
+		new_group.last_command = -1;
+		new_group.movable = movable;
+		new_group.prim_type = prim_type;
+		new_group.projection = *projection;
+		new_group.shader = shader_ref(shader);
+		new_group.texture = image_ref(texture);
+		image_add_reader(texture);
+		new_group.transform = *transform;
+		new_group.x1 = x1; new_group.y1 = y1;
+		new_group.x2 = x2; new_group.y2 = y2;
+		vector_push(it->groups, &new_group);
+		group = vector_get(it->groups, vector_len(it->groups) - 1);
+	}
+	else if (movable && group->movable) {
+		group->x1 = x1 < group->x1 ? x1 : group->x1;
+		group->y1 = y1 < group->y1 ? y1 : group->y1;
+		group->x2 = x2 > group->x2 ? x2 : group->x2;
+		group->y2 = y2 > group->y2 ? y2 : group->y2;
+	}
+	else {
+		group->movable = false;
+	}
+
+	command.first_vertex = first_vertex;
+	command.next_command = -1;
+	command.num_vertices = num_vertices;
+	vector_push(it->commands, &command);
+	index = vector_len(it->commands) - 1;
+	if (group->last_command >= 0)
+		((struct command*)vector_get(it->commands, group->last_command))->next_command = index;
+	else
+		group->first_command = index;
+	group->last_command = index;
+	group->num_vertices += num_vertices;
+}
+
+void
+render_queue_clear(render_queue_t* it)
+{
+	struct group* group;
+
+	iter_t iter;
+
+	iter = vector_enum(it->groups);
+	while ((group = iter_next(&iter))) {
+		image_remove_reader(group->texture);
+		image_unref(group->texture);
+		shader_unref(group->shader);
+	}
+	vector_clear(it->commands);
+	vector_clear(it->groups);
+	vector_clear(it->vertices);
+}
+
+void
+render_queue_flush(render_queue_t* it, ALLEGRO_BITMAP* target)
+{
+	ALLEGRO_BITMAP* bitmap;
+	struct command* command;
+	struct group*   group;
+	int             index;
+	ALLEGRO_STATE   old_state;
+	ALLEGRO_VERTEX* vertices;
+
+	int i;
+
+	// note: a flush can be triggered in the middle of another draw, e.g. when a
+	//       deferred surface is used as a texture, so the previous target and
+	//       blender are restored afterwards.
+	if (it->flushing || vector_len(it->groups) == 0)
+		return;
+	it->flushing = true;
+	al_store_state(&old_state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+	for (i = 0; i < vector_len(it->groups); ++i) {
+		group = vector_get(it->groups, i);
+
+		// this may flush the texture's own queue, so do it before setting state
+		bitmap = group->texture != NULL ? image_bitmap(group->texture) : NULL;
+
+		if (!vector_resize(it->scratch, group->num_vertices))
+			continue;
+		vertices = vector_get(it->scratch, 0);
+		for (index = group->first_command; index >= 0; index = command->next_command) {
+			command = vector_get(it->commands, index);
+			memcpy(vertices, vector_get(it->vertices, command->first_vertex),
+				command->num_vertices * sizeof(ALLEGRO_VERTEX));
+			vertices += command->num_vertices;
+		}
+
+		render_set_target(target);
+		render_set_clip(group->clip_box);
+		render_set_projection(&group->projection);
+		render_set_transform(&group->transform);
+		render_set_blend(group->blend_mode);
+		shader_use(group->shader, false);
+		al_draw_prim(vector_get(it->scratch, 0), NULL, bitmap, 0, group->num_vertices, group->prim_type);
+		render_count_draws(1);
+		counter_bind(bitmap);
+		counter_add(COUNTER_VERTICES, group->num_vertices);
+		++s_counts[RENDER_STAT_FLUSHED];
+	}
+	render_queue_clear(it);
+	al_restore_state(&old_state);
+	render_invalidate();
+	it->flushing = false;
+}
+
+static void
+apply_blend_mode(blend_mode_t mode)
+{
+	switch (mode) {
+		case BLEND_NORMAL:
+			al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
+			break;
+		case BLEND_ADD:
+			al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ONE);
+			break;
+		case BLEND_AVERAGE:
+			al_set_blender(ALLEGRO_ADD, ALLEGRO_CONST_COLOR, ALLEGRO_CONST_COLOR);
+			al_set_blend_color(al_map_rgba_f(0.5, 0.5, 0.5, 0.5));
+			break;
+		case BLEND_COPY_ALPHA:
+			al_set_separate_blender(
+				ALLEGRO_ADD, ALLEGRO_ZERO, ALLEGRO_ONE,
+				ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+			break;
+		case BLEND_COPY_RGB:
+			al_set_separate_blender(
+				ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO,
+				ALLEGRO_ADD, ALLEGRO_ZERO, ALLEGRO_ONE);
+			break;
+		case BLEND_INVERT:
+			al_set_blender(ALLEGRO_ADD, ALLEGRO_ZERO, ALLEGRO_INVERSE_SRC_COLOR);
+			break;
+		case BLEND_MULTIPLY:
+			al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ONE);
+			break;
+		case BLEND_REPLACE:
+			al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+			break;
+		case BLEND_SUBTRACT:
+			al_set_blender(ALLEGRO_DEST_MINUS_SRC, ALLEGRO_ONE, ALLEGRO_ONE);
+			break;
+		default:
+			// this shouldn't happen, but in case it does, just output nothing to make it
+			// obvious something went wrong.
+			al_set_blender(ALLEGRO_ADD, ALLEGRO_ZERO, ALLEGRO_ZERO);
+	}
+}
+
+static int
+push_as_list(vector_t* list, shape_type_t type, const ALLEGRO_VERTEX* vertices, int num_vertices)
+{
+	int i;
+
+	// convert strips, fans and loops to plain lists so that consecutive draws can
+	// be concatenated without being stitched together.
+	switch (type) {
+	case SHAPE_LINE_LOOP:
+	case SHAPE_LINE_STRIP:
+		for (i = 0; i < num_vertices - 1; ++i) {
+			vector_push(list, &vertices[i]);
+			vector_push(list, &vertices[i + 1]);
+		}
+		if (type == SHAPE_LINE_LOOP && num_vertices > 2) {
+			vector_push(list, &vertices[num_vertices - 1]);
+			vector_push(list, &vertices[0]);
+		}
+		return ALLEGRO_PRIM_LINE_LIST;
+	case SHAPE_LINES:
+		for (i = 0; i < num_vertices - num_vertices % 2; ++i)
+			vector_push(list, &vertices[i]);
+		return ALLEGRO_PRIM_LINE_LIST;
+	case SHAPE_TRI_FAN:
+		for (i = 1; i < num_vertices - 1; ++i) {
+			vector_push(list, &vertices[0]);
+			vector_push(list, &vertices[i]);
+			vector_push(list, &vertices[i + 1]);
+		}
+		return ALLEGRO_PRIM_TRIANGLE_LIST;
+	case SHAPE_TRI_STRIP:
+		for (i = 0; i < num_vertices - 2; ++i) {
+			vector_push(list, &vertices[i % 2 == 0 ? i : i + 1]);
+			vector_push(list, &vertices[i % 2 == 0 ? i + 1 : i]);
+			vector_push(list, &vertices[i + 2]);
+		}
+		return ALLEGRO_PRIM_TRIANGLE_LIST;
+	case SHAPE_TRIANGLES:
+		for (i = 0; i < num_vertices - num_vertices % 3; ++i)
+			vector_push(list, &vertices[i]);
+		return ALLEGRO_PRIM_TRIANGLE_LIST;
+	default:
+		for (i = 0; i < num_vertices; ++i)
+			vector_push(list, &vertices[i]);
+		return ALLEGRO_PRIM_POINT_LIST;
+	}
+}
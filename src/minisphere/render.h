@@ -0,0 +1,78 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef SPHERE__RENDER_H__INCLUDED
+#define SPHERE__RENDER_H__INCLUDED
+
+#include "image.h"
+#include "galileo.h"
+
+#define RENDER_QUEUE_LOOKBACK 16
+
+typedef struct render_queue render_queue_t;
+
+typedef
+enum render_stat
+{
+	RENDER_STAT_DRAWS,
+	RENDER_STAT_BLEND,
+	RENDER_STAT_CLIP,
+	RENDER_STAT_SHADER,
+	RENDER_STAT_TARGET,
+	RENDER_STAT_TRANSFORM,
+	RENDER_STAT_SKIPPED,
+	RENDER_STAT_QUEUED,
+	RENDER_STAT_FLUSHED,
+	RENDER_STAT_MAX
+} render_stat_t;
+
+void            render_count_draws    (int num_draws);
+void            render_end_frame      (void);
+void            render_forget         (ALLEGRO_BITMAP* bitmap);
+void            render_invalidate     (void);
+bool            render_has_shader     (ALLEGRO_SHADER* shader);
+ALLEGRO_BITMAP* render_target         (void);
+void            render_set_blend      (blend_mode_t mode);
+void            render_set_clip       (rect_t clip_box);
+void            render_set_projection (const ALLEGRO_TRANSFORM* matrix);
+bool            render_set_shader     (ALLEGRO_SHADER* shader);
+void            render_set_target     (ALLEGRO_BITMAP* bitmap);
+void            render_set_transform  (const ALLEGRO_TRANSFORM* matrix);
+unsigned int    render_stat           (render_stat_t stat);
+render_queue_t* render_queue_new      (void);
+void            render_queue_free     (render_queue_t* it);
+int             render_queue_len      (const render_queue_t* it);
+void            render_queue_add      (render_queue_t* it, shape_type_t type, image_t* texture, shader_t* shader, blend_mode_t blend_mode, rect_t clip_box, const ALLEGRO_TRANSFORM* projection, const ALLEGRO_TRANSFORM* transform, const ALLEGRO_VERTEX* vertices, int num_vertices);
+void            render_queue_clear    (render_queue_t* it);
+void            render_queue_flush    (render_queue_t* it, ALLEGRO_BITMAP* target);
+
+#endif // SPHERE__RENDER_H__INCLUDED
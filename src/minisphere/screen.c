@@ -38,13 +38,18 @@
 #include "minisphere.h"
 #include "screen.h"
 
+#include "counter.h"
 #include "debugger.h"
 #include "font.h"
 #include "image.h"
+#include "input.h"
+#include "pacer.h"
+#include "render.h"
 
 struct screen
 {
 	image_t*         backbuffer;
+	path_t*          capture_path;
 	rect_t           clip_rect;
 	ALLEGRO_DISPLAY* display;
 	font_t*          font;
@@ -55,12 +60,15 @@ struct screen
 	double           last_flip_time;
 	int              max_skips;
 	double           next_frame_time;
+	unsigned int     num_captures;
 	int              num_flips;
 	int              num_frames;
 	int              num_skips;
+	int              refresh_rate;
 	bool             show_fps;
 	bool             skipping_frame;
 	bool             take_screenshot;
+	bool             vsync;
 	int              x_offset;
 	float            x_scale;
 	int              x_size;
@@ -69,14 +77,15 @@ struct screen
 	int              y_size;
 };
 
+static void draw_counters   (screen_t* screen, int x, int y);
 static void refresh_display (screen_t* screen);
 
 screen_t*
-screen_new(const char* title, image_t* icon, size2_t resolution, int frameskip, font_t* font)
+screen_new(const char* title, image_t* icon, size2_t resolution, int frameskip, bool vsync, bool headless, font_t* font)
 {
 	image_t*             backbuffer = NULL;
 	int                  bitmap_flags;
-	ALLEGRO_DISPLAY*     display;
+	ALLEGRO_DISPLAY*     display = NULL;
 	ALLEGRO_BITMAP*      icon_bitmap;
 	ALLEGRO_MONITOR_INFO desktop_info;
 	ALLEGRO_STATE        old_state;
@@ -84,24 +93,34 @@ screen_new(const char* title, image_t* icon, size2_t resolution, int frameskip,
 	int                  x_scale = 1;
 	int                  y_scale = 1;
 
-	console_log(1, "initializing render context at %dx%d", resolution.width, resolution.height);
-
-	al_set_new_window_title(title);
-	al_set_new_display_flags(ALLEGRO_OPENGL | ALLEGRO_PROGRAMMABLE_PIPELINE);
-	if (al_get_monitor_info(0, &desktop_info)) {
-		x_scale = ((desktop_info.x2 - desktop_info.x1) / 1.5) / resolution.width;
-		y_scale = ((desktop_info.y2 - desktop_info.y1) / 1.5) / resolution.height;
-		x_scale = y_scale = fmax(fmin(x_scale, y_scale), 1.0);
+	console_log(1, "initializing %srender context at %dx%d",
+		headless ? "headless " : "", resolution.width, resolution.height);
+
+	// in headless mode there's no display at all.  everything, including the
+	// backbuffer, is rendered into memory bitmaps by Allegro's software renderer,
+	// so this works without a GPU or window system.
+	if (!headless) {
+		al_set_new_window_title(title);
+		al_set_new_display_flags(ALLEGRO_OPENGL | ALLEGRO_PROGRAMMABLE_PIPELINE);
+		if (vsync)
+			al_set_new_display_option(ALLEGRO_VSYNC, 1, ALLEGRO_SUGGEST);
+		if (al_get_monitor_info(0, &desktop_info)) {
+			x_scale = ((desktop_info.x2 - desktop_info.x1) / 1.5) / resolution.width;
+			y_scale = ((desktop_info.y2 - desktop_info.y1) / 1.5) / resolution.height;
+			x_scale = y_scale = fmax(fmin(x_scale, y_scale), 1.0);
+		}
+		display = al_create_display(resolution.width * x_scale, resolution.height * y_scale);
 	}
-	display = al_create_display(resolution.width * x_scale, resolution.height * y_scale);
 
 	// using a custom backbuffer allows pixel-perfect rendering regardless of
 	// actual viewport size.
-	if (display != NULL) {
+	if (display != NULL || headless) {
 		// no alpha channel.  this sidesteps a few edge cases involving alpha blending
 		// and the screen-grab functions.
 		al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
 		al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ANY_24_NO_ALPHA);
+		if (headless)
+			al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
 		backbuffer = image_new(resolution.width, resolution.height, NULL);
 		al_restore_state(&old_state);
 	}
@@ -110,7 +129,7 @@ screen_new(const char* title, image_t* icon, size2_t resolution, int frameskip,
 		return NULL;
 	}
 
-	if (icon != NULL) {
+	if (icon != NULL && display != NULL) {
 		bitmap_flags = al_get_new_bitmap_flags() | ALLEGRO_NO_PRESERVE_TEXTURE;
 		al_set_new_bitmap_flags(
 			ALLEGRO_NO_PREMULTIPLIED_ALPHA | ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR
@@ -129,6 +148,10 @@ screen_new(const char* title, image_t* icon, size2_t resolution, int frameskip,
 	screen->x_size = resolution.width;
 	screen->y_size = resolution.height;
 	screen->max_skips = frameskip;
+	if (display != NULL) {
+		screen->vsync = vsync && al_get_display_option(display, ALLEGRO_VSYNC) != 2;
+		screen->refresh_rate = al_get_display_refresh_rate(display);
+	}
 
 	screen->fps_poll_time = al_get_time() + 1.0;
 	screen->next_frame_time = al_get_time();
@@ -150,7 +173,9 @@ screen_free(screen_t* it)
 
 	console_log(1, "shutting down render context");
 	image_unref(it->backbuffer);
-	al_destroy_display(it->display);
+	if (it->display != NULL)
+		al_destroy_display(it->display);
+	path_free(it->capture_path);
 	free(it);
 }
 
@@ -178,6 +203,18 @@ screen_size(const screen_t* it)
 	return mk_size2(it->x_size, it->y_size);
 }
 
+void
+screen_capture_frames(screen_t* it, const char* dirname)
+{
+	path_free(it->capture_path);
+	it->capture_path = NULL;
+	if (dirname == NULL)
+		return;
+	it->capture_path = path_new_dir(dirname);
+	path_mkdir(it->capture_path);
+	it->num_captures = 0;
+}
+
 bool
 screen_skipping_frame(const screen_t* it)
 {
@@ -201,6 +238,14 @@ screen_get_mouse_xy(const screen_t* it, int* o_x, int* o_y)
 {
 	ALLEGRO_MOUSE_STATE mouse_state;
 
+	// the input script, if there is one, takes over the mouse.  otherwise, if
+	// there's no display, there's no mouse either.
+	if (mouse_scripted_xy(o_x, o_y))
+		return;
+	if (it->display == NULL) {
+		*o_x = *o_y = 0;
+		return;
+	}
 	al_get_mouse_state(&mouse_state);
 	*o_x = (mouse_state.x - it->x_offset) / it->x_scale;
 	*o_y = (mouse_state.y - it->y_offset) / it->y_scale;
@@ -230,6 +275,8 @@ screen_set_fullscreen(screen_t* it, bool fullscreen)
 void
 screen_set_mouse_xy(screen_t* it, int x, int y)
 {
+	if (it->display == NULL)
+		return;
 	x = x * it->x_scale + it->x_offset;
 	y = y * it->y_scale + it->y_offset;
 	al_set_mouse_xy(it->display, x, y);
@@ -245,7 +292,7 @@ screen_draw_status(screen_t* it, const char* text, color_t color)
 	int               width;
 	int               height;
 
-	if (it->font == NULL)
+	if (it->font == NULL || it->display == NULL)
 		return;
 
 	screen_cx = al_get_display_width(it->display);
@@ -260,6 +307,7 @@ screen_draw_status(screen_t* it, const char* text, color_t color)
 	al_set_target_backbuffer(it->display);
 	al_draw_filled_rounded_rectangle(bounds.x1, bounds.y1, bounds.x2, bounds.y2, 4, 4,
 		al_map_rgba(16, 16, 16, 192));
+	render_count_draws(1);
 	font_set_mask(it->font, mk_color(0, 0, 0, 255));
 	font_draw_text(it->font, (bounds.x1 + bounds.x2) / 2 + 1,
 		bounds.y1 + 6, TEXT_ALIGN_CENTER, text);
@@ -274,10 +322,12 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 {
 	time_t            datetime;
 	char*             filename;
+	double            flip_start;
 	char              fps_text[20];
 	const char*       game_filename;
 	const path_t*     game_root;
 	bool              is_backbuffer_valid;
+	bool              is_vsync_paced;
 	ALLEGRO_STATE     old_state;
 	ALLEGRO_BITMAP*   old_target;
 	path_t*           path;
@@ -297,6 +347,19 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 	start_time = al_get_time();
 #endif
 
+	// with vsync on, al_flip_display() already blocks until the next vertical
+	// blank.  if that comes around at least as often as we want frames, the flip
+	// does all the waiting and pacer_wait() is skipped, so give idle jobs their
+	// share of the frame now, before the flip blocks.
+	is_vsync_paced = framerate > 0 && it->vsync && it->refresh_rate > 0
+		&& framerate >= it->refresh_rate;
+	if (is_vsync_paced)
+		pacer_idle(it->next_frame_time - PACER_SPIN_TIME);
+
+	// draw anything still waiting in the backbuffer's render queue
+	flip_start = al_get_time();
+	image_flush(it->backbuffer);
+
 	// update FPS with 1s granularity
 	if (al_get_time() >= it->fps_poll_time) {
 		it->fps_flips = it->num_flips;
@@ -307,9 +370,15 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 
 	// flip the backbuffer, unless the preceeding frame was skipped
 	is_backbuffer_valid = !it->skipping_frame;
-	screen_cx = al_get_display_width(it->display);
-	screen_cy = al_get_display_height(it->display);
-	if (is_backbuffer_valid) {
+	if (is_backbuffer_valid && it->capture_path != NULL) {
+		filename = strnewf("frame%06u.png", it->num_captures++);
+		path_change_name(it->capture_path, filename);
+		al_save_bitmap(path_cstr(it->capture_path), image_bitmap(it->backbuffer));
+		free(filename);
+	}
+	if (is_backbuffer_valid && it->display != NULL) {
+		screen_cx = al_get_display_width(it->display);
+		screen_cy = al_get_display_height(it->display);
 		if (it->take_screenshot) {
 			al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
 			al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ANY_24_NO_ALPHA);
@@ -341,6 +410,7 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 		al_draw_scaled_bitmap(image_bitmap(it->backbuffer), 0, 0, it->x_size, it->y_size,
 			it->x_offset, it->y_offset, it->x_size * it->x_scale, it->y_size * it->y_scale,
 			0x0);
+		render_count_draws(1);
 		if (debugger_attached())
 			screen_draw_status(it, debugger_name(), debugger_color());
 		if (it->show_fps && it->font != NULL) {
@@ -351,10 +421,12 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 			x = screen_cx - it->x_offset - 108;
 			y = screen_cy - it->y_offset - 24;
 			al_draw_filled_rounded_rectangle(x, y, x + 100, y + 16, 4, 4, al_map_rgba(16, 16, 16, 192));
+			render_count_draws(1);
 			font_set_mask(it->font, mk_color(0, 0, 0, 255));
 			font_draw_text(it->font, x + 51, y + 3, TEXT_ALIGN_CENTER, fps_text);
 			font_set_mask(it->font, mk_color(255, 255, 255, 255));
 			font_draw_text(it->font, x + 50, y + 2, TEXT_ALIGN_CENTER, fps_text);
+			draw_counters(it, x + 100, y - 4);
 		}
 		al_set_target_bitmap(old_target);
 		al_flip_display();
@@ -362,9 +434,16 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 		it->num_skips = 0;
 		++it->num_flips;
 	}
+	else if (is_backbuffer_valid) {
+		// headless: nothing to present, but it still counts as a flip
+		it->last_flip_time = al_get_time();
+		it->num_skips = 0;
+		++it->num_flips;
+	}
 	else {
 		++it->num_skips;
 	}
+	pacer_record(PACER_FLIP, al_get_time() - flip_start);
 
 	// if framerate is nonzero and we're backed up on frames, skip frames until we
 	// catch up. there is a cap on consecutive frameskips to avoid the situation where
@@ -372,7 +451,13 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 	// that we lag instead of never rendering anything at all.
 	if (framerate > 0) {
 		it->skipping_frame = it->last_flip_time > it->next_frame_time && it->num_skips < it->max_skips;
-		sphere_sleep(it->next_frame_time - al_get_time());
+
+		// if vsync is doing the pacing, idle jobs already ran before the flip and
+		// there's nothing left to wait for.  otherwise sleep as usual, but with
+		// vsync on, don't bother spinning since the flip will snap to a refresh
+		// anyway.
+		if (!is_vsync_paced)
+			pacer_wait(it->next_frame_time, !it->vsync);
 		if (it->num_skips >= it->max_skips)  // did we skip too many frames?
 			it->next_frame_time = al_get_time() + 1.0 / framerate;
 		else
@@ -382,7 +467,10 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 		it->skipping_frame = false;
 		it->next_frame_time = al_get_time();
 	}
+	pacer_end_frame(!is_backbuffer_valid);
 	++it->num_frames;
+	render_end_frame();
+	counters_end_frame();
 	if (!it->skipping_frame && need_clear) {
 		// disable clipping so we can clear the whole backbuffer.
 		scissor = image_get_scissor(it->backbuffer);
@@ -406,6 +494,7 @@ screen_grab(screen_t* it, int x, int y, int width, int height)
 		goto on_error;
 	image_render_to(image, NULL);
 	al_draw_bitmap_region(image_bitmap(it->backbuffer), x, y, width, height, 0, 0, 0x0);
+	render_count_draws(1);
 	return image;
 
 on_error:
@@ -431,6 +520,8 @@ screen_resize(screen_t* it, int x_size, int y_size)
 void
 screen_show_mouse(screen_t* it, bool visible)
 {
+	if (it->display == NULL)
+		return;
 	if (visible)
 		al_show_mouse_cursor(it->display);
 	else
@@ -456,6 +547,32 @@ screen_unskip_frame(screen_t* it)
 	al_clear_to_color(al_map_rgba(0, 0, 0, 255));
 }
 
+static void
+draw_counters(screen_t* screen, int x, int y)
+{
+	int   line_height;
+	char* text;
+	int   x1, y1;
+
+	int i;
+
+	// the counters panel sits directly above the FPS display, right-aligned
+	// with it.  (x, y) is the bottom-right corner of the panel.
+	line_height = font_height(screen->font) + 1;
+	x1 = x - 160;
+	y1 = y - COUNTER_MAX * line_height - 8;
+	al_draw_filled_rounded_rectangle(x1, y1, x, y, 4, 4, al_map_rgba(16, 16, 16, 192));
+	render_count_draws(1);
+	for (i = 0; i < COUNTER_MAX; ++i) {
+		text = strnewf("%s: %u", counter_name(i), counter_value(i));
+		font_set_mask(screen->font, mk_color(0, 0, 0, 255));
+		font_draw_text(screen->font, x1 + 7, y1 + 5 + i * line_height, TEXT_ALIGN_LEFT, text);
+		font_set_mask(screen->font, mk_color(255, 255, 255, 255));
+		font_draw_text(screen->font, x1 + 6, y1 + 4 + i * line_height, TEXT_ALIGN_LEFT, text);
+		free(text);
+	}
+}
+
 static void
 refresh_display(screen_t* screen)
 {
@@ -463,6 +580,11 @@ refresh_display(screen_t* screen)
 	int                  real_width;
 	int                  real_height;
 
+	if (screen->display == NULL) {
+		image_render_to(screen->backbuffer, NULL);
+		return;
+	}
+
 	al_set_display_flag(screen->display, ALLEGRO_FULLSCREEN_WINDOW, screen->fullscreen);
 	if (screen->fullscreen) {
 		real_width = al_get_display_width(screen->display);
@@ -39,12 +39,13 @@
 
 typedef struct screen screen_t;
 
-screen_t*        screen_new               (const char* title, image_t* icon, size2_t resolution, int frameskip, font_t* font);
+screen_t*        screen_new               (const char* title, image_t* icon, size2_t resolution, int frameskip, bool vsync, bool headless, font_t* font);
 void             screen_free              (screen_t* it);
 image_t*         screen_backbuffer        (const screen_t* it);
 rect_t           screen_bounds            (const screen_t* it);
 ALLEGRO_DISPLAY* screen_display           (const screen_t* it);
 size2_t          screen_size              (const screen_t* it);
+void             screen_capture_frames    (screen_t* it, const char* dirname);
 bool             screen_skipping_frame    (const screen_t* it);
 int              screen_get_frameskip     (const screen_t* it);
 bool             screen_get_fullscreen    (const screen_t* it);
@@ -34,11 +34,22 @@
 #include "script.h"
 
 #include "api.h"
+#include "counter.h"
 #include "debugger.h"
 #include "jsal.h"
 #include "pegasus.h"
 #include "utility.h"
 
+#define CACHE_MAX_AGE  (30 * 24 * 60 * 60)  // 30 days
+#define CACHE_MAX_SIZE (64 * 1024 * 1024)   // 64 MiB
+
+struct cache_entry
+{
+	time_t            access_time;
+	ALLEGRO_FS_ENTRY* fse;
+	uint64_t          size;
+};
+
 struct script
 {
 	unsigned int  refcount;
@@ -47,18 +58,50 @@ struct script
 	bool          in_use;
 };
 
+static void* on_fetch_bytecode   (const char* name, size_t *out_size);
+static int   order_cache_entries (const void* a_ptr, const void* b_ptr);
+static void  prune_cache         (const path_t* path);
+
 static int s_next_script_id = 1;
 
 void
 scripts_init(void)
 {
+	path_t* cache_path;
+
 	console_log(1, "initializing JS script manager");
+
+	// compiled scripts are cached as bytecode so that later runs of the same
+	// code can skip the parser.  packages built by Cell with `Sphere.Precompile`
+	// enabled also carry their own bytecode, which takes precedence.
+	cache_path = path_rebase(path_new("miniSphere/.jsCache/"), home_path());
+	if (path_mkdir(cache_path)) {
+		prune_cache(cache_path);
+		jsal_set_cache_dir(path_cstr(cache_path), SPHERE_VERSION);
+	}
+	else {
+		console_log(1, "  couldn't create bytecode cache, disabling");
+		jsal_set_cache_dir(NULL, SPHERE_VERSION);
+	}
+	jsal_on_fetch_bytecode(on_fetch_bytecode);
+	path_free(cache_path);
 }
 
 void
 scripts_uninit(void)
 {
+	js_stats_t stats;
+
 	console_log(1, "shutting down JS script manager");
+
+	stats = jsal_stats();
+	console_log(2, "  %u scripts parsed in %.2f ms", stats.num_parses,
+		stats.parse_time * 1000.0);
+	console_log(2, "  %u scripts loaded from bytecode in %.2f ms", stats.num_cache_loads,
+		stats.cache_load_time * 1000.0);
+	console_log(2, "  %u host objects created, %u too large for slab pool",
+		stats.num_object_allocs, stats.num_heap_objects);
+	console_log(2, "  %u KiB reserved for slab pool", (unsigned int)(stats.pool_size / 1024));
 }
 
 bool
@@ -190,6 +233,7 @@ script_run(script_t* script, bool allow_reentry)
 	script_ref(script);
 
 	// execute the script!
+	counter_add(COUNTER_SCRIPTS, 1);
 	script->in_use = true;
 	jsal_push_ref_weak(script->function);
 	jsal_call(0);
@@ -198,3 +242,86 @@ script_run(script_t* script, bool allow_reentry)
 
 	script_unref(script);
 }
+
+static void*
+on_fetch_bytecode(const char* name, size_t *out_size)
+{
+	void* bytecode;
+	char* pathname;
+
+	if (g_game == NULL)
+		return NULL;
+	pathname = strnewf("@/.bytecode/%s", name);
+	if ((bytecode = game_read_file(g_game, pathname, out_size)))
+		console_log(4, "using precompiled bytecode '%s'", pathname);
+	free(pathname);
+	return bytecode;
+}
+
+static int
+order_cache_entries(const void* a_ptr, const void* b_ptr)
+{
+	const struct cache_entry* a;
+	const struct cache_entry* b;
+
+	// most recently used entries first
+	a = a_ptr;
+	b = b_ptr;
+	return b->access_time > a->access_time ? 1
+		: b->access_time < a->access_time ? -1
+		: 0;
+}
+
+static void
+prune_cache(const path_t* path)
+{
+	struct cache_entry* entry;
+	struct cache_entry  entry_obj;
+	vector_t*           entries;
+	ALLEGRO_FS_ENTRY*   file_info;
+	ALLEGRO_FS_ENTRY*   fse;
+	time_t              now;
+	int                 num_pruned = 0;
+	uint64_t            total_size = 0;
+
+	iter_t iter;
+
+	// note: entries are evicted least recently used first.  a cache hit only reads
+	//       the file, so the access time is used when the filesystem tracks it;
+	//       otherwise this degrades to evicting the oldest entries.
+	if (!(entries = vector_new(sizeof(struct cache_entry))))
+		return;
+	fse = al_create_fs_entry(path_cstr(path));
+	if (al_get_fs_entry_mode(fse) & ALLEGRO_FILEMODE_ISDIR && al_open_directory(fse)) {
+		while ((file_info = al_read_directory(fse))) {
+			if (!(al_get_fs_entry_mode(file_info) & ALLEGRO_FILEMODE_ISFILE)) {
+				al_destroy_fs_entry(file_info);
+				continue;
+			}
+			entry_obj.access_time = al_get_fs_entry_atime(file_info);
+			if (al_get_fs_entry_mtime(file_info) > entry_obj.access_time)
+				entry_obj.access_time = al_get_fs_entry_mtime(file_info);
+			entry_obj.fse = file_info;
+			entry_obj.size = al_get_fs_entry_size(file_info);
+			vector_push(entries, &entry_obj);
+		}
+		al_close_directory(fse);
+	}
+	al_destroy_fs_entry(fse);
+
+	vector_sort(entries, order_cache_entries);
+	now = time(NULL);
+	iter = vector_enum(entries);
+	while ((entry = iter_next(&iter))) {
+		if (now - entry->access_time <= CACHE_MAX_AGE)
+			total_size += entry->size;
+		if (now - entry->access_time > CACHE_MAX_AGE || total_size > CACHE_MAX_SIZE) {
+			if (al_remove_fs_entry(entry->fse))
+				++num_pruned;
+		}
+		al_destroy_fs_entry(entry->fse);
+	}
+	vector_free(entries);
+	if (num_pruned > 0)
+		console_log(1, "  pruned %d stale entries from bytecode cache", num_pruned);
+}
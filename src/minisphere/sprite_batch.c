@@ -0,0 +1,227 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include "minisphere.h"
+#include "sprite_batch.h"
+
+#include "color.h"
+#include "galileo.h"
+#include "image.h"
+#include "render.h"
+#include "vector.h"
+
+struct sprite_batch
+{
+	unsigned int refcount;
+	unsigned int id;
+	blend_mode_t blend_mode;
+	int          next_order;
+	bool         sorted;
+	vector_t*    sprites;
+	vector_t*    vertices;
+};
+
+struct sprite
+{
+	blend_mode_t   blend_mode;
+	int            order;
+	image_t*       texture;
+	ALLEGRO_VERTEX corners[4];
+};
+
+static int compare_sprites (const void* in_a, const void* in_b);
+
+static unsigned int s_next_batch_id = 1;
+
+sprite_batch_t*
+sprite_batch_new(bool sorted)
+{
+	sprite_batch_t* batch;
+
+	console_log(4, "creating new sprite batch #%u", s_next_batch_id);
+
+	batch = calloc(1, sizeof(sprite_batch_t));
+	batch->blend_mode = BLEND_NORMAL;
+	batch->sorted = sorted;
+	batch->sprites = vector_new(sizeof(struct sprite));
+	batch->vertices = vector_new(sizeof(ALLEGRO_VERTEX));
+
+	batch->id = s_next_batch_id++;
+	return sprite_batch_ref(batch);
+}
+
+sprite_batch_t*
+sprite_batch_ref(sprite_batch_t* it)
+{
+	if (it != NULL)
+		++it->refcount;
+	return it;
+}
+
+void
+sprite_batch_unref(sprite_batch_t* it)
+{
+	if (it == NULL || --it->refcount > 0)
+		return;
+
+	console_log(4, "disposing sprite batch #%u no longer in use", it->id);
+	sprite_batch_clear(it);
+	vector_free(it->sprites);
+	vector_free(it->vertices);
+	free(it);
+}
+
+int
+sprite_batch_len(const sprite_batch_t* it)
+{
+	return vector_len(it->sprites);
+}
+
+blend_mode_t
+sprite_batch_get_blend_mode(const sprite_batch_t* it)
+{
+	return it->blend_mode;
+}
+
+void
+sprite_batch_set_blend_mode(sprite_batch_t* it, blend_mode_t mode)
+{
+	it->blend_mode = mode;
+}
+
+void
+sprite_batch_add(sprite_batch_t* it, image_t* texture, float x, float y, float width, float height, float u1, float v1, float u2, float v2, color_t color)
+{
+	ALLEGRO_COLOR vertex_color;
+	struct sprite sprite;
+
+	vertex_color = nativecolor(color);
+	sprite.blend_mode = it->blend_mode;
+	sprite.order = it->next_order++;
+	sprite.texture = image_ref(texture);
+	sprite.corners[0] = (ALLEGRO_VERTEX) { x, y, 0.0f, u1, v1, vertex_color };
+	sprite.corners[1] = (ALLEGRO_VERTEX) { x + width, y, 0.0f, u2, v1, vertex_color };
+	sprite.corners[2] = (ALLEGRO_VERTEX) { x, y + height, 0.0f, u1, v2, vertex_color };
+	sprite.corners[3] = (ALLEGRO_VERTEX) { x + width, y + height, 0.0f, u2, v2, vertex_color };
+	vector_push(it->sprites, &sprite);
+}
+
+void
+sprite_batch_clear(sprite_batch_t* it)
+{
+	struct sprite* sprite;
+
+	iter_t iter;
+
+	iter = vector_enum(it->sprites);
+	while ((sprite = iter_next(&iter)))
+		image_unref(sprite->texture);
+	vector_clear(it->sprites);
+	it->next_order = 0;
+}
+
+int
+sprite_batch_draw(sprite_batch_t* it, image_t* surface, transform_t* transform)
+{
+	ALLEGRO_BITMAP* bitmap;
+	blend_mode_t    blend_mode;
+	int             num_draws = 0;
+	int             num_sprites;
+	blend_mode_t    old_blend_mode;
+	struct sprite*  sprite;
+	image_t*        texture;
+	ALLEGRO_VERTEX* vertices;
+
+	int i, j;
+
+	// note: consecutive sprites sharing a texture and blend mode are merged into
+	//       a single triangle list, so a batch costs one draw call per run rather
+	//       than one per sprite.  for sorted batches, sprites are first grouped by
+	//       blend mode and texture (keeping submission order within each group),
+	//       which minimizes the number of runs at the cost of draw order.  if the
+	//       surface is in deferred mode, runs are queued instead of being drawn
+	//       immediately.
+
+	num_sprites = vector_len(it->sprites);
+	if (num_sprites == 0)
+		return 0;
+	if (it->sorted)
+		vector_sort(it->sprites, compare_sprites);
+
+	old_blend_mode = image_get_blend_mode(surface);
+
+	if (!vector_resize(it->vertices, num_sprites * 6))
+		return 0;
+	vertices = vector_get(it->vertices, 0);
+	i = 0;
+	while (i < num_sprites) {
+		sprite = vector_get(it->sprites, i);
+		texture = sprite->texture;
+		bitmap = texture != NULL ? image_bitmap(texture) : NULL;
+		blend_mode = sprite->blend_mode;
+		j = 0;
+		do {
+			vertices[j++] = sprite->corners[0];
+			vertices[j++] = sprite->corners[1];
+			vertices[j++] = sprite->corners[2];
+			vertices[j++] = sprite->corners[2];
+			vertices[j++] = sprite->corners[1];
+			vertices[j++] = sprite->corners[3];
+			if (++i >= num_sprites)
+				break;
+			sprite = vector_get(it->sprites, i);
+		} while ((sprite->texture != NULL ? image_bitmap(sprite->texture) : NULL) == bitmap
+			&& sprite->blend_mode == blend_mode);
+		image_set_blend_mode(surface, blend_mode);
+		if (!image_defer_draw(surface, galileo_shader(), transform, SHAPE_TRIANGLES, texture, vertices, j)) {
+			image_render_with(surface, galileo_shader(), transform);
+			al_draw_prim(vertices, NULL, bitmap, 0, j, ALLEGRO_PRIM_TRIANGLE_LIST);
+			render_count_draws(1);
+		}
+		++num_draws;
+	}
+	image_set_blend_mode(surface, old_blend_mode);
+	return num_draws;
+}
+
+static int
+compare_sprites(const void* in_a, const void* in_b)
+{
+	const struct sprite* a = in_a;
+	const struct sprite* b = in_b;
+
+	if (a->blend_mode != b->blend_mode)
+		return a->blend_mode < b->blend_mode ? -1 : 1;
+	if (a->texture != b->texture)
+		return (uintptr_t)a->texture < (uintptr_t)b->texture ? -1 : 1;
+	return a->order - b->order;
+}
@@ -0,0 +1,50 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef SPHERE__SPRITE_BATCH_H__INCLUDED
+#define SPHERE__SPRITE_BATCH_H__INCLUDED
+
+#include "image.h"
+
+typedef struct sprite_batch sprite_batch_t;
+
+sprite_batch_t* sprite_batch_new            (bool sorted);
+sprite_batch_t* sprite_batch_ref            (sprite_batch_t* it);
+void            sprite_batch_unref          (sprite_batch_t* it);
+int             sprite_batch_len            (const sprite_batch_t* it);
+blend_mode_t    sprite_batch_get_blend_mode (const sprite_batch_t* it);
+void            sprite_batch_set_blend_mode (sprite_batch_t* it, blend_mode_t mode);
+void            sprite_batch_add            (sprite_batch_t* it, image_t* texture, float x, float y, float width, float height, float u1, float v1, float u2, float v2, color_t color);
+void            sprite_batch_clear          (sprite_batch_t* it);
+int             sprite_batch_draw           (sprite_batch_t* it, image_t* surface, transform_t* transform);
+
+#endif // SPHERE__SPRITE_BATCH_H__INCLUDED
@@ -35,6 +35,7 @@
 
 #include "atlas.h"
 #include "image.h"
+#include "render.h"
 #include "vector.h"
 
 #pragma pack(push, 1)
@@ -561,6 +562,7 @@ spriteset_draw(const spriteset_t* it, color_t mask, bool is_flipped, double thet
 	al_draw_tinted_scaled_rotated_bitmap(image_bitmap(image), nativecolor(mask),
 		(float)image_w / 2, (float)image_h / 2, x + scale_w / 2, y + scale_h / 2,
 		scale_x, scale_y, theta, is_flipped ? ALLEGRO_FLIP_VERTICAL : 0x0);
+	render_count_draws(1);
 }
 
 bool
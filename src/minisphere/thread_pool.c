@@ -0,0 +1,204 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+// the thread pool runs blocking work (file I/O, decompression, etc.) in the
+// background so it doesn't stall the frame.  each task has two parts: `work`, which
+// runs on a pool thread and must not touch JavaScript or any other engine state
+// owned by the main thread, and `finish`, which is called on the main thread from
+// thread_pool_update() once the work is done.
+
+#include "minisphere.h"
+#include "thread_pool.h"
+
+#define MAX_THREADS 4
+
+struct task
+{
+	task_func_t finish;
+	void*       userdata;
+	task_func_t work;
+};
+
+static bool  start_threads (void);
+static void* thread_main   (ALLEGRO_THREAD* thread, void* userdata);
+
+static vector_t*       s_finished;
+static ALLEGRO_MUTEX*  s_mutex = NULL;
+static int             s_num_pending = 0;
+static int             s_num_threads = 0;
+static vector_t*       s_queue;
+static bool            s_quitting = false;
+static ALLEGRO_THREAD* s_threads[MAX_THREADS];
+static ALLEGRO_COND*   s_wakeup = NULL;
+
+void
+thread_pool_init(void)
+{
+	console_log(1, "initializing thread pool");
+	s_finished = vector_new(sizeof(struct task));
+	s_queue = vector_new(sizeof(struct task));
+	s_num_pending = 0;
+	s_num_threads = 0;
+	s_quitting = false;
+}
+
+void
+thread_pool_uninit(void)
+{
+	int i;
+
+	console_log(1, "shutting down thread pool");
+
+	// let the pool threads run through whatever work is still queued before shutting
+	// them down: the work might be writing a save file, for instance.
+	if (s_num_threads > 0) {
+		al_lock_mutex(s_mutex);
+		s_quitting = true;
+		al_broadcast_cond(s_wakeup);
+		al_unlock_mutex(s_mutex);
+		for (i = 0; i < s_num_threads; ++i) {
+			al_join_thread(s_threads[i], NULL);
+			al_destroy_thread(s_threads[i]);
+		}
+		thread_pool_update();
+		al_destroy_cond(s_wakeup);
+		al_destroy_mutex(s_mutex);
+	}
+	vector_free(s_finished);
+	vector_free(s_queue);
+}
+
+bool
+thread_pool_busy(void)
+{
+	return s_num_pending > 0;
+}
+
+bool
+thread_pool_push(task_func_t work, task_func_t finish, void* userdata)
+{
+	struct task task;
+
+	if (s_num_threads == 0 && !start_threads())
+		return false;
+
+	task.finish = finish;
+	task.userdata = userdata;
+	task.work = work;
+	al_lock_mutex(s_mutex);
+	if (!vector_push(s_queue, &task)) {
+		al_unlock_mutex(s_mutex);
+		return false;
+	}
+	al_signal_cond(s_wakeup);
+	al_unlock_mutex(s_mutex);
+	++s_num_pending;
+	return true;
+}
+
+void
+thread_pool_update(void)
+{
+	struct task task;
+
+	while (s_num_pending > 0) {
+		al_lock_mutex(s_mutex);
+		if (vector_len(s_finished) == 0) {
+			al_unlock_mutex(s_mutex);
+			break;
+		}
+		task = *(struct task*)vector_get(s_finished, 0);
+		vector_remove(s_finished, 0);
+		al_unlock_mutex(s_mutex);
+		--s_num_pending;
+		if (task.finish != NULL)
+			task.finish(task.userdata);
+	}
+}
+
+static bool
+start_threads(void)
+{
+	int num_threads;
+
+	// the pool is spun up on first use, so games that never do any background work
+	// don't pay for it.
+	num_threads = al_get_cpu_count() - 1;
+	num_threads = num_threads < 1 ? 1
+		: num_threads > MAX_THREADS ? MAX_THREADS
+		: num_threads;
+	console_log(2, "starting %d pool thread(s)", num_threads);
+
+	if (!(s_mutex = al_create_mutex()))
+		goto on_error;
+	if (!(s_wakeup = al_create_cond()))
+		goto on_error;
+	while (s_num_threads < num_threads) {
+		if (!(s_threads[s_num_threads] = al_create_thread(thread_main, NULL)))
+			break;
+		al_start_thread(s_threads[s_num_threads++]);
+	}
+	if (s_num_threads == 0)
+		goto on_error;
+	return true;
+
+on_error:
+	if (s_wakeup != NULL)
+		al_destroy_cond(s_wakeup);
+	if (s_mutex != NULL)
+		al_destroy_mutex(s_mutex);
+	s_wakeup = NULL;
+	s_mutex = NULL;
+	return false;
+}
+
+static void*
+thread_main(ALLEGRO_THREAD* thread, void* userdata)
+{
+	struct task task;
+
+	al_lock_mutex(s_mutex);
+	while (true) {
+		while (vector_len(s_queue) == 0 && !s_quitting)
+			al_wait_cond(s_wakeup, s_mutex);
+		if (vector_len(s_queue) == 0)
+			break;  // quitting and nothing left to do
+		task = *(struct task*)vector_get(s_queue, 0);
+		vector_remove(s_queue, 0);
+		al_unlock_mutex(s_mutex);
+		task.work(task.userdata);
+		al_lock_mutex(s_mutex);
+		vector_push(s_finished, &task);
+	}
+	al_unlock_mutex(s_mutex);
+	return NULL;
+}
@@ -36,6 +36,7 @@
 #include "atlas.h"
 #include "image.h"
 #include "obstruction.h"
+#include "render.h"
 
 struct tileset
 {
@@ -334,4 +335,5 @@ tileset_draw(const tileset_t* tileset, color_t mask, float x, float y, int tile_
 	tile_index = tileset->tiles[tile_index].image_index;
 	al_draw_tinted_bitmap(image_bitmap(tileset->tiles[tile_index].image),
 		nativecolor(mask), x, y, 0x0);
+	render_count_draws(1);
 }
@@ -52,6 +52,8 @@
 #include "legacy.h"
 #include "logger.h"
 #include "map_engine.h"
+#include "prim_cache.h"
+#include "render.h"
 #include "script.h"
 #include "spriteset.h"
 #include "windowstyle.h"
@@ -520,9 +522,11 @@ enum sound_effect_mode
 	SE_MULTIPLE,
 };
 
-static font_t*  s_default_font;
-static int      s_frame_rate = 0;
-static mixer_t* s_sound_mixer;
+static font_t*   s_default_font;
+static int       s_frame_rate = 0;
+static js_ref_t* s_key_x;
+static js_ref_t* s_key_y;
+static mixer_t*  s_sound_mixer;
 
 void
 vanilla_init(void)
@@ -535,6 +539,10 @@ vanilla_init(void)
 
 	s_sound_mixer = mixer_new(44100, 16, 2);
 
+	// pre-create property keys for the vertex-list primitives
+	s_key_x = jsal_new_key("x");
+	s_key_y = jsal_new_key("y");
+
 	// set up a dictionary to track RequireScript() calls
 	jsal_push_hidden_stash();
 	jsal_push_new_bare_object();
@@ -1186,6 +1194,13 @@ vanilla_init(void)
 	api_define_const(NULL, "SE_MULTIPLE", 1);
 }
 
+void
+vanilla_uninit(void)
+{
+	jsal_unref(s_key_x);
+	jsal_unref(s_key_y);
+}
+
 void
 jsal_push_sphere_bytearray(bytearray_t* array)
 {
@@ -1544,6 +1559,7 @@ js_ApplyColorMask(int num_args, bool is_ctor, intptr_t magic)
 	galileo_reset();
 	al_draw_filled_rectangle(0, 0, resolution.width, resolution.height,
 		nativecolor(color));
+	render_count_draws(1);
 	return false;
 }
 
@@ -1669,6 +1685,7 @@ js_BezierCurve(int num_args, bool is_ctor, intptr_t magic)
 		points[i].color = nativecolor(color);
 	galileo_reset();
 	al_draw_prim(points, NULL, NULL, 0, num_points, ALLEGRO_PRIM_POINT_LIST);
+	render_count_draws(1);
 	return false;
 }
 
@@ -2077,7 +2094,7 @@ js_Delay(int num_args, bool is_ctor, intptr_t magic)
 
 	if (timeout < 0.0)
 		jsal_error(JS_RANGE_ERROR, "Invalid delay timeout '%g'", timeout);
-	sphere_sleep(floor(timeout) / 1000.0);
+	sphere_delay(floor(timeout) / 1000.0);
 	return false;
 }
 
@@ -2306,15 +2323,11 @@ js_ExitMapEngine(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_FilledCircle(int num_args, bool is_ctor, intptr_t magic)
 {
-	color_t         color;
-	int             num_points;
-	double          phi;
-	float           radius;
-	ALLEGRO_VERTEX* vertices;
-	float           x;
-	float           y;
-
-	int i;
+	color_t color;
+	int     num_points;
+	float   radius;
+	float   x;
+	float   y;
 
 	x = trunc(jsal_to_number(0));
 	y = trunc(jsal_to_number(1));
@@ -2324,24 +2337,8 @@ js_FilledCircle(int num_args, bool is_ctor, intptr_t magic)
 	if (screen_skipping_frame(g_screen))
 		return false;
 	num_points = fmin(radius, 126);
-	vertices = alloca((num_points + 2) * sizeof(ALLEGRO_VERTEX));
-	vertices[0].x = x;
-	vertices[0].y = y;
-	vertices[0].z = 0.0f;
-	vertices[0].color = nativecolor(color);
-	for (i = 0; i < num_points; ++i) {
-		phi = 2 * M_PI * i / num_points;
-		vertices[i + 1].x = x + cosf(phi) * radius;
-		vertices[i + 1].y = y - sinf(phi) * radius;
-		vertices[i + 1].z = 0.0f;
-		vertices[i + 1].color = nativecolor(color);
-	}
-	vertices[i + 1].x = x + cosf(0.0f) * radius;
-	vertices[i + 1].y = y - sinf(0.0f) * radius;
-	vertices[i + 1].z = 0.0f;
-	vertices[i + 1].color = nativecolor(color);
 	galileo_reset();
-	al_draw_prim(vertices, NULL, NULL, 0, num_points + 2, ALLEGRO_PRIM_TRIANGLE_FAN);
+	prim_draw_ellipse(x, y, radius, radius, num_points, color, color);
 	return false;
 }
 
@@ -2355,16 +2352,12 @@ js_FilledComplex(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_FilledEllipse(int num_args, bool is_ctor, intptr_t magic)
 {
-	color_t         color;
-	int             num_points;
-	double          phi;
-	float           radius_x;
-	float           radius_y;
-	ALLEGRO_VERTEX* vertices;
-	float           x;
-	float           y;
-
-	int i;
+	color_t color;
+	int     num_points;
+	float   radius_x;
+	float   radius_y;
+	float   x;
+	float   y;
 
 	x = trunc(jsal_to_number(0));
 	y = trunc(jsal_to_number(1));
@@ -2375,24 +2368,8 @@ js_FilledEllipse(int num_args, bool is_ctor, intptr_t magic)
 	if (screen_skipping_frame(g_screen))
 		return false;
 	num_points = ceil(fmin(10 * sqrt((radius_x + radius_y) / 2), 126));
-	vertices = alloca((num_points + 2) * sizeof(ALLEGRO_VERTEX));
-	vertices[0].x = x;
-	vertices[0].y = y;
-	vertices[0].z = 0.0f;
-	vertices[0].color = nativecolor(color);
-	for (i = 0; i < num_points; ++i) {
-		phi = 2 * M_PI * i / num_points;
-		vertices[i + 1].x = x + cosf(phi) * radius_x;
-		vertices[i + 1].y = y - sinf(phi) * radius_y;
-		vertices[i + 1].z = 0.0f;
-		vertices[i + 1].color = nativecolor(color);
-	}
-	vertices[i + 1].x = x + cosf(0.0f) * radius_x;
-	vertices[i + 1].y = y - sinf(0.0f) * radius_y;
-	vertices[i + 1].z = 0.0f;
-	vertices[i + 1].color = nativecolor(color);
 	galileo_reset();
-	al_draw_prim(vertices, NULL, NULL, 0, num_points + 2, ALLEGRO_PRIM_TRIANGLE_FAN);
+	prim_draw_ellipse(x, y, radius_x, radius_y, num_points, color, color);
 	return false;
 }
 
@@ -3694,7 +3671,7 @@ js_GetTileWidth(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_GetTime(int num_args, bool is_ctor, intptr_t magic)
 {
-	jsal_push_number(floor(al_get_time() * 1000));
+	jsal_push_number(floor(sphere_now() * 1000));
 	return true;
 }
 
@@ -3922,16 +3899,12 @@ js_GrabSurface(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_GradientCircle(int num_args, bool is_ctor, intptr_t magic)
 {
-	color_t         inner_color;
-	int             num_points;
-	color_t         outer_color;
-	double          phi;
-	float           radius;
-	ALLEGRO_VERTEX* vertices;
-	float           x;
-	float           y;
-
-	int i;
+	color_t inner_color;
+	int     num_points;
+	color_t outer_color;
+	float   radius;
+	float   x;
+	float   y;
 
 	x = trunc(jsal_to_number(0));
 	y = trunc(jsal_to_number(1));
@@ -3942,23 +3915,8 @@ js_GradientCircle(int num_args, bool is_ctor, intptr_t magic)
 	if (screen_skipping_frame(g_screen))
 		return false;
 	num_points = fmin(radius, 126);
-	vertices = alloca((num_points + 2) * sizeof(ALLEGRO_VERTEX));
-	vertices[0].x = x;
-	vertices[0].y = y;
-	vertices[0].z = 0.0f;
-	vertices[0].color = nativecolor(inner_color);
-	for (i = 0; i < num_points; ++i) {
-		phi = 2.0 * M_PI * i / num_points;
-		vertices[i + 1].x = x + cosf(phi) * radius;
-		vertices[i + 1].y = y - sinf(phi) * radius;
-		vertices[i + 1].z = 0.0f;
-		vertices[i + 1].color = nativecolor(outer_color);
-	}
-	vertices[i + 1].x = x + cosf(0.0f) * radius;
-	vertices[i + 1].y = y - sinf(0.0f) * radius;
-	vertices[i + 1].z = 0.0f;
-	vertices[i + 1].color = nativecolor(outer_color);
-	al_draw_prim(vertices, NULL, NULL, 0, num_points + 2, ALLEGRO_PRIM_TRIANGLE_FAN);
+	galileo_reset();
+	prim_draw_ellipse(x, y, radius, radius, num_points, inner_color, outer_color);
 	return false;
 }
 
@@ -3972,17 +3930,13 @@ js_GradientComplex(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_GradientEllipse(int num_args, bool is_ctor, intptr_t magic)
 {
-	color_t         inner_color;
-	int             num_points;
-	color_t         outer_color;
-	double          phi;
-	float           radius_x;
-	float           radius_y;
-	ALLEGRO_VERTEX* vertices;
-	float           x;
-	float           y;
-
-	int i;
+	color_t inner_color;
+	int     num_points;
+	color_t outer_color;
+	float   radius_x;
+	float   radius_y;
+	float   x;
+	float   y;
 
 	x = trunc(jsal_to_number(0));
 	y = trunc(jsal_to_number(1));
@@ -3994,24 +3948,8 @@ js_GradientEllipse(int num_args, bool is_ctor, intptr_t magic)
 	if (screen_skipping_frame(g_screen))
 		return false;
 	num_points = ceil(fmin(10 * sqrt((radius_x + radius_y) / 2), 126));
-	vertices = alloca((num_points + 2) * sizeof(ALLEGRO_VERTEX));
-	vertices[0].x = x;
-	vertices[0].y = y;
-	vertices[0].z = 0.0f;
-	vertices[0].color = nativecolor(inner_color);
-	for (i = 0; i < num_points; ++i) {
-		phi = 2 * M_PI * i / num_points;
-		vertices[i + 1].x = x + cosf(phi) * radius_x;
-		vertices[i + 1].y = y - sinf(phi) * radius_y;
-		vertices[i + 1].z = 0.0f;
-		vertices[i + 1].color = nativecolor(outer_color);
-	}
-	vertices[i + 1].x = x + cosf(0.0f) * radius_x;
-	vertices[i + 1].y = y - sinf(0.0f) * radius_y;
-	vertices[i + 1].z = 0.0f;
-	vertices[i + 1].color = nativecolor(outer_color);
 	galileo_reset();
-	al_draw_prim(vertices, NULL, NULL, 0, num_points + 2, ALLEGRO_PRIM_TRIANGLE_FAN);
+	prim_draw_ellipse(x, y, radius_x, radius_y, num_points, inner_color, outer_color);
 	return false;
 }
 
@@ -4047,6 +3985,7 @@ js_GradientLine(int num_args, bool is_ctor, intptr_t magic)
 	};
 	galileo_reset();
 	al_draw_prim(verts, NULL, NULL, 0, 4, ALLEGRO_PRIM_TRIANGLE_FAN);
+	render_count_draws(1);
 	return false;
 }
 
@@ -4079,6 +4018,7 @@ js_GradientRectangle(int num_args, bool is_ctor, intptr_t magic)
 	};
 	galileo_reset();
 	al_draw_prim(verts, NULL, NULL, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+	render_count_draws(1);
 	return false;
 }
 
@@ -4108,6 +4048,7 @@ js_GradientTriangle(int num_args, bool is_ctor, intptr_t magic)
 	};
 	galileo_reset();
 	al_draw_prim(verts, NULL, NULL, 0, 3, ALLEGRO_PRIM_TRIANGLE_LIST);
+	render_count_draws(1);
 	return false;
 }
 
@@ -4343,18 +4284,14 @@ js_IsMapEngineRunning(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_IsMouseButtonPressed(int num_args, bool is_ctor, intptr_t magic)
 {
-	int                 button;
-	int                 button_id;
-	ALLEGRO_DISPLAY*    display;
-	ALLEGRO_MOUSE_STATE mouse_state;
+	int         button;
+	mouse_key_t key;
 
 	button = jsal_to_int(0);
-	button_id = button == MOUSE_BUTTON_RIGHT ? 2
-		: button == MOUSE_BUTTON_MIDDLE ? 3
-		: 1;
-	al_get_mouse_state(&mouse_state);
-	display = screen_display(g_screen);
-	jsal_push_boolean(mouse_state.display == display && al_mouse_button_down(&mouse_state, button_id));
+	key = button == MOUSE_BUTTON_RIGHT ? MOUSE_KEY_RIGHT
+		: button == MOUSE_BUTTON_MIDDLE ? MOUSE_KEY_MIDDLE
+		: MOUSE_KEY_LEFT;
+	jsal_push_boolean(mouse_is_key_down(key));
 	return true;
 }
 
@@ -4421,6 +4358,7 @@ js_Line(int num_args, bool is_ctor, intptr_t magic)
 		return false;
 	galileo_reset();
 	al_draw_line(x1, y1, x2, y2, nativecolor(color), 1);
+	render_count_draws(1);
 	return false;
 }
 
@@ -4481,8 +4419,8 @@ js_LineSeries(int num_args, bool is_ctor, intptr_t magic)
 	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
 		jsal_get_prop_index(0, i);
-		jsal_get_prop_string(-1, "x");
-		jsal_get_prop_string(-2, "y");
+		jsal_get_prop_key(-1, s_key_x);
+		jsal_get_prop_key(-2, s_key_y);
 		x = trunc(jsal_to_number(-2));
 		y = trunc(jsal_to_number(-1));
 		jsal_pop(3);
@@ -4498,6 +4436,7 @@ js_LineSeries(int num_args, bool is_ctor, intptr_t magic)
 		type == LINE_STRIP ? ALLEGRO_PRIM_LINE_STRIP
 			: type == LINE_LOOP ? ALLEGRO_PRIM_LINE_LOOP
 			: ALLEGRO_PRIM_LINE_LIST);
+	render_count_draws(1);
 	return false;
 }
 
@@ -4749,7 +4688,7 @@ js_OutlinedCircle(int num_args, bool is_ctor, intptr_t magic)
 	if (screen_skipping_frame(g_screen))
 		return false;
 	galileo_reset();
-	al_draw_circle(x, y, radius, nativecolor(color), 1.0);
+	prim_draw_ellipse_outline(x, y, radius, radius, 1.0, color);
 	return false;
 }
 
@@ -4772,7 +4711,7 @@ js_OutlinedEllipse(int num_args, bool is_ctor, intptr_t magic)
 	if (screen_skipping_frame(g_screen))
 		return false;
 	galileo_reset();
-	al_draw_ellipse(x, y, rx, ry, nativecolor(color), 1.0);
+	prim_draw_ellipse_outline(x, y, rx, ry, 1.0, color);
 	return false;
 }
 
@@ -4796,6 +4735,7 @@ js_OutlinedRectangle(int num_args, bool is_ctor, intptr_t magic)
 		return false;
 	galileo_reset();
 	al_draw_rectangle(x1, y1, x2, y2, nativecolor(color), thickness);
+	render_count_draws(1);
 	return false;
 }
 
@@ -4823,6 +4763,7 @@ js_OutlinedRoundRectangle(int num_args, bool is_ctor, intptr_t magic)
 		return false;
 	galileo_reset();
 	al_draw_rounded_rectangle(x, y, x + width - 1, y + height - 1, radius, radius, nativecolor(color), thickness);
+	render_count_draws(1);
 	return false;
 }
 
@@ -4837,6 +4778,7 @@ js_Point(int num_args, bool is_ctor, intptr_t magic)
 		return false;
 	galileo_reset();
 	al_draw_pixel(x, y, nativecolor(color));
+	render_count_draws(1);
 	return false;
 }
 
@@ -4861,8 +4803,8 @@ js_PointSeries(int num_args, bool is_ctor, intptr_t magic)
 	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
 		jsal_get_prop_index(0, i);
-		jsal_get_prop_string(-1, "x");
-		jsal_get_prop_string(-2, "y");
+		jsal_get_prop_key(-1, s_key_x);
+		jsal_get_prop_key(-2, s_key_y);
 		x = trunc(jsal_to_number(-2));
 		y = trunc(jsal_to_number(-1));
 		jsal_pop(3);
@@ -4875,6 +4817,7 @@ js_PointSeries(int num_args, bool is_ctor, intptr_t magic)
 	}
 	galileo_reset();
 	al_draw_prim(vertices, NULL, NULL, 0, num_points, ALLEGRO_PRIM_POINT_LIST);
+	render_count_draws(1);
 	return false;
 }
 
@@ -4963,6 +4906,7 @@ js_Rectangle(int num_args, bool is_ctor, intptr_t magic)
 		return false;
 	galileo_reset();
 	al_draw_filled_rectangle(x, y, x + width, y + height, nativecolor(color));
+	render_count_draws(1);
 	return false;
 }
 
@@ -5145,7 +5089,7 @@ js_RoundRectangle(int num_args, bool is_ctor, intptr_t magic)
 	if (screen_skipping_frame(g_screen))
 		return false;
 	galileo_reset();
-	al_draw_filled_rounded_rectangle(x, y, x + width, y + height, radius, radius, nativecolor(color));
+	prim_draw_round_rect(x, y, width, height, radius, color);
 	return false;
 }
 
@@ -6288,6 +6232,7 @@ js_Triangle(int num_args, bool is_ctor, intptr_t magic)
 		return false;
 	galileo_reset();
 	al_draw_filled_triangle(x1, y1, x2, y2, x3, y3, nativecolor(color));
+	render_count_draws(1);
 	return false;
 }
 
@@ -6880,6 +6825,7 @@ js_Font_drawZoomedText(int num_args, bool is_ctor, intptr_t magic)
 
 	galileo_reset();
 	al_draw_scaled_bitmap(bitmap, 0, 0, width, height, x, y, width * scale, height * scale, 0x0);
+	render_count_draws(1);
 	al_destroy_bitmap(bitmap);
 	return false;
 }
@@ -7072,6 +7018,7 @@ js_Image_blit(int num_args, bool is_ctor, intptr_t magic)
 	galileo_reset();
 	image_set_blend_mode(screen_backbuffer(g_screen), blend_mode);
 	al_draw_bitmap(image_bitmap(image), x, y, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -7100,6 +7047,7 @@ js_Image_blitMask(int num_args, bool is_ctor, intptr_t magic)
 	galileo_reset();
 	image_set_blend_mode(screen_backbuffer(g_screen), blend_mode);
 	al_draw_tinted_bitmap(image_bitmap(image), nativecolor(mask), x, y, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -7148,6 +7096,7 @@ js_Image_rotateBlit(int num_args, bool is_ctor, intptr_t magic)
 	image_set_blend_mode(screen_backbuffer(g_screen), blend_mode);
 	al_draw_rotated_bitmap(image_bitmap(image), width / 2, height / 2,
 		x + width / 2, y + height / 2, angle, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -7183,6 +7132,7 @@ js_Image_rotateBlitMask(int num_args, bool is_ctor, intptr_t magic)
 	image_set_blend_mode(screen_backbuffer(g_screen), blend_mode);
 	al_draw_tinted_rotated_bitmap(image_bitmap(image), nativecolor(mask),
 		width / 2, height / 2, x + width / 2, y + height / 2, angle, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -7236,6 +7186,7 @@ js_Image_transformBlit(int num_args, bool is_ctor, intptr_t magic)
 	galileo_reset();
 	image_set_blend_mode(screen_backbuffer(g_screen), blend_mode);
 	al_draw_prim(v, NULL, image_bitmap(image), 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+	render_count_draws(1);
 	return false;
 }
 
@@ -7284,6 +7235,7 @@ js_Image_transformBlitMask(int num_args, bool is_ctor, intptr_t magic)
 	galileo_reset();
 	image_set_blend_mode(screen_backbuffer(g_screen), blend_mode);
 	al_draw_prim(v, NULL, image_bitmap(image), 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+	render_count_draws(1);
 	return false;
 }
 
@@ -7317,6 +7269,7 @@ js_Image_zoomBlit(int num_args, bool is_ctor, intptr_t magic)
 	image_set_blend_mode(screen_backbuffer(g_screen), blend_mode);
 	al_draw_scaled_bitmap(image_bitmap(image), 0, 0, width, height,
 		x, y, width * scale, height * scale, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -7352,6 +7305,7 @@ js_Image_zoomBlitMask(int num_args, bool is_ctor, intptr_t magic)
 	image_set_blend_mode(screen_backbuffer(g_screen), blend_mode);
 	al_draw_tinted_scaled_bitmap(image_bitmap(image), nativecolor(mask),
 		0, 0, width, height, x, y, width * scale, height * scale, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8248,6 +8202,7 @@ js_Surface_bezierCurve(int num_args, bool is_ctor, intptr_t magic)
 		vertices[i].color = nativecolor(color);
 	image_render_to(image, NULL);
 	al_draw_prim(vertices, NULL, NULL, 0, num_points, ALLEGRO_PRIM_POINT_LIST);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8267,6 +8222,7 @@ js_Surface_blit(int num_args, bool is_ctor, intptr_t magic)
 		return false;
 	galileo_reset();
 	al_draw_bitmap(image_bitmap(image), x, y, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8288,6 +8244,7 @@ js_Surface_blitMaskSurface(int num_args, bool is_ctor, intptr_t magic)
 
 	image_render_to(image, NULL);
 	al_draw_tinted_bitmap(image_bitmap(src_image), nativecolor(mask), x, y, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8307,6 +8264,7 @@ js_Surface_blitSurface(int num_args, bool is_ctor, intptr_t magic)
 
 	image_render_to(image, NULL);
 	al_draw_bitmap(image_bitmap(src_image), x, y, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8347,6 +8305,7 @@ js_Surface_cloneSection(int num_args, bool is_ctor, intptr_t magic)
 	image_render_to(new_image, NULL);
 	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
 	al_draw_bitmap_region(image_bitmap(image), x, y, width, height, 0, 0, 0x0);
+	render_count_draws(1);
 	jsal_push_class_obj(SV1_SURFACE, new_image, false);
 	return true;
 }
@@ -8405,6 +8364,7 @@ js_Surface_filledCircle(int num_args, bool is_ctor, intptr_t magic)
 
 	image_render_to(image, NULL);
 	al_draw_filled_circle(x, y, radius, nativecolor(color));
+	render_count_draws(1);
 	return false;
 }
 
@@ -8428,6 +8388,7 @@ js_Surface_filledEllipse(int num_args, bool is_ctor, intptr_t magic)
 
 	image_render_to(image, NULL);
 	al_draw_filled_ellipse(x, y, radius_x, radius_y, nativecolor(color));
+	render_count_draws(1);
 	return false;
 }
 
@@ -8521,6 +8482,7 @@ js_Surface_gradientCircle(int num_args, bool is_ctor, intptr_t magic)
 	vertices[i + 1].color = nativecolor(outer_color);
 	image_render_to(image, NULL);
 	al_draw_prim(vertices, NULL, NULL, 0, num_points + 2, ALLEGRO_PRIM_TRIANGLE_FAN);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8568,6 +8530,7 @@ js_Surface_gradientEllipse(int num_args, bool is_ctor, intptr_t magic)
 	vertices[i + 1].color = nativecolor(outer_color);
 	image_render_to(image, NULL);
 	al_draw_prim(vertices, NULL, NULL, 0, num_points + 2, ALLEGRO_PRIM_TRIANGLE_FAN);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8603,6 +8566,7 @@ js_Surface_gradientRectangle(int num_args, bool is_ctor, intptr_t magic)
 	};
 	image_render_to(image, NULL);
 	al_draw_prim(verts, NULL, NULL, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8639,6 +8603,7 @@ js_Surface_gradientLine(int num_args, bool is_ctor, intptr_t magic)
 	};
 	image_render_to(image, NULL);
 	al_draw_prim(verts, NULL, NULL, 0, 4, ALLEGRO_PRIM_TRIANGLE_FAN);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8662,6 +8627,7 @@ js_Surface_line(int num_args, bool is_ctor, intptr_t magic)
 
 	image_render_to(image, NULL);
 	al_draw_line(x1, y1, x2, y2, nativecolor(color), 1);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8692,8 +8658,8 @@ js_Surface_lineSeries(int num_args, bool is_ctor, intptr_t magic)
 	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
 		jsal_get_prop_index(0, i);
-		jsal_get_prop_string(-1, "x");
-		jsal_get_prop_string(-2, "y");
+		jsal_get_prop_key(-1, s_key_x);
+		jsal_get_prop_key(-2, s_key_y);
 		x = trunc(jsal_to_number(-2));
 		y = trunc(jsal_to_number(-1));
 		jsal_pop(3);
@@ -8709,6 +8675,7 @@ js_Surface_lineSeries(int num_args, bool is_ctor, intptr_t magic)
 		type == LINE_STRIP ? ALLEGRO_PRIM_LINE_STRIP
 			: type == LINE_LOOP ? ALLEGRO_PRIM_LINE_LOOP
 			: ALLEGRO_PRIM_LINE_LIST);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8730,6 +8697,7 @@ js_Surface_outlinedCircle(int num_args, bool is_ctor, intptr_t magic)
 
 	image_render_to(image, NULL);
 	al_draw_circle(x, y, radius, nativecolor(color), 1.0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8753,6 +8721,7 @@ js_Surface_outlinedEllipse(int num_args, bool is_ctor, intptr_t magic)
 
 	image_render_to(image, NULL);
 	al_draw_ellipse(x, y, radius_x, radius_y, nativecolor(color), 1.0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8779,8 +8748,8 @@ js_Surface_pointSeries(int num_args, bool is_ctor, intptr_t magic)
 	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
 		jsal_get_prop_index(0, i);
-		jsal_get_prop_string(-1, "x");
-		jsal_get_prop_string(-2, "y");
+		jsal_get_prop_key(-1, s_key_x);
+		jsal_get_prop_key(-2, s_key_y);
 		x = trunc(jsal_to_number(-2));
 		y = trunc(jsal_to_number(-1));
 		jsal_pop(3);
@@ -8793,6 +8762,7 @@ js_Surface_pointSeries(int num_args, bool is_ctor, intptr_t magic)
 	}
 	image_render_to(image, NULL);
 	al_draw_prim(vertices, NULL, NULL, 0, num_points, ALLEGRO_PRIM_POINT_LIST);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8819,6 +8789,7 @@ js_Surface_outlinedRectangle(int num_args, bool is_ctor, intptr_t magic)
 
 	image_render_to(image, NULL);
 	al_draw_rectangle(x1, y1, x2, y2, nativecolor(color), thickness);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8886,6 +8857,7 @@ js_Surface_rotate(int num_args, bool is_ctor, intptr_t magic)
 	image_render_to(new_image, NULL);
 	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
 	al_draw_rotated_bitmap(image_bitmap(image), width / 2, height / 2, new_width / 2, new_height / 2, angle, 0x0);
+	render_count_draws(1);
 
 	// swap out the image pointer and free old image
 	jsal_set_class_ptr(-1, new_image);
@@ -8918,6 +8890,7 @@ js_Surface_rotateBlitMaskSurface(int num_args, bool is_ctor, intptr_t magic)
 	image_render_to(image, NULL);
 	al_draw_tinted_rotated_bitmap(image_bitmap(source_image), nativecolor(mask),
 		width / 2, height / 2, x + width / 2, y + height / 2, angle, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8943,6 +8916,7 @@ js_Surface_rotateBlitSurface(int num_args, bool is_ctor, intptr_t magic)
 	height = image_height(source_image);
 	image_render_to(image, NULL);
 	al_draw_rotated_bitmap(image_bitmap(source_image), width / 2, height / 2, x + width / 2, y + height / 2, angle, 0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -8966,6 +8940,7 @@ js_Surface_rectangle(int num_args, bool is_ctor, intptr_t magic)
 
 	image_render_to(image, NULL);
 	al_draw_filled_rectangle(x, y, x + width, y + height, nativecolor(color));
+	render_count_draws(1);
 	return false;
 }
 
@@ -9090,6 +9065,7 @@ js_Surface_transformBlitMaskSurface(int num_args, bool is_ctor, intptr_t magic)
 	};
 	image_render_to(image, NULL);
 	al_draw_prim(v, NULL, image_bitmap(source_image), 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+	render_count_draws(1);
 	return false;
 }
 
@@ -9125,6 +9101,7 @@ js_Surface_transformBlitSurface(int num_args, bool is_ctor, intptr_t magic)
 	};
 	image_render_to(image, NULL);
 	al_draw_prim(v, NULL, image_bitmap(source_image), 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+	render_count_draws(1);
 	return false;
 }
 
@@ -9155,6 +9132,7 @@ js_Surface_zoomBlitMaskSurface(int num_args, bool is_ctor, intptr_t magic)
 		nativecolor(mask),
 		0, 0, width, height, x, y, width * scale, height * scale,
 		0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -9182,6 +9160,7 @@ js_Surface_zoomBlitSurface(int num_args, bool is_ctor, intptr_t magic)
 	al_draw_scaled_bitmap(image_bitmap(source_image),
 		0, 0, width, height, x, y, width * scale, height * scale,
 		0x0);
+	render_count_draws(1);
 	return false;
 }
 
@@ -35,6 +35,11 @@
 
 #include "color.h"
 #include "image.h"
+#include "render.h"
+#include "vector.h"
+
+#define MAX_MESHES 8
+#define MAX_QUADS  4096
 
 enum back_mode
 {
@@ -47,11 +52,26 @@ enum back_mode
 
 struct windowstyle
 {
-	int       refcount;
-	int       bg_style;
-	color_t   color_mask;
-	color_t   gradient[4];
-	image_t*  images[9];
+	int          refcount;
+	image_t*     atlas;
+	int          bg_style;
+	color_t      color_mask;
+	color_t      gradient[4];
+	image_t*     images[9];
+	struct mesh* meshes[MAX_MESHES];
+	unsigned int next_stamp;
+	rect_t       regions[9];
+	int          white_x;
+	int          white_y;
+};
+
+struct mesh
+{
+	color_t      color_mask;
+	int          height;
+	unsigned int stamp;
+	vector_t*    vertices;
+	int          width;
 };
 
 #pragma pack(push, 1)
@@ -67,6 +87,15 @@ struct rws_header
 };
 #pragma pack(pop)
 
+static void         build_atlas   (windowstyle_t* winstyle);
+static struct mesh* build_mesh    (windowstyle_t* winstyle, int width, int height);
+static void         draw_direct   (windowstyle_t* winstyle, int x, int y, int width, int height);
+static struct mesh* find_mesh     (windowstyle_t* winstyle, int width, int height);
+static void         free_mesh     (struct mesh* mesh);
+static void         push_gradient (vector_t* vertices, windowstyle_t* winstyle, int x, int y, int width, int height);
+static void         push_quad     (vector_t* vertices, float x1, float y1, float x2, float y2, float u1, float v1, float u2, float v2, ALLEGRO_COLOR color);
+static void         push_tiled    (vector_t* vertices, windowstyle_t* winstyle, int index, int x, int y, int width, int height);
+
 windowstyle_t*
 winstyle_load(const char* filename)
 {
@@ -110,6 +139,7 @@ winstyle_load(const char* filename)
 	winstyle->color_mask = mk_color(255, 255, 255, 255);
 	for (i = 0; i < 4; ++i)
 		winstyle->gradient[i] = rws.corner_colors[i];
+	build_atlas(winstyle);
 	return winstyle_ref(winstyle);
 
 on_error:
@@ -139,6 +169,9 @@ winstyle_unref(windowstyle_t* it)
 	for (i = 0; i < 9; ++i) {
 		image_unref(it->images[i]);
 	}
+	for (i = 0; i < MAX_MESHES; ++i)
+		free_mesh(it->meshes[i]);
+	image_unref(it->atlas);
 	free(it);
 }
 
@@ -156,6 +189,124 @@ winstyle_set_mask(windowstyle_t* it, color_t color)
 
 void
 winstyle_draw(windowstyle_t* it, int x, int y, int width, int height)
+{
+	ALLEGRO_TRANSFORM matrix;
+	struct mesh*      mesh;
+
+	// note: if the windowstyle has an atlas, the whole window is drawn as a
+	//       single triangle list.  the mesh is built in window coordinates and
+	//       cached, so drawing the same window again only costs a draw call.
+	if (it->atlas == NULL || !(mesh = find_mesh(it, width, height)) || mesh->vertices == NULL) {
+		draw_direct(it, x, y, width, height);
+		return;
+	}
+	al_identity_transform(&matrix);
+	al_translate_transform(&matrix, x, y);
+	render_set_transform(&matrix);
+	al_draw_prim(vector_get(mesh->vertices, 0), NULL, image_bitmap(it->atlas),
+		0, vector_len(mesh->vertices), ALLEGRO_PRIM_TRIANGLE_LIST);
+	render_count_draws(1);
+	render_set_transform(NULL);
+}
+
+static void
+build_atlas(windowstyle_t* winstyle)
+{
+	int max_w = 1;
+	int max_h = 1;
+	int pitch_x;
+	int pitch_y;
+
+	int i;
+
+	// note: each cell is padded by a pixel to prevent filtering from bleeding
+	//       neighboring images into the edges.  the extra cell at the end holds a
+	//       single white pixel, used to draw the gradient with the same texture.
+	for (i = 0; i < 9; ++i) {
+		if (image_width(winstyle->images[i]) > max_w)
+			max_w = image_width(winstyle->images[i]);
+		if (image_height(winstyle->images[i]) > max_h)
+			max_h = image_height(winstyle->images[i]);
+	}
+	pitch_x = max_w + 2;
+	pitch_y = max_h + 2;
+	if (!(winstyle->atlas = image_new(pitch_x * 10, pitch_y, NULL))) {
+		console_log(2, "couldn't create windowstyle atlas, falling back");
+		return;
+	}
+	image_fill(winstyle->atlas, mk_color(0, 0, 0, 0));
+	for (i = 0; i < 9; ++i) {
+		winstyle->regions[i] = mk_rect(pitch_x * i + 1, 1,
+			pitch_x * i + 1 + image_width(winstyle->images[i]),
+			1 + image_height(winstyle->images[i]));
+		image_blit(winstyle->images[i], winstyle->atlas, winstyle->regions[i].x1, winstyle->regions[i].y1);
+	}
+	winstyle->white_x = pitch_x * 9 + 1;
+	winstyle->white_y = 1;
+	image_set_pixel(winstyle->atlas, winstyle->white_x, winstyle->white_y, mk_color(255, 255, 255, 255));
+}
+
+static struct mesh*
+build_mesh(windowstyle_t* winstyle, int width, int height)
+{
+	ALLEGRO_COLOR mask;
+	struct mesh*  mesh;
+	int           w[9], h[9];
+
+	int i;
+
+	mesh = calloc(1, sizeof(struct mesh));
+	mesh->color_mask = winstyle->color_mask;
+	mesh->width = width;
+	mesh->height = height;
+	mesh->vertices = vector_new(sizeof(ALLEGRO_VERTEX));
+
+	mask = nativecolor(winstyle->color_mask);
+	for (i = 0; i < 9; ++i) {
+		w[i] = image_width(winstyle->images[i]);
+		h[i] = image_height(winstyle->images[i]);
+	}
+
+	// same drawing order as draw_direct(): background, gradient, corners, edges
+	switch (winstyle->bg_style) {
+	case BG_TILE:
+	case BG_TILE_GRADIENT:
+		push_tiled(mesh->vertices, winstyle, 8, 0, 0, width, height);
+		break;
+	case BG_STRETCH:
+	case BG_STRETCH_GRADIENT:
+		push_quad(mesh->vertices, 0, 0, width, height,
+			winstyle->regions[8].x1, winstyle->regions[8].y1,
+			winstyle->regions[8].x2, winstyle->regions[8].y2, mask);
+		break;
+	}
+	if (winstyle->bg_style == BG_GRADIENT
+		|| winstyle->bg_style == BG_TILE_GRADIENT
+		|| winstyle->bg_style == BG_STRETCH_GRADIENT)
+	{
+		push_gradient(mesh->vertices, winstyle, 0, 0, width, height);
+	}
+	push_tiled(mesh->vertices, winstyle, 0, -w[0], -h[0], w[0], h[0]);
+	push_tiled(mesh->vertices, winstyle, 2, width, -h[2], w[2], h[2]);
+	push_tiled(mesh->vertices, winstyle, 4, width, height, w[4], h[4]);
+	push_tiled(mesh->vertices, winstyle, 6, -w[6], height, w[6], h[6]);
+	push_tiled(mesh->vertices, winstyle, 1, 0, -h[1], width, h[1]);
+	push_tiled(mesh->vertices, winstyle, 3, width, 0, w[3], height);
+	push_tiled(mesh->vertices, winstyle, 5, 0, height, width, h[5]);
+	push_tiled(mesh->vertices, winstyle, 7, -w[7], 0, w[7], height);
+
+	if (vector_len(mesh->vertices) > MAX_QUADS * 6) {
+		// too many tiles to be worth caching, e.g. a tiny background tile in a
+		// large window.  the mesh is kept without vertices so we remember to draw
+		// this size directly rather than trying to build it again every frame.
+		vector_free(mesh->vertices);
+		mesh->vertices = NULL;
+	}
+	return mesh;
+}
+
+static void
+draw_direct(windowstyle_t* winstyle, int x, int y, int width, int height)
 {
 	color_t gradient[4];
 	color_t mask;
@@ -173,17 +324,17 @@ winstyle_draw(windowstyle_t* it, int x, int y, int width, int height)
 	// 7 - left
 	// 8 - background
 
-	mask = it->color_mask;
+	mask = winstyle->color_mask;
 
 	for (i = 0; i < 9; ++i) {
-		w[i] = image_width(it->images[i]);
-		h[i] = image_height(it->images[i]);
+		w[i] = image_width(winstyle->images[i]);
+		h[i] = image_height(winstyle->images[i]);
 	}
 	for (i = 0; i < 4; ++i) {
-		gradient[i].r = mask.r * it->gradient[i].r / 255;
-		gradient[i].g = mask.g * it->gradient[i].g / 255;
-		gradient[i].b = mask.b * it->gradient[i].b / 255;
-		gradient[i].a = mask.a * it->gradient[i].a / 255;
+		gradient[i].r = mask.r * winstyle->gradient[i].r / 255;
+		gradient[i].g = mask.g * winstyle->gradient[i].g / 255;
+		gradient[i].b = mask.b * winstyle->gradient[i].b / 255;
+		gradient[i].a = mask.a * winstyle->gradient[i].a / 255;
 	}
 	ALLEGRO_VERTEX verts[] = {
 		{ x, y, 0, 0, 0, nativecolor(gradient[0]) },
@@ -192,31 +343,159 @@ winstyle_draw(windowstyle_t* it, int x, int y, int width, int height)
 		{ x + width, y + height, 0, 0, 0, nativecolor(gradient[3]) },
 	};
 
-	switch (it->bg_style) {
+	switch (winstyle->bg_style) {
 	case BG_TILE:
-		image_draw_tiled_masked(it->images[8], mask, x, y, width, height);
+		image_draw_tiled_masked(winstyle->images[8], mask, x, y, width, height);
 		break;
 	case BG_STRETCH:
-		image_draw_scaled_masked(it->images[8], mask, x, y, width, height);
+		image_draw_scaled_masked(winstyle->images[8], mask, x, y, width, height);
 		break;
 	case BG_GRADIENT:
 		al_draw_prim(verts, NULL, NULL, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+		render_count_draws(1);
 		break;
 	case BG_TILE_GRADIENT:
-		image_draw_tiled_masked(it->images[8], mask, x, y, width, height);
+		image_draw_tiled_masked(winstyle->images[8], mask, x, y, width, height);
 		al_draw_prim(verts, NULL, NULL, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+		render_count_draws(1);
 		break;
 	case BG_STRETCH_GRADIENT:
-		image_draw_scaled_masked(it->images[8], mask, x, y, width, height);
+		image_draw_scaled_masked(winstyle->images[8], mask, x, y, width, height);
 		al_draw_prim(verts, NULL, NULL, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+		render_count_draws(1);
 		break;
 	}
-	image_draw_masked(it->images[0], mask, x - w[0], y - h[0]);
-	image_draw_masked(it->images[2], mask, x + width, y - h[2]);
-	image_draw_masked(it->images[4], mask, x + width, y + height);
-	image_draw_masked(it->images[6], mask, x - w[6], y + height);
-	image_draw_tiled_masked(it->images[1], mask, x, y - h[1], width, h[1]);
-	image_draw_tiled_masked(it->images[3], mask, x + width, y, w[3], height);
-	image_draw_tiled_masked(it->images[5], mask, x, y + height, width, h[5]);
-	image_draw_tiled_masked(it->images[7], mask, x - w[7], y, w[7], height);
+	image_draw_masked(winstyle->images[0], mask, x - w[0], y - h[0]);
+	image_draw_masked(winstyle->images[2], mask, x + width, y - h[2]);
+	image_draw_masked(winstyle->images[4], mask, x + width, y + height);
+	image_draw_masked(winstyle->images[6], mask, x - w[6], y + height);
+	image_draw_tiled_masked(winstyle->images[1], mask, x, y - h[1], width, h[1]);
+	image_draw_tiled_masked(winstyle->images[3], mask, x + width, y, w[3], height);
+	image_draw_tiled_masked(winstyle->images[5], mask, x, y + height, width, h[5]);
+	image_draw_tiled_masked(winstyle->images[7], mask, x - w[7], y, w[7], height);
+}
+
+static struct mesh*
+find_mesh(windowstyle_t* winstyle, int width, int height)
+{
+	struct mesh* mesh;
+	color_t      mask;
+	int          slot = 0;
+
+	int i;
+
+	mask = winstyle->color_mask;
+	for (i = 0; i < MAX_MESHES; ++i) {
+		mesh = winstyle->meshes[i];
+		if (mesh == NULL) {
+			slot = i;
+			break;
+		}
+		if (mesh->width == width && mesh->height == height
+			&& mesh->color_mask.r == mask.r && mesh->color_mask.g == mask.g
+			&& mesh->color_mask.b == mask.b && mesh->color_mask.a == mask.a)
+		{
+			mesh->stamp = winstyle->next_stamp++;
+			return mesh;
+		}
+		if (mesh->stamp < winstyle->meshes[slot]->stamp)
+			slot = i;
+	}
+
+	// not in the cache, replace the least recently used mesh with a new one
+	if (!(mesh = build_mesh(winstyle, width, height)))
+		return NULL;
+	free_mesh(winstyle->meshes[slot]);
+	winstyle->meshes[slot] = mesh;
+	mesh->stamp = winstyle->next_stamp++;
+	return mesh;
+}
+
+static void
+free_mesh(struct mesh* mesh)
+{
+	if (mesh == NULL)
+		return;
+	vector_free(mesh->vertices);
+	free(mesh);
+}
+
+static void
+push_gradient(vector_t* vertices, windowstyle_t* winstyle, int x, int y, int width, int height)
+{
+	ALLEGRO_VERTEX corners[4];
+	color_t        mask;
+
+	int i;
+
+	// the gradient samples the atlas's white pixel, so the vertex colors come
+	// through unchanged.
+	mask = winstyle->color_mask;
+	for (i = 0; i < 4; ++i) {
+		corners[i].x = i % 2 == 0 ? x : x + width;
+		corners[i].y = i < 2 ? y : y + height;
+		corners[i].z = 0.0f;
+		corners[i].u = winstyle->white_x + 0.5f;
+		corners[i].v = winstyle->white_y + 0.5f;
+		corners[i].color = nativecolor(mk_color(
+			mask.r * winstyle->gradient[i].r / 255,
+			mask.g * winstyle->gradient[i].g / 255,
+			mask.b * winstyle->gradient[i].b / 255,
+			mask.a * winstyle->gradient[i].a / 255));
+	}
+	vector_push(vertices, &corners[0]);
+	vector_push(vertices, &corners[1]);
+	vector_push(vertices, &corners[2]);
+	vector_push(vertices, &corners[2]);
+	vector_push(vertices, &corners[1]);
+	vector_push(vertices, &corners[3]);
+}
+
+static void
+push_quad(vector_t* vertices, float x1, float y1, float x2, float y2, float u1, float v1, float u2, float v2, ALLEGRO_COLOR color)
+{
+	ALLEGRO_VERTEX corners[4] = {
+		{ x1, y1, 0, u1, v1, color },
+		{ x2, y1, 0, u2, v1, color },
+		{ x1, y2, 0, u1, v2, color },
+		{ x2, y2, 0, u2, v2, color },
+	};
+
+	vector_push(vertices, &corners[0]);
+	vector_push(vertices, &corners[1]);
+	vector_push(vertices, &corners[2]);
+	vector_push(vertices, &corners[2]);
+	vector_push(vertices, &corners[1]);
+	vector_push(vertices, &corners[3]);
+}
+
+static void
+push_tiled(vector_t* vertices, windowstyle_t* winstyle, int index, int x, int y, int width, int height)
+{
+	ALLEGRO_COLOR mask;
+	rect_t        region;
+	int           tile_w, tile_h;
+
+	int i_x, i_y;
+
+	// the atlas can't wrap texture coordinates like a standalone bitmap, so
+	// tiling is done by laying down one quad per tile, clipping the last ones.
+	mask = nativecolor(winstyle->color_mask);
+	region = winstyle->regions[index];
+	tile_w = region.x2 - region.x1;
+	tile_h = region.y2 - region.y1;
+	if (tile_w <= 0 || tile_h <= 0)
+		return;
+	for (i_y = 0; i_y < height; i_y += tile_h) {
+		for (i_x = 0; i_x < width; i_x += tile_w) {
+			if (vector_len(vertices) > MAX_QUADS * 6)
+				return;
+			push_quad(vertices,
+				x + i_x, y + i_y,
+				x + fmin(i_x + tile_w, width), y + fmin(i_y + tile_h, height),
+				region.x1, region.y1,
+				region.x1 + fmin(tile_w, width - i_x), region.y1 + fmin(tile_h, height - i_y),
+				mask);
+		}
+	}
 }
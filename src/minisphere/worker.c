@@ -0,0 +1,269 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2018, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include "minisphere.h"
+#include "worker.h"
+
+struct worker
+{
+	unsigned int    refcount;
+	unsigned int    id;
+	char*           filename;
+	vector_t*       inbox;
+	ALLEGRO_MUTEX*  mutex;
+	vector_t*       outbox;
+	bool            running;
+	js_runtime_t*   runtime;
+	char*           source;
+	size_t          source_size;
+	bool            terminating;
+	ALLEGRO_THREAD* thread;
+	ALLEGRO_COND*   wakeup;
+};
+
+static void  free_messages  (vector_t* messages);
+static void  on_worker_post (js_message_t* message, void* userdata);
+static void* worker_main    (ALLEGRO_THREAD* thread, void* userdata);
+
+static unsigned int s_next_worker_id = 1;
+
+worker_t*
+worker_new(const char* filename, const void* source, size_t size)
+{
+	worker_t* worker;
+
+	console_log(2, "creating worker #%u for '%s'", s_next_worker_id, filename);
+
+	if (!(worker = calloc(1, sizeof(worker_t))))
+		goto on_error;
+	if (!(worker->source = malloc(size + 1)))
+		goto on_error;
+	memcpy(worker->source, source, size);
+	worker->source[size] = '\0';
+	worker->source_size = size;
+	worker->filename = strdup(filename);
+	worker->inbox = vector_new(sizeof(js_message_t*));
+	worker->outbox = vector_new(sizeof(js_message_t*));
+	if (!(worker->mutex = al_create_mutex()))
+		goto on_error;
+	if (!(worker->wakeup = al_create_cond()))
+		goto on_error;
+
+	worker->running = true;
+	if (!(worker->thread = al_create_thread(worker_main, worker)))
+		goto on_error;
+	al_start_thread(worker->thread);
+
+	worker->id = s_next_worker_id++;
+	return worker_ref(worker);
+
+on_error:
+	console_log(2, "    failed to create worker #%u", s_next_worker_id++);
+	if (worker != NULL) {
+		if (worker->wakeup != NULL)
+			al_destroy_cond(worker->wakeup);
+		if (worker->mutex != NULL)
+			al_destroy_mutex(worker->mutex);
+		vector_free(worker->inbox);
+		vector_free(worker->outbox);
+		free(worker->filename);
+		free(worker->source);
+		free(worker);
+	}
+	return NULL;
+}
+
+worker_t*
+worker_ref(worker_t* it)
+{
+	++it->refcount;
+	return it;
+}
+
+void
+worker_unref(worker_t* it)
+{
+	if (it == NULL || --it->refcount > 0)
+		return;
+
+	console_log(3, "disposing worker #%u no longer in use", it->id);
+	worker_terminate(it);
+	al_join_thread(it->thread, NULL);
+	al_destroy_thread(it->thread);
+	free_messages(it->inbox);
+	free_messages(it->outbox);
+	al_destroy_cond(it->wakeup);
+	al_destroy_mutex(it->mutex);
+	free(it->filename);
+	free(it->source);
+	free(it);
+}
+
+bool
+worker_running(worker_t* it)
+{
+	bool running;
+
+	// note: a worker is considered to be running as long as there are messages it posted
+	//       that haven't been received yet, even if the thread itself has exited.
+	al_lock_mutex(it->mutex);
+	running = it->running || vector_len(it->outbox) > 0;
+	al_unlock_mutex(it->mutex);
+	return running;
+}
+
+bool
+worker_post(worker_t* it, js_message_t* message)
+{
+	// note: the worker takes ownership of the message, even on failure.
+	al_lock_mutex(it->mutex);
+	if (!it->running || it->terminating) {
+		al_unlock_mutex(it->mutex);
+		jsal_message_free(message);
+		return false;
+	}
+	vector_push(it->inbox, &message);
+	al_signal_cond(it->wakeup);
+	al_unlock_mutex(it->mutex);
+	return true;
+}
+
+js_message_t*
+worker_receive(worker_t* it)
+{
+	js_message_t* message = NULL;
+
+	al_lock_mutex(it->mutex);
+	if (vector_len(it->outbox) > 0) {
+		message = *(js_message_t**)vector_get(it->outbox, 0);
+		vector_remove(it->outbox, 0);
+	}
+	al_unlock_mutex(it->mutex);
+	return message;
+}
+
+void
+worker_terminate(worker_t* it)
+{
+	al_lock_mutex(it->mutex);
+	if (!it->terminating)
+		console_log(2, "terminating worker #%u", it->id);
+	it->terminating = true;
+	if (it->runtime != NULL)
+		jsal_runtime_interrupt(it->runtime);
+	al_broadcast_cond(it->wakeup);
+	al_unlock_mutex(it->mutex);
+}
+
+static void
+free_messages(vector_t* messages)
+{
+	js_message_t** p_message;
+
+	iter_t iter;
+
+	iter = vector_enum(messages);
+	while ((p_message = iter_next(&iter)))
+		jsal_message_free(*p_message);
+	vector_free(messages);
+}
+
+static void
+on_worker_post(js_message_t* message, void* userdata)
+{
+	worker_t* worker;
+
+	// note: this is called on the worker thread.
+	worker = userdata;
+	al_lock_mutex(worker->mutex);
+	vector_push(worker->outbox, &message);
+	al_unlock_mutex(worker->mutex);
+}
+
+static void*
+worker_main(ALLEGRO_THREAD* thread, void* userdata)
+{
+	bool          have_error = false;
+	js_message_t* message;
+	js_runtime_t* runtime;
+	bool          succeeded;
+	worker_t*     worker;
+
+	worker = userdata;
+
+	if (!(runtime = jsal_runtime_new(on_worker_post, worker))) {
+		fprintf(stderr, "ERROR: couldn't create JS runtime for worker '%s'\n", worker->filename);
+		goto finished;
+	}
+	al_lock_mutex(worker->mutex);
+	worker->runtime = runtime;
+	if (worker->terminating)
+		jsal_runtime_interrupt(runtime);
+	al_unlock_mutex(worker->mutex);
+
+	if (!jsal_runtime_eval(runtime, worker->filename, worker->source, worker->source_size)) {
+		have_error = true;
+		goto finished;
+	}
+	while (!jsal_runtime_closed(runtime)) {
+		al_lock_mutex(worker->mutex);
+		while (vector_len(worker->inbox) == 0 && !worker->terminating)
+			al_wait_cond(worker->wakeup, worker->mutex);
+		if (worker->terminating) {
+			al_unlock_mutex(worker->mutex);
+			break;
+		}
+		message = *(js_message_t**)vector_get(worker->inbox, 0);
+		vector_remove(worker->inbox, 0);
+		al_unlock_mutex(worker->mutex);
+		succeeded = jsal_runtime_post(runtime, message);
+		jsal_message_free(message);
+		if (!succeeded) {
+			have_error = true;
+			break;
+		}
+	}
+
+finished:
+	al_lock_mutex(worker->mutex);
+	if (have_error && !worker->terminating) {
+		// an uncaught error in a worker doesn't take down the engine, but it does
+		// end the worker.
+		fprintf(stderr, "ERROR: uncaught JS error in worker '%s'\n", worker->filename);
+		fprintf(stderr, "%s\n", jsal_runtime_error(runtime));
+	}
+	worker->runtime = NULL;
+	worker->running = false;
+	al_unlock_mutex(worker->mutex);
+	jsal_runtime_free(runtime);
+	return NULL;
+}
@@ -63,14 +63,22 @@ static const char* class_name_from_id        (int class_id);
 
 static int       s_class_index[1000];
 static vector_t* s_classes;
+static js_ref_t* s_key_enumerable;
+static js_ref_t* s_key_get;
 static js_ref_t* s_key_prototype;
+static js_ref_t* s_key_set;
+static js_ref_t* s_key_value;
 
 void
 api_init(void)
 {
 	s_classes = vector_new(sizeof(struct class_data));
 
+	s_key_enumerable = jsal_new_key("enumerable");
+	s_key_get = jsal_new_key("get");
 	s_key_prototype = jsal_new_key("prototype");
+	s_key_set = jsal_new_key("set");
+	s_key_value = jsal_new_key("value");
 
 	// JavaScript 'global' binding (like Node.js)
 	// also map global 'exports' to the global object, as TypeScript likes to add
@@ -78,7 +86,7 @@ api_init(void)
 	jsal_push_global_object();
 	jsal_push_eval("({ writable: false, enumerable: false, configurable: false })");
 	jsal_push_global_object();
-	jsal_put_prop_string(-2, "value");
+	jsal_put_prop_key(-2, s_key_value);
 	jsal_dup(-1);
 	jsal_def_prop_string(-3, "global");
 	jsal_def_prop_string(-2, "exports");
@@ -92,7 +100,11 @@ api_uninit(void)
 
 	iter_t iter;
 
+	jsal_unref(s_key_enumerable);
+	jsal_unref(s_key_get);
 	jsal_unref(s_key_prototype);
+	jsal_unref(s_key_set);
+	jsal_unref(s_key_value);
 	iter = vector_enum(s_classes);
 	while (iter_next(&iter)) {
 		class_data = iter.ptr;
@@ -118,11 +130,11 @@ api_define_const(const char* enum_name, const char* name, double value)
 			jsal_push_known_symbol("toStringTag");
 			jsal_push_new_object();
 			jsal_push_string(enum_name);
-			jsal_put_prop_string(-2, "value");
+			jsal_put_prop_key(-2, s_key_value);
 			jsal_def_prop(-3);
 
 			// global.<name> = <namespace>
-			jsal_put_prop_string(-2, "value");
+			jsal_put_prop_key(-2, s_key_value);
 			jsal_def_prop_string(-2, enum_name);
 
 			jsal_get_prop_string(-1, enum_name);
@@ -131,7 +143,7 @@ api_define_const(const char* enum_name, const char* name, double value)
 
 	jsal_push_eval("({ enumerable: false, writable: false, configurable: true })");
 	jsal_push_number(value);
-	jsal_put_prop_string(-2, "value");
+	jsal_put_prop_key(-2, s_key_value);
 	jsal_def_prop_string(-2, name);
 	if (enum_name != NULL) {
 		// generate a TypeScript-style bidirectional enumeration:
@@ -141,7 +153,7 @@ api_define_const(const char* enum_name, const char* name, double value)
 		jsal_to_string(-1);
 		jsal_push_eval("({ enumerable: false, writable: false, configurable: true })");
 		jsal_push_string(name);
-		jsal_put_prop_string(-2, "value");
+		jsal_put_prop_key(-2, s_key_value);
 		jsal_def_prop(-2);
 	}
 
@@ -175,11 +187,11 @@ api_define_function(const char* namespace_name, const char* name, js_function_t
 			jsal_push_known_symbol("toStringTag");
 			jsal_push_new_object();
 			jsal_push_string(namespace_name);
-			jsal_put_prop_string(-2, "value");
+			jsal_put_prop_key(-2, s_key_value);
 			jsal_def_prop(-3);
 
 			// global.<name> = <namespace>
-			jsal_put_prop_string(-2, "value");
+			jsal_put_prop_key(-2, s_key_value);
 			jsal_def_prop_string(-2, namespace_name);
 
 			jsal_get_prop_string(-1, namespace_name);
@@ -188,7 +200,7 @@ api_define_function(const char* namespace_name, const char* name, js_function_t
 
 	jsal_push_eval("({ writable: true, configurable: true })");
 	jsal_push_new_function(callback, name, 0, magic);
-	jsal_put_prop_string(-2, "value");
+	jsal_put_prop_key(-2, s_key_value);
 	jsal_def_prop_string(-2, name);
 
 	if (namespace_name != NULL)
@@ -207,7 +219,7 @@ api_define_method(const char* class_name, const char* name, js_function_t callba
 
 	jsal_push_eval("({ writable: true, configurable: true })");
 	jsal_push_new_function(callback, name, 0, magic);
-	jsal_put_prop_string(-2, "value");
+	jsal_put_prop_key(-2, s_key_value);
 	if (strncmp(name, "@@", 2) == 0) {
 		jsal_push_known_symbol(&name[2]);
 		jsal_pull(-2);
@@ -238,11 +250,11 @@ api_define_object(const char* namespace_name, const char* name, int class_id, vo
 			jsal_push_known_symbol("toStringTag");
 			jsal_push_new_object();
 			jsal_push_string(namespace_name);
-			jsal_put_prop_string(-2, "value");
+			jsal_put_prop_key(-2, s_key_value);
 			jsal_def_prop(-3);
 
 			// global.<name> = <namespace>
-			jsal_put_prop_string(-2, "value");
+			jsal_put_prop_key(-2, s_key_value);
 			jsal_def_prop_string(-2, namespace_name);
 
 			jsal_get_prop_string(-1, namespace_name);
@@ -251,7 +263,7 @@ api_define_object(const char* namespace_name, const char* name, int class_id, vo
 
 	jsal_push_eval("({ enumerable: false, writable: false, configurable: true })");
 	jsal_push_class_obj(class_id, udata, false);
-	jsal_put_prop_string(-2, "value");
+	jsal_put_prop_key(-2, s_key_value);
 	jsal_def_prop_string(-2, name);
 	if (namespace_name != NULL)
 		jsal_pop(1);
@@ -270,14 +282,14 @@ api_define_property(const char* class_name, const char* name, bool enumerable, j
 	// populate the property descriptor
 	jsal_push_eval("({ configurable: true })");
 	jsal_push_boolean(enumerable);
-	jsal_put_prop_string(-2, "enumerable");
+	jsal_put_prop_key(-2, s_key_enumerable);
 	if (getter != NULL) {
 		jsal_push_new_function(getter, "get", 0, 0);
-		jsal_put_prop_string(-2, "get");
+		jsal_put_prop_key(-2, s_key_get);
 	}
 	if (setter != NULL) {
 		jsal_push_new_function(setter, "set", 0, 0);
-		jsal_put_prop_string(-2, "set");
+		jsal_put_prop_key(-2, s_key_set);
 	}
 
 	jsal_def_prop_string(-2, name);
@@ -302,11 +314,11 @@ api_define_static_prop(const char* namespace_name, const char* name, js_function
 			jsal_push_known_symbol("toStringTag");
 			jsal_push_new_object();
 			jsal_push_string(namespace_name);
-			jsal_put_prop_string(-2, "value");
+			jsal_put_prop_key(-2, s_key_value);
 			jsal_def_prop(-3);
 
 			// global.<name> = <namespace>
-			jsal_put_prop_string(-2, "value");
+			jsal_put_prop_key(-2, s_key_value);
 			jsal_def_prop_string(-2, namespace_name);
 
 			jsal_get_prop_string(-1, namespace_name);
@@ -317,11 +329,11 @@ api_define_static_prop(const char* namespace_name, const char* name, js_function
 	jsal_push_eval("({ configurable: true })");
 	if (getter != NULL) {
 		jsal_push_new_function(getter, "get", 0, 0);
-		jsal_put_prop_string(-2, "get");
+		jsal_put_prop_key(-2, s_key_get);
 	}
 	if (setter != NULL) {
 		jsal_push_new_function(setter, "set", 0, 0);
-		jsal_put_prop_string(-2, "set");
+		jsal_put_prop_key(-2, s_key_set);
 	}
 	jsal_def_prop_string(-2, name);
 	if (namespace_name != NULL)
@@ -350,7 +362,7 @@ api_define_subclass(const char* name, int class_id, int super_id, js_function_t
 	jsal_push_known_symbol("toStringTag");
 	jsal_push_new_object();
 	jsal_push_string(name);
-	jsal_put_prop_string(-2, "value");
+	jsal_put_prop_key(-2, s_key_value);
 	jsal_def_prop(-3);
 
 	// IMPORTANT: `class_id` should never exceed 999.
@@ -370,20 +382,20 @@ api_define_subclass(const char* name, int class_id, int super_id, js_function_t
 		// <prototype>.constructor = <ctor>;
 		jsal_push_new_object();
 		jsal_dup(-2);
-		jsal_put_prop_string(-2, "value");
+		jsal_put_prop_key(-2, s_key_value);
 		jsal_def_prop_string(-3, "constructor");
 
 		// <ctor>.prototype = <prototype>
 		jsal_push_new_object();
 		jsal_dup(-3);
-		jsal_put_prop_string(-2, "value");
+		jsal_put_prop_key(-2, s_key_value);
 		jsal_def_prop_string(-2, "prototype");
 
 		// global.<name> = <ctor>;
 		jsal_push_global_object();
 		jsal_push_eval("({ writable: true, configurable: true })");
 		jsal_pull(-3);
-		jsal_put_prop_string(-2, "value");
+		jsal_put_prop_key(-2, s_key_value);
 		jsal_def_prop_string(-2, name);
 		jsal_pop(1);
 	}
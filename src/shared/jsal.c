@@ -45,10 +45,13 @@
 #include <limits.h>
 #include <math.h>
 #include <setjmp.h>
+#include <time.h>
 #if !defined(_WIN32)
 #include <alloca.h>
+#include <unistd.h>
 #else
 #include <malloc.h>
+#include <process.h>
 #endif
 
 #include <ChakraCore.h>
@@ -64,12 +67,71 @@
 #define jsal_jmpbuf               jmp_buf
 #endif
 
+// property IDs for short names passed to the jsal_*_string() functions are
+// cached so that hot paths don't pay for a string conversion and a hash lookup
+// inside ChakraCore on every access.  the table is never rehashed; once it
+// fills up, new names just get a fresh, uncached ID.
+#define INTERNED_KEY_SLOTS  1024
+#define MAX_INTERNED_KEYS   (INTERNED_KEY_SLOTS * 3 / 4)
+#define MAX_INTERNED_NAME   31
+
+// host objects (a `struct object` followed by the host's payload) are carved out of
+// slabs, one free list per size class, instead of being calloc'd one at a time.
+// most of them are small and short-lived (e.g. a Color returned from a getter), so
+// this takes a lot of pressure off the system allocator.  objects too large for the
+// biggest size class go to the heap as before.  slabs are only released by
+// jsal_uninit().
+#define NUM_SIZE_CLASSES  9
+#define SLAB_SIZE         65536
+
+static const size_t SIZE_CLASSES[NUM_SIZE_CLASSES] = { 32, 48, 64, 96, 128, 192, 256, 384, 512 };
+
+// scripts smaller than this aren't worth caching: they parse quickly and the
+// source of a cached script has to be kept alive for the lifetime of the runtime.
+#define MIN_CACHED_SOURCE  4096
+
+struct js_message
+{
+	struct blob* buffers;
+	char*        json;
+	size_t       json_length;
+	int          num_buffers;
+};
+
 struct js_ref
 {
 	bool  weak_ref;
 	JsRef value;
 };
 
+struct js_runtime
+{
+	bool               closed;
+	JsContextRef       context;
+	JsValueRef         decoder;
+	JsValueRef         encoder;
+	char*              error;
+	JsRuntimeHandle    handle;
+	vector_t*          jobs;
+	js_post_callback_t on_post;
+	void*              userdata;
+};
+
+struct blob
+{
+	void*  data;
+	size_t size;
+};
+
+struct bytecode_header
+{
+	char     signature[4];
+	uint32_t version;
+	uint64_t source_hash;
+	uint32_t source_size;
+	uint32_t bytecode_size;
+};
+
 struct breakpoint
 {
 	int          column;
@@ -78,6 +140,19 @@ struct breakpoint
 	int          line;
 };
 
+struct interned_key
+{
+	uint32_t        hash;
+	JsPropertyIdRef id;
+	char            name[MAX_INTERNED_NAME + 1];
+};
+
+struct cached_script
+{
+	JsSourceContext context;
+	JsValueRef      source;
+};
+
 struct function
 {
 	js_function_t callback;
@@ -105,6 +180,13 @@ struct object
 	void*          data;
 	js_finalizer_t finalizer;
 	JsValueRef     object;
+	int            size_class;
+};
+
+struct pool
+{
+	void*  free_list;
+	size_t slot_size;
 };
 
 struct rejection
@@ -114,27 +196,53 @@ struct rejection
 	JsValueRef value;
 };
 
+static void CHAKRA_CALLBACK        on_before_collect           (void* userdata);
 static void CHAKRA_CALLBACK        on_debugger_event           (JsDiagDebugEvent event_type, JsValueRef data, void* userdata);
 static JsErrorCode CHAKRA_CALLBACK on_fetch_dynamic_import     (JsSourceContext importer, JsValueRef specifier, JsModuleRecord *out_module);
 static JsErrorCode CHAKRA_CALLBACK on_fetch_imported_module    (JsModuleRecord importer, JsValueRef specifier, JsModuleRecord *out_module);
 static void CHAKRA_CALLBACK        on_finalize_host_object     (void* userdata);
 static JsValueRef CHAKRA_CALLBACK  on_js_to_native_call        (JsValueRef callee, JsValueRef argv[], unsigned short argc, JsNativeFunctionInfo* env, void* userdata);
+static bool CHAKRA_CALLBACK        on_load_script_source       (JsSourceContext source_context, JsValueRef *out_value, JsParseScriptAttributes *out_attributes);
+static bool CHAKRA_CALLBACK        on_memory_event             (void* userdata, JsMemoryEventType event_type, size_t size);
 static JsErrorCode CHAKRA_CALLBACK on_notify_module_ready      (JsModuleRecord module, JsValueRef exception);
 static void CHAKRA_CALLBACK        on_reject_promise_unhandled (JsValueRef promise, JsValueRef reason, bool handled, void* userdata);
 static void CHAKRA_CALLBACK        on_resolve_reject_promise   (JsValueRef function, void* userdata);
+static JsValueRef CHAKRA_CALLBACK  on_runtime_close            (JsValueRef callee, bool is_ctor, JsValueRef argv[], unsigned short argc, void* userdata);
+static void CHAKRA_CALLBACK        on_runtime_job              (JsValueRef task, void* userdata);
+static JsValueRef CHAKRA_CALLBACK  on_runtime_post             (JsValueRef callee, bool is_ctor, JsValueRef argv[], unsigned short argc, void* userdata);
+static JsValueRef CHAKRA_CALLBACK  on_runtime_print            (JsValueRef callee, bool is_ctor, JsValueRef argv[], unsigned short argc, void* userdata);
+static char*                       bytecode_name               (const struct bytecode_header* header);
 static void                        decode_debugger_value       (void);
+static struct object*              alloc_object                (size_t size);
+static JsValueRef                  decode_message              (JsValueRef decoder, const js_message_t* message);
+static char*                       dup_value_string            (JsValueRef value);
+static js_message_t*               encode_message              (JsValueRef encoder, JsValueRef value);
 static const char*                 filename_from_script_id     (unsigned int script_id);
+static void                        free_object                 (struct object* object_info);
 static void                        free_ref                    (js_ref_t* ref);
 static JsModuleRecord              get_module_record           (const char* specifier, JsModuleRecord parent, const char* url, bool *out_is_new);
 static js_ref_t*                   get_ref                     (int stack_index);
 static JsValueRef                  get_value                   (int stack_index);
+static bool                        make_message_codec          (JsValueRef *out_encoder, JsValueRef *out_decoder);
 static JsPropertyIdRef             make_property_id            (JsValueRef key_value);
 static js_ref_t*                   make_ref                    (JsRef value, bool weak_ref);
+static JsValueRef                  parse_bytecode              (const void* data, size_t size, const struct bytecode_header* header, JsValueRef source, JsValueRef url);
 static JsValueRef                  pop_value                   (void);
 static void                        push_debug_callback_args    (JsValueRef event_data);
 static unsigned int                script_id_from_filename     (const char* filename);
+static bool                        hash_source                 (JsValueRef source, struct bytecode_header *out_header);
+static uint32_t                    hash_version                (const char* version);
+static JsPropertyIdRef             intern_key                  (const char* name);
+static JsValueRef                  load_bytecode               (const struct bytecode_header* header, JsValueRef source, JsValueRef url);
+static void*                       make_bytecode               (JsValueRef source, struct bytecode_header* header, size_t *out_size);
 static int                         push_value                  (JsValueRef value, bool weak_ref);
+static double                      read_clock                  (void);
 static void                        resize_stack                (int new_size);
+static bool                        run_runtime_jobs            (js_runtime_t* runtime);
+static void                        save_bytecode               (struct bytecode_header* header, JsValueRef source);
+static void                        set_runtime_error           (js_runtime_t* runtime);
+static void                        set_runtime_function        (const char* name, JsNativeFunction callback, js_runtime_t* runtime);
+static void*                       slurp_file                  (const char* path, size_t *out_size);
 static void                        throw_on_error              (void);
 static void                        throw_value                 (JsValueRef value);
 
@@ -145,26 +253,51 @@ static int vasprintf (char* *out, const char* format, va_list ap);
 
 static js_break_callback_t  s_break_callback = NULL;
 static vector_t*            s_breakpoints;
+static char*                s_cache_dirname = NULL;
+static bool                 s_cache_enabled = false;
+static js_gc_callback_t     s_gc_callback = NULL;
+static size_t               s_heap_growth = 0;
+static size_t               s_heap_size = 0;
+static js_fetch_callback_t  s_fetch_callback = NULL;
+static double               s_cache_load_time = 0.0;
+static uint32_t             s_cache_version;
+static vector_t*            s_cached_scripts;
 static JsValueRef           s_callee_value = JS_INVALID_REFERENCE;
 static jsal_jmpbuf*         s_catch_label = NULL;
 static js_import_callback_t s_import_callback = NULL;
 static js_job_callback_t    s_job_callback = NULL;
 static JsContextRef         s_js_context;
+static JsValueRef           s_message_decoder = JS_INVALID_REFERENCE;
+static JsValueRef           s_message_encoder = JS_INVALID_REFERENCE;
 static JsValueRef           s_js_false;
 static JsValueRef           s_js_null;
 static JsRuntimeHandle      s_js_runtime = NULL;
 static JsValueRef           s_js_true;
 static JsValueRef           s_js_undefined;
+static struct interned_key* s_interned_keys;
 static js_ref_t*            s_key_done;
 static js_ref_t*            s_key_length;
 static js_ref_t*            s_key_next;
 static js_ref_t*            s_key_value;
 static vector_t*            s_module_cache;
 static vector_t*            s_module_jobs;
+static int                  s_native_depth = 0;
 static JsValueRef           s_newtarget_value = JS_INVALID_REFERENCE;
 static JsSourceContext      s_next_source_context = 1;
+static unsigned int         s_num_alloc_failures = 0;
+static unsigned int         s_num_cache_loads = 0;
+static unsigned int         s_num_gc_runs = 0;
+static unsigned int         s_num_heap_objects = 0;
+static unsigned int         s_num_host_objects = 0;
+static int                  s_num_interned_keys = 0;
+static unsigned int         s_num_native_calls = 0;
+static unsigned int         s_num_object_allocs = 0;
+static unsigned int         s_num_parses = 0;
+static double               s_parse_time = 0.0;
+static struct pool          s_pools[NUM_SIZE_CLASSES];
 static js_reject_callback_t s_reject_callback = NULL;
 static vector_t*            s_rejections;
+static vector_t*            s_slabs;
 static int                  s_stack_base;
 static JsValueRef           s_stash;
 static JsValueRef           s_this_value = JS_INVALID_REFERENCE;
@@ -177,6 +310,8 @@ jsal_init(void)
 	JsModuleRecord module_record;
 	JsErrorCode    result;
 
+	int i;
+
 	result = JsCreateRuntime(
 		JsRuntimeAttributeAllowScriptInterrupt
 			| JsRuntimeAttributeDispatchSetExceptionsToDebugger
@@ -194,6 +329,8 @@ jsal_init(void)
 	JsGetFalseValue(&s_js_false);
 
 	// set up the callbacks
+	JsSetRuntimeBeforeCollectCallback(s_js_runtime, NULL, on_before_collect);
+	JsSetRuntimeMemoryAllocationCallback(s_js_runtime, NULL, on_memory_event);
 	JsSetPromiseContinuationCallback(on_resolve_reject_promise, NULL);
 	JsSetHostPromiseRejectionTracker(on_reject_promise_unhandled, NULL);
 	JsInitializeModuleRecord(NULL, NULL, &module_record);
@@ -208,12 +345,21 @@ jsal_init(void)
 	s_value_stack = vector_new(sizeof(js_ref_t));
 	s_stack_base = 0;
 	s_breakpoints = vector_new(sizeof(struct breakpoint));
+	s_cached_scripts = vector_new(sizeof(struct cached_script));
 	s_module_cache = vector_new(sizeof(struct module));
 	s_module_jobs = vector_new(sizeof(struct module_job));
 	s_rejections = vector_new(sizeof(struct rejection));
+	s_slabs = vector_new(sizeof(void*));
+	for (i = 0; i < NUM_SIZE_CLASSES; ++i) {
+		s_pools[i].free_list = NULL;
+		s_pools[i].slot_size = SIZE_CLASSES[i];
+	}
 
 	vector_reserve(s_value_stack, 128);
 
+	s_interned_keys = calloc(INTERNED_KEY_SLOTS, sizeof(struct interned_key));
+	s_num_interned_keys = 0;
+
 	s_key_done = jsal_new_key("done");
 	s_key_length = jsal_new_key("length");
 	s_key_next = jsal_new_key("next");
@@ -231,8 +377,10 @@ on_error:
 void
 jsal_uninit(void)
 {
-	struct breakpoint* breakpoint;
-	struct module*     module;
+	struct breakpoint*     breakpoint;
+	struct cached_script*  cached;
+	int                    i;
+	struct module*         module;
 
 	iter_t iter;
 
@@ -241,12 +389,23 @@ jsal_uninit(void)
 	jsal_unref(s_key_next);
 	jsal_unref(s_key_value);
 
+	for (i = 0; i < INTERNED_KEY_SLOTS; ++i) {
+		if (s_interned_keys[i].id != JS_INVALID_REFERENCE)
+			JsRelease(s_interned_keys[i].id, NULL);
+	}
+	free(s_interned_keys);
+
 	iter = vector_enum(s_breakpoints);
 	while (iter_next(&iter)) {
 		breakpoint = iter.ptr;
 		free(breakpoint->filename);
 	}
 
+	iter = vector_enum(s_cached_scripts);
+	while ((cached = iter_next(&iter))) {
+		JsRelease(cached->source, NULL);
+	}
+
 	iter = vector_enum(s_module_cache);
 	while ((module = iter_next(&iter))) {
 		JsRelease(module->record, NULL);
@@ -257,13 +416,27 @@ jsal_uninit(void)
 	resize_stack(0);
 
 	vector_free(s_breakpoints);
+	vector_free(s_cached_scripts);
 	vector_free(s_module_cache);
 	vector_free(s_module_jobs);
 	vector_free(s_value_stack);
 	vector_free(s_rejections);
+	if (s_message_encoder != JS_INVALID_REFERENCE) {
+		JsRelease(s_message_decoder, NULL);
+		JsRelease(s_message_encoder, NULL);
+	}
 	JsRelease(s_stash, NULL);
 	JsSetCurrentContext(JS_INVALID_REFERENCE);
 	JsDisposeRuntime(s_js_runtime);
+	free(s_cache_dirname);
+	s_cache_dirname = NULL;
+
+	// note: this must be done after the runtime is disposed, since disposing it
+	//       finalizes any remaining host objects.
+	iter = vector_enum(s_slabs);
+	while (iter_next(&iter))
+		free(*(void**)iter.ptr);
+	vector_free(s_slabs);
 }
 
 void
@@ -356,6 +529,14 @@ jsal_update(bool in_event_loop)
 	}
 }
 
+void
+jsal_idle(void)
+{
+	// note: this lets ChakraCore do housekeeping, including garbage collection, that
+	//       it would otherwise have to fit in while script is running.
+	JsIdle(NULL);
+}
+
 bool
 jsal_busy(void)
 {
@@ -363,6 +544,38 @@ jsal_busy(void)
 		|| vector_len(s_rejections) > 0;
 }
 
+bool
+jsal_in_script(void)
+{
+	// note: C code only runs with JS on the stack when JS has called into it, so
+	//       this is true exactly when there's a native call in progress.
+	return s_native_depth > 0;
+}
+
+js_stats_t
+jsal_stats(void)
+{
+	js_stats_t stats;
+
+	stats.cache_load_time = s_cache_load_time;
+	stats.heap_growth = s_heap_growth;
+	stats.heap_size = s_heap_size;
+	JsGetRuntimeMemoryLimit(s_js_runtime, &stats.memory_limit);
+	if (stats.memory_limit == (size_t)-1)
+		stats.memory_limit = 0;
+	stats.num_alloc_failures = s_num_alloc_failures;
+	stats.num_cache_loads = s_num_cache_loads;
+	stats.num_gc_runs = s_num_gc_runs;
+	stats.num_heap_objects = s_num_heap_objects;
+	stats.num_host_objects = s_num_host_objects;
+	stats.num_native_calls = s_num_native_calls;
+	stats.num_object_allocs = s_num_object_allocs;
+	stats.num_parses = s_num_parses;
+	stats.parse_time = s_parse_time;
+	stats.pool_size = vector_len(s_slabs) * SLAB_SIZE;
+	return stats;
+}
+
 bool
 jsal_vm_enabled(void)
 {
@@ -378,6 +591,18 @@ jsal_on_enqueue_job(js_job_callback_t callback)
 	s_job_callback = callback;
 }
 
+void
+jsal_on_collect_garbage(js_gc_callback_t callback)
+{
+	s_gc_callback = callback;
+}
+
+void
+jsal_on_fetch_bytecode(js_fetch_callback_t callback)
+{
+	s_fetch_callback = callback;
+}
+
 void
 jsal_on_import_module(js_import_callback_t callback)
 {
@@ -390,6 +615,38 @@ jsal_on_reject_promise(js_reject_callback_t callback)
 	s_reject_callback = callback;
 }
 
+void
+jsal_set_cache_dir(const char* dirname, const char* version)
+{
+	size_t length;
+
+	// note: scripts are looked up in the cache by a hash of their source text.  the
+	//       version string is stored with each entry so that bytecode from a different
+	//       build is never loaded.  ChakraCore does its own check as well, but it's
+	//       cheaper to reject a stale file before handing it over.
+	//       `dirname` may be NULL, in which case only bytecode provided by the host
+	//       (see jsal_on_fetch_bytecode()) is used and nothing is written to disk.
+	free(s_cache_dirname);
+	s_cache_dirname = NULL;
+	if (dirname != NULL) {
+		length = strlen(dirname);
+		if (length > 0 && dirname[length - 1] != '/' && dirname[length - 1] != '\\')
+			asprintf(&s_cache_dirname, "%s/", dirname);
+		else
+			s_cache_dirname = strdup(dirname);
+	}
+	s_cache_version = hash_version(version);
+	s_cache_enabled = true;
+}
+
+void
+jsal_set_memory_limit(size_t max_bytes)
+{
+	// note: ChakraCore uses (size_t)-1 to mean "no limit"; JSAL uses 0 for
+	//       consistency with the engine's other budgets.
+	JsSetRuntimeMemoryLimit(s_js_runtime, max_bytes > 0 ? max_bytes : (size_t)-1);
+}
+
 void
 jsal_call(int num_args)
 {
@@ -430,13 +687,38 @@ jsal_compile(const char* filename)
 {
 	/* [ ... source ] -> [ ... function ] */
 
-	JsValueRef function;
-	JsValueRef name_string;
-	JsValueRef source_string;
+	JsValueRef             function = JS_INVALID_REFERENCE;
+	struct bytecode_header header;
+	bool                   is_cacheable;
+	JsValueRef             name_string;
+	JsErrorCode            result;
+	JsValueRef             source_string;
+	double                 start_time;
 
+	// note: bytecode isn't used while a debugger is attached; breakpoints and
+	//       stepping need the engine to see the source as it's parsed.
 	source_string = pop_value();
 	JsCreateString(filename, strlen(filename), &name_string);
-	JsParse(source_string, s_next_source_context, name_string, JsParseScriptAttributeNone, &function);
+	start_time = read_clock();
+	is_cacheable = s_cache_enabled && s_break_callback == NULL
+		&& hash_source(source_string, &header);
+	if (is_cacheable) {
+		header.version = s_cache_version;
+		function = load_bytecode(&header, source_string, name_string);
+	}
+	if (function != JS_INVALID_REFERENCE) {
+		s_cache_load_time += read_clock() - start_time;
+		++s_num_cache_loads;
+	}
+	else {
+		result = JsParse(source_string, s_next_source_context, name_string, JsParseScriptAttributeNone, &function);
+		if (result == JsNoError) {
+			s_parse_time += read_clock() - start_time;
+			++s_num_parses;
+			if (is_cacheable)
+				save_bytecode(&header, source_string);
+		}
+	}
 	throw_on_error();
 	push_value(function, false);
 	return (unsigned int)s_next_source_context++;
@@ -499,10 +781,14 @@ jsal_def_prop_string(int object_index, const char* name)
 {
 	/* [ ... descriptor ] -> [ ... ] */
 
-	object_index = jsal_normalize_index(object_index);
-	jsal_push_string(name);
-	jsal_insert(-2);
-	jsal_def_prop(object_index);
+	JsValueRef descriptor;
+	JsValueRef object;
+	bool       result;
+
+	object = get_value(object_index);
+	descriptor = pop_value();
+	JsDefineProperty(object, intern_key(name), descriptor, &result);
+	throw_on_error();
 }
 
 bool
@@ -526,8 +812,15 @@ jsal_del_global(void)
 bool
 jsal_del_global_string(const char* name)
 {
-	jsal_push_string(name);
-	return jsal_del_global();
+	JsValueRef object;
+	JsValueRef result;
+	bool       retval;
+
+	JsGetGlobalObject(&object);
+	JsDeleteProperty(object, intern_key(name), true, &result);
+	throw_on_error();
+	JsBooleanToBool(result, &retval);
+	return retval;
 }
 
 bool
@@ -559,9 +852,15 @@ jsal_del_prop_index(int object_index, int name)
 bool
 jsal_del_prop_string(int object_index, const char* name)
 {
-	object_index = jsal_normalize_index(object_index);
-	jsal_push_string(name);
-	return jsal_del_prop(object_index);
+	JsValueRef object;
+	JsValueRef result;
+	bool       retval;
+
+	object = get_value(object_index);
+	JsDeleteProperty(object, intern_key(name), true, &result);
+	throw_on_error();
+	JsBooleanToBool(result, &retval);
+	return retval;
 }
 
 int
@@ -674,6 +973,30 @@ jsal_get_buffer_ptr(int at_index, size_t *out_size)
 	return value;
 }
 
+js_buffer_type_t
+jsal_get_buffer_type(int at_index)
+{
+	JsTypedArrayType array_type;
+	JsValueType      type;
+	JsValueRef       value_ref;
+
+	value_ref = get_value(at_index);
+	JsGetValueType(value_ref, &type);
+	if (type != JsTypedArray)
+		return JS_ARRAYBUFFER;
+	JsGetTypedArrayInfo(value_ref, &array_type, NULL, NULL, NULL);
+	return array_type == JsArrayTypeInt8 ? JS_INT8ARRAY
+		: array_type == JsArrayTypeInt16 ? JS_INT16ARRAY
+		: array_type == JsArrayTypeInt32 ? JS_INT32ARRAY
+		: array_type == JsArrayTypeUint8 ? JS_UINT8ARRAY
+		: array_type == JsArrayTypeUint8Clamped ? JS_UINT8ARRAY_CLAMPED
+		: array_type == JsArrayTypeUint16 ? JS_UINT16ARRAY
+		: array_type == JsArrayTypeUint32 ? JS_UINT32ARRAY
+		: array_type == JsArrayTypeFloat32 ? JS_FLOAT32ARRAY
+		: array_type == JsArrayTypeFloat64 ? JS_FLOAT64ARRAY
+		: JS_ARRAYBUFFER;
+}
+
 bool
 jsal_get_global(void)
 {
@@ -696,8 +1019,14 @@ jsal_get_global_string(const char* name)
 {
 	/* [ ... ] -> [ ... value ] */
 
-	jsal_push_string(name);
-	return jsal_get_global();
+	JsValueRef object;
+	JsValueRef value;
+
+	JsGetGlobalObject(&object);
+	JsGetProperty(object, intern_key(name), &value);
+	throw_on_error();
+	push_value(value, true);
+	return value != s_js_undefined;
 }
 
 void*
@@ -842,13 +1171,11 @@ jsal_get_prop_string(int object_index, const char* name)
 {
 	/* [ ... ] -> [ ... value ] */
 
-	JsPropertyIdRef key;
-	js_ref_t*       object_ref;
-	JsValueRef      value;
+	js_ref_t*  object_ref;
+	JsValueRef value;
 
 	object_ref = get_ref(object_index);
-	JsCreatePropertyId(name, strlen(name), &key);
-	JsGetProperty(object_ref->value, key, &value);
+	JsGetProperty(object_ref->value, intern_key(name), &value);
 	throw_on_error();
 	push_value(value, object_ref->weak_ref);
 	return value != s_js_undefined;
@@ -918,9 +1245,12 @@ jsal_has_own_prop_index(int object_index, int name)
 bool
 jsal_has_own_prop_string(int object_index, const char* name)
 {
-	object_index = jsal_normalize_index(object_index);
-	jsal_push_string(name);
-	return jsal_has_own_prop(object_index);
+	bool       has_property;
+	JsValueRef object;
+
+	object = get_value(object_index);
+	JsHasOwnProperty(object, intern_key(name), &has_property);
+	return has_property;
 }
 
 bool
@@ -949,9 +1279,12 @@ jsal_has_prop_index(int object_index, int name)
 bool
 jsal_has_prop_string(int object_index, const char* name)
 {
-	object_index = jsal_normalize_index(object_index);
-	jsal_push_string(name);
-	return jsal_has_prop(object_index);
+	bool       has_property;
+	JsValueRef object;
+
+	object = get_value(object_index);
+	JsHasProperty(object, intern_key(name), &has_property);
+	return has_property;
 }
 
 void
@@ -1150,13 +1483,61 @@ jsal_make_buffer(int object_index, js_buffer_type_t buffer_type, void* buffer, s
 	JsSetIndexedPropertiesToExternalData(object, buffer, type, (unsigned int)num_items);
 }
 
+void*
+jsal_make_bytecode(const char* version, char* *out_name, size_t *out_size)
+{
+	/* [ ... source ] -> [ ... ] */
+
+	void*                  bytecode;
+	struct bytecode_header header;
+	JsValueRef             source;
+
+	source = pop_value();
+	if (!hash_source(source, &header))
+		return NULL;
+	header.version = hash_version(version);
+	if (!(bytecode = make_bytecode(source, &header, out_size)))
+		return NULL;
+	*out_name = bytecode_name(&header);
+	return bytecode;
+}
+
+void
+jsal_message_free(js_message_t* message)
+{
+	int i;
+
+	if (message == NULL)
+		return;
+	for (i = 0; i < message->num_buffers; ++i)
+		free(message->buffers[i].data);
+	free(message->buffers);
+	free(message->json);
+	free(message);
+}
+
+js_message_t*
+jsal_message_new(int at_index)
+{
+	// note: messages are runtime-neutral (plain JSON text plus copies of any binary
+	//       buffers), so they can be handed off to another thread and decoded there.
+	js_message_t* message;
+	JsValueRef    value;
+
+	value = get_value(at_index);
+	if (s_message_encoder == JS_INVALID_REFERENCE)
+		make_message_codec(&s_message_encoder, &s_message_decoder);
+	if (!(message = encode_message(s_message_encoder, value))) {
+		throw_on_error();
+		jsal_error(JS_ERROR, "Couldn't serialize value for message");
+	}
+	return message;
+}
+
 js_ref_t*
 jsal_new_key(const char* name)
 {
-	JsPropertyIdRef key;
-
-	JsCreatePropertyId(name, strlen(name), &key);
-	return make_ref(key, false);
+	return make_ref(intern_key(name), false);
 }
 
 bool
@@ -1301,6 +1682,20 @@ jsal_push_lstring(const char* value, size_t length)
 	return push_value(ref, false);
 }
 
+int
+jsal_push_message(const js_message_t* message)
+{
+	JsValueRef value;
+
+	if (s_message_encoder == JS_INVALID_REFERENCE)
+		make_message_codec(&s_message_encoder, &s_message_decoder);
+	if ((value = decode_message(s_message_decoder, message)) == JS_INVALID_REFERENCE) {
+		throw_on_error();
+		jsal_error(JS_ERROR, "Couldn't deserialize message");
+	}
+	return push_value(value, false);
+}
+
 int
 jsal_push_new_array(void)
 {
@@ -1420,7 +1815,7 @@ jsal_push_new_host_object(js_finalizer_t finalizer, size_t data_size, void* *out
 
 	prototype = pop_value();
 
-	object_info = calloc(1, sizeof(struct object) + data_size);
+	object_info = alloc_object(sizeof(struct object) + data_size);
 	data_ptr = &object_info[1];
 	if (out_data_ptr != NULL)
 		*out_data_ptr = data_ptr;
@@ -1654,14 +2049,12 @@ jsal_put_prop_string(int object_index, const char* name)
 {
 	/* [ ... value ] -> [ ... ] */
 
-	JsPropertyIdRef key;
-	JsValueRef      object;
-	JsValueRef      value;
+	JsValueRef object;
+	JsValueRef value;
 
 	object = get_value(object_index);
 	value = pop_value();
-	JsCreatePropertyId(name, strlen(name), &key);
-	JsSetProperty(object, key, value, true);
+	JsSetProperty(object, intern_key(name), value, true);
 	throw_on_error();
 }
 
@@ -2171,6 +2564,27 @@ jsal_try_parse(int at_index)
 	}
 }
 
+bool
+jsal_try_push_message(const js_message_t* message)
+{
+	/* [ ... ] -> [ ... value ] */
+
+	jsal_jmpbuf  label;
+	jsal_jmpbuf* last_catch_label;
+
+	last_catch_label = s_catch_label;
+	if (jsal_setjmp(label) == 0) {
+		s_catch_label = &label;
+		jsal_push_message(message);
+		s_catch_label = last_catch_label;
+		return true;
+	}
+	else {
+		s_catch_label = last_catch_label;
+		return false;
+	}
+}
+
 void
 jsal_unref(js_ref_t* ref)
 {
@@ -2180,6 +2594,154 @@ jsal_unref(js_ref_t* ref)
 	free(ref);
 }
 
+js_runtime_t*
+jsal_runtime_new(js_post_callback_t on_post, void* userdata)
+{
+	// note: a secondary runtime is completely isolated from the main one: it has its own
+	//       heap, its own global object and none of the host APIs.  it must be used only
+	//       from the thread that created it, with the exception of
+	//       jsal_runtime_interrupt(), which may be called from any thread.
+	JsContextRef  last_context;
+	JsErrorCode   result;
+	js_runtime_t* runtime;
+
+	if (!(runtime = calloc(1, sizeof(js_runtime_t))))
+		return NULL;
+	result = JsCreateRuntime(
+		JsRuntimeAttributeAllowScriptInterrupt
+			| JsRuntimeAttributeEnableExperimentalFeatures,
+		NULL, &runtime->handle);
+	if (result != JsNoError)
+		goto on_error;
+	if (JsCreateContext(runtime->handle, &runtime->context) != JsNoError)
+		goto on_error;
+	runtime->jobs = vector_new(sizeof(JsValueRef));
+	runtime->on_post = on_post;
+	runtime->userdata = userdata;
+
+	JsGetCurrentContext(&last_context);
+	JsSetCurrentContext(runtime->context);
+	JsSetPromiseContinuationCallback(on_runtime_job, runtime);
+	make_message_codec(&runtime->encoder, &runtime->decoder);
+	set_runtime_function("close", on_runtime_close, runtime);
+	set_runtime_function("postMessage", on_runtime_post, runtime);
+	set_runtime_function("print", on_runtime_print, runtime);
+	JsSetCurrentContext(last_context);
+	if (runtime->encoder == JS_INVALID_REFERENCE)
+		goto on_error;
+	return runtime;
+
+on_error:
+	jsal_runtime_free(runtime);
+	return NULL;
+}
+
+void
+jsal_runtime_free(js_runtime_t* runtime)
+{
+	JsContextRef last_context;
+	JsValueRef*  task;
+
+	iter_t iter;
+
+	if (runtime == NULL)
+		return;
+	if (runtime->context != JS_INVALID_REFERENCE) {
+		JsGetCurrentContext(&last_context);
+		JsSetCurrentContext(runtime->context);
+		iter = vector_enum(runtime->jobs);
+		while ((task = iter_next(&iter)))
+			JsRelease(*task, NULL);
+		if (runtime->encoder != JS_INVALID_REFERENCE) {
+			JsRelease(runtime->decoder, NULL);
+			JsRelease(runtime->encoder, NULL);
+		}
+		JsSetCurrentContext(last_context);
+	}
+	if (runtime->handle != JS_INVALID_RUNTIME_HANDLE)
+		JsDisposeRuntime(runtime->handle);
+	vector_free(runtime->jobs);
+	free(runtime->error);
+	free(runtime);
+}
+
+bool
+jsal_runtime_closed(const js_runtime_t* runtime)
+{
+	return runtime->closed;
+}
+
+const char*
+jsal_runtime_error(const js_runtime_t* runtime)
+{
+	return runtime->error;
+}
+
+bool
+jsal_runtime_eval(js_runtime_t* runtime, const char* filename, const char* source, size_t length)
+{
+	JsContextRef last_context;
+	JsValueRef   name_string;
+	JsValueRef   result;
+	JsValueRef   source_string;
+	bool         succeeded = false;
+
+	JsGetCurrentContext(&last_context);
+	JsSetCurrentContext(runtime->context);
+	JsCreateString(source, length, &source_string);
+	JsCreateString(filename, strlen(filename), &name_string);
+	if (JsRun(source_string, 0, name_string, JsParseScriptAttributeNone, &result) != JsNoError) {
+		set_runtime_error(runtime);
+		goto finished;
+	}
+	succeeded = run_runtime_jobs(runtime);
+
+finished:
+	JsSetCurrentContext(last_context);
+	return succeeded;
+}
+
+void
+jsal_runtime_interrupt(js_runtime_t* runtime)
+{
+	JsDisableRuntimeExecution(runtime->handle);
+}
+
+bool
+jsal_runtime_post(js_runtime_t* runtime, const js_message_t* message)
+{
+	JsValueRef      args[2];
+	JsValueRef      function;
+	JsPropertyIdRef key;
+	JsContextRef    last_context;
+	JsValueRef      result;
+	bool            succeeded = false;
+	JsValueType     value_type;
+
+	JsGetCurrentContext(&last_context);
+	JsSetCurrentContext(runtime->context);
+	JsGetGlobalObject(&args[0]);
+	JsCreatePropertyId("onMessage", 9, &key);
+	JsGetProperty(args[0], key, &function);
+	JsGetValueType(function, &value_type);
+	if (value_type != JsFunction) {
+		// no message handler, drop the message on the floor.
+		succeeded = true;
+		goto finished;
+	}
+	if ((args[1] = decode_message(runtime->decoder, message)) == JS_INVALID_REFERENCE
+		|| JsCallFunction(function, args, 2, &result) != JsNoError)
+	{
+		set_runtime_error(runtime);
+		goto finished;
+	}
+	succeeded = run_runtime_jobs(runtime);
+
+finished:
+	JsSetCurrentContext(last_context);
+	return succeeded;
+}
+
 bool
 jsal_debug_init(js_break_callback_t on_breakpoint)
 {
@@ -2381,6 +2943,56 @@ jsal_debug_inspect_var(int call_index, int var_index)
 	}
 }
 
+static struct object*
+alloc_object(size_t size)
+{
+	struct object* object_info;
+	struct pool*   pool;
+	uint8_t*       slab;
+	int            size_class;
+
+	size_t i;
+
+	++s_num_object_allocs;
+	++s_num_host_objects;
+	for (size_class = 0; size_class < NUM_SIZE_CLASSES; ++size_class) {
+		if (size <= SIZE_CLASSES[size_class])
+			break;
+	}
+	if (size_class < NUM_SIZE_CLASSES) {
+		pool = &s_pools[size_class];
+		if (pool->free_list == NULL && (slab = malloc(SLAB_SIZE))) {
+			vector_push(s_slabs, &slab);
+			for (i = 0; i + pool->slot_size <= SLAB_SIZE; i += pool->slot_size) {
+				*(void**)&slab[i] = pool->free_list;
+				pool->free_list = &slab[i];
+			}
+		}
+		if ((object_info = pool->free_list)) {
+			pool->free_list = *(void**)object_info;
+			memset(object_info, 0, size);
+			object_info->size_class = size_class;
+			return object_info;
+		}
+	}
+
+	// too big for a slab (or out of memory for a new one), use the heap
+	++s_num_heap_objects;
+	object_info = calloc(1, size);
+	object_info->size_class = -1;
+	return object_info;
+}
+
+static char*
+bytecode_name(const struct bytecode_header* header)
+{
+	char* name;
+
+	asprintf(&name, "%08x%08x.jsbc",
+		(uint32_t)(header->source_hash >> 32), (uint32_t)header->source_hash);
+	return name;
+}
+
 static void
 decode_debugger_value(void)
 {
@@ -2419,6 +3031,130 @@ decode_debugger_value(void)
 	jsal_remove(-5);
 }
 
+static JsValueRef
+decode_message(JsValueRef decoder, const js_message_t* message)
+{
+	JsValueRef    args[3];
+	JsValueRef    buffer;
+	ChakraBytePtr buffer_ptr;
+	unsigned int  buffer_size;
+	JsValueRef    index;
+	JsValueRef    result;
+	int           i;
+
+	JsGetUndefinedValue(&args[0]);
+	if (message->json != NULL)
+		JsCreateString(message->json, message->json_length, &args[1]);
+	else
+		JsGetUndefinedValue(&args[1]);
+	JsCreateArray(message->num_buffers, &args[2]);
+	for (i = 0; i < message->num_buffers; ++i) {
+		if (JsCreateArrayBuffer((unsigned int)message->buffers[i].size, &buffer) != JsNoError)
+			return JS_INVALID_REFERENCE;
+		JsGetArrayBufferStorage(buffer, &buffer_ptr, &buffer_size);
+		memcpy(buffer_ptr, message->buffers[i].data, message->buffers[i].size);
+		JsIntToNumber(i, &index);
+		JsSetIndexedProperty(args[2], index, buffer);
+	}
+	if (JsCallFunction(decoder, args, 3, &result) != JsNoError)
+		return JS_INVALID_REFERENCE;
+	return result;
+}
+
+static char*
+dup_value_string(JsValueRef value)
+{
+	char*  buffer;
+	size_t length;
+
+	if (JsConvertValueToString(value, &value) != JsNoError)
+		return NULL;
+	JsCopyString(value, NULL, 0, &length);
+	if (!(buffer = malloc(length + 1)))
+		return NULL;
+	JsCopyString(value, buffer, length, NULL);
+	buffer[length] = '\0';
+	return buffer;
+}
+
+static js_message_t*
+encode_message(JsValueRef encoder, JsValueRef value)
+{
+	JsValueRef      args[2];
+	ChakraBytePtr   buffer_ptr;
+	unsigned int    buffer_size;
+	JsValueRef      buffers;
+	JsValueRef      index;
+	JsValueRef      item;
+	JsValueRef      json;
+	JsPropertyIdRef key;
+	JsValueRef      length_value;
+	js_message_t*   message;
+	int             num_buffers;
+	JsValueRef      result;
+	JsValueType     value_type;
+	int             i;
+
+	JsGetUndefinedValue(&args[0]);
+	args[1] = value;
+	if (JsCallFunction(encoder, args, 2, &result) != JsNoError)
+		return NULL;
+	JsIntToNumber(0, &index);
+	JsGetIndexedProperty(result, index, &json);
+	JsIntToNumber(1, &index);
+	JsGetIndexedProperty(result, index, &buffers);
+	JsCreatePropertyId("length", 6, &key);
+	JsGetProperty(buffers, key, &length_value);
+	JsNumberToInt(length_value, &num_buffers);
+
+	if (!(message = calloc(1, sizeof(js_message_t))))
+		return NULL;
+	JsGetValueType(json, &value_type);
+	if (value_type == JsString) {
+		// JSON.stringify() returns undefined for things like functions; in that case
+		// we leave the JSON text NULL and the value is received as `undefined`.
+		JsCopyString(json, NULL, 0, &message->json_length);
+		if (!(message->json = malloc(message->json_length + 1)))
+			goto on_error;
+		JsCopyString(json, message->json, message->json_length, NULL);
+		message->json[message->json_length] = '\0';
+	}
+	if (num_buffers > 0) {
+		if (!(message->buffers = calloc(num_buffers, sizeof(struct blob))))
+			goto on_error;
+		message->num_buffers = num_buffers;
+		for (i = 0; i < num_buffers; ++i) {
+			JsIntToNumber(i, &index);
+			JsGetIndexedProperty(buffers, index, &item);
+			JsGetArrayBufferStorage(item, &buffer_ptr, &buffer_size);
+			if (!(message->buffers[i].data = malloc(buffer_size > 0 ? buffer_size : 1)))
+				goto on_error;
+			memcpy(message->buffers[i].data, buffer_ptr, buffer_size);
+			message->buffers[i].size = buffer_size;
+		}
+	}
+	return message;
+
+on_error:
+	jsal_message_free(message);
+	return NULL;
+}
+
+static void
+free_object(struct object* object_info)
+{
+	struct pool* pool;
+
+	--s_num_host_objects;
+	if (object_info->size_class < 0) {
+		free(object_info);
+		return;
+	}
+	pool = &s_pools[object_info->size_class];
+	*(void**)object_info = pool->free_list;
+	pool->free_list = object_info;
+}
+
 static void
 free_ref(js_ref_t* ref)
 {
@@ -2447,6 +3183,196 @@ get_value(int stack_index)
 	return ref->value;
 }
 
+static bool
+hash_source(JsValueRef source, struct bytecode_header *out_header)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	size_t   i;
+	size_t   length;
+	char*    text;
+
+	JsCopyString(source, NULL, 0, &length);
+	if (length < MIN_CACHED_SOURCE || length > UINT32_MAX)
+		return false;
+	if (!(text = malloc(length)))
+		return false;
+	JsCopyString(source, text, length, NULL);
+	for (i = 0; i < length; ++i)
+		hash = (hash ^ (uint8_t)text[i]) * 1099511628211ULL;
+	free(text);
+
+	memcpy(out_header->signature, "JSBC", 4);
+	out_header->version = 0;
+	out_header->source_hash = hash;
+	out_header->source_size = (uint32_t)length;
+	out_header->bytecode_size = 0;
+	return true;
+}
+
+static uint32_t
+hash_version(const char* version)
+{
+	uint32_t    hash = 2166136261u;
+	const char* p_char;
+
+	for (p_char = version; *p_char != '\0'; ++p_char)
+		hash = (hash ^ (uint8_t)*p_char) * 16777619u;
+	return hash;
+}
+
+static JsPropertyIdRef
+intern_key(const char* name)
+{
+	struct interned_key* entry;
+	uint32_t             hash = 2166136261u;
+	JsPropertyIdRef      key;
+	size_t               length;
+	const char*          p_char;
+	int                  slot;
+
+	for (p_char = name; *p_char != '\0'; ++p_char)
+		hash = (hash ^ (uint8_t)*p_char) * 16777619u;
+	length = p_char - name;
+	if (length > MAX_INTERNED_NAME) {
+		JsCreatePropertyId(name, length, &key);
+		return key;
+	}
+
+	slot = hash & (INTERNED_KEY_SLOTS - 1);
+	while ((entry = &s_interned_keys[slot])->id != JS_INVALID_REFERENCE) {
+		if (entry->hash == hash && strcmp(entry->name, name) == 0)
+			return entry->id;
+		slot = (slot + 1) & (INTERNED_KEY_SLOTS - 1);
+	}
+	JsCreatePropertyId(name, length, &key);
+	if (s_num_interned_keys < MAX_INTERNED_KEYS) {
+		JsAddRef(key, NULL);
+		entry->hash = hash;
+		entry->id = key;
+		memcpy(entry->name, name, length + 1);
+		++s_num_interned_keys;
+	}
+	return key;
+}
+
+static JsValueRef
+load_bytecode(const struct bytecode_header* header, JsValueRef source, JsValueRef url)
+{
+	void*      data;
+	JsValueRef function = JS_INVALID_REFERENCE;
+	char*      name;
+	char*      path;
+	size_t     size;
+
+	// bytecode supplied by the host (e.g. precompiled into a game package) takes
+	// precedence over the on-disk cache.
+	name = bytecode_name(header);
+	if (s_fetch_callback != NULL && (data = s_fetch_callback(name, &size))) {
+		function = parse_bytecode(data, size, header, source, url);
+		free(data);
+	}
+	if (function == JS_INVALID_REFERENCE && s_cache_dirname != NULL) {
+		asprintf(&path, "%s%s", s_cache_dirname, name);
+		if ((data = slurp_file(path, &size))) {
+			function = parse_bytecode(data, size, header, source, url);
+			free(data);
+		}
+		free(path);
+	}
+	free(name);
+	return function;
+}
+
+static void*
+make_bytecode(JsValueRef source, struct bytecode_header* header, size_t *out_size)
+{
+	JsValueRef   buffer;
+	uint8_t*     bytecode;
+	uint8_t*     data;
+	JsValueRef   exception;
+	bool         has_exception;
+	unsigned int size;
+
+	if (JsSerialize(source, &buffer, JsParseScriptAttributeNone) != JsNoError) {
+		// the source doesn't compile as a script, e.g. it's an ES module.
+		JsHasException(&has_exception);
+		if (has_exception)
+			JsGetAndClearException(&exception);
+		return NULL;
+	}
+	JsGetArrayBufferStorage(buffer, &bytecode, &size);
+	header->bytecode_size = size;
+	if (!(data = malloc(sizeof(struct bytecode_header) + size)))
+		return NULL;
+	memcpy(data, header, sizeof(struct bytecode_header));
+	memcpy(data + sizeof(struct bytecode_header), bytecode, size);
+	*out_size = sizeof(struct bytecode_header) + size;
+	return data;
+}
+
+static bool
+make_message_codec(JsValueRef *out_encoder, JsValueRef *out_decoder)
+{
+	// messages passed between runtimes are encoded as JSON text, with any ArrayBuffers
+	// and typed arrays split out and copied as raw binary blobs.  the codec is written
+	// in JS since it needs to be instantiated once for each runtime.
+	static const char* const CODEC_SOURCE =
+		"(function (global) {\n"
+		"    const BUFFER_KEY = '\\u0001buffer';\n"
+		"    return {\n"
+		"        encode(value) {\n"
+		"            const buffers = [];\n"
+		"            const json = JSON.stringify(value, function (key, value) {\n"
+		"                if (value instanceof ArrayBuffer) {\n"
+		"                    buffers.push(value);\n"
+		"                    return { [BUFFER_KEY]: buffers.length - 1 };\n"
+		"                }\n"
+		"                else if (ArrayBuffer.isView(value)) {\n"
+		"                    buffers.push(value.buffer.slice(value.byteOffset, value.byteOffset + value.byteLength));\n"
+		"                    return { [BUFFER_KEY]: buffers.length - 1, type: value.constructor.name };\n"
+		"                }\n"
+		"                return value;\n"
+		"            });\n"
+		"            return [ json, buffers ];\n"
+		"        },\n"
+		"        decode(json, buffers) {\n"
+		"            if (json === undefined)\n"
+		"                return undefined;\n"
+		"            return JSON.parse(json, function (key, value) {\n"
+		"                if (value !== null && typeof value === 'object' && BUFFER_KEY in value) {\n"
+		"                    const buffer = buffers[value[BUFFER_KEY]];\n"
+		"                    return value.type !== undefined ? new global[value.type](buffer) : buffer;\n"
+		"                }\n"
+		"                return value;\n"
+		"            });\n"
+		"        },\n"
+		"    };\n"
+		"})(this);\n";
+
+	JsValueRef      codec;
+	JsValueRef      decoder;
+	JsValueRef      encoder;
+	JsPropertyIdRef key;
+	JsValueRef      name_string;
+	JsValueRef      source_string;
+
+	*out_encoder = JS_INVALID_REFERENCE;
+	*out_decoder = JS_INVALID_REFERENCE;
+	JsCreateString(CODEC_SOURCE, strlen(CODEC_SOURCE), &source_string);
+	JsCreateString("%/messageCodec.js", 17, &name_string);
+	if (JsRun(source_string, 0, name_string, JsParseScriptAttributeLibraryCode, &codec) != JsNoError)
+		return false;
+	JsCreatePropertyId("encode", 6, &key);
+	JsGetProperty(codec, key, &encoder);
+	JsCreatePropertyId("decode", 6, &key);
+	JsGetProperty(codec, key, &decoder);
+	JsAddRef(encoder, NULL);
+	JsAddRef(decoder, NULL);
+	*out_encoder = encoder;
+	*out_decoder = decoder;
+	return true;
+}
+
 static JsPropertyIdRef
 make_property_id(JsValueRef key)
 {
@@ -2482,6 +3408,52 @@ make_ref(JsRef value, bool weak_ref)
 	return ref;
 }
 
+static JsValueRef
+parse_bytecode(const void* data, size_t size, const struct bytecode_header* header, JsValueRef source, JsValueRef url)
+{
+	JsValueRef             buffer;
+	uint8_t*               bytecode;
+	struct cached_script   cached;
+	JsValueRef             exception;
+	struct bytecode_header file_header;
+	JsValueRef             function;
+	bool                   has_exception;
+	unsigned int           buffer_size;
+
+	if (size < sizeof(struct bytecode_header))
+		return JS_INVALID_REFERENCE;
+	memcpy(&file_header, data, sizeof(struct bytecode_header));
+	if (memcmp(file_header.signature, header->signature, 4) != 0
+		|| file_header.version != header->version
+		|| file_header.source_hash != header->source_hash
+		|| file_header.source_size != header->source_size
+		|| file_header.bytecode_size != size - sizeof(struct bytecode_header))
+	{
+		return JS_INVALID_REFERENCE;
+	}
+	if (JsCreateArrayBuffer(file_header.bytecode_size, &buffer) != JsNoError)
+		return JS_INVALID_REFERENCE;
+	JsGetArrayBufferStorage(buffer, &bytecode, &buffer_size);
+	memcpy(bytecode, (const uint8_t*)data + sizeof(struct bytecode_header), buffer_size);
+
+	// ChakraCore rejects bytecode produced by a different engine build; if that
+	// happens, the caller just falls back on parsing the source.
+	if (JsParseSerialized(buffer, on_load_script_source, s_next_source_context, url, &function) != JsNoError) {
+		JsHasException(&has_exception);
+		if (has_exception)
+			JsGetAndClearException(&exception);
+		return JS_INVALID_REFERENCE;
+	}
+
+	// ChakraCore keeps the bytecode buffer alive on its own, but it still asks for
+	// the source whenever it needs it (e.g. for Function#toString()).
+	JsAddRef(source, NULL);
+	cached.context = s_next_source_context;
+	cached.source = source;
+	vector_push(s_cached_scripts, &cached);
+	return function;
+}
+
 static JsValueRef
 pop_value(void)
 {
@@ -2608,6 +3580,21 @@ push_value(JsValueRef value, bool weak_ref)
 	return vector_len(s_value_stack) - s_stack_base - 1;
 }
 
+static double
+read_clock(void)
+{
+	struct timespec now;
+
+	// note: clock() measures CPU time, not elapsed time, so it misses any time
+	//       spent waiting on file I/O.  use a wall clock instead.
+#if defined(_WIN32)
+	timespec_get(&now, TIME_UTC);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+	return now.tv_sec + now.tv_nsec / 1.0e9;
+}
+
 static void
 resize_stack(int new_size)
 {
@@ -2634,6 +3621,127 @@ resize_stack(int new_size)
 	}
 }
 
+static bool
+run_runtime_jobs(js_runtime_t* runtime)
+{
+	JsValueRef result;
+	JsValueRef task;
+	JsValueRef undefined;
+
+	JsGetUndefinedValue(&undefined);
+	while (vector_len(runtime->jobs) > 0) {
+		task = *(JsValueRef*)vector_get(runtime->jobs, 0);
+		vector_remove(runtime->jobs, 0);
+		if (JsCallFunction(task, &undefined, 1, &result) != JsNoError) {
+			JsRelease(task, NULL);
+			set_runtime_error(runtime);
+			return false;
+		}
+		JsRelease(task, NULL);
+	}
+	return true;
+}
+
+static void
+save_bytecode(struct bytecode_header* header, JsValueRef source)
+{
+	void*  data;
+	FILE*  file;
+	bool   is_ok;
+	char*  name;
+	char*  path;
+	size_t size;
+	char*  temp_path;
+
+	// note: the entry is written under a temporary name and then renamed into place
+	//       so that another instance never sees a partial file.  if the rename fails,
+	//       another instance most likely got there first; entries are keyed on the
+	//       source hash, so its copy is just as good.
+	if (s_cache_dirname == NULL)
+		return;
+	if (!(data = make_bytecode(source, header, &size)))
+		return;
+	name = bytecode_name(header);
+	asprintf(&path, "%s%s", s_cache_dirname, name);
+	asprintf(&temp_path, "%s.%d.tmp", path, (int)getpid());
+	if ((file = fopen(temp_path, "wb"))) {
+		is_ok = fwrite(data, 1, size, file) == size;
+		is_ok = fclose(file) == 0 && is_ok;
+		if (!is_ok || rename(temp_path, path) != 0)
+			remove(temp_path);
+	}
+	free(temp_path);
+	free(path);
+	free(name);
+	free(data);
+}
+
+static void
+set_runtime_error(js_runtime_t* runtime)
+{
+	JsValueRef      exception;
+	JsPropertyIdRef key;
+	JsValueRef      stack;
+	JsValueType     value_type;
+
+	free(runtime->error);
+	runtime->error = NULL;
+	if (JsGetAndClearException(&exception) != JsNoError) {
+		// no exception means the runtime was interrupted or ran out of memory.
+		runtime->error = strdup("script execution was interrupted");
+		return;
+	}
+	JsCreatePropertyId("stack", 5, &key);
+	JsGetValueType(exception, &value_type);
+	if (value_type == JsError && JsGetProperty(exception, key, &stack) == JsNoError) {
+		JsGetValueType(stack, &value_type);
+		if (value_type == JsString)
+			exception = stack;
+	}
+	if (!(runtime->error = dup_value_string(exception)))
+		runtime->error = strdup("unknown error");
+}
+
+static void
+set_runtime_function(const char* name, JsNativeFunction callback, js_runtime_t* runtime)
+{
+	JsValueRef      function;
+	JsValueRef      global;
+	JsPropertyIdRef key;
+
+	JsGetGlobalObject(&global);
+	JsCreateFunction(callback, runtime, &function);
+	JsCreatePropertyId(name, strlen(name), &key);
+	JsSetProperty(global, key, function, true);
+}
+
+static void*
+slurp_file(const char* path, size_t *out_size)
+{
+	void* data = NULL;
+	FILE* file;
+	long  size;
+
+	if (!(file = fopen(path, "rb")))
+		return NULL;
+	fseek(file, 0, SEEK_END);
+	if ((size = ftell(file)) < 0)
+		goto on_error;
+	fseek(file, 0, SEEK_SET);
+	if (!(data = malloc(size > 0 ? size : 1)))
+		goto on_error;
+	if (fread(data, 1, size, file) != (size_t)size)
+		goto on_error;
+	fclose(file);
+	*out_size = size;
+	return data;
+
+on_error:
+	free(data);
+	fclose(file);
+	return NULL;
+}
+
 static void
 throw_on_error(void)
 {
@@ -2662,6 +3770,15 @@ throw_value(JsValueRef value)
 	}
 }
 
+static void CHAKRA_CALLBACK
+on_before_collect(void* userdata)
+{
+	++s_num_gc_runs;
+	if (s_gc_callback != NULL)
+		s_gc_callback(s_heap_size, s_heap_growth);
+	s_heap_growth = 0;
+}
+
 static void CHAKRA_CALLBACK
 on_debugger_event(JsDiagDebugEvent event_type, JsValueRef data, void* userdata)
 {
@@ -2851,7 +3968,7 @@ on_finalize_host_object(void* userdata)
 	object_info = userdata;
 	if (object_info->finalizer != NULL)
 		object_info->finalizer(object_info->data);
-	free(object_info);
+	free_object(object_info);
 }
 
 static JsValueRef CHAKRA_CALLBACK
@@ -2872,6 +3989,8 @@ on_js_to_native_call(JsValueRef callee, JsValueRef argv[], unsigned short argc,
 	int i;
 
 	function_data = userdata;
+	++s_native_depth;
+	++s_num_native_calls;
 
 	last_stack_base = s_stack_base;
 	last_callee_value = s_callee_value;
@@ -2914,9 +4033,50 @@ on_js_to_native_call(JsValueRef callee, JsValueRef argv[], unsigned short argc,
 	s_newtarget_value = last_newtarget_value;
 	s_this_value = last_this_value;
 	s_stack_base = last_stack_base;
+	--s_native_depth;
 	return retval;
 }
 
+static bool CHAKRA_CALLBACK
+on_load_script_source(JsSourceContext source_context, JsValueRef *out_value, JsParseScriptAttributes *out_attributes)
+{
+	struct cached_script* cached;
+
+	iter_t iter;
+
+	iter = vector_enum(s_cached_scripts);
+	while ((cached = iter_next(&iter))) {
+		if (cached->context != source_context)
+			continue;
+		*out_value = cached->source;
+		*out_attributes = JsParseScriptAttributeNone;
+		return true;
+	}
+	return false;
+}
+
+static bool CHAKRA_CALLBACK
+on_memory_event(void* userdata, JsMemoryEventType event_type, size_t size)
+{
+	// note: these events are for memory ChakraCore acquires from (or returns to) the
+	//       OS, not individual JS allocations, so this is cheap to track.
+	switch (event_type) {
+	case JsMemoryAllocate:
+		s_heap_size += size;
+		s_heap_growth += size;
+		break;
+	case JsMemoryFree:
+		s_heap_size -= size < s_heap_size ? size : s_heap_size;
+		break;
+	case JsMemoryFailure:
+		s_heap_size -= size < s_heap_size ? size : s_heap_size;
+		s_heap_growth -= size < s_heap_growth ? size : s_heap_growth;
+		++s_num_alloc_failures;
+		break;
+	}
+	return true;
+}
+
 static JsErrorCode CHAKRA_CALLBACK
 on_notify_module_ready(JsModuleRecord module, JsValueRef exception)
 {
@@ -2984,6 +4144,76 @@ on_resolve_reject_promise(JsValueRef task, void* userdata)
 	s_stack_base = last_stack_base;
 }
 
+static JsValueRef CHAKRA_CALLBACK
+on_runtime_close(JsValueRef callee, bool is_ctor, JsValueRef argv[], unsigned short argc, void* userdata)
+{
+	js_runtime_t* runtime;
+	JsValueRef    undefined;
+
+	runtime = userdata;
+	runtime->closed = true;
+	JsGetUndefinedValue(&undefined);
+	return undefined;
+}
+
+static void CHAKRA_CALLBACK
+on_runtime_job(JsValueRef task, void* userdata)
+{
+	js_runtime_t* runtime;
+
+	runtime = userdata;
+	JsAddRef(task, NULL);
+	vector_push(runtime->jobs, &task);
+}
+
+static JsValueRef CHAKRA_CALLBACK
+on_runtime_post(JsValueRef callee, bool is_ctor, JsValueRef argv[], unsigned short argc, void* userdata)
+{
+	JsValueRef    error;
+	JsValueRef    message_string;
+	bool          has_exception;
+	js_message_t* message;
+	js_runtime_t* runtime;
+	JsValueRef    undefined;
+
+	runtime = userdata;
+	JsGetUndefinedValue(&undefined);
+	if (!(message = encode_message(runtime->encoder, argc > 1 ? argv[1] : undefined))) {
+		JsHasException(&has_exception);
+		if (!has_exception) {
+			JsCreateString("couldn't serialize value for message", 37, &message_string);
+			JsCreateError(message_string, &error);
+			JsSetException(error);
+		}
+		return JS_INVALID_REFERENCE;
+	}
+	if (runtime->on_post != NULL)
+		runtime->on_post(message, runtime->userdata);
+	else
+		jsal_message_free(message);
+	return undefined;
+}
+
+static JsValueRef CHAKRA_CALLBACK
+on_runtime_print(JsValueRef callee, bool is_ctor, JsValueRef argv[], unsigned short argc, void* userdata)
+{
+	char*      text;
+	JsValueRef undefined;
+
+	int i;
+
+	for (i = 1; i < argc; ++i) {
+		if (!(text = dup_value_string(argv[i])))
+			continue;
+		printf(i < argc - 1 ? "%s " : "%s", text);
+		free(text);
+	}
+	printf("\n");
+	fflush(stdout);
+	JsGetUndefinedValue(&undefined);
+	return undefined;
+}
+
 #if !defined(__APPLE__)
 static int
 asprintf(char** out, const char* format, ...)
@@ -38,7 +38,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-typedef struct js_ref js_ref_t;
+typedef struct js_message js_message_t;
+typedef struct js_ref     js_ref_t;
+typedef struct js_runtime js_runtime_t;
 
 typedef
 enum js_buffer_type
@@ -82,22 +84,51 @@ enum js_error_type
 	JS_URI_ERROR,
 } js_error_type_t;
 
+typedef
+struct js_stats
+{
+	double       cache_load_time;
+	size_t       heap_growth;
+	size_t       heap_size;
+	size_t       memory_limit;
+	unsigned int num_alloc_failures;
+	unsigned int num_cache_loads;
+	unsigned int num_gc_runs;
+	unsigned int num_heap_objects;
+	unsigned int num_host_objects;
+	unsigned int num_native_calls;
+	unsigned int num_object_allocs;
+	unsigned int num_parses;
+	double       parse_time;
+	size_t       pool_size;
+} js_stats_t;
+
 typedef bool      (* js_function_t)        (int num_args, bool is_ctor, intptr_t magic);
 typedef js_step_t (* js_break_callback_t)  (void);
+typedef void*     (* js_fetch_callback_t)  (const char* name, size_t *out_size);
 typedef void      (* js_finalizer_t)       (void* host_ptr);
+typedef void      (* js_gc_callback_t)     (size_t heap_size, size_t heap_growth);
 typedef void      (* js_job_callback_t)    (void);
 typedef bool      (* js_reject_callback_t) (void);
 typedef void      (* js_throw_callback_t)  (void);
 typedef void      (* js_import_callback_t) (void);
+typedef void      (* js_post_callback_t)   (js_message_t* message, void* userdata);
 
 bool         jsal_init                     (void);
 void         jsal_uninit                   (void);
 void         jsal_update                   (bool in_event_loop);
+void         jsal_idle                     (void);
 bool         jsal_busy                     (void);
+bool         jsal_in_script                (void);
+js_stats_t   jsal_stats                    (void);
 bool         jsal_vm_enabled               (void);
 void         jsal_on_enqueue_job           (js_job_callback_t callback);
+void         jsal_on_collect_garbage       (js_gc_callback_t callback);
+void         jsal_on_fetch_bytecode        (js_fetch_callback_t callback);
 void         jsal_on_import_module         (js_import_callback_t callback);
 void         jsal_on_reject_promise        (js_reject_callback_t callback);
+void         jsal_set_cache_dir            (const char* dirname, const char* version);
+void         jsal_set_memory_limit         (size_t max_bytes);
 void         jsal_call                     (int num_args);
 void         jsal_call_method              (int num_args);
 unsigned int jsal_compile                  (const char* filename);
@@ -118,6 +149,7 @@ void         jsal_eval_module              (const char* specifier, const char* u
 void         jsal_gc                       (void);
 bool         jsal_get_boolean              (int at_index);
 void*        jsal_get_buffer_ptr           (int at_index, size_t *out_size);
+js_buffer_type_t jsal_get_buffer_type      (int at_index);
 bool         jsal_get_global               (void);
 bool         jsal_get_global_string        (const char* name);
 void*        jsal_get_host_data            (int at_index);
@@ -155,6 +187,9 @@ bool         jsal_is_subclass_ctor         (void);
 bool         jsal_is_symbol                (int stack_index);
 bool         jsal_is_undefined             (int stack_index);
 void         jsal_make_buffer              (int object_index, js_buffer_type_t buffer_type, void* buffer, size_t num_items);
+void*        jsal_make_bytecode            (const char* version, char* *out_name, size_t *out_size);
+void         jsal_message_free             (js_message_t* message);
+js_message_t* jsal_message_new             (int at_index);
 js_ref_t*    jsal_new_key                  (const char* name);
 bool         jsal_next                     (int iter_index);
 int          jsal_normalize_index          (int index);
@@ -170,6 +205,7 @@ int          jsal_push_hidden_stash        (void);
 int          jsal_push_int                 (int value);
 int          jsal_push_known_symbol        (const char* name);
 int          jsal_push_lstring             (const char* value, size_t length);
+int          jsal_push_message             (const js_message_t* message);
 int          jsal_push_new_array           (void);
 int          jsal_push_new_bare_object     (void);
 int          jsal_push_new_buffer          (js_buffer_type_t type, size_t length, void* *out_data_ptr);
@@ -233,8 +269,17 @@ bool         jsal_try_compile              (const char* filename);
 bool         jsal_try_construct            (int num_args);
 bool         jsal_try_eval_module          (const char* specifier, const char* url);
 bool         jsal_try_parse                (int at_index);
+bool         jsal_try_push_message         (const js_message_t* message);
 void         jsal_unref                    (js_ref_t* ref);
 
+js_runtime_t* jsal_runtime_new       (js_post_callback_t on_post, void* userdata);
+void          jsal_runtime_free      (js_runtime_t* runtime);
+bool          jsal_runtime_closed    (const js_runtime_t* runtime);
+const char*   jsal_runtime_error     (const js_runtime_t* runtime);
+bool          jsal_runtime_eval      (js_runtime_t* runtime, const char* filename, const char* source, size_t length);
+void          jsal_runtime_interrupt (js_runtime_t* runtime);
+bool          jsal_runtime_post      (js_runtime_t* runtime, const js_message_t* message);
+
 bool jsal_debug_init               (js_break_callback_t callback);
 void jsal_debug_uninit             (void);
 void jsal_debug_on_throw           (js_throw_callback_t callback);